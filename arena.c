@@ -0,0 +1,118 @@
+/* This file is part of OpenU's C project implementation, called assembler
+ * Copyright (C) 2020 Arthur Zamarin, Norel Farjun */
+
+#include "arena.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/** default size of every chunk's data, bigger allocations get a chunk of their own */
+#define ARENA_CHUNK_SIZE (64 * 1024)
+
+/** alignment good enough for any type */
+union arena_align {
+    long l;
+    double d;
+    void *p;
+    void (*f)(void);
+};
+#define ARENA_ALIGN(size) (((size) + sizeof(union arena_align) - 1) & ~(sizeof(union arena_align) - 1))
+
+struct arena_chunk {
+    struct arena_chunk *next;
+    size_t size; /* data bytes in chunk */
+    size_t used; /* data bytes already handed out */
+    /* here goes tightly the data, starting at aligned offset */
+};
+#define ARENA_CHUNK_HEADER ARENA_ALIGN(sizeof(struct arena_chunk))
+
+arena_t arena_new(void) {
+    arena_t arena = {NULL, 0, 0, 0};
+    return arena;
+}
+
+void arena_dealloc(arena_t *arena) {
+    struct arena_chunk *iter = arena->head, *tmp;
+    while (iter) {
+        tmp = iter->next;
+        free(iter);
+        iter = tmp;
+    }
+    arena->head = NULL;
+}
+
+void arena_reset(arena_t *arena) {
+    struct arena_chunk *iter = arena->head, *tmp, *kept = NULL;
+    while (iter) {
+        tmp = iter->next;
+        if (!kept && iter->size == ARENA_CHUNK_SIZE)
+            kept = iter;
+        else
+            free(iter);
+        iter = tmp;
+    }
+    if (kept) {
+        kept->next = NULL;
+        kept->used = 0;
+    }
+    arena->head = kept;
+    arena->reserved = kept ? ARENA_CHUNK_HEADER + ARENA_CHUNK_SIZE : 0;
+    arena->used = 0;
+    arena->alloc_cnt = 0;
+}
+
+void *arena_alloc(arena_t *arena, size_t size) {
+    struct arena_chunk *chunk = arena->head;
+    void *res;
+
+    size = ARENA_ALIGN(size);
+    if (!chunk || chunk->size - chunk->used < size) {
+        const size_t chunk_size = (size > ARENA_CHUNK_SIZE) ? size : ARENA_CHUNK_SIZE;
+        if (!(chunk = malloc(ARENA_CHUNK_HEADER + chunk_size)))
+            return NULL;
+        chunk->size = chunk_size;
+        chunk->used = 0;
+        arena->reserved += ARENA_CHUNK_HEADER + chunk_size;
+        if (arena->head && size > ARENA_CHUNK_SIZE) {
+            /* keep the current chunk on top, as it still has free space */
+            chunk->next = arena->head->next;
+            arena->head->next = chunk;
+        } else {
+            chunk->next = arena->head;
+            arena->head = chunk;
+        }
+    }
+    res = (char *)chunk + ARENA_CHUNK_HEADER + chunk->used;
+    chunk->used += size;
+
+    arena->alloc_cnt++;
+    arena->used += size;
+    return res;
+}
+
+void *arena_realloc(arena_t *arena, void *ptr, size_t old_size, size_t new_size) {
+    struct arena_chunk **link, *chunk;
+    void *res;
+
+    old_size = ARENA_ALIGN(old_size);
+    new_size = ARENA_ALIGN(new_size);
+    if (ptr && old_size > ARENA_CHUNK_SIZE && new_size > old_size) {
+        /* big allocations are alone in their chunk, so the chunk itself can be resized */
+        for (link = &arena->head; *link; link = &(*link)->next) {
+            if ((char *)*link + ARENA_CHUNK_HEADER != (char *)ptr)
+                continue;
+            if (!(chunk = realloc(*link, ARENA_CHUNK_HEADER + new_size)))
+                return NULL;
+            *link = chunk;
+            arena->reserved += new_size - chunk->size;
+            arena->used += new_size - chunk->used;
+            chunk->size = chunk->used = new_size;
+            return (char *)chunk + ARENA_CHUNK_HEADER;
+        }
+    }
+    if (!(res = arena_alloc(arena, new_size)))
+        return NULL;
+    if (ptr)
+        memcpy(res, ptr, old_size < new_size ? old_size : new_size);
+    return res;
+}
@@ -0,0 +1,49 @@
+/* This file is part of OpenU's C project implementation, called assembler
+ * Copyright (C) 2020 Arthur Zamarin, Norel Farjun */
+
+#ifndef ASM_ARENA_H
+#define ASM_ARENA_H
+
+#include <stddef.h>
+
+/**
+ * Bump allocator: memory is taken from big chunks and is released only all at once.
+ * Also counts the memory usage, for monitoring purposes.
+ */
+struct arena_chunk;
+typedef struct arena_t {
+    struct arena_chunk *head; /* current chunk, chained to the older chunks */
+    size_t reserved;          /* bytes taken from the system */
+    size_t used;              /* bytes handed out by arena_alloc, never lower until the reset as nothing is freed */
+    unsigned long alloc_cnt;  /* count of arena_alloc calls */
+} arena_t;
+
+/**
+ * create and return a new empty arena_t structure
+ */
+arena_t arena_new(void);
+/**
+ * free all the memory ever allocated from {arena}
+ */
+void arena_dealloc(arena_t *arena);
+
+/**
+ * release all the allocations of {arena} at once, and zero its counters
+ * one default sized chunk is kept for reuse, so a warm arena doesn't go back to the system for small files
+ */
+void arena_reset(arena_t *arena);
+
+/**
+ * allocate {size} bytes from {arena}, aligned for any type
+ * return NULL if out of memory
+ */
+void *arena_alloc(arena_t *arena, size_t size);
+/**
+ * grow the allocation {ptr} of {old_size} bytes from {arena} to {new_size} bytes, keeping its content
+ * a big allocation, which has a chunk of its own, is resized in place by the system; otherwise the content is
+ * copied into a new allocation, and the old one is released only with the whole arena
+ * return the new address, or NULL if out of memory (then {ptr} stays valid)
+ */
+void *arena_realloc(arena_t *arena, void *ptr, size_t old_size, size_t new_size);
+
+#endif
@@ -0,0 +1,227 @@
+/* This file is part of OpenU's C project implementation, called assembler
+ * Copyright (C) 2020 Arthur Zamarin, Norel Farjun */
+
+/*
+ * Generator of synthetic assembly sources for the benchmarks.
+ * The output is a valid program, using every opcode with its legal addressing modes.
+ * The same options and seed always generate the same program.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+typedef enum {FALSE=0, TRUE} BOOL;
+
+/**
+ * Holds the generation parameters, as given on the command line
+ */
+typedef struct {
+    unsigned long lines;   /* count of statement lines (without extern and entry lines) */
+    unsigned label_pct;    /* percentage of lines which define a label */
+    unsigned forward_pct;  /* percentage of label operands which reference a label defined later */
+    unsigned data_pct;     /* percentage of lines which are .data or .string */
+    unsigned externs;      /* count of external labels */
+    unsigned entries;      /* count of labels declared as entry */
+    unsigned long seed;
+} gen_params_t;
+
+/** state of the generator's random numbers, independent of the libc implementation */
+static unsigned long g_rand_state;
+
+/**
+ * return a random number in range [0, {range}), {range} must be positive
+ */
+static unsigned long gen_rand(unsigned long range) {
+    g_rand_state = (g_rand_state * 1103515245UL + 12345UL) & 0xffffffffUL;
+    return ((g_rand_state >> 8) & 0xffffffUL) % range;
+}
+
+/**
+ * Addressing modes, as masks of allowed modes for an operand
+ */
+enum {
+    MODE_IMMEDIATE = 1,
+    MODE_LABEL     = 2,
+    MODE_MEM_REG   = 4,
+    MODE_REG       = 8,
+    MODE_ADDR      = MODE_LABEL | MODE_MEM_REG,
+    MODE_RW        = MODE_ADDR | MODE_REG,
+    MODE_RO        = MODE_RW | MODE_IMMEDIATE
+};
+
+/** all opcodes with their allowed modes, 0 for no such operand */
+static const struct {
+    const char *text;
+    unsigned src, dst;
+} g_opcodes[] = {
+    {"mov", MODE_RO, MODE_RW},   {"cmp", MODE_RO, MODE_RO},   {"add", MODE_RO, MODE_RW},
+    {"sub", MODE_RO, MODE_RW},   {"lea", MODE_LABEL, MODE_RW}, {"clr", 0, MODE_RW},
+    {"not", 0, MODE_RW},         {"inc", 0, MODE_RW},         {"dec", 0, MODE_RW},
+    {"jmp", 0, MODE_ADDR},       {"bne", 0, MODE_ADDR},       {"red", 0, MODE_RW},
+    {"prn", 0, MODE_RO},         {"jsr", 0, MODE_ADDR},       {"rts", 0, 0},
+    {"stop", 0, 0}
+};
+
+/** percentage of every opcode in the generated code, roughly as in hand written programs, sums to 100 */
+static const unsigned g_opcode_weights[] = {31, 8, 8, 6, 4, 3, 2, 6, 6, 5, 6, 3, 5, 4, 2, 1};
+
+/**
+ * print into {out} the name of a label to use as operand, while {defined} of {total} labels are already defined
+ */
+static void gen_label_operand(FILE *out, const gen_params_t *params, unsigned long defined, unsigned long total) {
+    if (params->externs && gen_rand(10) == 0)
+        fprintf(out, "X%lu", gen_rand(params->externs));
+    else if (defined < total && (defined == 0 || gen_rand(100) < params->forward_pct))
+        fprintf(out, "L%lu", defined + gen_rand(total - defined));
+    else if (defined)
+        fprintf(out, "L%lu", gen_rand(defined));
+    else
+        fputs("X0", out); /* only reached when there are no labels at all */
+}
+
+/**
+ * print into {out} an operand in one of the modes in {modes}
+ */
+static void gen_operand(FILE *out, const gen_params_t *params, unsigned modes, unsigned long defined, unsigned long total) {
+    unsigned mode;
+    if (total == 0 && params->externs == 0)
+        modes &= ~MODE_LABEL;
+    do {
+        mode = 1U << gen_rand(4);
+    } while (!(modes & mode));
+
+    switch (mode) {
+        case MODE_IMMEDIATE:
+            fprintf(out, "#%ld", (long)gen_rand(2000) - 1000);
+            break;
+        case MODE_LABEL:
+            gen_label_operand(out, params, defined, total);
+            break;
+        case MODE_MEM_REG:
+            fprintf(out, "*r%lu", gen_rand(8));
+            break;
+        default:
+            fprintf(out, "r%lu", gen_rand(8));
+            break;
+    }
+}
+
+/**
+ * print into {out} one instruction statement
+ */
+static void gen_instruction(FILE *out, const gen_params_t *params, unsigned long defined, unsigned long total) {
+    unsigned i, weight = (unsigned)gen_rand(100);
+    for (i = 0; weight >= g_opcode_weights[i]; ++i)
+        weight -= g_opcode_weights[i];
+    if (g_opcodes[i].src == MODE_LABEL && total == 0 && params->externs == 0)
+        i = 0; /* lea can't be used without labels */
+
+    fprintf(out, "%s", g_opcodes[i].text);
+    if (g_opcodes[i].src) {
+        putc(' ', out);
+        gen_operand(out, params, g_opcodes[i].src, defined, total);
+        fputs(", ", out);
+        gen_operand(out, params, g_opcodes[i].dst, defined, total);
+    } else if (g_opcodes[i].dst) {
+        putc(' ', out);
+        gen_operand(out, params, g_opcodes[i].dst, defined, total);
+    }
+    putc('\n', out);
+}
+
+/**
+ * print into {out} one data definition statement
+ */
+static void gen_data(FILE *out) {
+    static const char letters[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+    unsigned long i, cnt;
+    if (gen_rand(2)) {
+        fputs(".data ", out);
+        for (i = 0, cnt = 1 + gen_rand(8); i < cnt; ++i)
+            fprintf(out, i ? ", %ld" : "%ld", (long)gen_rand(20000) - 10000);
+    } else {
+        fputs(".string \"", out);
+        for (i = 0, cnt = 1 + gen_rand(30); i < cnt; ++i)
+            putc(letters[gen_rand(sizeof(letters) - 1)], out);
+        putc('"', out);
+    }
+    putc('\n', out);
+}
+
+/**
+ * print into {out} the whole program described by {params}
+ */
+static void gen_program(FILE *out, const gen_params_t *params) {
+    const unsigned long total = params->lines * params->label_pct / 100;
+    unsigned long line, defined = 0;
+    unsigned i;
+    BOOL has_label;
+
+    for (i = 0; i < params->externs; ++i)
+        fprintf(out, ".extern X%u\n", i);
+    for (line = 0; line < params->lines; ++line) {
+        /* labels are spread evenly, so exactly {total} are defined */
+        if ((has_label = (line + 1) * params->label_pct / 100 > defined))
+            fprintf(out, "L%lu: ", defined++);
+        if (line + 1 == params->lines)
+            fputs("stop\n", out);
+        else if (gen_rand(100) < params->data_pct)
+            gen_data(out);
+        else if (!has_label && gen_rand(50) == 0)
+            fputs("; comment line\n", out);
+        else
+            gen_instruction(out, params, defined, total);
+    }
+    for (i = 0; i < params->entries && i < total; ++i)
+        fprintf(out, ".entry L%lu\n", (unsigned long)i * total / params->entries);
+}
+
+/**
+ * parse the option {name} with value {value} into {params}
+ * return false if it isn't a known option
+ */
+static BOOL parse_option(gen_params_t *params, const char *name, const char *value) {
+    unsigned long num;
+    char *endp;
+    if (!value || !*value)
+        return FALSE;
+    num = strtoul(value, &endp, 10);
+    if (*endp)
+        return FALSE;
+
+    if (!strcmp(name, "--lines"))
+        params->lines = num;
+    else if (!strcmp(name, "--labels") && num <= 100)
+        params->label_pct = (unsigned)num;
+    else if (!strcmp(name, "--forward") && num <= 100)
+        params->forward_pct = (unsigned)num;
+    else if (!strcmp(name, "--data") && num <= 100)
+        params->data_pct = (unsigned)num;
+    else if (!strcmp(name, "--externs"))
+        params->externs = (unsigned)num;
+    else if (!strcmp(name, "--entries"))
+        params->entries = (unsigned)num;
+    else if (!strcmp(name, "--seed"))
+        params->seed = num;
+    else
+        return FALSE;
+    return TRUE;
+}
+
+int main(int argc, char *argv[]) {
+    gen_params_t params = {10000, 20, 30, 15, 0, 0, 1};
+    int i;
+    for (i = 1; i < argc; i += 2) {
+        if (!parse_option(&params, argv[i], argv[i + 1])) {
+            fprintf(stderr, "usage: %s [--lines N] [--labels PCT] [--forward PCT] [--data PCT]"
+                            " [--externs N] [--entries N] [--seed N]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (params.lines == 0)
+        params.lines = 1;
+    g_rand_state = params.seed;
+    gen_program(stdout, &params);
+    return 0;
+}
@@ -0,0 +1,51 @@
+/* This file is part of OpenU's C project implementation, called assembler
+ * Copyright (C) 2020 Arthur Zamarin, Norel Farjun */
+
+/*
+ * Runs a command with its stdout discarded, and prints its wall time (seconds) and peak RSS (KB):
+ *     measure <command> [args...]
+ * Exits with failure if the command couldn't run or failed.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+int main(int argc, char *argv[]) {
+    struct timespec start, end;
+    struct rusage usage;
+    int status, devnull;
+    pid_t pid;
+
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <command> [args...]\n", argv[0]);
+        return 1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if ((pid = fork()) < 0) {
+        perror("fork");
+        return 1;
+    } else if (pid == 0) {
+        if ((devnull = open("/dev/null", O_WRONLY)) >= 0)
+            dup2(devnull, STDOUT_FILENO);
+        execvp(argv[1], argv + 1);
+        perror(argv[1]);
+        _exit(127);
+    }
+    if (waitpid(pid, &status, 0) < 0) {
+        perror("waitpid");
+        return 1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    getrusage(RUSAGE_CHILDREN, &usage);
+
+    printf("%.6f %ld\n", (double)(end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9,
+           (long)usage.ru_maxrss);
+    return !(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
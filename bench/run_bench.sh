@@ -0,0 +1,101 @@
+#!/bin/bash
+
+# This file is part of OpenU's C project implementation, called assembler
+# Copyright (C) 2020 Arthur Zamarin */
+
+# You shouldn't call this script by itself, but by calling `make bench` or `make bench-baseline`
+
+# $1 - executable file
+# $2 - basedir
+# $3 - "--update" to store the results as the new baseline
+# Environment:
+#   BENCH_RUNS      - runs of every corpus, the fastest one counts (default 7)
+#   BENCH_TOLERANCE - allowed slowdown or memory growth against the baseline, in percent (default 25)
+#   BENCH_MIN_TIME  - corpora assembled faster than that in the baseline, in seconds, are reported but not judged,
+#                     as their time is mostly the start of the process (default 0.02)
+_RUNS="${BENCH_RUNS:-7}"
+_TOLERANCE="${BENCH_TOLERANCE:-25}"
+_MIN_TIME="${BENCH_MIN_TIME:-0.02}"
+_BASELINE="${2}/baseline.txt"
+_CORPUS_DIR="${2}/corpus"
+
+# name, then generator arguments
+_CORPORA=(
+    "small      --lines 30000"
+    "mixed      --lines 100000"
+    "labels     --lines 100000 --labels 60 --forward 70"
+    "data       --lines 100000 --data 70"
+    "symbols    --lines 100000 --labels 40 --externs 400 --entries 400"
+    "code-only  --lines 100000 --labels 0 --data 0"
+)
+
+_run_corpus() {
+    # $1 - executable file
+    # $2 - corpus name
+    # prints: lines words seconds peak_rss_kb
+    local _basename _lines _words _best _rss _run _result _time _rss_run
+    _basename="${_CORPUS_DIR}/${2}"
+    _lines=$(wc -l < "${_basename}.as")
+    for ((_run = 0; _run < _RUNS; _run++)); do
+        _result=$("${BENCH_MEASURE}" "$1" "${_basename}") || { echo "assembling ${2} failed" >&2; return 1; }
+        read -r _time _rss_run <<< "${_result}"
+        if [[ -z "${_best}" ]] || awk -v a="${_time}" -v b="${_best}" 'BEGIN { exit !(a < b) }'; then
+            _best="${_time}"
+        fi
+        [[ -z "${_rss}" || "${_rss_run}" -gt "${_rss}" ]] && _rss="${_rss_run}"
+    done
+    _words=$(awk 'NR == 1 { print $1 + $2 }' "${_basename}.ob")
+    echo "${_lines} ${_words} ${_best} ${_rss}"
+}
+
+_generate_corpora() {
+    local _entry _name _args
+    mkdir -p "${_CORPUS_DIR}"
+    for _entry in "${_CORPORA[@]}"; do
+        read -r _name _args <<< "${_entry}"
+        # shellcheck disable=SC2086
+        "${BENCH_GEN}" ${_args} > "${_CORPUS_DIR}/${_name}.as" || return 1
+    done
+}
+
+BENCH_GEN="${BENCH_GEN:-${2}/gen}"
+BENCH_MEASURE="${BENCH_MEASURE:-${2}/measure}"
+_generate_corpora || { echo "generating corpora failed"; exit 1; }
+
+_status=0
+_results=()
+printf "%-10s %8s %8s %10s %12s %12s %10s  %s\n" corpus lines words seconds lines/s words/s rss-KB "vs baseline"
+for _entry in "${_CORPORA[@]}"; do
+    read -r _name _args <<< "${_entry}"
+    _result=$(_run_corpus "$1" "${_name}") || exit 1
+    read -r _lines _words _time _rss <<< "${_result}"
+    _results+=("${_name} ${_result}")
+
+    _compare=""
+    _base=$(awk -v n="${_name}" '$1 == n { print $4, $5 }' "${_BASELINE}" 2>/dev/null)
+    if [[ -n "${_base}" && "$3" != "--update" ]]; then
+        read -r _base_time _base_rss <<< "${_base}"
+        _compare=$(awk -v t="${_time}" -v bt="${_base_time}" -v r="${_rss}" -v br="${_base_rss}" -v tol="${_TOLERANCE}" \
+                -v min="${_MIN_TIME}" 'BEGIN {
+            speed = bt / t * 100; mem = r / br * 100
+            verdict = (bt < min) ? "too short" : (speed < 100 - tol || mem > 100 + tol) ? "REGRESSION" : "ok"
+            printf "%s speed %.0f%% rss %.0f%%", verdict, speed, mem
+        }')
+        [[ "${_compare}" == REGRESSION* ]] && _status=1
+    fi
+    awk -v n="${_name}" -v l="${_lines}" -v w="${_words}" -v t="${_time}" -v r="${_rss}" -v c="${_compare}" \
+        'BEGIN { printf "%-10s %8d %8d %10.4f %12.0f %12.0f %10d  %s\n", n, l, w, t, l / t, w / t, r, c }'
+done
+
+if [[ "$3" == "--update" ]]; then
+    {
+        echo "# corpus lines words seconds peak_rss_kb"
+        printf "%s\n" "${_results[@]}"
+    } > "${_BASELINE}"
+    echo "baseline stored into ${_BASELINE}"
+elif [[ ! -f "${_BASELINE}" ]]; then
+    echo "no baseline found, run \`make bench-baseline\` to create it"
+elif [[ ${_status} -ne 0 ]]; then
+    echo "[FAIL] performance regression against ${_BASELINE}"
+fi
+exit ${_status}
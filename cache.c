@@ -0,0 +1,144 @@
+/* This file is part of OpenU's C project implementation, called assembler
+ * Copyright (C) 2020 Arthur Zamarin, Norel Farjun */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include "cache.h"
+#include "parser.h"
+#include "outbuf.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/** all output extensions, the object file first as it always exists in a complete entry */
+static const char *const g_extensions[] = {OUTPUT_OBJECT_EXTENSION, OUTPUT_ENTRIES_EXTENSION, OUTPUT_EXTERNALS_EXTENSION,
+                                          OUTPUT_BINARY_EXTENSION};
+
+/** name of the file of an entry holding the diagnostics printed while assembling */
+#define CACHE_DIAG_NAME "diag"
+
+/** FNV-1a 64 bit constants, built from 32 bit halves to stay inside C90 literals */
+#define CACHE_FNV_BASIS ((((uint64_t)0xcbf29ce4UL) << 32) | 0x84222325UL)
+#define CACHE_FNV_PRIME ((((uint64_t)0x100UL) << 32) | 0x000001b3UL)
+
+/**
+ * continue the FNV-1a {hash} over {len} bytes of {data}
+ */
+static uint64_t cache_hash(uint64_t hash, const char *data, size_t len) {
+    const unsigned char *ptr = (const unsigned char *)data, *end = ptr + len;
+    for (; ptr != end; ++ptr)
+        hash = (hash ^ *ptr) * CACHE_FNV_PRIME;
+    return hash;
+}
+
+void cache_key(const source_t *src, const char *options, char key[CACHE_KEY_LEN + 1]) {
+    uint64_t hash = CACHE_FNV_BASIS;
+
+    /* the terminators separate the parts, so they can't be shifted into each other */
+    hash = cache_hash(hash, ASSEMBLER_VERSION, sizeof(ASSEMBLER_VERSION));
+    hash = cache_hash(hash, options, strlen(options) + 1);
+    hash = cache_hash(hash, src->data, src->len);
+    sprintf(key, "%08lx%08lx", (unsigned long)(hash >> 32), (unsigned long)(hash & 0xffffffffUL));
+}
+
+/**
+ * return the malloced path "{dir}/{name}{suffix}"
+ */
+static char *cache_path(const char *dir, const char *name, const char *suffix) {
+    char *path = malloc(strlen(dir) + strlen(name) + strlen(suffix) + 2);
+    if (path)
+        sprintf(path, "%s/%s%s", dir, name, suffix);
+    return path;
+}
+
+BOOL cache_restore(const char *cache_dir, const char *key, const char *basename, FILE *out) {
+    char *entry, *cached, *output;
+    source_t content, diag;
+    BOOL res = TRUE;
+    unsigned i;
+
+    if (!(entry = cache_path(cache_dir, key, "")))
+        return FALSE;
+    if (!(cached = cache_path(entry, CACHE_DIAG_NAME, "")) || !source_open(&diag, cached)) {
+        /* every complete entry has the diagnostics, even when there were none */
+        free(cached);
+        free(entry);
+        return FALSE;
+    }
+    free(cached);
+    for (i = 0; res && i < ARR_SIZE(g_extensions); ++i) {
+        if (!(cached = cache_path(entry, g_extensions[i] + 1, "")))
+            res = FALSE;
+        else if (!source_open(&content, cached))
+            res = (i != 0 && errno == ENOENT); /* only the object file is mandatory */
+        else {
+            if (!(output = malloc(strlen(basename) + MAX_LEN_EXTENSION + 1)))
+                res = FALSE;
+            else {
+                sprintf(output, "%s%s", basename, g_extensions[i]);
+                res = outbuf_write_data(content.data, content.len, output, TRUE);
+                free(output);
+            }
+            source_close(&content);
+        }
+        free(cached);
+    }
+    if (res)
+        fwrite(diag.data, 1, diag.len, out);
+    source_close(&diag);
+    free(entry);
+    return res;
+}
+
+/**
+ * remove the directory {dir} of an entry, with all the files in it
+ */
+static void cache_remove_entry(const char *dir) {
+    char *path;
+    unsigned i;
+    for (i = 0; i < ARR_SIZE(g_extensions); ++i)
+        if ((path = cache_path(dir, g_extensions[i] + 1, ""))) {
+            remove(path);
+            free(path);
+        }
+    if ((path = cache_path(dir, CACHE_DIAG_NAME, ""))) {
+        remove(path);
+        free(path);
+    }
+    rmdir(dir);
+}
+
+char *cache_store_begin(const char *cache_dir, const char *key, unsigned unique) {
+    char suffix[64], *tmp_dir;
+    if (mkdir(cache_dir, 0777) && errno != EEXIST)
+        return NULL;
+    sprintf(suffix, ".tmp.%ld.%u", (long)getpid(), unique);
+    if (!(tmp_dir = cache_path(cache_dir, key, suffix)))
+        return NULL;
+    if (mkdir(tmp_dir, 0777)) {
+        free(tmp_dir);
+        return NULL;
+    }
+    return tmp_dir;
+}
+
+BOOL cache_store_diag(const char *tmp_dir, const char *data, size_t len) {
+    char *path = cache_path(tmp_dir, CACHE_DIAG_NAME, "");
+    BOOL res = path && outbuf_write_data(data, len, path, FALSE);
+    free(path);
+    return res;
+}
+
+void cache_store_end(const char *cache_dir, const char *key, char *tmp_dir, BOOL commit) {
+    char *entry = commit ? cache_path(cache_dir, key, "") : NULL;
+    /* renaming fails when a concurrent run already stored the same entry, which is just as good */
+    if (!entry || rename(tmp_dir, entry))
+        cache_remove_entry(tmp_dir);
+    free(entry);
+    free(tmp_dir);
+}
@@ -0,0 +1,53 @@
+/* This file is part of OpenU's C project implementation, called assembler
+ * Copyright (C) 2020 Arthur Zamarin, Norel Farjun */
+
+#ifndef ASM_CACHE_H
+#define ASM_CACHE_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+#include "global.h"
+#include "source.h"
+
+/**
+ * On disk build cache of the output files.
+ * Every entry is a directory named by the key of its input, holding the output files named by their
+ * extension without the dot, and the diagnostics printed while assembling, so a hit prints them again. Entries are created in a temporary directory and renamed when complete,
+ * so concurrent runs never see a partial entry.
+ */
+
+/** count of characters in a key, without the terminator */
+#define CACHE_KEY_LEN 16
+
+/**
+ * compute into {key} the cache key of assembling {src} with {options}, a text describing all the options
+ * affecting the outputs. The key is a hash of the source bytes, ASSEMBLER_VERSION and {options}.
+ */
+void cache_key(const source_t *src, const char *options, char key[CACHE_KEY_LEN + 1]);
+
+/**
+ * restore the outputs of {basename} from the entry {key} in {cache_dir}, and print its diagnostics into {out}
+ * output files which already have the cached content aren't touched
+ * return false if there is no such entry or restoring failed, having printed nothing
+ */
+BOOL cache_restore(const char *cache_dir, const char *key, const char *basename, FILE *out);
+
+/**
+ * create a temporary directory for the entry {key} in {cache_dir}, {unique} must differ between concurrent
+ * stores of the same process
+ * return the malloced path of the directory, or NULL on error
+ */
+char *cache_store_begin(const char *cache_dir, const char *key, unsigned unique);
+/**
+ * store the {len} bytes of {data} as the diagnostics of the entry being stored in {tmp_dir}
+ * return false on any error
+ */
+BOOL cache_store_diag(const char *tmp_dir, const char *data, size_t len);
+/**
+ * finish the store started with {tmp_dir}: if {commit} is set the directory becomes the entry {key}
+ * in {cache_dir}, otherwise it is removed. {tmp_dir} is freed.
+ */
+void cache_store_end(const char *cache_dir, const char *key, char *tmp_dir, BOOL commit);
+
+#endif
@@ -0,0 +1,219 @@
+/* This file is part of OpenU's C project implementation, called assembler
+ * Copyright (C) 2020 Arthur Zamarin, Norel Farjun */
+
+/*
+ * Client of an assembler started with --serve, a drop in replacement for running the assembler itself:
+ *     asmclient [--socket=PATH] [--stop] [--incremental] file1 file2 ...
+ * The socket is taken from the ASM_SOCKET environment variable when not given. The files are assembled by
+ * the server in the client's directory, and the diagnostics are printed exactly as the assembler prints them.
+ * --stop asks the server to shut down after assembling the files.
+ * --incremental builds every file line by line with OPEN and EDIT requests, for testing the incremental mode.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "global.h"
+#include "server.h"
+
+/** how long to wait for a server which is just starting up */
+#define CLIENT_CONNECT_TRIES 50
+#define CLIENT_CONNECT_DELAY_NS 100000000L
+
+/**
+ * connect to the server listening on {socket_path}, retrying while it isn't up yet
+ * return the socket, or -1 on error
+ */
+static int client_connect(const char *socket_path) {
+    struct sockaddr_un addr;
+    struct timespec delay;
+    int fd, tries;
+
+    if (strlen(socket_path) >= sizeof(addr.sun_path))
+        return -1;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socket_path);
+    delay.tv_sec = 0;
+    delay.tv_nsec = CLIENT_CONNECT_DELAY_NS;
+
+    for (tries = 0; tries < CLIENT_CONNECT_TRIES; ++tries) {
+        if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+            return -1;
+        if (!connect(fd, (struct sockaddr *)&addr, sizeof(addr)))
+            return fd;
+        close(fd);
+        if (errno != ENOENT && errno != ECONNREFUSED)
+            return -1;
+        nanosleep(&delay, NULL);
+    }
+    return -1;
+}
+
+/**
+ * copy {len} bytes from {in} into {out}, or just skip them if {out} is NULL
+ * return false if {in} ended before
+ */
+static BOOL client_copy(FILE *in, unsigned long len, FILE *out) {
+    char buffer[4096];
+    size_t chunk;
+    for (; len; len -= chunk) {
+        chunk = len < sizeof(buffer) ? (size_t)len : sizeof(buffer);
+        if (fread(buffer, 1, chunk, in) != chunk)
+            return FALSE;
+        if (out)
+            fwrite(buffer, 1, chunk, out);
+    }
+    return TRUE;
+}
+
+/**
+ * read the answers of one request from {in}, printing the diagnostics into ERR_STREAM if {is_printed}
+ * return false if the server reported an error or the answers are broken
+ */
+static BOOL client_read_answer(FILE *in, BOOL is_printed) {
+    char line[4200], extension[16];
+    unsigned long len;
+
+    while (fgets(line, sizeof(line), in)) {
+        if (sscanf(line, "DIAG %lu", &len) == 1) {
+            if (!client_copy(in, len, is_printed ? ERR_STREAM : NULL))
+                return FALSE;
+        } else if (sscanf(line, "CONTENT %15s %lu", extension, &len) == 2) {
+            if (!client_copy(in, len, NULL))
+                return FALSE;
+        } else if (!strncmp(line, "END ", 4))
+            return TRUE;
+        else if (!strncmp(line, "ERROR ", 6)) {
+            fprintf(stderr, "server error: %s", line + 6);
+            return FALSE;
+        } else if (strncmp(line, "OUTPUT ", 7))
+            return FALSE;
+    }
+    return FALSE;
+}
+
+/**
+ * read all the content of {path} into a new buffer, and set its {*len}
+ * return NULL if the file can't be read
+ */
+static char *client_read_file(const char *path, size_t *len) {
+    FILE *file = fopen(path, "rb");
+    char *data = NULL;
+    long size;
+
+    if (!file)
+        return NULL;
+    if (!fseek(file, 0, SEEK_END) && (size = ftell(file)) >= 0 && !fseek(file, 0, SEEK_SET) &&
+            (data = malloc(size ? (size_t)size : 1)) && fread(data, 1, (size_t)size, file) != (size_t)size) {
+        free(data);
+        data = NULL;
+    }
+    *len = data ? (size_t)size : 0;
+    fclose(file);
+    return data;
+}
+
+/** held line which is an error, so no outputs are written until the file is complete */
+#define CLIENT_BAD_LINE "!\n"
+
+/**
+ * assemble {basename} through {out} and {in} with incremental requests: a source of one bad line is opened, the
+ * lines of the file are inserted after it one by one from the last, so every line is parsed alone and moves the
+ * following ones, and at last the bad line is removed.
+ * Only the answer of the last request is printed, so the diagnostics are those of a FILE request.
+ * return false if the answers are broken
+ */
+static BOOL client_incremental(FILE *out, FILE *in, const char *basename) {
+    char *path = malloc(strlen(basename) + sizeof(".as")), *data;
+    size_t len, end, start;
+    BOOL res;
+
+    if (!path)
+        return FALSE;
+    sprintf(path, "%s.as", basename);
+    data = client_read_file(path, &len);
+    free(path);
+    if (!data) { /* the server reports it */
+        fprintf(out, "FILE %s\n", basename);
+        return fflush(out) == 0 && client_read_answer(in, TRUE);
+    }
+    fprintf(out, "OPEN %lu %s\n%s", (unsigned long)strlen(CLIENT_BAD_LINE), basename, CLIENT_BAD_LINE);
+    res = fflush(out) == 0 && client_read_answer(in, FALSE);
+    for (end = len; res && end > 0; end = start) {
+        for (start = end - 1; start > 0 && data[start - 1] != '\n'; --start);
+        fprintf(out, "EDIT 1 0 %lu\n", (unsigned long)(end - start));
+        fwrite(data + start, 1, end - start, out);
+        res = fflush(out) == 0 && client_read_answer(in, FALSE);
+    }
+    if (res) {
+        fprintf(out, "EDIT 0 1 0\n");
+        res = fflush(out) == 0 && client_read_answer(in, TRUE);
+    }
+    free(data);
+    return res;
+}
+
+int main(int argc, char *argv[]) {
+    const char *socket_path = getenv(SERVER_SOCKET_ENV);
+    char cwd[4096];
+    BOOL stop = FALSE, incremental = FALSE, res = TRUE;
+    FILE *out, *in;
+    int i, fd, files_cnt = 0;
+
+    for (i = 1; i < argc; i++) {
+        if (!strncmp(argv[i], "--socket=", 9) && argv[i][9])
+            socket_path = argv[i] + 9;
+        else if (!strcmp(argv[i], "--stop"))
+            stop = TRUE;
+        else if (!strcmp(argv[i], "--incremental"))
+            incremental = TRUE;
+        else if (argv[i][0] == '-') {
+            fprintf(ERR_STREAM, "unknown option \'%s\'\n", argv[i]);
+            return 1;
+        } else
+            ++files_cnt;
+    }
+    if (!socket_path) {
+        fprintf(ERR_STREAM, "no socket given, use --socket=PATH or set %s\n", SERVER_SOCKET_ENV);
+        return 1;
+    }
+    if (files_cnt == 0 && !stop) {
+        fprintf(ERR_STREAM, "no input files given\n");
+        return 1;
+    }
+    if (!getcwd(cwd, sizeof(cwd)) || (fd = client_connect(socket_path)) < 0) {
+        fprintf(ERR_STREAM, "unable to connect to \'%s\'\n", socket_path);
+        return 1;
+    }
+    if (!(out = fdopen(fd, "w")) || !(in = fdopen(dup(fd), "r"))) {
+        fprintf(ERR_STREAM, "out of memory\n");
+        return 1;
+    }
+
+    /* one request at a time, so neither side blocks on a full socket while the other one writes */
+    fprintf(out, "CWD %s\n", cwd);
+    for (i = 1; res && i < argc; i++)
+        if (argv[i][0] == '-')
+            continue;
+        else if (incremental)
+            res = client_incremental(out, in, argv[i]);
+        else {
+            fprintf(out, "FILE %s\n", argv[i]);
+            res = fflush(out) == 0 && client_read_answer(in, TRUE);
+        }
+    if (stop)
+        fprintf(out, "SHUTDOWN\n");
+    fflush(out);
+    fclose(out);
+    fclose(in);
+    return !res;
+}
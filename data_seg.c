@@ -2,63 +2,86 @@
  * Copyright (C) 2020 Arthur Zamarin, Norel Farjun */
 
 #include "data_seg.h"
-#include "global.h"
 
-#include <stdlib.h>
 #include <string.h>
 
-struct dataseg_node {
-    struct dataseg_node *next;
-    uint16_t data[128];
-};
+#if defined(__GNUC__) && defined(__SSE2__)
+#define DATASEG_SSE2
+#include <emmintrin.h>
+#endif
 
-dataseg_t dataseg_new() {
-    dataseg_t seg = {NULL, NULL, 0};
+/** initial count of words, the array doubles when full */
+#define DATASEG_INITIAL_CAPACITY 256
+
+dataseg_t dataseg_new(arena_t *arena) {
+    dataseg_t seg = {NULL, 0, 0, NULL};
+    seg.arena = arena;
     return seg;
 }
 
-void dataseg_dealloc(dataseg_t *seg) {
-    struct dataseg_node *iter = seg->head, *tmp;
-    while (iter) {
-        tmp = iter->next;
-        free(iter);
-        iter = tmp;
-    }
+void dataseg_clear(dataseg_t *seg) {
+    seg->size = 0;
 }
 
 /**
- * allocate a new node at the tail of {seg}
+ * make room for {count} more words in {seg}, doubling its array as needed
+ * return false if out of memory
  */
-static void dataseg_allocate_node(dataseg_t *seg) {
-    struct dataseg_node *node = malloc(sizeof(struct dataseg_node));
-    if (seg->head == NULL)
-        seg->head = node;
-    else
-        seg->tail->next = node;
-    seg->tail = node;
-    node->next = NULL;
+static BOOL dataseg_reserve(dataseg_t *seg, size_t count) {
+    unsigned long capacity = seg->capacity ? seg->capacity : DATASEG_INITIAL_CAPACITY;
+    uint16_t *words;
+    if (seg->size + count <= seg->capacity)
+        return TRUE;
+    while (capacity < seg->size + count)
+        capacity *= 2;
+    if (!(words = arena_realloc(seg->arena, seg->words, seg->capacity * sizeof(uint16_t), capacity * sizeof(uint16_t))))
+        return FALSE;
+    seg->words = words;
+    seg->capacity = (unsigned)capacity;
+    return TRUE;
 }
 
-void dataseg_append_number(dataseg_t *seg, uint16_t number) {
-    unsigned pos = seg->size % ARR_SIZE(seg->tail->data);
-    if (pos == 0)
-        dataseg_allocate_node(seg);
-    seg->tail->data[pos] = number;
-    seg->size += 1;
+BOOL dataseg_append_number(dataseg_t *seg, uint16_t number) {
+    if (seg->size == seg->capacity && !dataseg_reserve(seg, 1))
+        return FALSE;
+    seg->words[seg->size++] = number;
+    return TRUE;
+}
+
+BOOL dataseg_append_numbers(dataseg_t *seg, const uint16_t *numbers, size_t count) {
+    if (!dataseg_reserve(seg, count))
+        return FALSE;
+    memcpy(seg->words + seg->size, numbers, count * sizeof(uint16_t));
+    seg->size += (unsigned)count;
+    return TRUE;
+}
+
+/**
+ * widen {len} characters of {str} into words of {out}
+ */
+static void dataseg_widen(uint16_t *out, const char *str, size_t len) {
+    size_t i = 0;
+#ifdef DATASEG_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= len; i += 16) {
+        const __m128i v = _mm_loadu_si128((const __m128i *)(str + i));
+        _mm_storeu_si128((__m128i *)(out + i), _mm_unpacklo_epi8(v, zero));
+        _mm_storeu_si128((__m128i *)(out + i + 8), _mm_unpackhi_epi8(v, zero));
+    }
+#endif
+    for (; i < len; ++i)
+        out[i] = (uint16_t)(unsigned char)str[i];
 }
 
-void dataseg_append_string(dataseg_t *seg, const char *str) {
-    for (; *str; ++str)
-        dataseg_append_number(seg, (uint16_t)(unsigned char)*str);
-    dataseg_append_number(seg, 0);
+BOOL dataseg_append_string(dataseg_t *seg, const char *str, size_t len) {
+    if (!dataseg_reserve(seg, len + 1))
+        return FALSE;
+    dataseg_widen(seg->words + seg->size, str, len);
+    seg->words[seg->size + len] = 0;
+    seg->size += (unsigned)len + 1;
+    return TRUE;
 }
 
-void dataseg_output(dataseg_t *seg, unsigned start_addr, FILE *object_file) {
-    unsigned i, remaining = seg->size % ARR_SIZE(seg->head->data);
-    struct dataseg_node *iter;
-    for (iter = seg->head; iter != seg->tail; iter = iter->next)
-        for (i = 0; i < ARR_SIZE(iter->data); ++i)
-            fprintf(object_file, OBJECT_FILE_OUTPUT_FORMAT, start_addr++, iter->data[i]);
-    for (i = 0; i < remaining; ++i)
-        fprintf(object_file, OBJECT_FILE_OUTPUT_FORMAT, start_addr++, seg->tail->data[i]);
+void dataseg_output(dataseg_t *seg, unsigned start_addr, outbuf_t *object) {
+    outbuf_put_object_words(object, start_addr, seg->words, seg->size);
 }
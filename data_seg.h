@@ -4,40 +4,52 @@
 #ifndef ASM_DATA_SEG_H
 #define ASM_DATA_SEG_H
 
-#include <stdio.h>
 #include <stdint.h>
 
+#include "global.h"
+#include "arena.h"
+#include "outbuf.h"
+
 /**
  * Holds the data segment structure and content.
- * Uses linked list of fixed size slot array
+ * The words are kept in one contiguous array, which grows geometrically
  */
-struct dataseg_node;
 typedef struct {
-    struct dataseg_node *head;
-    struct dataseg_node *tail;
-    uint16_t size;
+    uint16_t *words;
+    unsigned size;     /* count of words */
+    unsigned capacity; /* count of allocated words */
+    arena_t *arena;    /* memory source for the array */
 } dataseg_t;
 
 /**
- * create and return a new dataseg_t structure
+ * create and return a new dataseg_t structure, which allocates from {arena}
+ * all the memory is owned by {arena}, so there is no dealloc function
  */
-dataseg_t dataseg_new(void);
+dataseg_t dataseg_new(arena_t *arena);
+
 /**
- * free and clean the {seg} structure
+ * remove all the words of {seg}, keeping its memory for the next ones
  */
-void dataseg_dealloc(dataseg_t *seg);
-
+void dataseg_clear(dataseg_t *seg);
 /**
  * append {number} as one slot at the end of the {seg} structure
+ * return false if out of memory
+ */
+BOOL dataseg_append_number(dataseg_t *seg, uint16_t number);
+/**
+ * append the {count} {numbers} at the end of the {seg} structure
+ * return false if out of memory
  */
-void dataseg_append_number(dataseg_t *seg, uint16_t number);
+BOOL dataseg_append_numbers(dataseg_t *seg, const uint16_t *numbers, size_t count);
 /**
- * append {str} as zero terminated slot array at the end of the {seg} structure
+ * append {str} of {len} characters as zero terminated slot array at the end of the {seg} structure
+ * return false if out of memory
  */
-void dataseg_append_string(dataseg_t *seg, const char *str);
+BOOL dataseg_append_string(dataseg_t *seg, const char *str, size_t len);
 /**
- * output the {seg} structure into {object_file}, while the addressing starts with {start_addr}
+ * output the {seg} structure into {object}, while the addressing starts with {start_addr}
+ * {object} must have room for all the records
  */
-void dataseg_output(dataseg_t *seg, unsigned start_addr, FILE *object_file);
+void dataseg_output(dataseg_t *seg, unsigned start_addr, outbuf_t *object);
 
 #endif
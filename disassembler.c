@@ -0,0 +1,865 @@
+/* This file is part of OpenU's C project implementation, called assembler
+ * Copyright (C) 2020 Arthur Zamarin, Norel Farjun */
+
+/*
+ * Disassembler of text object files back into assembly source:
+ *     disassembler [--stdout] basename...
+ * Every argument is a basename of text object files (.ob, and .ent and .ext if they exist), which is written as
+ * <basename>_dis.as, or into stdout with --stdout. Assembling the output gives back the same object files.
+ *
+ * Labels are named by the entries file, and external operands by the externals file. Any other address used by an
+ * operand gets a generated label "L<address>". As operands hold 12 bits, a label past 4095 is found by the low bits of
+ * its address, and so are the entries of a default (not --large) entries file. The data segment is written as
+ * ".string" where the words are a string the assembler accepts, and as ".data" elsewhere.
+ *
+ * The object file is mapped and read twice, once to find the addresses used by operands and once to write the
+ * source, so the only memory per word is one byte of flags. Command words are decoded with a table of all the
+ * 15 bit words, built once from the opcodes encoding table.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "global.h"
+#include "source.h"
+#include "lexer.h"
+#include "opcodes.h"
+#include "instructions_list.h"
+#include "parser.h"
+
+#define DIS_OUTPUT_SUFFIX "_dis"
+#define DIS_OUT_BUFFER_SIZE 65536
+#define DIS_WORDS_RANGE 0x8000U
+#define DIS_SIGN_BIT 0x4000L
+/** the generated labels are "L<address>", or more 'L's when a symbol already looks like that */
+#define DIS_PREFIX_CHAR 'L'
+#define DIS_MAX_PREFIX_LEN 8
+/** count of addresses a label operand holds, larger addresses wrap by default */
+#define DIS_LABEL_ADDRS (1UL << (DATA_LABEL_RANGE(BIT_RANGE_END) - DATA_LABEL_RANGE(BIT_RANGE_START) + 1))
+/** characters of a ".string" statement besides its characters */
+#define DIS_STRING_EXTRA_LEN (sizeof(".string \"\"") - 1)
+/** signed value of the data {word} */
+#define DIS_DATA_VALUE(word) (((word) & DIS_SIGN_BIT) ? (long)(word) - 2 * DIS_SIGN_BIT : (long)(word))
+
+/** flags of every word in the image */
+enum dis_mark {
+    DIS_MARK_STATEMENT = 0x1, /* first word of an instruction or a data statement, so it may have a label */
+    DIS_MARK_TARGET    = 0x2, /* used by a label operand or an entry, so it has a label */
+    DIS_MARK_ENTRY     = 0x4  /* has an entry */
+};
+
+/**
+ * Decoded command word, {size} is 0 when the word isn't a legal command
+ */
+typedef struct {
+    uint8_t opcode;
+    uint8_t src;  /* operand_access of the first operand */
+    uint8_t dst;  /* operand_access of the second operand */
+    uint8_t size; /* count of words of the instruction */
+} dis_command_t;
+
+/** every command word, indexed by its value */
+static dis_command_t g_commands[DIS_WORDS_RANGE];
+
+/**
+ * One decoded operand
+ */
+typedef struct {
+    unsigned access;   /* operand_access */
+    unsigned value;    /* register, 12 bit immediate, or label address */
+    BOOL is_external;
+    unsigned long site; /* address of the operand word */
+} dis_operand_t;
+
+/**
+ * One decoded instruction
+ */
+typedef struct {
+    dis_command_t cmd;
+    dis_operand_t src;
+    dis_operand_t dst;
+} dis_inst_t;
+
+/**
+ * One line of the entries or externals file, its name points into the mapped file
+ */
+typedef struct {
+    const char *name;
+    size_t len;
+    unsigned long addr;
+} dis_symbol_t;
+
+/**
+ * Output stream through a fixed buffer
+ */
+typedef struct {
+    FILE *stream;
+    size_t len;
+    BOOL is_ok;
+    char data[DIS_OUT_BUFFER_SIZE];
+} dis_out_t;
+
+/**
+ * One object being disassembled
+ */
+typedef struct {
+    const char *name;
+    source_t ob;
+    size_t records;              /* offset of the first word record in {ob} */
+    size_t pos;                  /* offset of the next record to read */
+    unsigned long next_addr;     /* address of the next record to read */
+    unsigned long code_size, data_size;
+    source_t ent, ext;           /* empty when the file doesn't exist */
+    dis_symbol_t *entries;       /* in the order of the entries file */
+    dis_symbol_t *entries_by_addr; /* sorted by address, placed at their statements by dis_scan */
+    dis_symbol_t *externals;     /* sorted by use site */
+    unsigned long entries_cnt, externals_cnt;
+    unsigned long externals_used; /* count of external operands written */
+    unsigned char *marks;        /* dis_mark flags of every word */
+    unsigned long *targets;      /* the statement of every label operand value, 0 for unused values */
+    unsigned prefix_len;         /* count of DIS_PREFIX_CHAR in generated labels */
+} dis_image_t;
+
+/**
+ * fill g_commands from the opcodes encoding table
+ */
+static void dis_build_commands(void) {
+    unsigned opcode, src, dst, word;
+    for (opcode = 0; opcode < OPCODES_COUNT; ++opcode)
+        for (src = 0; src < OPERAND_ACCESS_RANGE; ++src)
+            for (dst = 0; dst < OPERAND_ACCESS_RANGE; ++dst)
+                if ((word = OPCODE_ENCODE(opcode, src, dst))) {
+                    g_commands[word].opcode = (uint8_t)opcode;
+                    g_commands[word].src = (uint8_t)src;
+                    g_commands[word].dst = (uint8_t)dst;
+                    g_commands[word].size = (uint8_t)(1 + !!src + !!dst -
+                                                      !!((src & OPERAND_ALL_REG) && (dst & OPERAND_ALL_REG)));
+                }
+}
+
+/**
+ * read a number in {base} (up to 10) from {*ptr} before {end} into {value}, skipping spaces before it
+ * return false if there is no number, or it doesn't fit 32 bits
+ */
+static BOOL dis_parse_number(const char **ptr, const char *end, unsigned base, unsigned long *value) {
+    const char *start;
+    for (; *ptr != end && LEXER_IS(**ptr, LEX_SPACE); ++*ptr);
+    for (start = *ptr, *value = 0; *ptr != end && **ptr >= '0' && **ptr < (char)('0' + base); ++*ptr)
+        if ((*value = *value * base + (unsigned)(**ptr - '0')) > 0xffffffffUL)
+            return FALSE;
+    return *ptr != start;
+}
+
+/**
+ * return true if only spaces are left from {ptr} to {end}
+ */
+static BOOL dis_at_end(const char *ptr, const char *end) {
+    for (; ptr != end && LEXER_IS(*ptr, LEX_SPACE); ++ptr);
+    return ptr == end;
+}
+
+/**
+ * read the next word record of {img} into {word}
+ * return false if there is none, or it isn't a record of the next address
+ */
+static BOOL dis_read_word(dis_image_t *img, unsigned *word) {
+    line_view_t line;
+    const char *ptr;
+    unsigned long addr, value;
+
+    do
+        if (!source_next_line(&img->ob, &img->pos, &line))
+            return FALSE;
+    while (dis_at_end(line.ptr, line.ptr + line.len));
+    ptr = line.ptr;
+    if (!dis_parse_number(&ptr, line.ptr + line.len, 10, &addr) ||
+            !dis_parse_number(&ptr, line.ptr + line.len, 8, &value) || !dis_at_end(ptr, line.ptr + line.len) ||
+            addr != img->next_addr || value >= DIS_WORDS_RANGE)
+        return FALSE;
+    ++img->next_addr;
+    *word = (unsigned)value;
+    return TRUE;
+}
+
+/**
+ * start reading the words of {img} again from the first record
+ */
+static void dis_rewind(dis_image_t *img) {
+    img->pos = img->records;
+    img->next_addr = OUTPUT_OBJECT_CODE_START;
+}
+
+/**
+ * return the word of register {reg} as the {is_dst} operand, like the assembler writes it
+ */
+static unsigned dis_register_word(unsigned reg, BOOL is_dst) {
+    unsigned word = 0;
+    BITS_SET(DATA_ARE_RANGE, word, INST_ARE_ABSOLUTE);
+    if (is_dst)
+        BITS_SET(DATA_DST_REG_RANGE, word, reg);
+    else
+        BITS_SET(DATA_SRC_REG_RANGE, word, reg);
+    return word;
+}
+
+/**
+ * decode the operand {word} at {site} accessed by {access} into {opr}, as the {is_dst} operand
+ * return false if the assembler can't write this word
+ */
+static BOOL dis_decode_operand(unsigned access, unsigned word, BOOL is_dst, unsigned long site, dis_operand_t *opr) {
+    const unsigned are = BITS_GET(DATA_ARE_RANGE, word);
+    opr->access = access;
+    opr->is_external = FALSE;
+    opr->site = site;
+    switch (access) {
+        case OPERAND_REG:
+        case OPERAND_MEM_REG:
+            opr->value = is_dst ? BITS_GET(DATA_DST_REG_RANGE, word) : BITS_GET(DATA_SRC_REG_RANGE, word);
+            return word == dis_register_word(opr->value, is_dst);
+        case OPERAND_IMMEDIATE:
+            opr->value = BITS_GET(DATA_IMMEDIATE_RANGE, word);
+            return are == INST_ARE_ABSOLUTE;
+        default:
+            opr->value = BITS_GET(DATA_LABEL_RANGE, word);
+            opr->is_external = are == INST_ARE_EXTERNAL;
+            return are == INST_ARE_RELETIVE || (are == INST_ARE_EXTERNAL && opr->value == 0);
+    }
+}
+
+/**
+ * read the instruction at {addr} of {img} into {inst}
+ * return false if it isn't an instruction the assembler writes, reporting why
+ */
+static BOOL dis_read_instruction(dis_image_t *img, unsigned long addr, dis_inst_t *inst) {
+    const unsigned long code_end = OUTPUT_OBJECT_CODE_START + img->code_size;
+    unsigned word, operand;
+    BOOL is_ok = TRUE;
+
+    if (!dis_read_word(img, &word)) {
+        fprintf(ERR_STREAM, "%s: bad object file record at %04lu\n", img->name, addr);
+        return FALSE;
+    }
+    inst->cmd = g_commands[word];
+    if (inst->cmd.size == 0) {
+        fprintf(ERR_STREAM, "%s: bad command word %05o at %04lu\n", img->name, word, addr);
+        return FALSE;
+    }
+    if (addr + inst->cmd.size > code_end) {
+        fprintf(ERR_STREAM, "%s: truncated instruction at %04lu\n", img->name, addr);
+        return FALSE;
+    }
+    inst->src.access = inst->dst.access = OPERAND_NONE;
+    if (inst->cmd.size > 1 && !dis_read_word(img, &operand)) {
+        fprintf(ERR_STREAM, "%s: bad object file record at %04lu\n", img->name, addr + 1);
+        return FALSE;
+    }
+    if ((inst->cmd.src & OPERAND_ALL_REG) && (inst->cmd.dst & OPERAND_ALL_REG)) {
+        /* both operands are register based, so they share one word */
+        dis_decode_operand(inst->cmd.src, operand, FALSE, addr + 1, &inst->src);
+        dis_decode_operand(inst->cmd.dst, operand, TRUE, addr + 1, &inst->dst);
+        is_ok = operand == (dis_register_word(inst->src.value, FALSE) | dis_register_word(inst->dst.value, TRUE));
+    } else {
+        if (inst->cmd.src)
+            is_ok = dis_decode_operand(inst->cmd.src, operand, FALSE, addr + 1, &inst->src);
+        if (is_ok && inst->cmd.dst && inst->cmd.src && !dis_read_word(img, &operand)) {
+            fprintf(ERR_STREAM, "%s: bad object file record at %04lu\n", img->name, addr + 2);
+            return FALSE;
+        }
+        if (is_ok && inst->cmd.dst)
+            is_ok = dis_decode_operand(inst->cmd.dst, operand, TRUE, addr + inst->cmd.size - 1, &inst->dst);
+    }
+    if (!is_ok)
+        fprintf(ERR_STREAM, "%s: bad operand word of the instruction at %04lu\n", img->name, addr);
+    return is_ok;
+}
+
+/**
+ * compare two dis_symbol_t by address, for qsort
+ */
+static int dis_compare_addr(const void *a, const void *b) {
+    const unsigned long x = ((const dis_symbol_t *)a)->addr, y = ((const dis_symbol_t *)b)->addr;
+    return (x > y) - (x < y);
+}
+
+/**
+ * compare two dis_symbol_t by name, for qsort
+ */
+static int dis_compare_name(const void *a, const void *b) {
+    const dis_symbol_t *x = a, *y = b;
+    int res = memcmp(x->name, y->name, x->len < y->len ? x->len : y->len);
+    return res ? res : (x->len > y->len) - (x->len < y->len);
+}
+
+/**
+ * load the symbols file at {path} into a malloced array at {symbols} of {cnt} items, keeping it mapped in {src}
+ * a missing file has no symbols
+ * return false if the file isn't valid or out of memory
+ */
+static BOOL dis_load_symbols(const char *path, source_t *src, dis_symbol_t **symbols, unsigned long *cnt) {
+    const char *ptr, *end;
+    line_view_t line;
+    size_t pos = 0;
+
+    *symbols = NULL;
+    *cnt = 0;
+    if (!source_open(src, path)) {
+        src->data = NULL;
+        src->len = 0;
+        src->is_mapped = FALSE;
+        return TRUE;
+    }
+    for (ptr = src->data; (ptr = memchr(ptr, '\n', src->len - (size_t)(ptr - src->data))); ++ptr)
+        ++*cnt;
+    if (!(*symbols = malloc((*cnt + 1) * sizeof(dis_symbol_t))))
+        return FALSE;
+    for (*cnt = 0; source_next_line(src, &pos, &line);) {
+        end = line.ptr + line.len;
+        if (dis_at_end(line.ptr, end))
+            continue;
+        for (ptr = line.ptr; LEXER_IS(*ptr, LEX_SPACE); ++ptr);
+        (*symbols)[*cnt].name = ptr;
+        for (; ptr != end && LEXER_IS(*ptr, LEX_GRAPH); ++ptr);
+        (*symbols)[*cnt].len = (size_t)(ptr - (*symbols)[*cnt].name);
+        if (!dis_parse_number(&ptr, end, 10, &(*symbols)[*cnt].addr) || !dis_at_end(ptr, end))
+            return FALSE;
+        ++*cnt;
+    }
+    return TRUE;
+}
+
+/**
+ * return true if {sym} is named like a generated label with a prefix of {prefix_len} characters
+ */
+static BOOL dis_is_generated_name(const dis_symbol_t *sym, unsigned prefix_len) {
+    size_t i;
+    if (sym->len <= prefix_len)
+        return FALSE;
+    for (i = 0; i < sym->len; ++i)
+        if (i < prefix_len ? sym->name[i] != DIS_PREFIX_CHAR : !LEXER_IS(sym->name[i], LEX_DIGIT))
+            return FALSE;
+    return TRUE;
+}
+
+/**
+ * choose the shortest prefix of the generated labels of {img} which no symbol uses
+ * return false if there is none
+ */
+static BOOL dis_choose_prefix(dis_image_t *img) {
+    unsigned long i;
+    BOOL is_used = TRUE;
+    for (img->prefix_len = 0; is_used && img->prefix_len < DIS_MAX_PREFIX_LEN;) {
+        ++img->prefix_len;
+        is_used = FALSE;
+        for (i = 0; i < img->entries_cnt && !is_used; ++i)
+            is_used = dis_is_generated_name(img->entries + i, img->prefix_len);
+        for (i = 0; i < img->externals_cnt && !is_used; ++i)
+            is_used = dis_is_generated_name(img->externals + i, img->prefix_len);
+    }
+    return !is_used;
+}
+
+/**
+ * close all the files of {img} and release its memory
+ */
+static void dis_close(dis_image_t *img) {
+    source_close(&img->ob);
+    if (img->ent.data)
+        source_close(&img->ent);
+    if (img->ext.data)
+        source_close(&img->ext);
+    free(img->entries);
+    free(img->entries_by_addr);
+    free(img->externals);
+    free(img->marks);
+    free(img->targets);
+}
+
+/**
+ * open the object files of {basename} into {img}
+ * return false if they can't be read or aren't valid, reporting why
+ */
+static BOOL dis_open(dis_image_t *img, const char *basename) {
+    const size_t len = strlen(basename);
+    char *path;
+    line_view_t header;
+    const char *ptr;
+    BOOL res;
+
+    memset(img, 0, sizeof(dis_image_t));
+    img->name = basename;
+    if (!(path = malloc(len + MAX_LEN_EXTENSION + 1))) {
+        fprintf(ERR_STREAM, "out of memory\n");
+        return FALSE;
+    }
+    strcpy(path, basename);
+    strcpy(path + len, OUTPUT_OBJECT_EXTENSION);
+    if (!source_open(&img->ob, path)) {
+        fprintf(ERR_STREAM, "%s: unable to read \'%s\'\n", basename, path);
+        free(path);
+        return FALSE;
+    }
+    strcpy(path + len, OUTPUT_ENTRIES_EXTENSION);
+    res = dis_load_symbols(path, &img->ent, &img->entries, &img->entries_cnt);
+    strcpy(path + len, OUTPUT_EXTERNALS_EXTENSION);
+    res = res && dis_load_symbols(path, &img->ext, &img->externals, &img->externals_cnt);
+    free(path);
+    if (!res) {
+        fprintf(ERR_STREAM, "%s: bad symbols file, or out of memory\n", basename);
+        dis_close(img);
+        return FALSE;
+    }
+
+    if (!source_next_line(&img->ob, &img->records, &header) ||
+            !(ptr = header.ptr, dis_parse_number(&ptr, header.ptr + header.len, 10, &img->code_size)) ||
+            !dis_parse_number(&ptr, header.ptr + header.len, 10, &img->data_size) ||
+            !dis_at_end(ptr, header.ptr + header.len) ||
+            img->code_size + img->data_size > img->ob.len / 4) { /* a record takes at least 4 bytes */
+        fprintf(ERR_STREAM, "%s: bad object file header\n", basename);
+        dis_close(img);
+        return FALSE;
+    }
+    if (!(img->marks = calloc(img->code_size + img->data_size + 1, 1)) ||
+            !(img->targets = calloc(DIS_LABEL_ADDRS, sizeof(unsigned long))) ||
+            !(img->entries_by_addr = malloc((img->entries_cnt + 1) * sizeof(dis_symbol_t)))) {
+        fprintf(ERR_STREAM, "out of memory\n");
+        dis_close(img);
+        return FALSE;
+    }
+    memcpy(img->entries_by_addr, img->entries, img->entries_cnt * sizeof(dis_symbol_t));
+    qsort(img->entries_by_addr, img->entries_cnt, sizeof(dis_symbol_t), dis_compare_addr);
+    qsort(img->externals, img->externals_cnt, sizeof(dis_symbol_t), dis_compare_addr);
+    return TRUE;
+}
+
+/**
+ * return the first statement of {img} at {addr} or after it in steps of DIS_LABEL_ADDRS, without any of {marks}
+ * all those addresses are written the same into an operand, and into the entries file by default
+ * return 0 if there is none
+ */
+static unsigned long dis_find_statement(const dis_image_t *img, unsigned long addr, unsigned marks) {
+    const unsigned long end = OUTPUT_OBJECT_CODE_START + img->code_size + img->data_size;
+    for (; addr < end; addr += DIS_LABEL_ADDRS)
+        if (addr >= OUTPUT_OBJECT_CODE_START &&
+                (img->marks[addr - OUTPUT_OBJECT_CODE_START] & (DIS_MARK_STATEMENT | marks)) == DIS_MARK_STATEMENT)
+            return addr;
+    return 0;
+}
+
+/**
+ * place the entries and the label operands of {img} at statements, and mark those
+ * the entries are moved to their place, and the label operands are mapped into {targets}
+ * return false if any of them has no place, reporting why
+ */
+static BOOL dis_place_labels(dis_image_t *img) {
+    dis_symbol_t *entry;
+    unsigned long i, addr;
+    BOOL res = TRUE;
+
+    for (i = 0; i < img->entries_cnt; ++i) {
+        entry = img->entries_by_addr + i;
+        if (!(addr = dis_find_statement(img, entry->addr, DIS_MARK_ENTRY))) {
+            fprintf(ERR_STREAM, "%s: entry \'%.*s\' has a bad address %lu\n", img->name, (int)entry->len,
+                    entry->name, entry->addr);
+            res = FALSE;
+            continue;
+        }
+        entry->addr = addr;
+        img->marks[addr - OUTPUT_OBJECT_CODE_START] |= DIS_MARK_ENTRY | DIS_MARK_TARGET;
+    }
+    qsort(img->entries_by_addr, img->entries_cnt, sizeof(dis_symbol_t), dis_compare_addr);
+
+    for (i = 0; i < DIS_LABEL_ADDRS; ++i) {
+        if (!img->targets[i])
+            continue;
+        if (!(img->targets[i] = dis_find_statement(img, i, 0))) {
+            fprintf(ERR_STREAM, "%s: no statement for label address %lu\n", img->name, i);
+            res = FALSE;
+            continue;
+        }
+        img->marks[img->targets[i] - OUTPUT_OBJECT_CODE_START] |= DIS_MARK_TARGET;
+    }
+    return res;
+}
+
+/**
+ * first pass over {img}: mark the statements and the addresses which need a label
+ * return false if the object can't be written as source, reporting why
+ */
+static BOOL dis_scan(dis_image_t *img) {
+    const unsigned long code_end = OUTPUT_OBJECT_CODE_START + img->code_size;
+    unsigned long addr, i, externals = 0;
+    dis_inst_t inst;
+    BOOL res;
+
+    dis_rewind(img);
+    for (addr = OUTPUT_OBJECT_CODE_START; addr < code_end; addr += inst.cmd.size) {
+        if (!dis_read_instruction(img, addr, &inst))
+            return FALSE;
+        img->marks[addr - OUTPUT_OBJECT_CODE_START] |= DIS_MARK_STATEMENT;
+        if (inst.src.access == OPERAND_LABEL && inst.src.is_external)
+            ++externals;
+        else if (inst.src.access == OPERAND_LABEL)
+            img->targets[inst.src.value] = 1;
+        if (inst.dst.access == OPERAND_LABEL && inst.dst.is_external)
+            ++externals;
+        else if (inst.dst.access == OPERAND_LABEL)
+            img->targets[inst.dst.value] = 1;
+    }
+    for (i = img->code_size; i < img->code_size + img->data_size; ++i)
+        img->marks[i] |= DIS_MARK_STATEMENT; /* every data word may start a statement */
+
+    res = dis_place_labels(img);
+    if (externals != img->externals_cnt) {
+        fprintf(ERR_STREAM, "%s: %lu external operands, but %lu external records\n", img->name, externals,
+                img->externals_cnt);
+        res = FALSE;
+    }
+    if (!dis_choose_prefix(img)) {
+        fprintf(ERR_STREAM, "%s: no free name for generated labels\n", img->name);
+        res = FALSE;
+    }
+    return res;
+}
+
+/**
+ * write the buffered output of {out} into its stream
+ */
+static void dis_flush(dis_out_t *out) {
+    if (out->len && fwrite(out->data, 1, out->len, out->stream) != out->len)
+        out->is_ok = FALSE;
+    out->len = 0;
+}
+
+/**
+ * write {len} characters of {text} into {out}
+ */
+static void dis_put(dis_out_t *out, const char *text, size_t len) {
+    size_t chunk;
+    for (; len; text += chunk, len -= chunk) {
+        if (out->len == DIS_OUT_BUFFER_SIZE)
+            dis_flush(out);
+        chunk = DIS_OUT_BUFFER_SIZE - out->len < len ? DIS_OUT_BUFFER_SIZE - out->len : len;
+        memcpy(out->data + out->len, text, chunk);
+        out->len += chunk;
+    }
+}
+
+#define dis_put_str(out, str) dis_put(out, str, strlen(str))
+
+/**
+ * format {value} in decimal into {buf}, which must hold 12 characters
+ * return its length
+ */
+static size_t dis_format_number(char *buf, long value) {
+    char digits[12];
+    size_t len = 0, count = 0;
+    unsigned long abs_value = value < 0 ? (unsigned long)-value : (unsigned long)value;
+    if (value < 0)
+        buf[len++] = '-';
+    do
+        digits[count++] = (char)('0' + abs_value % 10);
+    while ((abs_value /= 10));
+    while (count)
+        buf[len++] = digits[--count];
+    return len;
+}
+
+/**
+ * write the name of the label at {addr} of {img} into {out}
+ * return its length
+ */
+static size_t dis_put_label(const dis_image_t *img, dis_out_t *out, unsigned long addr) {
+    static const char prefix[DIS_MAX_PREFIX_LEN] = {
+        DIS_PREFIX_CHAR, DIS_PREFIX_CHAR, DIS_PREFIX_CHAR, DIS_PREFIX_CHAR,
+        DIS_PREFIX_CHAR, DIS_PREFIX_CHAR, DIS_PREFIX_CHAR, DIS_PREFIX_CHAR
+    };
+    dis_symbol_t key;
+    const dis_symbol_t *entry;
+    char buf[12];
+    size_t len;
+
+    key.addr = addr;
+    if ((entry = bsearch(&key, img->entries_by_addr, img->entries_cnt, sizeof(dis_symbol_t), dis_compare_addr))) {
+        dis_put(out, entry->name, entry->len);
+        return entry->len;
+    }
+    dis_put(out, prefix, img->prefix_len);
+    len = dis_format_number(buf, (long)addr);
+    dis_put(out, buf, len);
+    return img->prefix_len + len;
+}
+
+/**
+ * write {opr} of {img} into {out}
+ * return false if it is an external operand without an external record, reporting why
+ */
+static BOOL dis_put_operand(dis_image_t *img, dis_out_t *out, const dis_operand_t *opr) {
+    static const char *const registers[] = {"r0", "r1", "r2", "r3", "r4", "r5", "r6", "r7"};
+    const dis_symbol_t *ext;
+    char buf[12];
+    long value;
+
+    switch (opr->access) {
+        case OPERAND_MEM_REG:
+            dis_put(out, "*", 1);
+            /* fall through */
+        case OPERAND_REG:
+            dis_put(out, registers[opr->value], 2);
+            return TRUE;
+        case OPERAND_IMMEDIATE:
+            value = (long)opr->value;
+            if (value & 0x800L) /* sign extend the 12 bits */
+                value -= 0x1000L;
+            buf[0] = '#';
+            dis_put(out, buf, 1 + dis_format_number(buf + 1, value));
+            return TRUE;
+        default:
+            if (!opr->is_external) {
+                dis_put_label(img, out, img->targets[opr->value]);
+                return TRUE;
+            }
+            /* the external operands are written in the order of their sites, like the sorted records */
+            ext = img->externals + img->externals_used;
+            if (img->externals_used == img->externals_cnt || ext->addr != opr->site) {
+                fprintf(ERR_STREAM, "%s: external operand at %04lu has no external record\n", img->name, opr->site);
+                return FALSE;
+            }
+            ++img->externals_used;
+            dis_put(out, ext->name, ext->len);
+            return TRUE;
+    }
+}
+
+/**
+ * write the ".extern" and ".entry" declarations of {img} into {out}
+ * the entries keep their order, as the assembler writes them in the order they first appear
+ * return false if out of memory
+ */
+static BOOL dis_put_declarations(dis_image_t *img, dis_out_t *out) {
+    dis_symbol_t *names;
+    unsigned long i;
+
+    if (!(names = malloc((img->externals_cnt + 1) * sizeof(dis_symbol_t))))
+        return FALSE;
+    memcpy(names, img->externals, img->externals_cnt * sizeof(dis_symbol_t));
+    qsort(names, img->externals_cnt, sizeof(dis_symbol_t), dis_compare_name);
+    for (i = 0; i < img->externals_cnt; ++i)
+        if (i == 0 || dis_compare_name(names + i - 1, names + i)) {
+            dis_put_str(out, ".extern ");
+            dis_put(out, names[i].name, names[i].len);
+            dis_put(out, "\n", 1);
+        }
+    free(names);
+    if (img->ext.data && img->externals_cnt == 0) {
+        /* an empty externals file is written for unused externals, so declare one, named like no label */
+        dis_put_str(out, ".extern ");
+        dis_put_label(img, out, 0);
+        dis_put(out, "\n", 1);
+    }
+    for (i = 0; i < img->entries_cnt; ++i) {
+        dis_put_str(out, ".entry ");
+        dis_put(out, img->entries[i].name, img->entries[i].len);
+        dis_put(out, "\n", 1);
+    }
+    return TRUE;
+}
+
+/**
+ * return the count of characters of the string statement starting with {word} at data index {index} of {img},
+ * read on a copy of the reader, or 0 if the words there aren't a string the assembler writes within {max_len}
+ */
+static size_t dis_string_length(const dis_image_t *img, unsigned long index, unsigned word, size_t max_len) {
+    dis_image_t ahead = *img;
+    size_t len = 0;
+
+    while (word < 0x80U && LEXER_IS((char)word, LEX_ALNUM)) {
+        if (++len > max_len || ++index == img->code_size + img->data_size ||
+                img->marks[index] & DIS_MARK_TARGET || !dis_read_word(&ahead, &word))
+            return 0;
+    }
+    return word == 0 ? len : 0;
+}
+
+/**
+ * write the data segment of {img} into {out}, reading on from the first data record
+ * return false if a record is bad, reporting why
+ */
+static BOOL dis_put_data(dis_image_t *img, dis_out_t *out) {
+    const unsigned long size = img->code_size + img->data_size;
+    unsigned long i = img->code_size;
+    size_t line_len = 0, len, str_len;
+    unsigned word, k;
+    char buf[12], ch;
+    BOOL has_word = FALSE;
+
+    while (i < size) {
+        if (!has_word && !dis_read_word(img, &word)) {
+            fprintf(ERR_STREAM, "%s: bad object file record at %04lu\n", img->name, i + OUTPUT_OBJECT_CODE_START);
+            return FALSE;
+        }
+        has_word = FALSE;
+        len = dis_format_number(buf, DIS_DATA_VALUE(word));
+        if (line_len == 0) {
+            if (img->marks[i] & DIS_MARK_TARGET) {
+                line_len = dis_put_label(img, out, i + OUTPUT_OBJECT_CODE_START) + 2;
+                dis_put(out, ": ", 2);
+            }
+            if ((str_len = dis_string_length(img, i, word, line_len + DIS_STRING_EXTRA_LEN < MAX_LINE_LEN ?
+                                             MAX_LINE_LEN - line_len - DIS_STRING_EXTRA_LEN : 0))) {
+                dis_put_str(out, ".string \"");
+                for (k = 0; k < str_len; ++k) {
+                    ch = (char)word;
+                    dis_put(out, &ch, 1);
+                    if (!dis_read_word(img, &word))
+                        return FALSE; /* can't fail, dis_string_length already read those words */
+                }
+                dis_put(out, "\"\n", 2);
+                i += str_len + 1;
+                line_len = 0;
+                continue;
+            }
+            dis_put_str(out, ".data ");
+            line_len += sizeof(".data ") - 1;
+        } else if ((img->marks[i] & DIS_MARK_TARGET) || line_len + 2 + len > MAX_LINE_LEN ||
+                   dis_string_length(img, i, word, MAX_LINE_LEN - DIS_STRING_EXTRA_LEN)) {
+            /* a new statement for a label or a string, or when the line is full */
+            dis_put(out, "\n", 1);
+            line_len = 0;
+            has_word = TRUE;
+            continue;
+        } else {
+            dis_put(out, ", ", 2);
+            line_len += 2;
+        }
+        dis_put(out, buf, len);
+        line_len += len;
+        ++i;
+    }
+    if (line_len)
+        dis_put(out, "\n", 1);
+    return TRUE;
+}
+
+/**
+ * second pass over {img}: write its source into {out}
+ * return false if the object can't be written as source, reporting why
+ */
+static BOOL dis_write(dis_image_t *img, dis_out_t *out) {
+    const unsigned long code_end = OUTPUT_OBJECT_CODE_START + img->code_size;
+    unsigned long addr;
+    dis_inst_t inst;
+    const char *mnemonic;
+
+    if (!dis_put_declarations(img, out)) {
+        fprintf(ERR_STREAM, "out of memory\n");
+        return FALSE;
+    }
+    dis_rewind(img);
+    for (addr = OUTPUT_OBJECT_CODE_START; addr < code_end; addr += inst.cmd.size) {
+        if (!dis_read_instruction(img, addr, &inst))
+            return FALSE;
+        if (img->marks[addr - OUTPUT_OBJECT_CODE_START] & DIS_MARK_TARGET) {
+            dis_put_label(img, out, addr);
+            dis_put(out, ": ", 2);
+        }
+        mnemonic = get_opcode(inst.cmd.opcode)->opcode_text;
+        dis_put_str(out, mnemonic);
+        if (inst.cmd.src) {
+            dis_put(out, " ", 1);
+            if (!dis_put_operand(img, out, &inst.src))
+                return FALSE;
+            dis_put(out, ",", 1);
+        }
+        if (inst.cmd.dst) {
+            dis_put(out, " ", 1);
+            if (!dis_put_operand(img, out, &inst.dst))
+                return FALSE;
+        }
+        dis_put(out, "\n", 1);
+    }
+    if (!dis_put_data(img, out))
+        return FALSE;
+    if (!dis_at_end(img->ob.data + img->pos, img->ob.data + img->ob.len)) {
+        fprintf(ERR_STREAM, "%s: extra records after the data segment\n", img->name);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/**
+ * disassemble the object files of {basename} into {out}, or into <basename>_dis.as if {out} has no stream
+ * return false if failed, reporting why
+ */
+static BOOL dis_file(const char *basename, dis_out_t *out) {
+    const BOOL is_file = !out->stream;
+    char *path = NULL;
+    dis_image_t img;
+    BOOL res;
+
+    if (!dis_open(&img, basename))
+        return FALSE;
+    if (!(res = dis_scan(&img)))
+        goto end;
+    if (is_file) {
+        if (!(path = malloc(strlen(basename) + sizeof(DIS_OUTPUT_SUFFIX INPUT_EXTENSION)))) {
+            fprintf(ERR_STREAM, "out of memory\n");
+            res = FALSE;
+            goto end;
+        }
+        strcpy(path, basename);
+        strcat(path, DIS_OUTPUT_SUFFIX INPUT_EXTENSION);
+        if (!(out->stream = fopen(path, "w"))) {
+            fprintf(ERR_STREAM, "%s: unable to write \'%s\'\n", basename, path);
+            res = FALSE;
+            goto end;
+        }
+    }
+    out->len = 0;
+    out->is_ok = TRUE;
+    res = dis_write(&img, out);
+    dis_flush(out);
+    if (res && !out->is_ok) {
+        fprintf(ERR_STREAM, "%s: unable to write the output\n", basename);
+        res = FALSE;
+    }
+    if (is_file) {
+        if (fclose(out->stream) != 0)
+            res = FALSE;
+        out->stream = NULL;
+        if (!res)
+            remove(path);
+    }
+end:
+    free(path);
+    dis_close(&img);
+    return res;
+}
+
+int main(int argc, char *argv[]) {
+    static dis_out_t out;
+    BOOL to_stdout = FALSE, res = TRUE;
+    int arg, files = 0;
+
+    for (arg = 1; arg < argc; ++arg) {
+        if (!strcmp(argv[arg], "--stdout"))
+            to_stdout = TRUE;
+        else if (argv[arg][0] == '-') {
+            fprintf(ERR_STREAM, "unknown option \'%s\'\n", argv[arg]);
+            res = FALSE;
+        } else
+            ++files;
+    }
+    if (!res || files == 0) {
+        fprintf(ERR_STREAM, "usage: %s [--stdout] basename...\n", argv[0]);
+        return 1;
+    }
+
+    dis_build_commands();
+    for (arg = 1; arg < argc; ++arg)
+        if (argv[arg][0] != '-') {
+            out.stream = to_stdout ? stdout : NULL;
+            res &= dis_file(argv[arg], &out);
+        }
+    return !res;
+}
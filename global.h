@@ -37,12 +37,15 @@ typedef enum {FALSE=0, TRUE} BOOL;
 /* End of bitfield dragons, we have won */
 
 
+/** version of the assembler, bump it on every change of the outputs (it is part of the build cache keys) */
+#define ASSEMBLER_VERSION "2.0"
+
 /** Definitions of output formats for the various files */
 #define OBJECT_FILE_OUTPUT_FORMAT "%04u %05o\n"
 #define ENTRIES_FILE_OUTPUT_FORMAT "%s %04u\n"
 #define EXTERNALS_FILE_OUTPUT_FORMAT "%s %04u\n"
 
-/** destination stream for all errors */
+/** default destination stream for all errors */
 #define ERR_STREAM stdout
 
 #endif
@@ -0,0 +1,945 @@
+/* This file is part of OpenU's C project implementation, called assembler
+ * Copyright (C) 2020 Arthur Zamarin, Norel Farjun */
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "incremental.h"
+#include "arena.h"
+
+/** initial slots count of the symbols hash table, must be a power of 2 */
+#define INCREMENTAL_TABLE_INITIAL_CAPACITY 64
+/** initial count of lines the line table has room for, it doubles when full */
+#define INCREMENTAL_LINES_INITIAL_CAPACITY 256
+/** value of {first_moved} when no line moved since the last resolve */
+#define INCREMENTAL_NONE_MOVED UINT_MAX
+
+/** flags of one label in one line */
+enum incremental_use_flags {
+    INCREMENTAL_DEF_CODE = 0x1, /* the line defines the label on its instruction */
+    INCREMENTAL_DEF_DATA = 0x2, /* the line defines the label on its data */
+    INCREMENTAL_EXTERN   = 0x4, /* the line declares the label as external */
+    INCREMENTAL_ENTRY    = 0x8  /* the line declares the label as entry */
+};
+/** the flags of the uses which set the label, only one of them may be in a file */
+#define INCREMENTAL_SETS (INCREMENTAL_DEF_CODE | INCREMENTAL_DEF_DATA | INCREMENTAL_EXTERN)
+
+struct incremental_line_t;
+struct incremental_symbol_t;
+
+/**
+ * One label appearing in one line, chained with all the other uses of the label
+ */
+typedef struct incremental_use_t {
+    struct incremental_symbol_t *symbol;
+    struct incremental_line_t *line;
+    struct incremental_use_t *prev;
+    struct incremental_use_t *next;
+    unsigned flags; /* incremental_use_flags */
+    unsigned words; /* bit i is set when word i of the line is an operand of the label */
+} incremental_use_t;
+
+/**
+ * One line of the source, with the result of parsing it alone
+ * Note that the text goes tightly after the line itself, and all the results are one more allocation
+ */
+typedef struct incremental_line_t {
+    struct incremental_line_t *prev_new; /* chain of the lines which weren't parsed yet */
+    struct incremental_line_t *next_new;
+    unsigned index;          /* zero based line number */
+    size_t len;              /* characters count of the text, without the line break */
+    BOOL is_parsed;
+    BOOL is_ok;              /* was the line parsed successfully */
+    BOOL is_macro;           /* may it be a line of a macro, so the source can't be parsed by lines */
+    BOOL is_code;            /* are {words} code words, otherwise data words */
+    unsigned size;           /* count of {words} */
+    uint16_t *words;         /* final words, where the label operands are resolved with their labels */
+    unsigned uses_cnt;
+    incremental_use_t *uses; /* labels of the line, by order of first appearance in it */
+    size_t diag_len;
+    char *diag;              /* diagnostics of the line, all of them with the line number 0 */
+    /* here goes tightly the text */
+} incremental_line_t;
+
+/** return the text of {line} */
+#define incremental_line_text(line) ((const char *)(line) + sizeof(incremental_line_t))
+
+/**
+ * One label of the source, interned in the symbols hash table
+ * Note that the label string goes tightly after the symbol itself
+ */
+typedef struct incremental_symbol_t {
+    uint32_t hash;              /* hash of the label string, kept for rehashing */
+    size_t len;                 /* characters count of the label */
+    incremental_use_t *uses;    /* chain of all the uses of the label */
+    unsigned uses_cnt;
+    unsigned sets_cnt;          /* count of uses which set the label */
+    unsigned entries_cnt;       /* count of uses which declare the label as entry */
+    incremental_use_t *set;     /* one of the uses which set the label, when {sets_cnt} isn't 0 */
+    BOOL is_dirty;              /* did the uses which set the label change since it was resolved */
+    struct incremental_symbol_t *next_dirty;
+    BOOL is_extern;             /* is it resolved as external */
+    uint32_t addr;              /* absolute address, as resolved */
+    uint16_t word;              /* word of an operand of the label, as resolved */
+    /* here goes tightly the label */
+} incremental_symbol_t;
+
+/** return the label string of {symbol} */
+#define incremental_symbol_name(symbol) ((const char *)(symbol) + sizeof(incremental_symbol_t))
+
+struct incremental_t {
+    arena_t arena;                   /* owns the symbols and their table */
+    arena_t scratch;                 /* owns the sorted symbols and the output buffers, reset by every use */
+    incremental_line_t **lines;      /* the line table */
+    unsigned lines_cnt;
+    unsigned lines_capacity;
+    unsigned long *code_tree;        /* Fenwick tree of the code words count of every line, {lines_capacity} + 1 */
+    unsigned long *data_tree;        /* Fenwick tree of the data words count of every line */
+    BOOL is_trees_valid;             /* false after lines were added or removed, until the trees are rebuilt */
+    incremental_symbol_t **table;    /* hash table of the symbols (linear probing), NULL is empty slot */
+    unsigned table_capacity;         /* always a power of 2 */
+    unsigned symbols_cnt;
+    incremental_line_t *new_lines;   /* chain of the lines to parse */
+    incremental_symbol_t *dirty;     /* chain of the symbols to resolve again */
+    unsigned first_moved;            /* first line whose address may have changed since the last resolve */
+    unsigned long code_size;         /* count of code words of all the lines */
+    unsigned long data_size;         /* count of data words of all the lines */
+    unsigned long resolved_code_size; /* {code_size} of the last resolve, the data labels move with it */
+    BOOL is_resolved_large;          /* mode of the last resolve */
+    unsigned macro_lines;            /* count of lines which may be lines of macros */
+    unsigned bad_lines;              /* count of parsed lines with errors */
+    unsigned diag_lines;             /* count of parsed lines with diagnostics */
+    unsigned set_twice;              /* count of symbols set by more than one line */
+    unsigned not_found;              /* count of used symbols which no line sets */
+    unsigned entry_lines;
+    unsigned extern_lines;
+    BOOL is_full;                    /* was the last parse a full one, by the parser itself */
+    FILE *capture;                   /* receives the diagnostics of the parsed lines, or NULL until first used */
+    char *source_data;               /* the whole source, when {is_source_valid} */
+    size_t source_capacity;
+    BOOL is_source_valid;
+    source_t source;
+};
+
+struct incremental_t *incremental_new(void) {
+    struct incremental_t *inc = calloc(1, sizeof(struct incremental_t));
+    if (!inc)
+        return NULL;
+    inc->arena = arena_new();
+    inc->scratch = arena_new();
+    inc->is_trees_valid = FALSE;
+    inc->first_moved = INCREMENTAL_NONE_MOVED;
+    return inc;
+}
+
+/**
+ * return true if {len} characters of {text} have {word} inside
+ */
+static BOOL incremental_contains(const char *text, size_t len, const char *word) {
+    const size_t word_len = strlen(word);
+    const char *end = text + len, *iter;
+    for (iter = text; (size_t)(end - iter) >= word_len; ++iter)
+        if (!memcmp(iter, word, word_len))
+            return TRUE;
+    return FALSE;
+}
+
+/**
+ * return a new line of {len} characters of {text}, which isn't parsed yet
+ * return NULL if out of memory
+ */
+static incremental_line_t *incremental_line_new(const char *text, size_t len) {
+    incremental_line_t *line = malloc(sizeof(incremental_line_t) + len + 1);
+    if (!line)
+        return NULL;
+    memset(line, 0, sizeof(incremental_line_t));
+    line->len = len;
+    /* every macro line has "mcro" or "endmcro", and without them no line is a macro use */
+    line->is_macro = incremental_contains(text, len, "mcro");
+    memcpy((char *)line + sizeof(incremental_line_t), text, len);
+    ((char *)line + sizeof(incremental_line_t))[len] = '\0';
+    return line;
+}
+
+/**
+ * add {delta} to the words count of the line {index} in the Fenwick {tree} of {inc}
+ */
+static void incremental_tree_add(struct incremental_t *inc, unsigned long *tree, unsigned index, unsigned long delta) {
+    unsigned i;
+    for (i = index + 1; i <= inc->lines_cnt; i += i & -i)
+        tree[i] += delta;
+}
+
+/**
+ * return the sum of the words counts of the lines before the line {index} in the Fenwick {tree}
+ */
+static unsigned long incremental_tree_prefix(const unsigned long *tree, unsigned index) {
+    unsigned long sum = 0;
+    unsigned i;
+    for (i = index; i > 0; i -= i & -i)
+        sum += tree[i];
+    return sum;
+}
+
+/**
+ * rebuild the Fenwick trees of {inc} from the words counts of its lines, in linear time
+ */
+static void incremental_trees_build(struct incremental_t *inc) {
+    unsigned i, parent;
+    for (i = 1; i <= inc->lines_cnt; ++i) {
+        const incremental_line_t *line = inc->lines[i - 1];
+        inc->code_tree[i] = (line->is_code) ? line->size : 0;
+        inc->data_tree[i] = (line->is_code) ? 0 : line->size;
+    }
+    for (i = 1; i <= inc->lines_cnt; ++i)
+        if ((parent = i + (i & -i)) <= inc->lines_cnt) {
+            inc->code_tree[parent] += inc->code_tree[i];
+            inc->data_tree[parent] += inc->data_tree[i];
+        }
+    inc->is_trees_valid = TRUE;
+}
+
+/**
+ * add {sign} (1 or -1) times the counts {symbol} contributes to the counters of {inc}
+ */
+static void incremental_symbol_count(struct incremental_t *inc, const incremental_symbol_t *symbol, int sign) {
+    if (symbol->uses_cnt > 0 && symbol->sets_cnt == 0)
+        inc->not_found += sign;
+    if (symbol->sets_cnt > 1)
+        inc->set_twice += sign;
+}
+
+/**
+ * mark {symbol} of {inc} to be resolved again
+ */
+static void incremental_symbol_dirty(struct incremental_t *inc, incremental_symbol_t *symbol) {
+    if (symbol->is_dirty)
+        return;
+    symbol->is_dirty = TRUE;
+    symbol->next_dirty = inc->dirty;
+    inc->dirty = symbol;
+}
+
+/**
+ * calculate FNV-1a hash of the {label} string of {len} characters
+ */
+static uint32_t incremental_hash(const char *label, size_t len) {
+    uint32_t hash = 2166136261U;
+    for (; len; --len, ++label)
+        hash = (hash ^ (uint8_t)*label) * 16777619U;
+    return hash;
+}
+
+/**
+ * resize the symbols hash table of {inc} to {capacity} slots and reinsert all the symbols
+ * return false if allocation failed, in which case the old table is kept
+ */
+static BOOL incremental_rehash(struct incremental_t *inc, unsigned capacity) {
+    incremental_symbol_t **table = arena_alloc(&inc->arena, capacity * sizeof(incremental_symbol_t *));
+    unsigned i, slot;
+    if (!table)
+        return FALSE;
+    memset(table, 0, capacity * sizeof(incremental_symbol_t *));
+    for (i = 0; i < inc->table_capacity; ++i)
+        if (inc->table[i]) {
+            for (slot = inc->table[i]->hash & (capacity - 1); table[slot]; slot = (slot + 1) & (capacity - 1));
+            table[slot] = inc->table[i];
+        }
+    inc->table = table;
+    inc->table_capacity = capacity;
+    return TRUE;
+}
+
+/**
+ * return the symbol of {inc} named {label} of {len} characters, adding it if it is new
+ * the symbols are never removed, a symbol without uses is just skipped
+ * return NULL if out of memory
+ */
+static incremental_symbol_t *incremental_symbol_get(struct incremental_t *inc, const char *label, size_t len) {
+    const uint32_t hash = incremental_hash(label, len);
+    incremental_symbol_t *symbol;
+    unsigned slot;
+
+    if (2 * (inc->symbols_cnt + 1) > inc->table_capacity &&
+            !incremental_rehash(inc, inc->table_capacity ? 2 * inc->table_capacity : INCREMENTAL_TABLE_INITIAL_CAPACITY))
+        return NULL;
+    for (slot = hash & (inc->table_capacity - 1); (symbol = inc->table[slot]);
+         slot = (slot + 1) & (inc->table_capacity - 1))
+        if (symbol->hash == hash && symbol->len == len && !memcmp(incremental_symbol_name(symbol), label, len))
+            return symbol;
+
+    if (!(symbol = arena_alloc(&inc->arena, sizeof(incremental_symbol_t) + len + 1)))
+        return NULL;
+    memset(symbol, 0, sizeof(incremental_symbol_t));
+    symbol->hash = hash;
+    symbol->len = len;
+    memcpy((char *)symbol + sizeof(incremental_symbol_t), label, len);
+    ((char *)symbol + sizeof(incremental_symbol_t))[len] = '\0';
+    inc->table[slot] = symbol;
+    ++inc->symbols_cnt;
+    return symbol;
+}
+
+/**
+ * return the use which sets {symbol} in a full parse: the first one by line
+ */
+static const incremental_use_t *incremental_symbol_owner(const incremental_symbol_t *symbol) {
+    const incremental_use_t *iter, *owner = symbol->set;
+    if (symbol->sets_cnt > 1)
+        for (iter = symbol->uses; iter; iter = iter->next)
+            if ((iter->flags & INCREMENTAL_SETS) && iter->line->index < owner->line->index)
+                owner = iter;
+    return owner;
+}
+
+/**
+ * return the order of the first appearance of {symbol}, as an index of the line and of the label in the line
+ */
+static unsigned long incremental_symbol_first(const incremental_symbol_t *symbol, unsigned *position) {
+    const incremental_use_t *iter;
+    unsigned long first = ULONG_MAX;
+    for (iter = symbol->uses; iter; iter = iter->next)
+        if (iter->line->index < first || (iter->line->index == first && (unsigned)(iter - iter->line->uses) < *position)) {
+            first = iter->line->index;
+            *position = (unsigned)(iter - iter->line->uses);
+        }
+    return first;
+}
+
+/**
+ * remove {line} from the chain of lines to parse of {inc}
+ */
+static void incremental_line_unlink_new(struct incremental_t *inc, incremental_line_t *line) {
+    if (line->prev_new)
+        line->prev_new->next_new = line->next_new;
+    else
+        inc->new_lines = line->next_new;
+    if (line->next_new)
+        line->next_new->prev_new = line->prev_new;
+}
+
+/**
+ * take {line} out of {inc} and free it
+ */
+static void incremental_line_free(struct incremental_t *inc, incremental_line_t *line) {
+    unsigned i;
+    inc->macro_lines -= line->is_macro;
+    if (!line->is_parsed) {
+        incremental_line_unlink_new(inc, line);
+        free(line);
+        return;
+    }
+    for (i = 0; i < line->uses_cnt; ++i) {
+        incremental_use_t *use = line->uses + i;
+        incremental_symbol_t *symbol = use->symbol;
+        incremental_symbol_count(inc, symbol, -1);
+        if (use->prev)
+            use->prev->next = use->next;
+        else
+            symbol->uses = use->next;
+        if (use->next)
+            use->next->prev = use->prev;
+        --symbol->uses_cnt;
+        if (use->flags & INCREMENTAL_SETS) {
+            --symbol->sets_cnt;
+            if (symbol->set == use)
+                for (symbol->set = symbol->uses; symbol->set && !(symbol->set->flags & INCREMENTAL_SETS);
+                     symbol->set = symbol->set->next);
+            incremental_symbol_dirty(inc, symbol);
+        }
+        if (use->flags & INCREMENTAL_ENTRY) {
+            --symbol->entries_cnt;
+            --inc->entry_lines;
+        }
+        if (use->flags & INCREMENTAL_EXTERN)
+            --inc->extern_lines;
+        incremental_symbol_count(inc, symbol, 1);
+    }
+    if (line->is_code)
+        inc->code_size -= line->size;
+    else
+        inc->data_size -= line->size;
+    if (inc->is_trees_valid)
+        incremental_tree_add(inc, line->is_code ? inc->code_tree : inc->data_tree, line->index,
+                             -(unsigned long)line->size);
+    inc->bad_lines -= !line->is_ok;
+    inc->diag_lines -= line->diag_len > 0;
+    free(line->uses);
+    free(line);
+}
+
+/**
+ * add {line} of {inc} to the chain of lines to parse
+ */
+static void incremental_line_add_new(struct incremental_t *inc, incremental_line_t *line) {
+    line->prev_new = NULL;
+    line->next_new = inc->new_lines;
+    if (inc->new_lines)
+        inc->new_lines->prev_new = line;
+    inc->new_lines = line;
+    inc->macro_lines += line->is_macro;
+}
+
+void incremental_dealloc(struct incremental_t *inc) {
+    unsigned i;
+    for (i = 0; i < inc->lines_cnt; ++i) {
+        free(inc->lines[i]->uses);
+        free(inc->lines[i]);
+    }
+    free(inc->lines);
+    free(inc->code_tree);
+    free(inc->data_tree);
+    free(inc->source_data);
+    if (inc->capture)
+        fclose(inc->capture);
+    arena_dealloc(&inc->arena);
+    arena_dealloc(&inc->scratch);
+    free(inc);
+}
+
+/**
+ * make room in the line table and the trees of {inc} for {count} lines
+ * return false if allocation failed
+ */
+static BOOL incremental_reserve(struct incremental_t *inc, unsigned count) {
+    unsigned capacity = inc->lines_capacity ? inc->lines_capacity : INCREMENTAL_LINES_INITIAL_CAPACITY;
+    void *lines, *code_tree, *data_tree;
+    if (count <= inc->lines_capacity)
+        return TRUE;
+    while (capacity < count)
+        capacity *= 2;
+    if ((lines = realloc(inc->lines, capacity * sizeof(incremental_line_t *))))
+        inc->lines = lines;
+    if ((code_tree = realloc(inc->code_tree, (capacity + 1) * sizeof(unsigned long))))
+        inc->code_tree = code_tree;
+    if ((data_tree = realloc(inc->data_tree, (capacity + 1) * sizeof(unsigned long))))
+        inc->data_tree = data_tree;
+    if (!lines || !code_tree || !data_tree)
+        return FALSE;
+    inc->lines_capacity = capacity;
+    return TRUE;
+}
+
+/**
+ * split the {len} bytes of {text} into new lines, put into {*lines}, and set {*count} of them
+ * return false if out of memory
+ */
+static BOOL incremental_split(const char *text, size_t len, incremental_line_t ***lines, unsigned *count) {
+    const char *end = text + len, *iter, *eol;
+    unsigned cnt = 0;
+
+    for (iter = text; iter < end; iter = eol + 1, ++cnt)
+        if (!(eol = memchr(iter, '\n', (size_t)(end - iter))))
+            eol = end;
+    *count = cnt;
+    if (!(*lines = malloc((cnt ? cnt : 1) * sizeof(incremental_line_t *))))
+        return FALSE;
+    for (iter = text, cnt = 0; iter < end; iter = eol + 1, ++cnt) {
+        if (!(eol = memchr(iter, '\n', (size_t)(end - iter))))
+            eol = end;
+        if (!((*lines)[cnt] = incremental_line_new(iter, (size_t)(eol - iter)))) {
+            while (cnt-- > 0)
+                free((*lines)[cnt]);
+            free(*lines);
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+BOOL incremental_edit(struct incremental_t *inc, unsigned first, unsigned count, const char *text, size_t len) {
+    incremental_line_t **added;
+    unsigned added_cnt, i;
+
+    if (first > inc->lines_cnt || count > inc->lines_cnt - first)
+        return FALSE;
+    if (!incremental_split(text, len, &added, &added_cnt))
+        return FALSE;
+    if (!incremental_reserve(inc, inc->lines_cnt - count + added_cnt)) {
+        for (i = 0; i < added_cnt; ++i)
+            free(added[i]);
+        free(added);
+        return FALSE;
+    }
+
+    for (i = first; i < first + count; ++i)
+        incremental_line_free(inc, inc->lines[i]);
+    if (added_cnt != count) {
+        /* the following lines get new numbers, so the trees are built again */
+        memmove(inc->lines + first + added_cnt, inc->lines + first + count,
+                (inc->lines_cnt - first - count) * sizeof(incremental_line_t *));
+        inc->lines_cnt = inc->lines_cnt - count + added_cnt;
+        inc->is_trees_valid = FALSE;
+        for (i = first + added_cnt; i < inc->lines_cnt; ++i)
+            inc->lines[i]->index = i;
+    }
+    for (i = 0; i < added_cnt; ++i) {
+        inc->lines[first + i] = added[i];
+        added[i]->index = first + i;
+        incremental_line_add_new(inc, added[i]);
+    }
+    free(added);
+    if (first < inc->first_moved)
+        inc->first_moved = first;
+    inc->is_source_valid = FALSE;
+    return TRUE;
+}
+
+BOOL incremental_load(struct incremental_t *inc, const char *data, size_t len) {
+    if (!incremental_edit(inc, 0, inc->lines_cnt, data, len)) {
+        incremental_edit(inc, 0, inc->lines_cnt, NULL, 0);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+unsigned incremental_lines_count(const struct incremental_t *inc) {
+    return inc->lines_cnt;
+}
+
+const source_t *incremental_get_source(struct incremental_t *inc) {
+    size_t len = 0;
+    unsigned i;
+    char *data;
+
+    if (inc->is_source_valid)
+        return &inc->source;
+    for (i = 0; i < inc->lines_cnt; ++i)
+        len += inc->lines[i]->len + 1;
+    if (len > inc->source_capacity) {
+        if (!(data = realloc(inc->source_data, len)))
+            return NULL;
+        inc->source_data = data;
+        inc->source_capacity = len;
+    }
+    for (i = 0, len = 0; i < inc->lines_cnt; ++i) {
+        memcpy(inc->source_data + len, incremental_line_text(inc->lines[i]), inc->lines[i]->len);
+        len += inc->lines[i]->len;
+        inc->source_data[len++] = '\n';
+    }
+    inc->source.data = inc->source_data;
+    inc->source.len = len;
+    inc->source.is_mapped = FALSE;
+    inc->is_source_valid = TRUE;
+    return &inc->source;
+}
+
+/**
+ * read the {len} bytes of diagnostics written into the capture file of {inc} into {diag}, and empty it
+ * return false on read error
+ */
+static BOOL incremental_read_capture(struct incremental_t *inc, char *diag, size_t len) {
+    BOOL res;
+    rewind(inc->capture);
+    res = fread(diag, 1, len, inc->capture) == len;
+    /* the file isn't truncated, only the bytes before its position are meaningful */
+    rewind(inc->capture);
+    return res;
+}
+
+/**
+ * parse {line} of {inc} alone with {ctx}, whose diagnostics go into the capture file, and keep its results
+ * return false if out of memory
+ */
+static BOOL incremental_parse_line(struct incremental_t *inc, struct parser_ctx_t *ctx, incremental_line_t *line) {
+    const instructions_list *insts;
+    const labels_list_t *labels;
+    const dataseg_t *data_seg;
+    const labels_list_node_t *node;
+    incremental_use_t *use;
+    unsigned i, src, dst, access;
+    long diag_len;
+    BOOL is_ok;
+    char *block;
+
+    parser_reset(ctx);
+    is_ok = parser_parse_text_line(ctx, incremental_line_text(line), line->len, 0);
+    insts = parser_get_instructions(ctx);
+    labels = parser_get_labels(ctx);
+    data_seg = parser_get_data_seg(ctx);
+    if ((diag_len = ftell(inc->capture)) < 0)
+        return FALSE;
+
+    line->is_code = insts->size > 0;
+    line->size = (line->is_code) ? insts->size : data_seg->size;
+    line->uses_cnt = labels->count;
+    line->diag_len = (size_t)diag_len;
+    /* the uses, the words and the diagnostics share one allocation */
+    if (!(block = malloc(line->uses_cnt * sizeof(incremental_use_t) + line->size * sizeof(uint16_t) + line->diag_len + 1)))
+        return FALSE;
+    line->uses = (incremental_use_t *)block;
+    line->words = (uint16_t *)(block + line->uses_cnt * sizeof(incremental_use_t));
+    line->diag = (char *)(line->words + line->size);
+    if (line->diag_len && !incremental_read_capture(inc, line->diag, line->diag_len)) {
+        free(block);
+        return FALSE;
+    }
+
+    for (node = labels->head, use = line->uses; node; node = node->next, ++use) {
+        if (!(use->symbol = incremental_symbol_get(inc, labels_listnode_get_label(node),
+                                                   strlen(labels_listnode_get_label(node))))) {
+            free(block);
+            return FALSE;
+        }
+        use->line = line;
+        use->words = 0;
+        use->flags = 0;
+        if (node->isExtr)
+            use->flags |= INCREMENTAL_EXTERN;
+        else if (node->isSet)
+            use->flags |= (node->isDS) ? INCREMENTAL_DEF_DATA : INCREMENTAL_DEF_CODE;
+        if (node->isEntr)
+            use->flags |= INCREMENTAL_ENTRY;
+    }
+    if (line->is_code) {
+        instructions_list_operands_size(insts->slots[0], &src, &dst);
+        for (i = 0; i < line->size; ++i) {
+            /* a single operand word is dst, or both registers */
+            access = (i == 0) ? 0 : (line->size == 3 && i == 1) ? src : (line->size == 3 || !src) ? dst : OPERAND_REG;
+            if (access == OPERAND_LABEL) {
+                use = line->uses + insts->slots[i];
+                use->words |= 1U << i;
+                line->words[i] = use->symbol->word;
+            } else
+                line->words[i] = (uint16_t)insts->slots[i];
+        }
+    } else
+        memcpy(line->words, data_seg->words, line->size * sizeof(uint16_t));
+
+    /* all the results are kept, so link them */
+    for (i = 0, use = line->uses; i < line->uses_cnt; ++i, ++use) {
+        incremental_symbol_t *symbol = use->symbol;
+        incremental_symbol_count(inc, symbol, -1);
+        use->prev = NULL;
+        use->next = symbol->uses;
+        if (symbol->uses)
+            symbol->uses->prev = use;
+        symbol->uses = use;
+        ++symbol->uses_cnt;
+        if (use->flags & INCREMENTAL_SETS) {
+            if (symbol->sets_cnt++ == 0)
+                symbol->set = use;
+            incremental_symbol_dirty(inc, symbol);
+        }
+        if (use->flags & INCREMENTAL_ENTRY) {
+            ++symbol->entries_cnt;
+            ++inc->entry_lines;
+        }
+        if (use->flags & INCREMENTAL_EXTERN)
+            ++inc->extern_lines;
+        incremental_symbol_count(inc, symbol, 1);
+    }
+    if (line->is_code)
+        inc->code_size += line->size;
+    else
+        inc->data_size += line->size;
+    if (inc->is_trees_valid)
+        incremental_tree_add(inc, line->is_code ? inc->code_tree : inc->data_tree, line->index, line->size);
+    line->is_ok = is_ok;
+    inc->bad_lines += !is_ok;
+    inc->diag_lines += line->diag_len > 0;
+    line->is_parsed = TRUE;
+    return TRUE;
+}
+
+/**
+ * resolve again the address and the operand word of {symbol} of {inc}, patching its operands if the word changed
+ */
+static void incremental_symbol_resolve(struct incremental_t *inc, incremental_symbol_t *symbol, uint32_t addr_mask) {
+    const incremental_use_t *owner = (symbol->sets_cnt > 0) ? incremental_symbol_owner(symbol) : NULL;
+    incremental_use_t *use;
+    uint16_t word = 0;
+    unsigned i;
+
+    symbol->is_extern = owner && (owner->flags & INCREMENTAL_EXTERN);
+    if (!owner || symbol->is_extern)
+        symbol->addr = 0;
+    else if (owner->flags & INCREMENTAL_DEF_CODE)
+        symbol->addr = (uint32_t)((OUTPUT_OBJECT_CODE_START + incremental_tree_prefix(inc->code_tree, owner->line->index))
+                                  & addr_mask);
+    else
+        symbol->addr = (uint32_t)((OUTPUT_OBJECT_CODE_START + inc->code_size +
+                                   incremental_tree_prefix(inc->data_tree, owner->line->index)) & addr_mask);
+    if (symbol->is_extern)
+        BITS_SET(DATA_ARE_RANGE, word, INST_ARE_EXTERNAL);
+    else if (owner) {
+        BITS_SET(DATA_ARE_RANGE, word, INST_ARE_RELETIVE);
+        BITS_SET(DATA_LABEL_RANGE, word, (uint16_t)symbol->addr);
+    }
+    if (word == symbol->word)
+        return;
+    symbol->word = word;
+    for (use = symbol->uses; use; use = use->next)
+        for (i = 1; use->words >> i; ++i)
+            if (use->words & (1U << i))
+                use->line->words[i] = word;
+}
+
+/**
+ * resolve again the symbols of {inc} whose addresses may have changed since the last resolve: the ones whose
+ * setting lines changed, and the ones set by lines which moved
+ */
+static void incremental_resolve(struct incremental_t *inc, BOOL large) {
+    const uint32_t addr_mask = large ? LABELS_LIST_LARGE_ADDR_MASK : LABELS_LIST_ADDR_MASK;
+    const BOOL is_data_moved = inc->code_size != inc->resolved_code_size;
+    const BOOL is_all = large != inc->is_resolved_large;
+    incremental_symbol_t *symbol;
+    unsigned i;
+
+    if (!inc->is_trees_valid)
+        incremental_trees_build(inc);
+    for (symbol = inc->dirty; symbol; symbol = symbol->next_dirty)
+        incremental_symbol_resolve(inc, symbol, addr_mask);
+    if (inc->first_moved != INCREMENTAL_NONE_MOVED || is_data_moved || is_all)
+        for (i = 0; i < inc->table_capacity; ++i) {
+            const incremental_use_t *owner;
+            if (!(symbol = inc->table[i]) || symbol->is_dirty || symbol->sets_cnt == 0)
+                continue;
+            owner = incremental_symbol_owner(symbol);
+            if (is_all || owner->line->index >= inc->first_moved || (is_data_moved && (owner->flags & INCREMENTAL_DEF_DATA)))
+                incremental_symbol_resolve(inc, symbol, addr_mask);
+        }
+    for (symbol = inc->dirty; symbol; symbol = symbol->next_dirty)
+        symbol->is_dirty = FALSE;
+    inc->dirty = NULL;
+    inc->first_moved = INCREMENTAL_NONE_MOVED;
+    inc->resolved_code_size = inc->code_size;
+    inc->is_resolved_large = large;
+}
+
+/**
+ * print the diagnostics of {line} into {err_stream}, with its line number
+ */
+static void incremental_print_diag(const incremental_line_t *line, FILE *err_stream) {
+    const char *iter = line->diag, *end = line->diag + line->diag_len, *eol;
+    for (; iter < end; iter = eol + 1) {
+        if (!(eol = memchr(iter, '\n', (size_t)(end - iter))))
+            eol = end - 1;
+        /* every diagnostic of a line starts with its number, which was 0 */
+        fprintf(err_stream, "%u%.*s\n", line->index, (int)(eol - iter - 1), iter + 1);
+    }
+}
+
+/**
+ * print the diagnostics of all the lines of {inc} into {err_stream} in order, including the labels set again
+ */
+static void incremental_report_lines(const struct incremental_t *inc, FILE *err_stream) {
+    unsigned i, j;
+    for (i = 0; i < inc->lines_cnt; ++i) {
+        const incremental_line_t *line = inc->lines[i];
+        const incremental_use_t *again = NULL;
+        for (j = 0; inc->set_twice && j < line->uses_cnt; ++j)
+            if ((line->uses[j].flags & INCREMENTAL_SETS) && line->uses[j].symbol->sets_cnt > 1 &&
+                    incremental_symbol_owner(line->uses[j].symbol) != line->uses + j)
+                again = line->uses + j;
+        /* the label of the line is set before the statement is parsed, but an external after it */
+        if (again && !(again->flags & INCREMENTAL_EXTERN))
+            fprintf(err_stream, "%u: label \'%s\' address had been already set\n", i,
+                    incremental_symbol_name(again->symbol));
+        incremental_print_diag(line, err_stream);
+        if (again && (again->flags & INCREMENTAL_EXTERN))
+            fprintf(err_stream, "%u: label \'%s\' was already set previously\n", i,
+                    incremental_symbol_name(again->symbol));
+    }
+}
+
+/**
+ * Symbol with the order of its first appearance, for sorting
+ */
+typedef struct {
+    unsigned long first;
+    unsigned position;
+    const incremental_symbol_t *symbol;
+} incremental_ordered_t;
+
+/**
+ * compare two incremental_ordered_t by order of first appearance, for qsort
+ */
+static int incremental_ordered_cmp(const void *a, const void *b) {
+    const incremental_ordered_t *first = a, *second = b;
+    if (first->first != second->first)
+        return first->first < second->first ? -1 : 1;
+    return (first->position > second->position) - (first->position < second->position);
+}
+
+/**
+ * return a new array, allocated inside {inc}, of the used symbols of {inc} which are entries (if {is_entries}) or
+ * which aren't found, by order of their first appearance. Set {*count} of them
+ * return NULL if out of memory
+ */
+static incremental_ordered_t *incremental_ordered(struct incremental_t *inc, BOOL is_entries, unsigned *count) {
+    incremental_ordered_t *ordered;
+    unsigned i, cnt = 0;
+    if (!(ordered = arena_alloc(&inc->scratch, (inc->symbols_cnt + 1) * sizeof(incremental_ordered_t))))
+        return NULL;
+    for (i = 0; i < inc->table_capacity; ++i) {
+        const incremental_symbol_t *symbol = inc->table[i];
+        if (symbol && symbol->uses_cnt > 0 && (is_entries ? symbol->entries_cnt > 0 : symbol->sets_cnt == 0)) {
+            ordered[cnt].position = 0;
+            ordered[cnt].first = incremental_symbol_first(symbol, &ordered[cnt].position);
+            ordered[cnt++].symbol = symbol;
+        }
+    }
+    qsort(ordered, cnt, sizeof(incremental_ordered_t), incremental_ordered_cmp);
+    *count = cnt;
+    return ordered;
+}
+
+/**
+ * check that every label operand of {inc} fits in an operand word in large-program mode, like
+ * instructions_list_check_labels, reporting into {err_stream}
+ * return false if any operand can't be encoded
+ */
+static BOOL incremental_check_labels(const struct incremental_t *inc, FILE *err_stream) {
+    unsigned i, j, word;
+    BOOL flag = TRUE;
+    /* the labels addresses are below the end of the data segment */
+    if (OUTPUT_OBJECT_CODE_START + inc->code_size + inc->data_size <= (1UL << (DATA_LABEL_RANGE(BIT_RANGE_END) - DATA_LABEL_RANGE(BIT_RANGE_START) + 1)))
+        return TRUE;
+    for (i = 0; i < inc->lines_cnt; ++i) {
+        const incremental_line_t *line = inc->lines[i];
+        for (word = 1; line->is_code && word < line->size; ++word)
+            for (j = 0; j < line->uses_cnt; ++j) {
+                const incremental_symbol_t *symbol = line->uses[j].symbol;
+                if (!(line->uses[j].words & (1U << word)) || symbol->is_extern ||
+                        BITS_IS_IN_RANGE(DATA_LABEL_RANGE, (unsigned long)symbol->addr))
+                    continue;
+                fprintf(err_stream, "%u: address %lu of label \'%s\' can't be encoded in an operand\n", i,
+                        (unsigned long)symbol->addr, incremental_symbol_name(symbol));
+                flag = FALSE;
+            }
+    }
+    return flag;
+}
+
+BOOL incremental_parse(struct incremental_t *inc, struct parser_ctx_t *ctx) {
+    FILE *err_stream = parser_get_err_stream(ctx);
+    incremental_ordered_t *ordered;
+    const source_t *src;
+    unsigned i, count;
+    BOOL flag = TRUE;
+
+    arena_reset(&inc->scratch);
+    inc->is_full = inc->macro_lines > 0 || parser_get_optimize(ctx);
+    if (inc->is_full) {
+        /* macros and the optimizer span many lines, so the parser gets all of them */
+        parser_reset(ctx);
+        if (!(src = incremental_get_source(inc))) {
+            fprintf(err_stream, "out of memory\n");
+            return FALSE;
+        }
+        return parser_parse(ctx, src);
+    }
+
+    if (!inc->capture && !(inc->capture = tmpfile())) {
+        fprintf(err_stream, "unable to buffer diagnostics\n");
+        return FALSE;
+    }
+    parser_set_err_stream(ctx, inc->capture);
+    while (inc->new_lines) {
+        incremental_line_t *line = inc->new_lines;
+        if (!incremental_parse_line(inc, ctx, line)) {
+            flag = FALSE;
+            break;
+        }
+        incremental_line_unlink_new(inc, line);
+    }
+    parser_set_err_stream(ctx, err_stream);
+    parser_reset(ctx);
+    if (!flag) {
+        fprintf(err_stream, "out of memory\n");
+        return FALSE;
+    }
+    incremental_resolve(inc, parser_get_large(ctx));
+
+    if (inc->diag_lines > 0 || inc->set_twice > 0)
+        incremental_report_lines(inc, err_stream);
+    flag = inc->bad_lines == 0 && inc->set_twice == 0;
+    if (flag && inc->code_size == 0 && inc->data_size == 0) {
+        fprintf(err_stream, "No declaration in file\n");
+        flag = FALSE;
+    }
+    if (inc->not_found > 0) {
+        if (!(ordered = incremental_ordered(inc, FALSE, &count))) {
+            fprintf(err_stream, "out of memory\n");
+            return FALSE;
+        }
+        for (i = 0; i < count; ++i)
+            fprintf(err_stream, "address for label \'%s\' not found in assembly file\n",
+                    incremental_symbol_name(ordered[i].symbol));
+        flag = FALSE;
+    }
+    if (flag && parser_get_large(ctx))
+        flag = incremental_check_labels(inc, err_stream);
+    return flag;
+}
+
+/**
+ * return the symbol of the label operand in the word {word} of {line}, or NULL if it isn't a label operand
+ */
+static const incremental_symbol_t *incremental_operand(const incremental_line_t *line, unsigned word) {
+    unsigned i;
+    for (i = 0; i < line->uses_cnt; ++i)
+        if (line->uses[i].words & (1U << word))
+            return line->uses[i].symbol;
+    return NULL;
+}
+
+BOOL incremental_output(struct incremental_t *inc, struct parser_ctx_t *ctx, const char *basename) {
+    const incremental_symbol_t *symbol;
+    const incremental_line_t *line;
+    incremental_ordered_t *ordered = NULL;
+    outbuf_t object, entries, externals;
+    char header[32];
+    size_t header_len, externals_len = 0, entries_len = 0;
+    unsigned i, word, count = 0;
+    unsigned long addr;
+
+    if (inc->is_full)
+        return parser_output(ctx, basename);
+    arena_reset(&inc->scratch);
+
+    /* format all files in memory, every buffer has exactly the size of its file */
+    sprintf(header, "%4u %u\n", (unsigned)inc->code_size, (unsigned)inc->data_size);
+    header_len = strlen(header);
+    for (i = 0, addr = OUTPUT_OBJECT_CODE_START; inc->extern_lines > 0 && i < inc->lines_cnt; ++i) {
+        if (!(line = inc->lines[i])->is_code)
+            continue;
+        for (word = 1; word < line->size; ++word)
+            if ((symbol = incremental_operand(line, word)) && symbol->is_extern)
+                externals_len += OUTBUF_SYMBOL_LEN(symbol->len, addr + word);
+        addr += line->size;
+    }
+    if (inc->entry_lines > 0 && !(ordered = incremental_ordered(inc, TRUE, &count)))
+        return FALSE;
+    for (i = 0; i < count; ++i)
+        entries_len += OUTBUF_SYMBOL_LEN(ordered[i].symbol->len, ordered[i].symbol->addr);
+    if (!outbuf_init(&object, &inc->scratch, header_len + outbuf_object_len(OUTPUT_OBJECT_CODE_START,
+                                                                            inc->code_size + inc->data_size)) ||
+            (inc->extern_lines > 0 && !outbuf_init(&externals, &inc->scratch, externals_len)) ||
+            (inc->entry_lines > 0 && !outbuf_init(&entries, &inc->scratch, entries_len)))
+        return FALSE;
+
+    outbuf_put_text(&object, header, header_len);
+    for (i = 0, addr = OUTPUT_OBJECT_CODE_START; i < inc->lines_cnt; ++i) {
+        if (!(line = inc->lines[i])->is_code)
+            continue;
+        outbuf_put_object_words(&object, addr, line->words, line->size);
+        /* the dst operand is resolved first, so its externals record comes before the src one */
+        for (word = line->size; inc->extern_lines > 0 && --word > 0;)
+            if ((symbol = incremental_operand(line, word)) && symbol->is_extern)
+                outbuf_put_symbol(&externals, incremental_symbol_name(symbol), symbol->len, addr + word);
+        addr += line->size;
+    }
+    for (i = 0; i < inc->lines_cnt; ++i)
+        if (!(line = inc->lines[i])->is_code) {
+            outbuf_put_object_words(&object, addr, line->words, line->size);
+            addr += line->size;
+        }
+    for (i = 0; i < count; ++i)
+        outbuf_put_symbol(&entries, incremental_symbol_name(ordered[i].symbol), ordered[i].symbol->len,
+                          ordered[i].symbol->addr);
+    return parser_write_outputs(ctx, basename, &object, inc->entry_lines > 0 ? &entries : NULL,
+                                inc->extern_lines > 0 ? &externals : NULL);
+}
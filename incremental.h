@@ -0,0 +1,68 @@
+/* This file is part of OpenU's C project implementation, called assembler
+ * Copyright (C) 2020 Arthur Zamarin, Norel Farjun */
+
+#ifndef ASM_INCREMENTAL_H
+#define ASM_INCREMENTAL_H
+
+#include "global.h"
+#include "source.h"
+#include "parser.h"
+
+/**
+ * Incremental re-assembly of one source which is edited again and again, like in an editor.
+ * The session keeps the line table, where every line keeps its text and the result of parsing it alone: its words,
+ * its diagnostics, and the labels it defines, declares and uses. Edits replace a range of lines, and only the new
+ * lines are parsed again by the next incremental_parse. The code and data words counts of the lines are summed by
+ * two Fenwick trees, so the address of any line is found in logarithmic time. Every label operand word is resolved
+ * when its line is parsed, and later patched only when the address of its label changes.
+ * The diagnostics and the outputs are exactly those of parser_parse over the whole source. The checks spanning
+ * lines (labels set twice, labels not found) are made on the kept results, without parsing again.
+ * Sources with macros, and parsers running the optimizer, are assembled fully every time.
+ */
+
+struct incremental_t;
+
+/**
+ * create a new session holding an empty source
+ */
+struct incremental_t *incremental_new(void);
+/**
+ * free {inc} session, including all the memory allocated for it
+ */
+void incremental_dealloc(struct incremental_t *inc);
+
+/**
+ * replace all the source of {inc} by the {len} bytes of {data}
+ * return false if out of memory, leaving {inc} empty
+ */
+BOOL incremental_load(struct incremental_t *inc, const char *data, size_t len);
+/**
+ * replace {count} lines starting with the zero based line {first} of {inc} by the lines of the {len} bytes of
+ * {text}. A last line without a line break is a line as well, so an empty {text} just removes the lines.
+ * return false if the lines aren't inside the source, or out of memory, leaving {inc} unchanged
+ */
+BOOL incremental_edit(struct incremental_t *inc, unsigned first, unsigned count, const char *text, size_t len);
+/**
+ * return the count of lines of {inc}
+ */
+unsigned incremental_lines_count(const struct incremental_t *inc);
+/**
+ * return the whole source of {inc}, every line followed by a line break
+ * it is valid until the next change of {inc}
+ * return NULL if out of memory
+ */
+const source_t *incremental_get_source(struct incremental_t *inc);
+
+/**
+ * parse the source of {inc} with {ctx} and its settings, which must be the same for all the calls on {inc}
+ * the new lines are parsed one by one, resetting {ctx}, and the diagnostics are output like parser_parse does
+ * return true if the source was parsed successfully
+ */
+BOOL incremental_parse(struct incremental_t *inc, struct parser_ctx_t *ctx);
+/**
+ * output the source of {inc}, after a successful incremental_parse with the same {ctx}, like parser_output does
+ * return true if output was successful
+ */
+BOOL incremental_output(struct incremental_t *inc, struct parser_ctx_t *ctx, const char *basename);
+
+#endif
@@ -2,93 +2,424 @@
  * Copyright (C) 2020 Arthur Zamarin, Norel Farjun */
 
 #include "instructions_list.h"
+#include "scheduler.h"
 
 #include <stdlib.h>
+#include <string.h>
 
-instructions_list instructions_list_new() {
-    instructions_list list = {NULL, NULL, 0};
+/** initial count of slots and linenums, both arrays double when full */
+#define INSTRUCTIONS_LIST_INITIAL_CAPACITY 256
+/** least count of code words worth encoding in a chunk of its own */
+#define INSTRUCTIONS_LIST_CHUNK_MIN_WORDS 16384
+/** count of chunks for every thread, so the scheduler can balance the threads */
+#define INSTRUCTIONS_LIST_CHUNKS_PER_THREAD 4
+
+instructions_list instructions_list_new(arena_t *arena) {
+    instructions_list list = {NULL, NULL, 0, 0, 0, 0, 0, 0, NULL};
+    list.arena = arena;
     return list;
 }
 
-void instructions_list_dealloc(instructions_list *list) {
-    instruction_t *iter = list->head, *tmp;
-    while (iter) {
-        tmp = iter->next;
-        free (iter);
-        iter = tmp;
+/**
+ * make room for {count} more items of {item_size} bytes after {used} items in the array {*array} of {*capacity}
+ * items, doubling it as needed
+ * return false if allocation failed
+ */
+static BOOL instructions_list_reserve(arena_t *arena, void **array, unsigned *capacity, unsigned used, unsigned count,
+                                      size_t item_size) {
+    unsigned new_capacity = *capacity ? *capacity : INSTRUCTIONS_LIST_INITIAL_CAPACITY;
+    void *new_array;
+    if (used + count <= *capacity)
+        return TRUE;
+    while (new_capacity < used + count)
+        new_capacity *= 2;
+    if (!(new_array = arena_realloc(arena, *array, (size_t)*capacity * item_size, (size_t)new_capacity * item_size)))
+        return FALSE;
+    *array = new_array;
+    *capacity = new_capacity;
+    return TRUE;
+}
+
+/**
+ * return the slot of the non register {oprn} added to {list}: the final word for immediate, or the label's id
+ * a code label which is already defined is resolved when {list} resolves labels, if its address fits
+ */
+static uint32_t operand_slot(const instructions_list *list, const operand_t *oprn) {
+    const labels_list_node_t *node;
+    labels_list_node_t resolved;
+    uint16_t value = 0;
+    if (oprn->type == OPERAND_LABEL) {
+        node = oprn->u.label_ptr;
+        if (!list->resolve_mask || !node->isSet || node->isDS || node->isExtr)
+            return node->id;
+        /* a data label moves with the size of the code, and an external one needs its externals record */
+        resolved = *node;
+        resolved.addr = (node->addr + list->resolve_start) & list->resolve_mask;
+        if (!BITS_IS_IN_RANGE(DATA_LABEL_RANGE, (unsigned long)resolved.addr))
+            return node->id; /* reported with its line by instructions_list_check_labels */
+        return INSTRUCTIONS_LIST_RESOLVED | instructions_list_label_word(&resolved);
     }
+    BITS_SET(DATA_ARE_RANGE, value, INST_ARE_ABSOLUTE);
+    BITS_SET(DATA_IMMEDIATE_RANGE, value, (uint16_t)oprn->u.value);
+    return value;
 }
 
 /**
- * return the needed slot count for the {inst}'s operand (doesn't count the command itself}
- * should be 0, 1 or 2
- * the last line is responsible for the case when both operands are register based
+ * return the word of the register based {oprn}, as the {is_dst} operand
  */
-static unsigned instructions_list_operands_size(instruction_t *inst) {
-    return !!(inst->operands[0].type != OPERAND_NONE) + !!(inst->operands[1].type != OPERAND_NONE) -
-           !!((inst->operands[0].type & OPERAND_ALL_REG) && (inst->operands[1].type & OPERAND_ALL_REG));
+static uint16_t operand_register_word(const operand_t *oprn, BOOL is_dst) {
+    uint16_t value = 0;
+    BITS_SET(DATA_ARE_RANGE, value, INST_ARE_ABSOLUTE);
+    if (is_dst)
+        BITS_SET(DATA_DST_REG_RANGE, value, (uint16_t)oprn->u.value);
+    else
+        BITS_SET(DATA_SRC_REG_RANGE, value, (uint16_t)oprn->u.value);
+    return value;
 }
 
-void instructions_list_add(instructions_list *list, instruction_t *inst) {
-    inst->next = NULL;
-    if (list->head == NULL)
-        list->head = inst;
+BOOL instructions_list_add(instructions_list *list, uint16_t command, const operand_t operands[MAX_CNT_OPERAND],
+                           unsigned linenum) {
+    uint32_t *slot;
+    unsigned i;
+
+    if (!instructions_list_reserve(list->arena, (void **)&list->slots, &list->slots_capacity, list->size,
+                                   1 + MAX_CNT_OPERAND, sizeof(uint32_t)) ||
+            !instructions_list_reserve(list->arena, (void **)&list->linenums, &list->linenums_capacity, list->count,
+                                       1, sizeof(unsigned)))
+        return FALSE;
+
+    slot = list->slots + list->size;
+    *slot++ = command;
+    if ((operands[0].type & OPERAND_ALL_REG) && (operands[1].type & OPERAND_ALL_REG))
+        /* both operands are register based, so they share one word */
+        *slot++ = operand_register_word(operands + 0, TRUE) | operand_register_word(operands + 1, FALSE);
     else
-        list->tail->next = inst;
-    list->tail = inst;
-    list->size += 1 + instructions_list_operands_size(inst);
+        /* the operand words go in the order src, dst */
+        for (i = MAX_CNT_OPERAND; i-- > 0;)
+            if (operands[i].type & OPERAND_ALL_REG)
+                *slot++ = operand_register_word(operands + i, i == 0);
+            else if (operands[i].type != OPERAND_NONE)
+                *slot++ = operand_slot(list, operands + i);
+
+    list->linenums[list->count++] = linenum;
+    list->size = (unsigned)(slot - list->slots);
+    return TRUE;
+}
+
+unsigned instructions_list_operands_size(uint32_t command, unsigned *src, unsigned *dst) {
+    *src = BITS_GET(INST_OPR2_ACCS_RANGE, command);
+    *dst = BITS_GET(INST_OPR1_ACCS_RANGE, command);
+    return !!*src + !!*dst - !!((*src & OPERAND_ALL_REG) && (*dst & OPERAND_ALL_REG));
+}
+
+void instructions_list_resolve_labels(instructions_list *list, unsigned start_addr, uint32_t addr_mask) {
+    list->resolve_start = start_addr;
+    list->resolve_mask = addr_mask;
+}
+
+void instructions_list_clear(instructions_list *list) {
+    list->size = list->count = 0;
+}
+
+BOOL instructions_list_check_label(const labels_list_t *labels, uint32_t id, unsigned linenum, FILE *err_stream) {
+    const labels_list_node_t *node = labels_list_get_by_id(labels, id);
+    if (node->isExtr || BITS_IS_IN_RANGE(DATA_LABEL_RANGE, (unsigned long)node->addr))
+        return TRUE;
+    fprintf(err_stream, "%u: address %lu of label \'%s\' can't be encoded in an operand\n", linenum,
+            (unsigned long)node->addr, labels_listnode_get_label(node));
+    return FALSE;
 }
 
 /**
- * Calculate and return the correct binary representation of the {oprn} operand, based on {is_dst} flag.
- * In case it depends on an external label, output into {externals_file} with {addr} address
+ * return false and report into {err_stream} with {linenum} if the operand in {slot} accessed by {access} is a label
+ * whose address doesn't fit in the operand word
  */
-static uint16_t operand_get_value(const operand_t *oprn, BOOL is_dst, unsigned addr, FILE *externals_file) {
+static BOOL operand_check_label(const labels_list_t *labels, uint32_t slot, unsigned access, unsigned linenum,
+                                FILE *err_stream) {
+    return access != OPERAND_LABEL || instructions_list_is_resolved(slot) ||
+           instructions_list_check_label(labels, slot, linenum, err_stream);
+}
+
+BOOL instructions_list_check_labels(const instructions_list *list, const labels_list_t *labels, FILE *err_stream) {
+    unsigned i, index, size, src, dst, linenum;
+    BOOL flag = TRUE;
+    for (i = index = 0; i < list->size; i += 1 + size, ++index) {
+        size = instructions_list_operands_size(list->slots[i], &src, &dst);
+        linenum = instructions_list_linenum(list, index);
+        if (size == 2) {
+            flag &= operand_check_label(labels, list->slots[i + 1], src, linenum, err_stream);
+            flag &= operand_check_label(labels, list->slots[i + 2], dst, linenum, err_stream);
+        } else if (size == 1 && !src)
+            flag &= operand_check_label(labels, list->slots[i + 1], dst, linenum, err_stream);
+    }
+    return flag;
+}
+
+uint16_t instructions_list_label_word(const labels_list_node_t *node) {
     uint16_t value = 0;
-    switch (oprn->type) {
-        case OPERAND_REG:
-        case OPERAND_MEM_REG:
-            BITS_SET(DATA_ARE_RANGE, value, INST_ARE_ABSOLUTE);
-            if (is_dst)
-                BITS_SET(DATA_DST_REG_RANGE, value, (uint16_t)oprn->u.value);
-            else
-                BITS_SET(DATA_SRC_REG_RANGE, value, (uint16_t)oprn->u.value);
-            break;
-        case OPERAND_IMMEDIATE:
-            BITS_SET(DATA_ARE_RANGE, value, INST_ARE_ABSOLUTE);
-            BITS_SET(DATA_IMMEDIATE_RANGE, value, (uint16_t)oprn->u.value);
-            break;
-        case OPERAND_LABEL:
-            if (oprn->u.label_ptr->isExtr) {
-                BITS_SET(DATA_ARE_RANGE, value, INST_ARE_EXTERNAL);
-                fprintf(externals_file, EXTERNALS_FILE_OUTPUT_FORMAT, labels_listnode_get_label(oprn->u.label_ptr), addr);
-            } else {
-                BITS_SET(DATA_ARE_RANGE, value, INST_ARE_RELETIVE);
-                BITS_SET(DATA_LABEL_RANGE, value, (uint16_t)oprn->u.label_ptr->addr);
-            }
-            break;
-        case OPERAND_NONE:
-        default:
-            break;
+    if (node->isExtr)
+        BITS_SET(DATA_ARE_RANGE, value, INST_ARE_EXTERNAL);
+    else {
+        BITS_SET(DATA_ARE_RANGE, value, INST_ARE_RELETIVE);
+        BITS_SET(DATA_LABEL_RANGE, value, (uint16_t)node->addr);
     }
     return value;
 }
 
-void instructions_list_output(instructions_list *list, unsigned start_addr, FILE *object_file, FILE *externals_file) {
-    instruction_t *inst;
-    for (inst = list->head; inst; inst = inst->next) {
-        fprintf(object_file, OBJECT_FILE_OUTPUT_FORMAT, start_addr++, inst->command);
-        if (inst->operands[0].type != OPERAND_NONE) {
-            const unsigned size = instructions_list_operands_size(inst);
-            uint16_t operand1 = operand_get_value(inst->operands + 0, TRUE , start_addr + size - 1, externals_file);
-            if (inst->operands[1].type != OPERAND_NONE) {
-                uint16_t operand2 = operand_get_value(inst->operands + 1, FALSE, start_addr, externals_file);
-                if (size == 1)
-                    operand1 |= operand2;
-                else
-                    fprintf(object_file, OBJECT_FILE_OUTPUT_FORMAT, start_addr++, operand2);
-            }
-            fprintf(object_file, OBJECT_FILE_OUTPUT_FORMAT, start_addr++, operand1);
+/**
+ * Calculate and return the word of the operand in {slot}, which is accessed by {access}.
+ * In case it depends on an external label, output into {externals} with {addr} address and count it in {externals_cnt}
+ */
+static uint16_t operand_get_value(const labels_list_t *labels, uint32_t slot, unsigned access, unsigned addr,
+                                  outbuf_t *externals, unsigned long *externals_cnt) {
+    const labels_list_node_t *node;
+    if (access != OPERAND_LABEL || instructions_list_is_resolved(slot))
+        return (uint16_t)slot;
+    node = labels_list_get_by_id(labels, slot);
+    if (node->isExtr) {
+        outbuf_put_symbol(externals, labels_listnode_get_label(node), strlen(labels_listnode_get_label(node)), addr);
+        ++*externals_cnt;
+    }
+    return instructions_list_label_word(node);
+}
+
+/**
+ * return the length of the externals file record for the operand in {slot} accessed by {access} at {addr},
+ * or 0 if it isn't an external label
+ */
+static size_t operand_externals_len(const labels_list_t *labels, uint32_t slot, unsigned access, unsigned addr) {
+    const labels_list_node_t *node;
+    if (access != OPERAND_LABEL || instructions_list_is_resolved(slot) ||
+            !(node = labels_list_get_by_id(labels, slot))->isExtr)
+        return 0;
+    return OUTBUF_SYMBOL_LEN(strlen(labels_listnode_get_label(node)), addr);
+}
+
+/**
+ * return the length of the externals file records for the slots [{first}, {end}) of {list}, which start and end
+ * with whole instructions, while the addressing of {list} starts with {start_addr}
+ */
+static size_t instructions_list_range_externals_len(const instructions_list *list, const labels_list_t *labels,
+                                                    unsigned start_addr, unsigned first, unsigned end) {
+    unsigned i, size, src, dst;
+    size_t len = 0;
+    for (i = first; i < end; i += 1 + size) {
+        size = instructions_list_operands_size(list->slots[i], &src, &dst);
+        if (size == 2) {
+            len += operand_externals_len(labels, list->slots[i + 1], src, start_addr + i + 1);
+            len += operand_externals_len(labels, list->slots[i + 2], dst, start_addr + i + 2);
+        } else if (size == 1 && !src) /* a single operand is always dst */
+            len += operand_externals_len(labels, list->slots[i + 1], dst, start_addr + i + 1);
+    }
+    return len;
+}
+
+size_t instructions_list_externals_len(const instructions_list *list, const labels_list_t *labels, unsigned start_addr) {
+    return instructions_list_range_externals_len(list, labels, start_addr, 0, list->size);
+}
+
+/**
+ * output the slots [{first}, {end}) of {list}, which start and end with whole instructions, like
+ * instructions_list_output does
+ * return the count of records written into {externals}
+ */
+static unsigned long instructions_list_output_range(const instructions_list *list, const labels_list_t *labels,
+                                                    unsigned start_addr, unsigned first, unsigned end,
+                                                    outbuf_t *object, outbuf_t *externals) {
+    const uint32_t *slots = list->slots;
+    unsigned long externals_cnt = 0;
+    unsigned i, size, src, dst, addr;
+    uint16_t src_word, dst_word;
+
+    for (i = first; i < end; i += 1 + size) {
+        addr = start_addr + i;
+        size = instructions_list_operands_size(slots[i], &src, &dst);
+        outbuf_put_object_word(object, addr, (uint16_t)slots[i]);
+        if (size == 2) {
+            /* the dst operand is resolved first, so its externals record comes before the src one */
+            dst_word = operand_get_value(labels, slots[i + 2], dst, addr + 2, externals, &externals_cnt);
+            src_word = operand_get_value(labels, slots[i + 1], src, addr + 1, externals, &externals_cnt);
+            outbuf_put_object_word(object, addr + 1, src_word);
+            outbuf_put_object_word(object, addr + 2, dst_word);
+        } else if (size == 1) /* a single operand word is dst, or both registers */
+            outbuf_put_object_word(object, addr + 1, operand_get_value(labels, slots[i + 1], src ? OPERAND_REG : dst,
+                                                                       addr + 1, externals, &externals_cnt));
+    }
+    return externals_cnt;
+}
+
+unsigned long instructions_list_output(const instructions_list *list, const labels_list_t *labels, unsigned start_addr,
+                                       outbuf_t *object, outbuf_t *externals) {
+    return instructions_list_output_range(list, labels, start_addr, 0, list->size, object, externals);
+}
+
+/**
+ * return the word of the slot {slot} accessed by {access}, or 0 if it is a label operand which wasn't resolved
+ */
+static uint16_t operand_known_word(uint32_t slot, unsigned access) {
+    return (access == OPERAND_LABEL && !instructions_list_is_resolved(slot)) ? 0 : (uint16_t)slot;
+}
+
+void instructions_list_words(const instructions_list *list, unsigned first, unsigned end, uint16_t *words) {
+    const uint32_t *slots = list->slots;
+    unsigned i, size, src, dst;
+
+    for (i = first; i < end; i += 1 + size) {
+        size = instructions_list_operands_size(slots[i], &src, &dst);
+        *words++ = (uint16_t)slots[i];
+        if (size == 2) {
+            *words++ = operand_known_word(slots[i + 1], src);
+            *words++ = operand_known_word(slots[i + 2], dst);
+        } else if (size == 1)
+            *words++ = operand_known_word(slots[i + 1], src ? OPERAND_REG : dst);
+    }
+}
+
+/**
+ * patch the record of the word at {addr}, which is the word number {index} of the records {records} starting with
+ * {start_addr}, into the word of the label operand in {slot}, if it is one which wasn't resolved
+ */
+static void operand_patch_label(const labels_list_t *labels, uint32_t slot, unsigned access, unsigned start_addr,
+                                unsigned index, char *records, outbuf_t *externals, unsigned long *externals_cnt) {
+    outbuf_t record;
+    if (access != OPERAND_LABEL || instructions_list_is_resolved(slot))
+        return;
+    record.data = records + outbuf_object_len(start_addr, index);
+    record.len = 0;
+    record.capacity = outbuf_object_len(start_addr + index, 1);
+    outbuf_put_object_word(&record, start_addr + index,
+                           operand_get_value(labels, slot, access, start_addr + index, externals, externals_cnt));
+}
+
+unsigned long instructions_list_output_labels(const instructions_list *list, const labels_list_t *labels,
+                                              unsigned start_addr, char *records, outbuf_t *externals) {
+    const uint32_t *slots = list->slots;
+    unsigned long externals_cnt = 0;
+    unsigned i, size, src, dst;
+
+    for (i = 0; i < list->size; i += 1 + size) {
+        size = instructions_list_operands_size(slots[i], &src, &dst);
+        if (size == 2) {
+            /* the same order of the externals records as instructions_list_output */
+            operand_patch_label(labels, slots[i + 2], dst, start_addr, i + 2, records, externals, &externals_cnt);
+            operand_patch_label(labels, slots[i + 1], src, start_addr, i + 1, records, externals, &externals_cnt);
+        } else if (size == 1 && !src)
+            operand_patch_label(labels, slots[i + 1], dst, start_addr, i + 1, records, externals, &externals_cnt);
+    }
+    return externals_cnt;
+}
+
+/**
+ * One chunk of the code segment, encoded by one job of instructions_list_output_parallel.
+ * Its object records go straight to their place in the shared object buffer, which is known from the address of
+ * its first word. Its externals records are collected in a buffer of its own, as their place depends on the
+ * records of the chunks before it.
+ */
+typedef struct {
+    unsigned first, end;    /* slots range, starting and ending with whole instructions */
+    outbuf_t object;        /* window of the shared object buffer */
+    outbuf_t externals;     /* own externals records, data is NULL if there are none or out of memory */
+    unsigned long externals_cnt;
+    BOOL is_failed;         /* unable to allocate the externals records */
+} instructions_list_chunk_t;
+
+/** shared argument of the chunk jobs */
+typedef struct {
+    const instructions_list *list;
+    const labels_list_t *labels;
+    unsigned start_addr;
+    BOOL has_externals;     /* are there external labels, so the chunks must collect records */
+    instructions_list_chunk_t *chunks;
+} instructions_list_chunks_t;
+
+/**
+ * scheduler job encoding the chunk number {job} of the instructions_list_chunks_t {arg}
+ */
+static void instructions_list_chunk_func(unsigned job, void *arg) {
+    const instructions_list_chunks_t *shared = arg;
+    instructions_list_chunk_t *chunk = shared->chunks + job;
+    size_t len = 0;
+
+    if (shared->has_externals)
+        len = instructions_list_range_externals_len(shared->list, shared->labels, shared->start_addr, chunk->first,
+                                                    chunk->end);
+    if (len > 0) {
+        /* the jobs run concurrently, so the records can't be allocated from the list's arena */
+        if (!(chunk->externals.data = malloc(len))) {
+            chunk->is_failed = TRUE;
+            return;
+        }
+        chunk->externals.capacity = len;
+    }
+    chunk->externals_cnt = instructions_list_output_range(shared->list, shared->labels, shared->start_addr,
+                                                          chunk->first, chunk->end, &chunk->object,
+                                                          &chunk->externals);
+}
+
+BOOL instructions_list_output_parallel(const instructions_list *list, const labels_list_t *labels,
+                                       unsigned start_addr, outbuf_t *object, outbuf_t *externals,
+                                       unsigned threads_cnt, unsigned long *externals_cnt) {
+    instructions_list_chunks_t shared;
+    instructions_list_chunk_t *chunk;
+    struct scheduler_t *sched;
+    unsigned long *weights;
+    unsigned chunks_cnt, chunk_words, i, j, size, src, dst;
+    size_t object_len;
+    BOOL res = TRUE;
+
+    chunks_cnt = threads_cnt * INSTRUCTIONS_LIST_CHUNKS_PER_THREAD;
+    if (chunks_cnt > list->size / INSTRUCTIONS_LIST_CHUNK_MIN_WORDS)
+        chunks_cnt = list->size / INSTRUCTIONS_LIST_CHUNK_MIN_WORDS;
+    if (threads_cnt < 2 || chunks_cnt < 2) {
+        *externals_cnt = instructions_list_output(list, labels, start_addr, object, externals);
+        return TRUE;
+    }
+    if (!(shared.chunks = calloc(chunks_cnt, sizeof(instructions_list_chunk_t))) ||
+            !(weights = calloc(chunks_cnt, sizeof(unsigned long)))) {
+        free(shared.chunks);
+        return FALSE;
+    }
+    shared.list = list;
+    shared.labels = labels;
+    shared.start_addr = start_addr;
+    shared.has_externals = externals != NULL;
+
+    /* cut the slots at the first instruction starting past every chunk's share of the words */
+    chunk_words = list->size / chunks_cnt;
+    for (i = j = 0; j < chunks_cnt; ++j) {
+        chunk = shared.chunks + j;
+        chunk->first = i;
+        for (; i < list->size && (j == chunks_cnt - 1 || i < (j + 1) * chunk_words); i += 1 + size)
+            size = instructions_list_operands_size(list->slots[i], &src, &dst);
+        chunk->end = i;
+        weights[j] = chunk->end - chunk->first;
+        /* every chunk's records start at the length of the records of all the words before it */
+        object_len = outbuf_object_len(start_addr + chunk->first, chunk->end - chunk->first);
+        chunk->object.data = object->data + object->len + outbuf_object_len(start_addr, chunk->first);
+        chunk->object.capacity = object_len;
+    }
+
+    if (!(sched = scheduler_new(threads_cnt, chunks_cnt, weights, instructions_list_chunk_func, &shared))) {
+        free(weights);
+        free(shared.chunks);
+        return FALSE;
+    }
+    scheduler_dealloc(sched);
+
+    /* the chunks are in address order, so appending their externals records keeps the records sorted */
+    *externals_cnt = 0;
+    for (j = 0; j < chunks_cnt; ++j) {
+        chunk = shared.chunks + j;
+        object->len += chunk->object.len;
+        if (chunk->is_failed)
+            res = FALSE;
+        else if (chunk->externals.len > 0) {
+            outbuf_put_text(externals, chunk->externals.data, chunk->externals.len);
+            *externals_cnt += chunk->externals_cnt;
         }
+        free(chunk->externals.data);
     }
+    free(weights);
+    free(shared.chunks);
+    return res;
 }
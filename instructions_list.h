@@ -4,10 +4,12 @@
 #ifndef ASM_INSTRUCTIONS_LIST_H
 #define ASM_INSTRUCTIONS_LIST_H
 
-#include <stdio.h>
+#include <stddef.h>
 
 #include "opcodes.h"
+#include "outbuf.h"
 #include "labels_list.h"
+#include "arena.h"
 
 /** values relevant to the ARE field in every instruction */
 enum INST_ARE_VALS {
@@ -47,45 +49,116 @@ typedef struct {
 #define DATA_DST_REG_RANGE(F)   F( 3,  5)
 #define DATA_SRC_REG_RANGE(F)   F( 6,  8)
 
-/**
- * Holds full information about one instruction and its operands
- * Also acts as a node in the linked list
- */
-typedef struct instruction_t {
-    struct instruction_t *next;
-    operand_t operands[MAX_CNT_OPERAND]; /* the instruction's operands */
-    unsigned linenum;                    /* the linenum in code of the instruction */
-    uint16_t command;                    /* binary representation of the command itself */
-} instruction_t;
+/** flag of a label operand slot which holds its final word, as the label was resolved when it was added */
+#define INSTRUCTIONS_LIST_RESOLVED 0x80000000UL
+/** return true if the label operand {slot} was resolved when it was added */
+#define instructions_list_is_resolved(slot) (((slot) & INSTRUCTIONS_LIST_RESOLVED) != 0)
 
 /**
  * Holds the code segment structure and content.
- * Uses linked list of instruction_t
+ * Every code word has one slot, in address order: the command word followed by its operand words. A label
+ * operand slot holds the label's id until the output, every other slot already holds its final word.
+ * When resolving is on, a label operand of a code label which is already defined holds its final word too, with
+ * INSTRUCTIONS_LIST_RESOLVED set.
+ * The line of every instruction is kept in a side table, which is read only for diagnostics.
  */
 typedef struct {
-    instruction_t *head;
-    instruction_t *tail;
-    uint16_t size;
+    uint32_t *slots;            /* one slot per code word */
+    unsigned *linenums;         /* the line of every instruction, by instruction index */
+    unsigned size;              /* count of words */
+    unsigned count;             /* count of instructions */
+    unsigned slots_capacity;    /* count of allocated slots */
+    unsigned linenums_capacity; /* count of allocated linenums */
+    unsigned resolve_start;     /* address of the first code word when resolving */
+    uint32_t resolve_mask;      /* mask of the labels addresses when resolving, 0 to keep every label operand */
+    arena_t *arena;             /* memory source for the arrays */
 } instructions_list;
 
 /**
- * create and return a new instructions_list structure
+ * create and return a new instructions_list structure, which allocates from {arena}
+ * all the memory is owned by {arena}, so there is no dealloc function
+ */
+instructions_list instructions_list_new(arena_t *arena);
+
+/**
+ * adds the instruction {command} with {operands} (dst first, then src) from line {linenum} at the end of {list}
+ * return false if out of memory
  */
-instructions_list instructions_list_new(void);
+BOOL instructions_list_add(instructions_list *list, uint16_t command, const operand_t operands[MAX_CNT_OPERAND],
+                           unsigned linenum);
 /**
- * free and clean the {list} structure
+ * resolve the operands of code labels which are already defined when their instructions are added to {list},
+ * while the addressing starts with {start_addr} and the addresses are masked by {addr_mask} like
+ * labels_list_check_and_fix does, or stop resolving if {addr_mask} is 0
+ * the labels must never move after, so it can't be used with the optimizer
  */
-void instructions_list_dealloc(instructions_list *list);
-
+void instructions_list_resolve_labels(instructions_list *list, unsigned start_addr, uint32_t addr_mask);
+/**
+ * remove all the instructions of {list}, keeping its memory for the next ones
+ */
+void instructions_list_clear(instructions_list *list);
+/**
+ * return the count of operand words following the {command} word, and set its {src} and {dst} accesses
+ * two register based operands share one word
+ */
+unsigned instructions_list_operands_size(uint32_t command, unsigned *src, unsigned *dst);
+/**
+ * return the line of the instruction number {index} of {list}
+ */
+#define instructions_list_linenum(list, index) ((list)->linenums[index])
+/**
+ * return the word of an operand of the label {node}, whose address is already absolute
+ */
+uint16_t instructions_list_label_word(const labels_list_node_t *node);
+/**
+ * check that an operand of the label {id} of {labels}, in an instruction of line {linenum}, fits in its word
+ * if it doesn't, report it into {err_stream}
+ * return false if the operand can't be encoded
+ */
+BOOL instructions_list_check_label(const labels_list_t *labels, uint32_t id, unsigned linenum, FILE *err_stream);
+/**
+ * check that every label operand of {list} fits in an operand word, using the absolute addresses of {labels}
+ * every operand which can't be encoded is reported with its line into {err_stream}
+ * return false if any operand can't be encoded
+ */
+BOOL instructions_list_check_labels(const instructions_list *list, const labels_list_t *labels, FILE *err_stream);
+/**
+ * copy the words of the slots [{first}, {end}) of {list}, which start and end with whole instructions, into {words}
+ * a label operand which wasn't resolved is copied as 0, to be patched by instructions_list_output_labels
+ */
+void instructions_list_words(const instructions_list *list, unsigned first, unsigned end, uint16_t *words);
+/**
+ * patch the records of the label operands of {list} which weren't resolved into {records}, which holds the object
+ * file records of all the words of {list} starting with {start_addr}, using the labels of {labels}
+ * for every external label usage, output it into {externals}, which must have room for all the records
+ * return the count of records written into {externals}
+ */
+unsigned long instructions_list_output_labels(const instructions_list *list, const labels_list_t *labels,
+                                              unsigned start_addr, char *records, outbuf_t *externals);
+/**
+ * return the length of the externals file for {list} with the labels of {labels}, while the addressing starts
+ * with {start_addr}
+ */
+size_t instructions_list_externals_len(const instructions_list *list, const labels_list_t *labels, unsigned start_addr);
 /**
- * adds the {inst} at the end of the {list}
- * {inst} is malloced pointer that it's ownership is taken by {list}
+ * output the {list} structure with the labels of {labels} into {object}, while the addressing starts with
+ * {start_addr}
+ * for every external label usage, output it into {externals}
+ * both buffers must have room for all the records
+ * return the count of records written into {externals}
  */
-void instructions_list_add(instructions_list *list, instruction_t *inst);
+unsigned long instructions_list_output(const instructions_list *list, const labels_list_t *labels, unsigned start_addr,
+                                       outbuf_t *object, outbuf_t *externals);
 /**
- * output the {seg} structure into {object_file}, while the addressing starts with {start_addr}
- * for every external label usage, output it into {externals_file}
+ * output {list} like instructions_list_output, encoding chunks of the code segment on up to {threads_cnt} threads
+ * every instruction's address is known from its slot, so every chunk writes its object records straight into its
+ * place in {object}, while its externals records are collected apart and appended to {externals} in address order
+ * a code segment too small to be worth the threads is output in this thread
+ * the count of records written into {externals} is set into {externals_cnt}
+ * return false if out of memory, leaving {object} and {externals} partially written
  */
-void instructions_list_output(instructions_list *list, unsigned start_addr, FILE *object_file, FILE *externals_file);
+BOOL instructions_list_output_parallel(const instructions_list *list, const labels_list_t *labels,
+                                       unsigned start_addr, outbuf_t *object, outbuf_t *externals,
+                                       unsigned threads_cnt, unsigned long *externals_cnt);
 
 #endif
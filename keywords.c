@@ -0,0 +1,95 @@
+/* This file is part of OpenU's C project implementation, called assembler
+ * Copyright (C) 2020 Arthur Zamarin, Norel Farjun */
+
+#include "keywords.h"
+#include "global.h"
+#include "opcodes.h"
+
+#include <string.h>
+
+/**
+ * Perfect hash of all reserved words, based on first, second and last characters.
+ * Every word is placed at slot KEYWORDS_HASH of itself, with no collisions.
+ * When adding a word, the multipliers must be searched again so the slots stay unique.
+ */
+#define KEYWORDS_HASH(text, len) \
+    (((unsigned char)(text)[0] * 15U + (unsigned char)(text)[1] * 11U + (unsigned char)(text)[(len) - 1] * 12U) & 63U)
+#define KEYWORDS_MIN_LEN 2
+#define KEYWORDS_MAX_LEN 7
+
+static const keyword_t g_keywords[64] = {
+    /* 00 */ {NULL,      0, KW_NONE,      0},
+    /* 01 */ {NULL,      0, KW_NONE,      0},
+    /* 02 */ {NULL,      0, KW_NONE,      0},
+    /* 03 */ {"r3",      2, KW_REGISTER,  3},
+    /* 04 */ {NULL,      0, KW_NONE,      0},
+    /* 05 */ {"inc",     3, KW_OPCODE,    OPCODE_INC},
+    /* 06 */ {NULL,      0, KW_NONE,      0},
+    /* 07 */ {NULL,      0, KW_NONE,      0},
+    /* 08 */ {"r6",      2, KW_REGISTER,  6},
+    /* 09 */ {"clr",     3, KW_OPCODE,    OPCODE_CLR},
+    /* 10 */ {NULL,      0, KW_NONE,      0},
+    /* 11 */ {NULL,      0, KW_NONE,      0},
+    /* 12 */ {NULL,      0, KW_NONE,      0},
+    /* 13 */ {"string",  6, KW_DIRECTIVE, DIRECTIVE_STRING},
+    /* 14 */ {"rts",     3, KW_OPCODE,    OPCODE_RTS},
+    /* 15 */ {NULL,      0, KW_NONE,      0},
+    /* 16 */ {NULL,      0, KW_NONE,      0},
+    /* 17 */ {"entry",   5, KW_DIRECTIVE, DIRECTIVE_ENTRY},
+    /* 18 */ {NULL,      0, KW_NONE,      0},
+    /* 19 */ {"data",    4, KW_DIRECTIVE, DIRECTIVE_DATA},
+    /* 20 */ {NULL,      0, KW_NONE,      0},
+    /* 21 */ {"r1",      2, KW_REGISTER,  1},
+    /* 22 */ {NULL,      0, KW_NONE,      0},
+    /* 23 */ {"dec",     3, KW_OPCODE,    OPCODE_DEC},
+    /* 24 */ {"mcro",    4, KW_MACRO,     MACRO_START},
+    /* 25 */ {"endmcro", 7, KW_MACRO,     MACRO_END},
+    /* 26 */ {"r4",      2, KW_REGISTER,  4},
+    /* 27 */ {NULL,      0, KW_NONE,      0},
+    /* 28 */ {"sub",     3, KW_OPCODE,    OPCODE_SUB},
+    /* 29 */ {NULL,      0, KW_NONE,      0},
+    /* 30 */ {"prn",     3, KW_OPCODE,    OPCODE_PRN},
+    /* 31 */ {"r7",      2, KW_REGISTER,  7},
+    /* 32 */ {NULL,      0, KW_NONE,      0},
+    /* 33 */ {NULL,      0, KW_NONE,      0},
+    /* 34 */ {NULL,      0, KW_NONE,      0},
+    /* 35 */ {NULL,      0, KW_NONE,      0},
+    /* 36 */ {NULL,      0, KW_NONE,      0},
+    /* 37 */ {"jmp",     3, KW_OPCODE,    OPCODE_JMP},
+    /* 38 */ {NULL,      0, KW_NONE,      0},
+    /* 39 */ {"not",     3, KW_OPCODE,    OPCODE_NOT},
+    /* 40 */ {NULL,      0, KW_NONE,      0},
+    /* 41 */ {NULL,      0, KW_NONE,      0},
+    /* 42 */ {NULL,      0, KW_NONE,      0},
+    /* 43 */ {"add",     3, KW_OPCODE,    OPCODE_ADD},
+    /* 44 */ {"r2",      2, KW_REGISTER,  2},
+    /* 45 */ {NULL,      0, KW_NONE,      0},
+    /* 46 */ {NULL,      0, KW_NONE,      0},
+    /* 47 */ {NULL,      0, KW_NONE,      0},
+    /* 48 */ {"mov",     3, KW_OPCODE,    OPCODE_MOV},
+    /* 49 */ {"r5",      2, KW_REGISTER,  5},
+    /* 50 */ {NULL,      0, KW_NONE,      0},
+    /* 51 */ {NULL,      0, KW_NONE,      0},
+    /* 52 */ {"bne",     3, KW_OPCODE,    OPCODE_BNE},
+    /* 53 */ {"red",     3, KW_OPCODE,    OPCODE_RED},
+    /* 54 */ {NULL,      0, KW_NONE,      0},
+    /* 55 */ {"lea",     3, KW_OPCODE,    OPCODE_LEA},
+    /* 56 */ {NULL,      0, KW_NONE,      0},
+    /* 57 */ {"stop",    4, KW_OPCODE,    OPCODE_STOP},
+    /* 58 */ {NULL,      0, KW_NONE,      0},
+    /* 59 */ {"extern",  6, KW_DIRECTIVE, DIRECTIVE_EXTERN},
+    /* 60 */ {"cmp",     3, KW_OPCODE,    OPCODE_CMP},
+    /* 61 */ {NULL,      0, KW_NONE,      0},
+    /* 62 */ {"r0",      2, KW_REGISTER,  0},
+    /* 63 */ {"jsr",     3, KW_OPCODE,    OPCODE_JSR},
+};
+
+const keyword_t *keywords_find(const char *text, size_t len) {
+    const keyword_t *kw;
+    if (len < KEYWORDS_MIN_LEN || len > KEYWORDS_MAX_LEN)
+        return NULL;
+    kw = g_keywords + KEYWORDS_HASH(text, len);
+    if (kw->len != len || memcmp(kw->text, text, len))
+        return NULL;
+    return kw;
+}
@@ -0,0 +1,46 @@
+/* This file is part of OpenU's C project implementation, called assembler
+ * Copyright (C) 2020 Arthur Zamarin, Norel Farjun */
+
+#ifndef ASM_KEYWORDS_H
+#define ASM_KEYWORDS_H
+
+#include <stddef.h>
+
+/** kinds of reserved words */
+enum keyword_kind {
+    KW_NONE = 0,
+    KW_OPCODE,    /* value is enum opcode_number */
+    KW_REGISTER,  /* value is the register number */
+    KW_DIRECTIVE, /* value is enum directive_kind, the text is without the dot */
+    KW_MACRO      /* value is enum macro_kind */
+};
+
+enum directive_kind {
+    DIRECTIVE_DATA,
+    DIRECTIVE_STRING,
+    DIRECTIVE_ENTRY,
+    DIRECTIVE_EXTERN
+};
+
+enum macro_kind {
+    MACRO_START, /* "mcro", starts a macro definition */
+    MACRO_END    /* "endmcro", ends it */
+};
+
+/**
+ * information about a reserved word
+ */
+typedef struct {
+    const char *text;
+    unsigned len;
+    enum keyword_kind kind;
+    unsigned value;
+} keyword_t;
+
+/**
+ * returns the reserved word matching {text} of {len} characters, or NULL if it isn't one.
+ * Uses a perfect hash, so it costs one string compare.
+ */
+const keyword_t *keywords_find(const char *text, size_t len);
+
+#endif
@@ -1,71 +1,144 @@
 /* This file is part of OpenU's C project implementation, called assembler
  * Copyright (C) 2020 Arthur Zamarin, Norel Farjun */
 
-#include <stdlib.h>
 #include <string.h>
 
 #include "labels_list.h"
 #include "parser.h"
 
-labels_list_t labels_list_new(void) {
-    return NULL;
+/** initial slots count of the hash table, must be a power of 2 */
+#define LABELS_TABLE_INITIAL_CAPACITY 64
+
+labels_list_t labels_list_new(arena_t *arena) {
+    labels_list_t list = {NULL, NULL, NULL, 0, NULL, 0, 0, 0, 0, NULL};
+    list.arena = arena;
+    return list;
 }
 
-void labels_list_dealloc(labels_list_t *list) {
-    labels_list_node_t *iter = *list, *tmp;
-    while (iter) {
-        tmp = iter->next;
-        free (iter);
-        iter = tmp;
-    }
+/**
+ * calculate FNV-1a hash of the {label} string of {len} characters
+ */
+static uint32_t labels_list_hash(const char *label, size_t len) {
+    uint32_t hash = 2166136261U;
+    for (; len; --len, ++label)
+        hash = (hash ^ (uint8_t)*label) * 16777619U;
+    return hash;
 }
 
 /**
  * allocate a new node and put the {label} tightly at the end
  * also default sets needed variables
  */
-static labels_list_node_t *labels_list_node_alloc(const char *label) {
-    size_t len = strlen(label);
-    labels_list_node_t *node = malloc(sizeof(labels_list_node_t) + len + 1);
+static labels_list_node_t *labels_list_node_alloc(arena_t *arena, const char *label, size_t len, uint32_t hash) {
+    labels_list_node_t *node = arena_alloc(arena, sizeof(labels_list_node_t) + len + 1);
     if (node) {
         node->next = NULL;
+        node->hash = hash;
         node->isSet = FALSE;
         node->isExtr = FALSE;
         node->isEntr = FALSE;
-        memcpy((char *)node + sizeof(labels_list_node_t), label, len + 1);
+        memcpy((char *)node + sizeof(labels_list_node_t), label, len);
+        ((char *)node + sizeof(labels_list_node_t))[len] = '\0';
     }
     return node;
 }
 
-labels_list_node_t *labels_list_get_label(labels_list_t *list, const char *label) {
-    labels_list_node_t *iter, *prev = NULL;
-    if (!*list)
-        return (*list = labels_list_node_alloc(label));
-    for (iter = *list; iter; prev = iter, iter = iter->next)
-        if (!strcmp(labels_listnode_get_label(iter), label))
-            return iter;
-    return (prev->next = labels_list_node_alloc(label));
+/**
+ * resize the hash table of {list} to {capacity} slots and reinsert all the nodes
+ * the old table stays in the arena, the tables sum is bounded by twice the last one
+ * return false if allocation failed, in which case the old table is kept
+ */
+static BOOL labels_list_rehash(labels_list_t *list, unsigned capacity) {
+    labels_list_node_t *iter, **table = arena_alloc(list->arena, capacity * sizeof(labels_list_node_t *));
+    if (!table)
+        return FALSE;
+    memset(table, 0, capacity * sizeof(labels_list_node_t *));
+    for (iter = list->head; iter; iter = iter->next) {
+        unsigned slot = iter->hash & (capacity - 1);
+        while (table[slot])
+            slot = (slot + 1) & (capacity - 1);
+        table[slot] = iter;
+    }
+    list->table = table;
+    list->capacity = capacity;
+    return TRUE;
+}
+
+/**
+ * make room in the ids index of {list} for one more node, doubling it when full
+ * return false if allocation failed
+ */
+static BOOL labels_list_grow_nodes(labels_list_t *list) {
+    labels_list_node_t **nodes;
+    const unsigned capacity = list->nodes_capacity ? 2 * list->nodes_capacity : LABELS_TABLE_INITIAL_CAPACITY;
+    if (list->count < list->nodes_capacity)
+        return TRUE;
+    if (!(nodes = arena_realloc(list->arena, list->nodes, list->nodes_capacity * sizeof(labels_list_node_t *),
+                                capacity * sizeof(labels_list_node_t *))))
+        return FALSE;
+    list->nodes = nodes;
+    list->nodes_capacity = capacity;
+    return TRUE;
+}
+
+labels_list_node_t *labels_list_get_label(labels_list_t *list, const char *label, size_t len) {
+    const uint32_t hash = labels_list_hash(label, len);
+    labels_list_node_t *node;
+    unsigned slot;
+
+    /* keep load factor under 1/2, so probe sequences stay short */
+    if (2 * (list->count + 1) > list->capacity &&
+            !labels_list_rehash(list, list->capacity ? 2 * list->capacity : LABELS_TABLE_INITIAL_CAPACITY))
+        return NULL;
+
+    ++list->lookups;
+    for (slot = hash & (list->capacity - 1); (node = list->table[slot]); slot = (slot + 1) & (list->capacity - 1)) {
+        ++list->probes;
+        if (node->hash == hash && !strncmp(labels_listnode_get_label(node), label, len) && (labels_listnode_get_label(node))[len] == '\0')
+            return node;
+    }
+
+    if (!labels_list_grow_nodes(list) || !(node = labels_list_node_alloc(list->arena, label, len, hash)))
+        return NULL;
+    node->id = list->count;
+    list->nodes[list->count++] = node;
+    list->table[slot] = node;
+    if (list->head == NULL)
+        list->head = node;
+    else
+        list->tail->next = node;
+    list->tail = node;
+    return node;
 }
 
-BOOL labels_list_check_and_fix(labels_list_t *list, unsigned codeseg_size) {
+BOOL labels_list_check_and_fix(labels_list_t *list, unsigned codeseg_size, uint32_t addr_mask, FILE *err_stream) {
     labels_list_node_t *iter;
     BOOL flag = TRUE;
-    for (iter = *list; iter; iter = iter->next) {
+    for (iter = list->head; iter; iter = iter->next) {
         if (!iter->isSet) {
             flag = FALSE;
-            fprintf(ERR_STREAM, "address for label \'%s\' not found in assembly file\n", labels_listnode_get_label(iter));
+            fprintf(err_stream, "address for label \'%s\' not found in assembly file\n", labels_listnode_get_label(iter));
         } else if (iter->isExtr);
         else if (iter->isDS)
-            iter->addr += OUTPUT_OBJECT_CODE_START + codeseg_size;
+            iter->addr = (iter->addr + OUTPUT_OBJECT_CODE_START + codeseg_size) & addr_mask;
         else
-            iter->addr += OUTPUT_OBJECT_CODE_START;
+            iter->addr = (iter->addr + OUTPUT_OBJECT_CODE_START) & addr_mask;
     }
     return flag;
 }
 
-void labels_list_output_entries(labels_list_t *list, FILE *entries_file) {
+size_t labels_list_entries_len(labels_list_t *list) {
+    labels_list_node_t *iter;
+    size_t len = 0;
+    for (iter = list->head; iter; iter = iter->next)
+        if (iter->isEntr)
+            len += OUTBUF_SYMBOL_LEN(strlen(labels_listnode_get_label(iter)), iter->addr);
+    return len;
+}
+
+void labels_list_output_entries(labels_list_t *list, outbuf_t *entries) {
     labels_list_node_t *iter;
-    for (iter = *list; iter; iter = iter->next)
+    for (iter = list->head; iter; iter = iter->next)
         if (iter->isEntr)
-            fprintf(entries_file, ENTRIES_FILE_OUTPUT_FORMAT, labels_listnode_get_label(iter), iter->addr);
+            outbuf_put_symbol(entries, labels_listnode_get_label(iter), strlen(labels_listnode_get_label(iter)), iter->addr);
 }
@@ -8,15 +8,19 @@
 #include <stdint.h>
 
 #include "global.h"
+#include "arena.h"
+#include "outbuf.h"
 
 /**
  * Holds information about a one label
  * Note that the label string goes tightly after the node itself - use labels_listnode_get_label to the the label string
- * Also acts as a node in the linked list
+ * Also acts as a node in the linked list, which keeps the insertion order
  */
 typedef struct labels_list_node {
     struct labels_list_node *next;
-    unsigned addr  :12; /* relative address to the segment */
+    uint32_t hash;      /* hash of the label string, kept for rehashing */
+    unsigned id;        /* stable id of the label, by order of first appearance */
+    uint32_t addr;      /* relative address to the segment, absolute after labels_list_check_and_fix */
     unsigned isSet :1;  /* was the node already set */
     unsigned isDS  :1;  /* is in data segment, otherwise code segment */
     unsigned isExtr:1;  /* is external label */
@@ -24,36 +28,65 @@ typedef struct labels_list_node {
     /* here goes tightly the label */
 } labels_list_node_t;
 
+/** mask of the label addresses by default, which wrap at the 12 bits of a label operand (DATA_LABEL_RANGE) */
+#define LABELS_LIST_ADDR_MASK 0xFFFU
+/** mask of the label addresses in large-program mode, which never wrap */
+#define LABELS_LIST_LARGE_ADDR_MASK 0xFFFFFFFFUL
+
 /**
  * return the label's string from {node}
  */
 #define labels_listnode_get_label(node) (const char *)((const uint8_t *)(node) + sizeof(labels_list_node_t))
 
-typedef labels_list_node_t *labels_list_t;
 /**
- * create and return a new labels_list_t structure
+ * Holds all the labels of one assembly file.
+ * Every label is interned once: the nodes are chained by order of first appearance (for deterministic
+ * output), and indexed by an open addressing hash table (linear probing) for the lookups.
  */
-labels_list_t labels_list_new(void);
+typedef struct {
+    labels_list_node_t *head;
+    labels_list_node_t *tail;
+    labels_list_node_t **table; /* hash table of node pointers, NULL is empty slot */
+    unsigned capacity;          /* slots count in {table}, always a power of 2 */
+    labels_list_node_t **nodes; /* all the nodes, indexed by their id */
+    unsigned nodes_capacity;    /* slots count in {nodes} */
+    unsigned count;             /* count of labels in list */
+    unsigned long lookups;      /* count of labels_list_get_label calls, for statistics */
+    unsigned long probes;       /* count of nodes compared by all the lookups, for statistics */
+    arena_t *arena;             /* memory source for nodes and table */
+} labels_list_t;
+
 /**
- * free and clean the {list} structure
+ * create and return a new labels_list_t structure, which allocates from {arena}
+ * all the memory is owned by {arena}, so there is no dealloc function
  */
-void labels_list_dealloc(labels_list_t *list);
+labels_list_t labels_list_new(arena_t *arena);
 
 /**
- * search {list} structure for label matching {label} and return it if found
+ * search {list} structure for label matching {label} of {len} characters and return it if found
  *     if not found, create new unset node and return it.
  * Always returns a node, which is promised to not change it address until deallocation
  */
-labels_list_node_t *labels_list_get_label(labels_list_t *list, const char *label);
+labels_list_node_t *labels_list_get_label(labels_list_t *list, const char *label, size_t len);
 
 /**
- * check for correct address for every label in {list} structure
- * also fixes the relative segment addressing to absolute addressing using {codeseg_size}
+ * return the node of {list} whose id is {id}, which must be an id of an existing node
+ */
+#define labels_list_get_by_id(list, id) ((list)->nodes[id])
+
+/**
+ * check for correct address for every label in {list} structure, errors are outputted into {err_stream}
+ * also fixes the relative segment addressing to absolute addressing using {codeseg_size}, wrapped by {addr_mask}
+ */
+BOOL labels_list_check_and_fix(labels_list_t *list, unsigned codeseg_size, uint32_t addr_mask, FILE *err_stream);
+/**
+ * return the length of the entries file for {list}
  */
-BOOL labels_list_check_and_fix(labels_list_t *list, unsigned codeseg_size);
+size_t labels_list_entries_len(labels_list_t *list);
 /**
- * output all labels in {list} structure marked as entry into {entries_file}
+ * output all labels in {list} structure marked as entry into {entries}
+ * {entries} must have room for all the records
  */
-void labels_list_output_entries(labels_list_t *list, FILE *entries_file);
+void labels_list_output_entries(labels_list_t *list, outbuf_t *entries);
 
 #endif
@@ -0,0 +1,166 @@
+/* This file is part of OpenU's C project implementation, called assembler
+ * Copyright (C) 2020 Arthur Zamarin, Norel Farjun */
+
+#include "lexer.h"
+
+#include <string.h>
+#include <limits.h>
+
+#define S LEX_SPACE
+#define A LEX_ALPHA
+#define D LEX_DIGIT
+#define W LEX_WORD
+#define V LEX_VALUE
+#define G LEX_GRAPH
+const unsigned char g_lexer_classes[256] = {
+    0      , V|G    , V|G    , V|G    , V|G    , V|G    , V|G    , V|G,
+    V|G    , S      , S      , S|V    , S|V    , S|V    , V|G    , V|G,
+    V|G    , V|G    , V|G    , V|G    , V|G    , V|G    , V|G    , V|G,
+    V|G    , V|G    , V|G    , V|G    , V|G    , V|G    , V|G    , V|G,
+    S      , V|G    , V|G    , W|V|G  , V|G    , V|G    , V|G    , V|G,
+    V|G    , V|G    , W|V|G  , V|G    , G      , W|V|G  , V|G    , V|G,
+    D|W|V|G, D|W|V|G, D|W|V|G, D|W|V|G, D|W|V|G, D|W|V|G, D|W|V|G, D|W|V|G,
+    D|W|V|G, D|W|V|G, V|G    , V|G    , V|G    , V|G    , V|G    , V|G,
+    V|G    , A|W|V|G, A|W|V|G, A|W|V|G, A|W|V|G, A|W|V|G, A|W|V|G, A|W|V|G,
+    A|W|V|G, A|W|V|G, A|W|V|G, A|W|V|G, A|W|V|G, A|W|V|G, A|W|V|G, A|W|V|G,
+    A|W|V|G, A|W|V|G, A|W|V|G, A|W|V|G, A|W|V|G, A|W|V|G, A|W|V|G, A|W|V|G,
+    A|W|V|G, A|W|V|G, A|W|V|G, V|G    , V|G    , V|G    , V|G    , V|G,
+    V|G    , A|W|V|G, A|W|V|G, A|W|V|G, A|W|V|G, A|W|V|G, A|W|V|G, A|W|V|G,
+    A|W|V|G, A|W|V|G, A|W|V|G, A|W|V|G, A|W|V|G, A|W|V|G, A|W|V|G, A|W|V|G,
+    A|W|V|G, A|W|V|G, A|W|V|G, A|W|V|G, A|W|V|G, A|W|V|G, A|W|V|G, A|W|V|G,
+    A|W|V|G, A|W|V|G, A|W|V|G, V|G    , V|G    , V|G    , V|G    , V|G,
+    V|G    , V|G    , V|G    , V|G    , V|G    , V|G    , V|G    , V|G,
+    V|G    , V|G    , V|G    , V|G    , V|G    , V|G    , V|G    , V|G,
+    V|G    , V|G    , V|G    , V|G    , V|G    , V|G    , V|G    , V|G,
+    V|G    , V|G    , V|G    , V|G    , V|G    , V|G    , V|G    , V|G,
+    V|G    , V|G    , V|G    , V|G    , V|G    , V|G    , V|G    , V|G,
+    V|G    , V|G    , V|G    , V|G    , V|G    , V|G    , V|G    , V|G,
+    V|G    , V|G    , V|G    , V|G    , V|G    , V|G    , V|G    , V|G,
+    V|G    , V|G    , V|G    , V|G    , V|G    , V|G    , V|G    , V|G,
+    V|G    , V|G    , V|G    , V|G    , V|G    , V|G    , V|G    , V|G,
+    V|G    , V|G    , V|G    , V|G    , V|G    , V|G    , V|G    , V|G,
+    V|G    , V|G    , V|G    , V|G    , V|G    , V|G    , V|G    , V|G,
+    V|G    , V|G    , V|G    , V|G    , V|G    , V|G    , V|G    , V|G,
+    V|G    , V|G    , V|G    , V|G    , V|G    , V|G    , V|G    , V|G,
+    V|G    , V|G    , V|G    , V|G    , V|G    , V|G    , V|G    , V|G,
+    V|G    , V|G    , V|G    , V|G    , V|G    , V|G    , V|G    , V|G,
+    V|G    , V|G    , V|G    , V|G    , V|G    , V|G    , V|G    , V|G,
+};
+#undef S
+#undef A
+#undef D
+#undef W
+#undef V
+#undef G
+
+lexer_t lexer_new(line_view_t line) {
+    lexer_t lex;
+    lex.ptr = line.ptr;
+    lex.end = line.ptr + line.len;
+    return lex;
+}
+
+void lexer_skip_spaces(lexer_t *lex) {
+    while (lex->ptr != lex->end && LEXER_IS(*lex->ptr, LEX_SPACE))
+        lex->ptr++;
+}
+
+line_view_t lexer_take_run(lexer_t *lex, unsigned classes) {
+    line_view_t res;
+    res.ptr = lex->ptr;
+    while (lex->ptr != lex->end && LEXER_IS(*lex->ptr, classes))
+        lex->ptr++;
+    res.len = (size_t)(lex->ptr - res.ptr);
+    return res;
+}
+
+BOOL lexer_take_char(lexer_t *lex, char ch) {
+    if (lex->ptr == lex->end || *lex->ptr != ch)
+        return FALSE;
+    lex->ptr++;
+    return TRUE;
+}
+
+void lexer_scan_statement(line_view_t line, BOOL has_colon, BOOL has_dot, lexer_statement_t *stmt) {
+    lexer_t lex = lexer_new(line);
+
+    lexer_skip_spaces(&lex);
+    stmt->label.len = 0;
+    if (has_colon) {
+        stmt->label = lexer_take_run(&lex, LEX_ALNUM);
+        lexer_skip_spaces(&lex);
+        if (stmt->label.len == 0 || !lexer_take_char(&lex, ':')) {
+            /* not a label, restart */
+            stmt->label.len = 0;
+            lex = lexer_new(line);
+        }
+        lexer_skip_spaces(&lex);
+    }
+
+    stmt->rest = lex;
+    stmt->directive.len = 0;
+    if (has_dot && lexer_take_char(&lex, '.')) {
+        stmt->directive = lexer_take_run(&lex, LEX_ALNUM);
+        if (stmt->directive.len) {
+            lexer_skip_spaces(&lex);
+            stmt->rest = lex;
+        }
+    }
+}
+
+unsigned lexer_scan_instruction(lexer_t *lex, line_view_t words[LEXER_INSTRUCTION_WORDS]) {
+    lexer_skip_spaces(lex);
+    if ((words[0] = lexer_take_run(lex, LEX_WORD)).len == 0)
+        return 0;
+    lexer_skip_spaces(lex);
+    if ((words[1] = lexer_take_run(lex, LEX_WORD)).len == 0)
+        return 1;
+    lexer_skip_spaces(lex);
+    if (!lexer_take_char(lex, ','))
+        return 2;
+    lexer_skip_spaces(lex);
+    if ((words[2] = lexer_take_run(lex, LEX_WORD)).len == 0)
+        return 2;
+    lexer_skip_spaces(lex);
+    if ((words[3] = lexer_take_run(lex, LEX_GRAPH)).len == 0)
+        return 3;
+    return 4;
+}
+
+BOOL lexer_parse_number(line_view_t text, long *value) {
+    const char *ptr = text.ptr, *end = text.ptr + text.len, *digits;
+    BOOL negative = FALSE;
+    unsigned long res = 0;
+    const unsigned long limit = (unsigned long)LONG_MAX;
+
+    if (ptr != end && (*ptr == '-' || *ptr == '+'))
+        negative = (*ptr++ == '-');
+    for (digits = ptr; ptr != end && LEXER_IS(*ptr, LEX_DIGIT); ++ptr) {
+        const unsigned digit = (unsigned)(*ptr - '0');
+        /* saturate, while allowing the magnitude of LONG_MIN */
+        if (res > (limit + negative - digit) / 10)
+            res = limit + negative;
+        else
+            res = res * 10 + digit;
+    }
+    if (ptr == digits) {
+        *value = 0;
+        return text.len == 0;
+    } else if (ptr != end)
+        return FALSE;
+
+    if (!negative)
+        *value = (long)res;
+    else if (res > limit)
+        *value = LONG_MIN;
+    else
+        *value = -(long)res;
+    return TRUE;
+}
+
+int lexer_compare(line_view_t text, const char *str) {
+    int res = strncmp(text.ptr, str, text.len);
+    if (res == 0 && str[text.len] != '\0')
+        return -1; /* {text} is a prefix of {str} */
+    return res;
+}
@@ -0,0 +1,94 @@
+/* This file is part of OpenU's C project implementation, called assembler
+ * Copyright (C) 2020 Arthur Zamarin, Norel Farjun */
+
+#ifndef ASM_LEXER_H
+#define ASM_LEXER_H
+
+#include "global.h"
+#include "source.h"
+
+/**
+ * Characters classes, as bit flags. The classes are fixed ASCII ones and don't depend on locale.
+ */
+enum lexer_char_class {
+    LEX_SPACE   = 0x01, /* white space */
+    LEX_ALPHA   = 0x02, /* letter */
+    LEX_DIGIT   = 0x04, /* decimal digit */
+    LEX_WORD    = 0x08, /* letter, digit or one of "-#*" - allowed inside instruction's words */
+    LEX_VALUE   = 0x10, /* anything except ',', space, tab and newline - allowed inside data values */
+    LEX_GRAPH   = 0x20, /* anything except white space */
+    LEX_NONE    = 0x00,
+
+    LEX_ALNUM   = LEX_ALPHA | LEX_DIGIT
+};
+
+extern const unsigned char g_lexer_classes[256];
+/** check if {ch} belongs to at least one of {classes} */
+#define LEXER_IS(ch, classes) (g_lexer_classes[(unsigned char)(ch)] & (classes))
+
+/**
+ * Cursor over one line
+ */
+typedef struct {
+    const char *ptr;
+    const char *end;
+} lexer_t;
+
+/**
+ * Result of scanning the start of a statement line
+ */
+typedef struct {
+    line_view_t label;     /* defined label, empty if none */
+    line_view_t directive; /* directive name without the dot, empty if it is an instruction */
+    lexer_t rest;          /* the rest of the line, after the label and the directive */
+} lexer_statement_t;
+
+/** count of words lexer_scan_instruction may find */
+#define LEXER_INSTRUCTION_WORDS 4
+
+/**
+ * create a cursor at the start of {line}
+ */
+lexer_t lexer_new(line_view_t line);
+/** is the cursor {lex} at end of line */
+#define lexer_at_end(lex) ((lex)->ptr == (lex)->end)
+/**
+ * advance {lex} over white spaces
+ */
+void lexer_skip_spaces(lexer_t *lex);
+/**
+ * advance {lex} over all the characters belonging to {classes}, and return the view of them
+ */
+line_view_t lexer_take_run(lexer_t *lex, unsigned classes);
+/**
+ * advance {lex} over {ch} if it is the current character
+ * return true if it was advanced
+ */
+BOOL lexer_take_char(lexer_t *lex, char ch);
+
+/**
+ * split the start of {line} into the label definition, the directive name and the rest of the line
+ * a label is an alphanumeric word followed by ':', and a directive is '.' followed by alphanumeric word
+ * {has_colon} and {has_dot} tell whether those characters appear in the line at all
+ */
+void lexer_scan_statement(line_view_t line, BOOL has_colon, BOOL has_dot, lexer_statement_t *stmt);
+/**
+ * split instruction {lex} into {words}: the opcode, first operand, second operand (after a comma)
+ *     and anything that comes after those
+ * return the count of the words found, scanning stops at the first word which is missing or malformed
+ */
+unsigned lexer_scan_instruction(lexer_t *lex, line_view_t words[LEXER_INSTRUCTION_WORDS]);
+
+/**
+ * convert decimal number {text} into {value} - optional sign followed by digits
+ * an empty {text} is converted to zero, and too big numbers are saturated to the long range
+ * return false if {text} isn't a number
+ */
+BOOL lexer_parse_number(line_view_t text, long *value);
+
+/**
+ * compare {text} with zero terminated string {str}, return the sign like strcmp
+ */
+int lexer_compare(line_view_t text, const char *str);
+
+#endif
@@ -0,0 +1,387 @@
+/* This file is part of OpenU's C project implementation, called assembler
+ * Copyright (C) 2020 Arthur Zamarin, Norel Farjun */
+
+/*
+ * Linker of many assembled modules into a single image:
+ *     linker [-o output] [--binary] module...
+ * Every module is a basename of text object files (.ob, and .ent and .ext if they exist), or a path of a
+ * binary object file (.obb).
+ *
+ * The code segments of all modules are placed one after the other from OUTPUT_OBJECT_CODE_START, followed by
+ * all the data segments in the same order. Every relocatable operand is moved into its module's new place, and
+ * every external use site is patched with the address of the matching entry, looked up in a hash table of all
+ * the entries. The output is a single object file with no externals, with an entries file of all the entries.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "global.h"
+#include "objfile.h"
+#include "opcodes.h"
+#include "instructions_list.h"
+#include "parser.h"
+
+#define LINKER_DEFAULT_OUTPUT "a"
+
+/**
+ * One input module and its place in the linked image
+ */
+typedef struct {
+    const char *name;
+    objfile_t obj;
+    BOOL loaded;
+    unsigned code_base; /* linked address of the first code word */
+    unsigned data_base; /* linked address of the first data word */
+} link_module_t;
+
+/**
+ * Entry in the global symbols table, empty when {name} is NULL
+ */
+typedef struct {
+    const char *name;
+    unsigned addr;
+    const link_module_t *module;
+} link_symbol_t;
+
+/**
+ * Global symbols table, open addressing with linear probing over a power of two capacity
+ */
+typedef struct {
+    link_symbol_t *slots;
+    unsigned long mask;
+} link_symtab_t;
+
+/**
+ * return the FNV-1a hash of {name}
+ */
+static unsigned long link_hash(const char *name) {
+    unsigned long hash = 2166136261UL;
+    for (; *name; ++name)
+        hash = ((hash ^ (unsigned char)*name) * 16777619UL) & 0xffffffffUL;
+    return hash;
+}
+
+/**
+ * allocate {tab} for up to {cnt} symbols, keeping it at most half full
+ * return false if out of memory
+ */
+static BOOL link_symtab_init(link_symtab_t *tab, unsigned long cnt) {
+    unsigned long capacity = 16;
+    while (capacity < 2 * cnt)
+        capacity *= 2;
+    tab->mask = capacity - 1;
+    return (tab->slots = calloc(capacity, sizeof(link_symbol_t))) != NULL;
+}
+
+/**
+ * return the slot of {name} in {tab}, which is empty if there is no such symbol
+ */
+static link_symbol_t *link_symtab_find(const link_symtab_t *tab, const char *name) {
+    unsigned long i = link_hash(name) & tab->mask;
+    while (tab->slots[i].name && strcmp(tab->slots[i].name, name))
+        i = (i + 1) & tab->mask;
+    return tab->slots + i;
+}
+
+/**
+ * return true if {path} ends with {suffix}
+ */
+static BOOL link_has_suffix(const char *path, const char *suffix) {
+    const size_t len = strlen(path), suffix_len = strlen(suffix);
+    return len >= suffix_len && !strcmp(path + len - suffix_len, suffix);
+}
+
+/**
+ * translate the module's address {addr} into its linked address {linked}
+ * return false if {addr} is outside the module's segments
+ */
+static BOOL link_relocate(const link_module_t *module, unsigned long addr, unsigned *linked) {
+    const objfile_t *obj = &module->obj;
+    if (addr < obj->code_start || addr >= (unsigned long)obj->code_start + obj->code_size + obj->data_size)
+        return FALSE;
+    addr -= obj->code_start;
+    *linked = (unsigned)(addr < obj->code_size ? module->code_base + addr : module->data_base + (addr - obj->code_size));
+    return TRUE;
+}
+
+/**
+ * return the linked operand word for the operand {word} of {module} at its address {addr}, which is accessed
+ * by {access}, or a negative number on error
+ * external operands are left for the patching, and counted into {externals}
+ */
+static long link_operand(const link_module_t *module, unsigned word, unsigned addr, unsigned access,
+                         unsigned *externals) {
+    unsigned linked;
+    if (access != OPERAND_LABEL)
+        return word;
+    switch (BITS_GET(DATA_ARE_RANGE, word)) {
+        case INST_ARE_EXTERNAL:
+            ++*externals;
+            return word;
+        case INST_ARE_RELETIVE:
+            if (!link_relocate(module, BITS_GET(DATA_LABEL_RANGE, word), &linked)) {
+                fprintf(ERR_STREAM, "%s: label address out of the module at %04u\n", module->name, addr);
+                return -1;
+            }
+            if (!BITS_IS_IN_RANGE(DATA_LABEL_RANGE, (long)linked)) {
+                fprintf(ERR_STREAM, "%s: linked address %u doesn't fit the operand at %04u\n", module->name, linked, addr);
+                return -1;
+            }
+            BITS_SET(DATA_LABEL_RANGE, word, linked);
+            return word;
+        default:
+            fprintf(ERR_STREAM, "%s: bad label operand at %04u\n", module->name, addr);
+            return -1;
+    }
+}
+
+/**
+ * copy the code segment of {module} into {out}, decoding the instructions to relocate their label operands
+ * return the count of external operands, or a negative number on error
+ */
+static long link_code(const link_module_t *module, objfile_t *out) {
+    const objfile_t *obj = &module->obj;
+    const unsigned out_index = module->code_base - out->code_start;
+    unsigned i, j, word, src, dst, accesses[MAX_CNT_OPERAND], cnt, externals = 0;
+    long operand;
+
+    for (i = 0; i < obj->code_size; i += 1 + cnt) {
+        word = objfile_word(obj, i);
+        src = BITS_GET(INST_OPR2_ACCS_RANGE, word);
+        dst = BITS_GET(INST_OPR1_ACCS_RANGE, word);
+        if (src >= OPERAND_ACCESS_RANGE || dst >= OPERAND_ACCESS_RANGE ||
+                OPCODE_ENCODE(BITS_GET(INST_OPCODE_RANGE, word), src, dst) != word) {
+            fprintf(ERR_STREAM, "%s: bad command word at %04u\n", module->name, obj->code_start + i);
+            return -1;
+        }
+        /* the operand words follow in the order src, dst, and two register operands share one word */
+        cnt = 0;
+        if ((src & OPERAND_ALL_REG) && (dst & OPERAND_ALL_REG))
+            accesses[cnt++] = OPERAND_REG;
+        else {
+            if (src != OPERAND_NONE)
+                accesses[cnt++] = src;
+            if (dst != OPERAND_NONE)
+                accesses[cnt++] = dst;
+        }
+        if (i + cnt >= obj->code_size) {
+            fprintf(ERR_STREAM, "%s: truncated instruction at %04u\n", module->name, obj->code_start + i);
+            return -1;
+        }
+        objfile_set_word(out, out_index + i, word);
+        for (j = 0; j < cnt; ++j) {
+            operand = link_operand(module, objfile_word(obj, i + 1 + j), obj->code_start + i + 1 + j, accesses[j],
+                                   &externals);
+            if (operand < 0)
+                return -1;
+            objfile_set_word(out, out_index + i + 1 + j, (unsigned)operand);
+        }
+    }
+    return externals;
+}
+
+/**
+ * link {module} into {out}: copy its segments, relocate them and patch its external use sites from {tab}
+ * return false on any error, after printing it
+ */
+static BOOL link_module(const link_module_t *module, const link_symtab_t *tab, objfile_t *out) {
+    const objfile_t *obj = &module->obj;
+    const link_symbol_t *symbol;
+    const char *name;
+    unsigned i, site, index, word;
+    long externals;
+    BOOL res = TRUE;
+
+    if ((externals = link_code(module, out)) < 0)
+        return FALSE;
+    for (i = 0; i < obj->data_size; ++i)
+        objfile_set_word(out, module->data_base - out->code_start + i, objfile_word(obj, obj->code_size + i));
+
+    if ((unsigned long)externals != obj->externals_cnt) {
+        fprintf(ERR_STREAM, "%s: %lu external operands, but %u external records\n", module->name,
+                (unsigned long)externals, obj->externals_cnt);
+        return FALSE;
+    }
+    for (i = 0; i < obj->externals_cnt; ++i) {
+        name = objfile_symbol(obj, obj->entries_cnt + i, &site);
+        index = site - obj->code_start;
+        if (site < obj->code_start || index >= obj->code_size ||
+                BITS_GET(DATA_ARE_RANGE, word = objfile_word(obj, index)) != INST_ARE_EXTERNAL) {
+            fprintf(ERR_STREAM, "%s: external \'%s\' at %04u isn't an external operand\n", module->name, name, site);
+            res = FALSE;
+        } else if (!(symbol = link_symtab_find(tab, name))->name) {
+            fprintf(ERR_STREAM, "%s: unresolved external \'%s\' at %04u\n", module->name, name, site);
+            res = FALSE;
+        } else if (!BITS_IS_IN_RANGE(DATA_LABEL_RANGE, (long)symbol->addr)) {
+            fprintf(ERR_STREAM, "%s: linked address %u of \'%s\' doesn't fit the operand at %04u\n", module->name,
+                    symbol->addr, name, site);
+            res = FALSE;
+        } else {
+            word = 0;
+            BITS_SET(DATA_ARE_RANGE, word, INST_ARE_RELETIVE);
+            BITS_SET(DATA_LABEL_RANGE, word, symbol->addr);
+            objfile_set_word(out, module->code_base - out->code_start + index, word);
+        }
+    }
+    return res;
+}
+
+/**
+ * place all {cnt} {modules}, and collect their entries into {tab}
+ * set the total sizes into {code_size}, {data_size}, {entries_cnt} and {strings_size}
+ * return false on any error, after printing it
+ */
+static BOOL link_layout(link_module_t *modules, unsigned cnt, link_symtab_t *tab, unsigned long *code_size,
+                        unsigned long *data_size, unsigned long *entries_cnt, size_t *strings_size) {
+    link_symbol_t *symbol;
+    const char *name;
+    unsigned i, j, addr;
+    BOOL res = TRUE;
+
+    tab->slots = NULL;
+    *code_size = *data_size = *entries_cnt = 0;
+    *strings_size = 0;
+    for (i = 0; i < cnt; ++i) {
+        *code_size += modules[i].obj.code_size;
+        *data_size += modules[i].obj.data_size;
+        *entries_cnt += modules[i].obj.entries_cnt;
+    }
+    if (OUTPUT_OBJECT_CODE_START + *code_size + *data_size > 0xffffffffUL) {
+        fprintf(ERR_STREAM, "linked image is too large\n");
+        return FALSE;
+    }
+    if (!link_symtab_init(tab, *entries_cnt)) {
+        fprintf(ERR_STREAM, "out of memory\n");
+        return FALSE;
+    }
+
+    modules[0].code_base = OUTPUT_OBJECT_CODE_START;
+    modules[0].data_base = (unsigned)(OUTPUT_OBJECT_CODE_START + *code_size);
+    for (i = 0; i < cnt; ++i) {
+        if (i) {
+            modules[i].code_base = modules[i - 1].code_base + modules[i - 1].obj.code_size;
+            modules[i].data_base = modules[i - 1].data_base + modules[i - 1].obj.data_size;
+        }
+        for (j = 0; j < modules[i].obj.entries_cnt; ++j) {
+            name = objfile_symbol(&modules[i].obj, j, &addr);
+            if (!link_relocate(modules + i, addr, &addr)) {
+                fprintf(ERR_STREAM, "%s: entry \'%s\' is out of the module\n", modules[i].name, name);
+                res = FALSE;
+            } else if ((symbol = link_symtab_find(tab, name))->name) {
+                fprintf(ERR_STREAM, "%s: entry \'%s\' is already defined in \'%s\'\n", modules[i].name, name,
+                        symbol->module->name);
+                res = FALSE;
+            } else {
+                symbol->name = name;
+                symbol->addr = addr;
+                symbol->module = modules + i;
+                *strings_size += strlen(name) + 1;
+            }
+        }
+    }
+    return res;
+}
+
+/**
+ * link all {cnt} loaded {modules} into the object files of {output}, and the binary one if {binary} is set
+ * return false on any error, after printing it
+ */
+static BOOL link_all(link_module_t *modules, unsigned cnt, const char *output, BOOL binary) {
+    link_symtab_t tab;
+    objfile_t out;
+    unsigned long code_size, data_size, entries_cnt;
+    size_t strings_size, offset = 0;
+    unsigned i, j, index = 0, addr;
+    const char *name;
+    char *path;
+    BOOL res;
+
+    if (!link_layout(modules, cnt, &tab, &code_size, &data_size, &entries_cnt, &strings_size)) {
+        free(tab.slots);
+        return FALSE;
+    }
+    if (!objfile_create(&out, OUTPUT_OBJECT_CODE_START, (unsigned)code_size, (unsigned)data_size,
+                        (unsigned)entries_cnt, 0, strings_size, entries_cnt ? OBJFILE_HAS_ENTRIES : 0)) {
+        fprintf(ERR_STREAM, "out of memory\n");
+        free(tab.slots);
+        return FALSE;
+    }
+
+    res = TRUE;
+    for (i = 0; i < cnt; ++i) {
+        res &= link_module(modules + i, &tab, &out);
+        for (j = 0; j < modules[i].obj.entries_cnt; ++j) {
+            name = objfile_symbol(&modules[i].obj, j, &addr);
+            if (link_relocate(modules + i, addr, &addr)) {
+                objfile_set_symbol(&out, index++, offset, name, addr);
+                offset += strlen(name) + 1;
+            }
+        }
+    }
+    free(tab.slots);
+
+    if (res) {
+        if (!(res = objfile_write_text(&out, output)))
+            fprintf(ERR_STREAM, "unable to write the object files of \'%s\'\n", output);
+        else if (binary) {
+            if (!(path = malloc(strlen(output) + MAX_LEN_EXTENSION + 1)))
+                res = FALSE;
+            else {
+                sprintf(path, "%s%s", output, OUTPUT_BINARY_EXTENSION);
+                res = objfile_write_binary(&out, path, FALSE);
+                free(path);
+            }
+            if (!res)
+                fprintf(ERR_STREAM, "unable to write the binary object file of \'%s\'\n", output);
+        }
+    }
+    objfile_close(&out);
+    return res;
+}
+
+int main(int argc, char *argv[]) {
+    const char *output = LINKER_DEFAULT_OUTPUT;
+    link_module_t *modules;
+    BOOL binary = FALSE, res = TRUE;
+    unsigned cnt = 0, i;
+    int arg;
+
+    if (!(modules = calloc((size_t)argc, sizeof(link_module_t)))) {
+        fprintf(ERR_STREAM, "out of memory\n");
+        return 1;
+    }
+    for (arg = 1; arg < argc; ++arg) {
+        if (!strcmp(argv[arg], "-o") && arg + 1 < argc)
+            output = argv[++arg];
+        else if (!strcmp(argv[arg], "--binary"))
+            binary = TRUE;
+        else if (argv[arg][0] == '-') {
+            fprintf(ERR_STREAM, "unknown option \'%s\'\n", argv[arg]);
+            res = FALSE;
+        } else
+            modules[cnt++].name = argv[arg];
+    }
+    if (res && cnt == 0) {
+        fprintf(ERR_STREAM, "usage: %s [-o output] [--binary] module...\n", argv[0]);
+        res = FALSE;
+    }
+
+    for (i = 0; res && i < cnt; ++i) {
+        modules[i].loaded = link_has_suffix(modules[i].name, OUTPUT_BINARY_EXTENSION) ?
+                            objfile_open_binary(&modules[i].obj, modules[i].name) :
+                            objfile_open_text(&modules[i].obj, modules[i].name);
+        if (!modules[i].loaded) {
+            fprintf(ERR_STREAM, "unable to load \'%s\'\n", modules[i].name);
+            res = FALSE;
+        }
+    }
+    res = res && link_all(modules, cnt, output, binary);
+
+    for (i = 0; i < cnt; ++i)
+        if (modules[i].loaded)
+            objfile_close(&modules[i].obj);
+    free(modules);
+    return !res;
+}
@@ -0,0 +1,259 @@
+/* This file is part of OpenU's C project implementation, called assembler
+ * Copyright (C) 2020 Arthur Zamarin, Norel Farjun */
+
+#include <string.h>
+
+#include "macro.h"
+#include "lexer.h"
+#include "keywords.h"
+
+/** initial slots count of the hash table, must be a power of 2 */
+#define MACRO_TABLE_INITIAL_CAPACITY 16
+/** initial count of body lines, the array doubles when full */
+#define MACRO_BODIES_INITIAL_CAPACITY 64
+
+/** printf arguments for printing {len} characters of {ptr} with "%.*s" */
+#define MACRO_NAME_ARGS(ptr, len) (int)(len), (ptr)
+
+void macro_expander_init(macro_expander_t *exp, const source_t *src, size_t max_line_len, arena_t *arena,
+                         FILE *err_stream) {
+    exp->scan = prescan_new(src, max_line_len);
+    exp->feed = NULL;
+    exp->feed_arg = NULL;
+    exp->data = src->data;
+    exp->err_stream = err_stream;
+    exp->arena = arena;
+    exp->table = NULL;
+    exp->capacity = exp->count = 0;
+    exp->bodies = NULL;
+    exp->bodies_size = exp->bodies_capacity = 0;
+    exp->is_defining = exp->is_defining_valid = FALSE;
+    exp->expanding = NULL;
+    exp->expanded = 0;
+    exp->pending_pos = exp->pending_cnt = 0;
+    exp->consumed = 0;
+    exp->is_ok = TRUE;
+}
+
+void macro_set_feed(macro_expander_t *exp, macro_feed_func feed, void *arg) {
+    exp->feed = feed;
+    exp->feed_arg = arg;
+}
+
+/**
+ * report the error {text} about line {linenum} with {name} of {len} characters, and fail {exp}
+ */
+static void macro_error(macro_expander_t *exp, unsigned linenum, const char *text, const char *name, size_t len) {
+    exp->is_ok = FALSE;
+    if (exp->err_stream)
+        fprintf(exp->err_stream, "%u: %s \'%.*s\'\n", linenum, text, MACRO_NAME_ARGS(name, len));
+}
+
+/**
+ * calculate FNV-1a hash of the {name} string of {len} characters
+ */
+static uint32_t macro_hash(const char *name, size_t len) {
+    uint32_t hash = 2166136261U;
+    for (; len; --len, ++name)
+        hash = (hash ^ (uint8_t)*name) * 16777619U;
+    return hash;
+}
+
+/**
+ * return the macro of {exp} named {name} of {len} characters, or NULL if there is none
+ */
+static const macro_t *macro_find(const macro_expander_t *exp, const char *name, size_t len) {
+    const uint32_t hash = macro_hash(name, len);
+    const macro_t *macro;
+    unsigned slot;
+    if (exp->count == 0)
+        return NULL;
+    for (slot = hash & (exp->capacity - 1); (macro = exp->table[slot]); slot = (slot + 1) & (exp->capacity - 1))
+        if (macro->hash == hash && macro->name_len == len && !memcmp(macro->name, name, len))
+            return macro;
+    return NULL;
+}
+
+/**
+ * add a copy of {macro} into the hash table of {exp}, growing it to keep the load factor under 1/2
+ * the old table stays in the arena, the tables sum is bounded by twice the last one
+ * return false if allocation failed
+ */
+static BOOL macro_insert(macro_expander_t *exp, const macro_t *macro) {
+    macro_t **table, *copy;
+    unsigned i, slot, capacity;
+
+    if (2 * (exp->count + 1) > exp->capacity) {
+        capacity = exp->capacity ? 2 * exp->capacity : MACRO_TABLE_INITIAL_CAPACITY;
+        if (!(table = arena_alloc(exp->arena, capacity * sizeof(macro_t *))))
+            return FALSE;
+        memset(table, 0, capacity * sizeof(macro_t *));
+        for (i = 0; i < exp->capacity; ++i)
+            if (exp->table[i]) {
+                for (slot = exp->table[i]->hash & (capacity - 1); table[slot]; slot = (slot + 1) & (capacity - 1));
+                table[slot] = exp->table[i];
+            }
+        exp->table = table;
+        exp->capacity = capacity;
+    }
+    if (!(copy = arena_alloc(exp->arena, sizeof(macro_t))))
+        return FALSE;
+    *copy = *macro;
+    for (slot = copy->hash & (exp->capacity - 1); exp->table[slot]; slot = (slot + 1) & (exp->capacity - 1));
+    exp->table[slot] = copy;
+    ++exp->count;
+    return TRUE;
+}
+
+/**
+ * append {count} {lines} to the body of the macro being defined in {exp}
+ * return false if allocation failed
+ */
+static BOOL macro_append_body(macro_expander_t *exp, const prescan_line_t *lines, size_t count) {
+    size_t capacity = exp->bodies_capacity ? exp->bodies_capacity : MACRO_BODIES_INITIAL_CAPACITY;
+    prescan_line_t *bodies;
+    if (exp->bodies_size + count > exp->bodies_capacity) {
+        while (capacity < exp->bodies_size + count)
+            capacity *= 2;
+        if (!(bodies = arena_realloc(exp->arena, exp->bodies, exp->bodies_capacity * sizeof(prescan_line_t),
+                                     capacity * sizeof(prescan_line_t))))
+            return FALSE;
+        exp->bodies = bodies;
+        exp->bodies_capacity = capacity;
+    }
+    memcpy(exp->bodies + exp->bodies_size, lines, count * sizeof(prescan_line_t));
+    exp->bodies_size += count;
+    exp->defining.count += count;
+    return TRUE;
+}
+
+/**
+ * handle the "mcro" of {line}, whose name starts at {lex}
+ */
+static void macro_begin(macro_expander_t *exp, const prescan_line_t *line, lexer_t *lex) {
+    BOOL is_valid = FALSE;
+    line_view_t name;
+
+    lexer_skip_spaces(lex);
+    name = lexer_take_run(lex, LEX_ALNUM);
+    lexer_skip_spaces(lex);
+    if (exp->is_defining) {
+        macro_error(exp, line->linenum, "nested definition of macro", name.ptr, name.len);
+        return;
+    }
+    if (name.len == 0 || !LEXER_IS(name.ptr[0], LEX_ALPHA) || !lexer_at_end(lex))
+        macro_error(exp, line->linenum, "bad macro definition", exp->data + line->start, line->len);
+    else if (keywords_find(name.ptr, name.len))
+        macro_error(exp, line->linenum, "macro name is a reserved word", name.ptr, name.len);
+    else if (macro_find(exp, name.ptr, name.len))
+        macro_error(exp, line->linenum, "macro is already defined", name.ptr, name.len);
+    else
+        is_valid = TRUE;
+
+    /* the body of a bad definition is still consumed, but it is never expanded */
+    exp->defining.name = name.ptr;
+    exp->defining.name_len = name.len;
+    exp->is_defining_valid = is_valid;
+    exp->defining.hash = macro_hash(exp->defining.name, exp->defining.name_len);
+    exp->defining.first = exp->bodies_size;
+    exp->defining.count = 0;
+    exp->defining_line = line->linenum;
+    exp->is_defining = TRUE;
+}
+
+/**
+ * handle the "endmcro" of {line}, followed by {lex}
+ */
+static void macro_end(macro_expander_t *exp, const prescan_line_t *line, lexer_t *lex) {
+    lexer_skip_spaces(lex);
+    if (!exp->is_defining) {
+        macro_error(exp, line->linenum, "no macro definition to end with", "endmcro", 7);
+        return;
+    }
+    if (!lexer_at_end(lex))
+        macro_error(exp, line->linenum, "extra text after", "endmcro", 7);
+    exp->is_defining = FALSE;
+    if (exp->is_defining_valid && !macro_insert(exp, &exp->defining))
+        macro_error(exp, line->linenum, "out of memory defining macro", exp->defining.name, exp->defining.name_len);
+}
+
+/**
+ * find the kind of {line}: a keyword_t of KW_MACRO for "mcro" and "endmcro" lines, with {lex} set after it
+ * otherwise NULL, with {*macro} set to the macro the line uses, or NULL for a statement
+ */
+static const keyword_t *macro_classify(const macro_expander_t *exp, const prescan_line_t *line, lexer_t *lex,
+                                       const macro_t **macro) {
+    const keyword_t *kw;
+    line_view_t view, word;
+
+    *macro = NULL;
+    view.ptr = exp->data + line->start;
+    view.len = line->len;
+    *lex = lexer_new(view);
+    word = lexer_take_run(lex, LEX_ALNUM);
+    /* a macro line is a word followed by spaces, anything else (like a label's colon) makes a statement */
+    if (word.len == 0 || (!lexer_at_end(lex) && !LEXER_IS(*lex->ptr, LEX_SPACE)))
+        return NULL;
+    if ((kw = keywords_find(word.ptr, word.len)) && kw->kind == KW_MACRO)
+        return kw;
+    lexer_skip_spaces(lex);
+    if (lexer_at_end(lex))
+        *macro = macro_find(exp, word.ptr, word.len);
+    return NULL;
+}
+
+size_t macro_next(macro_expander_t *exp, prescan_line_t *lines, size_t max_lines) {
+    size_t count = 0, chunk;
+    const prescan_line_t *line;
+    const keyword_t *kw;
+    const macro_t *macro;
+    lexer_t lex;
+
+    while (count < max_lines) {
+        if (exp->expanding) {
+            chunk = exp->expanding->count - exp->expanded;
+            if (chunk > max_lines - count)
+                chunk = max_lines - count;
+            memcpy(lines + count, exp->bodies + exp->expanding->first + exp->expanded, chunk * sizeof(prescan_line_t));
+            count += chunk;
+            if ((exp->expanded += chunk) == exp->expanding->count)
+                exp->expanding = NULL;
+            continue;
+        }
+        if (exp->pending_pos == exp->pending_cnt) {
+            exp->pending_pos = 0;
+            exp->pending_cnt = exp->feed ? exp->feed(exp->feed_arg, exp->pending, MACRO_LINES_BATCH)
+                                         : prescan_next(&exp->scan, exp->pending, MACRO_LINES_BATCH);
+            if (exp->pending_cnt == 0) {
+                /* the lines already returned are parsed before any error here is reported, to keep the order */
+                if (exp->is_defining && count == 0) {
+                    exp->is_defining = FALSE;
+                    macro_error(exp, exp->defining_line, "missing endmcro for macro", exp->defining.name,
+                                exp->defining.name_len);
+                }
+                break;
+            }
+        }
+        line = exp->pending + exp->pending_pos;
+        if ((kw = macro_classify(exp, line, &lex, &macro)) && count > 0)
+            break; /* same as above, "mcro" and "endmcro" may report errors */
+        ++exp->pending_pos;
+        exp->consumed = line->start + line->len;
+        if (kw && kw->value == MACRO_START)
+            macro_begin(exp, line, &lex);
+        else if (kw)
+            macro_end(exp, line, &lex);
+        else if (!exp->is_defining) {
+            if (macro) {
+                exp->expanding = macro;
+                exp->expanded = 0;
+            } else
+                lines[count++] = *line;
+        /* a macro used inside a body is expanded right away, so expanding never nests */
+        } else if (!(macro ? macro_append_body(exp, exp->bodies + macro->first, macro->count)
+                           : macro_append_body(exp, line, 1)))
+            macro_error(exp, line->linenum, "out of memory defining macro", exp->defining.name,
+                        exp->defining.name_len);
+    }
+    return count;
+}
@@ -0,0 +1,103 @@
+/* This file is part of OpenU's C project implementation, called assembler
+ * Copyright (C) 2020 Arthur Zamarin, Norel Farjun */
+
+#ifndef ASM_MACRO_H
+#define ASM_MACRO_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "global.h"
+#include "arena.h"
+#include "source.h"
+#include "prescan.h"
+
+/**
+ * Macro expansion stage, between the prescan and the parser.
+ * A macro is defined by the lines between "mcro <name>" and "endmcro", and a line holding only <name> is
+ * expanded into them. Macros must be defined before their use, and bodies may use earlier macros.
+ * The bodies aren't copied: every macro is a run of prescan_line_t records pointing into the source, so an
+ * expansion only streams those records again, and the expanded lines keep the line numbers of the body.
+ */
+
+/** count of lines read from the prescan at once */
+#define MACRO_LINES_BATCH 256
+
+/**
+ * One defined macro, interned in the macros hash table
+ */
+typedef struct {
+    const char *name;  /* points into the source, not zero terminated */
+    size_t name_len;
+    uint32_t hash;     /* hash of the name, kept for rehashing */
+    size_t first;      /* index of the first body line in the bodies array */
+    size_t count;      /* count of body lines */
+} macro_t;
+
+/**
+ * function filling {lines} with up to {max_lines} next meaningful lines like prescan_next, with the user's {arg}
+ */
+typedef size_t (*macro_feed_func)(void *arg, prescan_line_t *lines, size_t max_lines);
+
+/**
+ * Holds the state of expanding one source in batches
+ */
+typedef struct {
+    prescan_t scan;
+    macro_feed_func feed;    /* source of the scanned lines instead of {scan}, or NULL */
+    void *feed_arg;
+    const char *data;        /* the source content */
+    FILE *err_stream;        /* destination of the diagnostics, or NULL to be silent */
+    arena_t *arena;          /* memory source for the table and the bodies */
+    macro_t **table;         /* hash table of the macros (linear probing), NULL is empty slot */
+    unsigned capacity;       /* slots count in {table}, always a power of 2 */
+    unsigned count;          /* count of defined macros */
+    prescan_line_t *bodies;  /* the lines of all the bodies, every macro owns a run of them */
+    size_t bodies_size;
+    size_t bodies_capacity;
+    macro_t defining;        /* the macro being defined, when {is_defining} */
+    unsigned defining_line;  /* line of the "mcro" of {defining} */
+    BOOL is_defining;
+    BOOL is_defining_valid;  /* is {defining} going to be added when it ends */
+    const macro_t *expanding; /* the macro being expanded, or NULL */
+    size_t expanded;         /* count of lines of {expanding} already streamed */
+    prescan_line_t pending[MACRO_LINES_BATCH]; /* lines read from {scan} and not handled yet */
+    size_t pending_pos;
+    size_t pending_cnt;
+    size_t consumed;         /* offset in the source past the last line taken from {pending} */
+    BOOL is_ok;              /* were all the macro lines correct */
+} macro_expander_t;
+
+/**
+ * create an expander over {src}, where lines longer than {max_line_len} are flagged like prescan_new does
+ * the diagnostics go into {err_stream}, or nowhere if it is NULL
+ * all the memory is owned by {arena}, so there is no dealloc function
+ */
+void macro_expander_init(macro_expander_t *exp, const source_t *src, size_t max_line_len, arena_t *arena,
+                         FILE *err_stream);
+/**
+ * take the scanned lines of {exp} from {feed} with {arg}, instead of scanning the source in this thread
+ * macro_linenum isn't valid then, as the scanning state is kept by the feed
+ */
+void macro_set_feed(macro_expander_t *exp, macro_feed_func feed, void *arg);
+/**
+ * expand the next meaningful lines of {exp} into {lines}, up to {max_lines}, like prescan_next
+ * the lines of macro definitions aren't returned, and every macro use is replaced by the lines of its body
+ * return the count of lines filled, 0 when the source is done
+ */
+size_t macro_next(macro_expander_t *exp, prescan_line_t *lines, size_t max_lines);
+/**
+ * return false if any macro line of {exp} was incorrect, valid after macro_next returned 0
+ */
+#define macro_is_ok(exp) ((exp)->is_ok)
+/**
+ * return the offset in the source past all the lines consumed by {exp}, which only grows. The lines of an
+ * expanded body are earlier in the source, so the offset of the last returned line may be lower than it.
+ */
+#define macro_consumed(exp) ((exp)->consumed)
+/**
+ * return the count of source lines scanned by {exp}
+ */
+#define macro_linenum(exp) ((exp)->scan.linenum)
+
+#endif
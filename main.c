@@ -1,52 +1,398 @@
 /* This file is part of OpenU's C project implementation, called assembler
  * Copyright (C) 2020 Arthur Zamarin, Norel Farjun */
 
+#define _POSIX_C_SOURCE 200112L
+
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <sys/stat.h>
 
 #include "parser.h"
+#include "arena.h"
+#include "source.h"
+#include "scheduler.h"
+#include "stats.h"
+#include "cache.h"
+#include "server.h"
+#include "optimizer.h"
+#include "incremental.h"
+
+/** print memory usage of every assembled file */
+static BOOL g_mem_stats = FALSE;
+/** print timings and counters of every assembled file */
+static BOOL g_stats = FALSE;
+/** destination file for the trace events, or NULL */
+static const char *g_trace_file = NULL;
+/** output also the binary object file */
+static BOOL g_binary = FALSE;
+/** output also the source after the macro expansion */
+static BOOL g_expanded = FALSE;
+/** assemble in large-program mode */
+static BOOL g_large = FALSE;
+/** run the peephole optimizer, and report its rewrites */
+static BOOL g_optimize = FALSE;
+/** scan the inputs and write the outputs on threads of their own */
+static BOOL g_pipeline = FALSE;
+/** spill the segments into temporary files while parsing, to assemble in bounded memory */
+static BOOL g_stream = FALSE;
+/** all the options affecting the outputs, as part of the cache keys */
+static char g_output_options[96];
+/** socket path to serve clients on, or NULL to assemble the arguments */
+static const char *g_serve_socket = NULL;
+/** directory of the build cache, or NULL for no caching */
+static const char *g_cache_dir = NULL;
+/** count of worker threads, 0 for assembling in the main thread */
+static unsigned g_jobs_cnt = 0;
+/** count of threads encoding the code segment of every file, 0 for encoding in the assembling thread */
+static unsigned g_output_threads = 0;
+/** maximal length of input lines */
+static size_t g_max_line_len = MAX_LINE_LEN;
+
+/**
+ * Holds one input file to assemble and the results of assembling it
+ */
+typedef struct {
+    const char *basename;
+    const char *path;        /* basename to read the source from, or NULL for {basename} */
+    unsigned index;          /* index of the job in the arguments */
+    FILE *out;               /* destination for the diagnostics */
+    stats_t *stats;          /* destination for timings and counters, or NULL */
+    struct parser_ctx_t *ctx; /* warm parser to reuse, or NULL to create one */
+    const source_t *src;     /* content of the file, or NULL to read it */
+    struct incremental_t *inc; /* held source to assemble incrementally instead of {src}, or NULL */
+    BOOL is_opened;          /* was the source opened, so it has timings and counters */
+    BOOL is_cached;          /* were the outputs restored from the build cache, instead of assembling it */
+    size_t mem_reserved;
+    size_t mem_used;
+    unsigned long mem_alloc_cnt;
+    BOOL is_optimized;       /* was the file optimized, so {optimized} holds its rewrites */
+    optimizer_report_t optimized;
+} assemble_job_t;
+
+/**
+ * parse all the options in {argv}, and remove them from it
+ * return the new arguments count, or -1 on bad option
+ */
+static int parse_options(int argc, char *argv[]) {
+    int i, res = 1;
+    for (i = 1; i < argc; i++) {
+        if (argv[i][0] != '-')
+            argv[res++] = argv[i];
+        else if (!strcmp(argv[i], "--mem-stats"))
+            g_mem_stats = TRUE;
+        else if (!strcmp(argv[i], "--binary"))
+            g_binary = TRUE;
+        else if (!strcmp(argv[i], "--dump-expanded"))
+            g_expanded = TRUE;
+        else if (!strcmp(argv[i], "--large"))
+            g_large = TRUE;
+        else if (!strcmp(argv[i], "--optimize"))
+            g_optimize = TRUE;
+        else if (!strcmp(argv[i], "--pipeline"))
+            g_pipeline = TRUE;
+        else if (!strcmp(argv[i], "--stream"))
+            g_stream = TRUE;
+        else if (!strcmp(argv[i], "--stats"))
+            g_stats = TRUE;
+        else if (!strncmp(argv[i], "--trace=", 8) && argv[i][8])
+            g_trace_file = argv[i] + 8;
+        else if (!strncmp(argv[i], "--serve=", 8) && argv[i][8])
+            g_serve_socket = argv[i] + 8;
+        else if (!strncmp(argv[i], "--cache-dir=", 12) && argv[i][12])
+            g_cache_dir = argv[i] + 12;
+        else if (!strncmp(argv[i], "--max-line-len=", 15)) {
+            char *endp;
+            long len = strtol(argv[i] + 15, &endp, 10);
+            if (*endp || len <= 0) {
+                fprintf(ERR_STREAM, "bad length for option \'--max-line-len\'\n");
+                return -1;
+            }
+            g_max_line_len = (size_t)len;
+        } else if (!strncmp(argv[i], "-j", 2)) {
+            const char *value = argv[i][2] ? argv[i] + 2 : argv[++i];
+            char *endp;
+            long jobs = value ? strtol(value, &endp, 10) : 0;
+            if (!value || *endp || jobs <= 0) {
+                fprintf(ERR_STREAM, "bad jobs count for option \'-j\'\n");
+                return -1;
+            }
+            g_jobs_cnt = (unsigned)jobs;
+        } else {
+            fprintf(ERR_STREAM, "unknown option \'%s\'\n", argv[i]);
+            return -1;
+        }
+    }
+    if (g_serve_socket && g_cache_dir) {
+        fprintf(ERR_STREAM, "option \'--cache-dir\' can't be used with \'--serve\'\n");
+        return -1;
+    }
+    /* the streamed outputs are written straight into their files, and never held whole in memory */
+    if (g_stream && (g_serve_socket || g_cache_dir || g_binary || g_optimize)) {
+        fprintf(ERR_STREAM, "option \'--stream\' can't be used with \'%s\'\n", g_serve_socket ? "--serve" :
+                g_cache_dir ? "--cache-dir" : g_binary ? "--binary" : "--optimize");
+        return -1;
+    }
+    sprintf(g_output_options, "max-line-len=%lu binary=%d large=%d optimize=%d", (unsigned long)g_max_line_len,
+            (int)g_binary, (int)g_large, (int)g_optimize);
+    return res;
+}
+
+/**
+ * copy the diagnostics captured in {diag} to {out} and close it, storing them in the cache entry {cache_tmp} if {store}
+ * return false if they should have been stored but weren't
+ */
+static BOOL assemble_flush_diag(FILE *diag, FILE *out, const char *cache_tmp, BOOL store) {
+    long len = ftell(diag);
+    char *data = len > 0 ? malloc((size_t)len) : NULL;
+    BOOL res = len == 0 || data;
+
+    rewind(diag);
+    if (res && len > 0 && fread(data, 1, (size_t)len, diag) != (size_t)len)
+        res = FALSE;
+    if (res)
+        fwrite(data, 1, (size_t)len, out);
+    else
+        fprintf(out, "unable to read the diagnostics\n");
+    if (res && store)
+        res = cache_store_diag(cache_tmp, data, (size_t)len);
+    free(data);
+    fclose(diag);
+    return res;
+}
+
+/**
+ * assemble the file described by {job}, all diagnostics go to {job->out}
+ * return true if the outputs were made
+ */
+static BOOL assemble_file(assemble_job_t *job) {
+    struct parser_ctx_t *ctx = job->ctx;
+    source_t asm_file;
+    const source_t *src = job->src;
+    const char *asm_path;
+    char key[CACHE_KEY_LEN + 1], *cache_tmp = NULL;
+    const char *status = "All done";
+    FILE *diag = NULL;
+    BOOL is_cached = FALSE, is_done = FALSE, is_stored;
+
+    if (!ctx && !(ctx = parser_new())) {
+        fprintf(job->out, "out of memory\n");
+        return FALSE;
+    }
+    parser_set_err_stream(ctx, job->out);
+    parser_set_max_line_len(ctx, g_max_line_len);
+    parser_set_binary(ctx, g_binary);
+    parser_set_large(ctx, g_large);
+    parser_set_optimize(ctx, g_optimize);
+    parser_set_output_threads(ctx, g_output_threads);
+    parser_set_pipeline(ctx, g_pipeline);
+    parser_set_stream(ctx, g_stream);
+    parser_set_stats(ctx, job->stats);
+    if (job->stats)
+        stats_phase_begin(job->stats, STATS_PHASE_READ);
+    if (!src && !job->inc) {
+        if (!(asm_path = parser_filename(ctx, job->path ? job->path : job->basename, INPUT_EXTENSION)) ||
+                !source_open(&asm_file, asm_path)) {
+            fprintf(job->out, "unable to open \'%s.as\'\n", job->basename);
+            if (!job->ctx)
+                parser_dealloc(ctx);
+            return FALSE;
+        }
+        src = &asm_file;
+    }
+    if (job->stats)
+        stats_phase_end(job->stats, STATS_PHASE_READ);
+    job->is_opened = TRUE;
+    fprintf(job->out, "*******************************************\n""file = %s\n", job->basename);
+    /* written before the cache is consulted, as it is meant for debugging the file even when it has errors */
+    if (g_expanded && ((job->inc && !(src = incremental_get_source(job->inc))) ||
+                       !parser_output_expanded(ctx, src, job->basename)))
+        fprintf(job->out, "Unable to output the expanded source\n");
+    if (g_cache_dir) {
+        /* on a miss, the outputs are copied into a new entry, and identical outputs aren't rewritten */
+        cache_key(src, g_output_options, key);
+        /* a hit prints the diagnostics stored with the entry, a miss captures them to be stored */
+        if (!(is_cached = cache_restore(g_cache_dir, key, job->basename, job->out)) &&
+                (cache_tmp = cache_store_begin(g_cache_dir, key, job->index)) && (diag = tmpfile())) {
+            parser_set_copy_dir(ctx, cache_tmp);
+            parser_set_err_stream(ctx, diag);
+        }
+        parser_set_keep_identical(ctx, TRUE);
+    }
+    if (!(job->is_cached = is_cached)) {
+        if (!(job->inc ? incremental_parse(job->inc, ctx) : parser_parse(ctx, src)))
+            status = "Bad input file - not outputting";
+        else if (!(job->inc ? incremental_output(job->inc, ctx, job->basename) : parser_output(ctx, job->basename)))
+            status = "Unable to output";
+        else {
+            is_done = TRUE;
+            job->is_optimized = g_optimize;
+            job->optimized = *parser_get_optimizer_report(ctx);
+        }
+    }
+    is_stored = diag && assemble_flush_diag(diag, job->out, cache_tmp, is_done);
+    parser_set_err_stream(ctx, job->out);
+    parser_set_copy_dir(ctx, NULL);
+    fprintf(job->out, "%s\n", status);
+    if (cache_tmp)
+        cache_store_end(g_cache_dir, key, cache_tmp, is_done && is_stored);
+    job->mem_reserved = parser_get_arena(ctx)->reserved;
+    job->mem_used = parser_get_arena(ctx)->used;
+    job->mem_alloc_cnt = parser_get_arena(ctx)->alloc_cnt;
+    if (!job->ctx)
+        parser_dealloc(ctx);
+    if (src == &asm_file)
+        source_close(&asm_file);
+    fprintf(job->out, "*******************************************\n");
+    return is_cached || is_done;
+}
 
-static FILE *get_assembly_path(const char *basename) {
-    char *newName;
-    FILE *asm_file;
-    /* build asm's file path */ {
-        size_t len = strlen(basename);
-        if (!(newName = malloc(len + MAX_LEN_EXTENSION + 1)))
-            return NULL;
-        memcpy(newName, basename, len);
-        strcpy(newName + len, INPUT_EXTENSION);
+/**
+ * print the results of {job} which weren't printed while assembling
+ */
+static void report_job(const assemble_job_t *job) {
+    if (g_mem_stats && job->mem_alloc_cnt)
+        fprintf(stderr, "%s: memory reserved=%lu used=%lu allocations=%lu\n", job->basename,
+                (unsigned long)job->mem_reserved, (unsigned long)job->mem_used, job->mem_alloc_cnt);
+    if (job->is_optimized)
+        fprintf(stderr, "%s: optimized threaded-jumps=%lu unreachable=%lu self-moves=%lu words-saved=%lu\n",
+                job->basename, job->optimized.threaded, job->optimized.unreachable, job->optimized.self_moves,
+                job->optimized.words_saved);
+    if (g_stats && job->stats && job->is_opened) {
+        stats_print(job->stats, stderr);
+        if (job->is_cached)
+            fprintf(stderr, "%s: outputs restored from the cache\n", job->basename);
     }
-    asm_file = fopen(newName, "r");
-    free(newName);
-    return asm_file;
+}
+
+/**
+ * server_assemble_func which assembles one request of a client
+ */
+static BOOL serve_file(void *arg, struct parser_ctx_t *ctx, const char *basename, const char *path,
+                       const source_t *src, struct incremental_t *inc, FILE *out) {
+    assemble_job_t job;
+    BOOL res;
+    (void)arg;
+    memset(&job, 0, sizeof(job));
+    job.basename = basename;
+    job.path = path;
+    job.out = out;
+    job.ctx = ctx;
+    job.src = src;
+    job.inc = inc;
+    res = assemble_file(&job);
+    report_job(&job);
+    return res;
+}
+
+/**
+ * scheduler_job_func which assembles into a temporary buffer file
+ */
+static void assemble_job_func(unsigned job, void *arg) {
+    assemble_job_t *jobs = arg;
+    if ((jobs[job].out = tmpfile()))
+        assemble_file(jobs + job);
+}
+
+/**
+ * assemble all {jobs_cnt} {jobs} in parallel, and output their diagnostics in order
+ */
+static void assemble_parallel(assemble_job_t *jobs, unsigned jobs_cnt) {
+    struct scheduler_t *sched;
+    unsigned long *weights = calloc(jobs_cnt, sizeof(unsigned long));
+    unsigned i;
+
+    for (i = 0; weights && i < jobs_cnt; i++) {
+        struct stat st;
+        char *path = malloc(strlen(jobs[i].basename) + MAX_LEN_EXTENSION + 1);
+        if (path) {
+            strcpy(path, jobs[i].basename);
+            strcat(path, INPUT_EXTENSION);
+            if (!stat(path, &st))
+                weights[i] = (unsigned long)st.st_size;
+            free(path);
+        }
+    }
+    if (!weights || !(sched = scheduler_new(g_jobs_cnt, jobs_cnt, weights, assemble_job_func, jobs))) {
+        free(weights);
+        for (i = 0; i < jobs_cnt; i++) {
+            assemble_file(jobs + i);
+            report_job(jobs + i);
+        }
+        return;
+    }
+    free(weights);
+
+    for (i = 0; i < jobs_cnt; i++) {
+        scheduler_wait_job(sched, i);
+        if (jobs[i].out) {
+            char buffer[4096];
+            size_t len;
+            rewind(jobs[i].out);
+            while ((len = fread(buffer, 1, sizeof(buffer), jobs[i].out)) > 0)
+                fwrite(buffer, 1, len, ERR_STREAM);
+            fclose(jobs[i].out);
+        } else
+            fprintf(ERR_STREAM, "unable to buffer output of \'%s\'\n", jobs[i].basename);
+        report_job(jobs + i);
+    }
+    fflush(ERR_STREAM);
+    scheduler_dealloc(sched);
 }
 
 int main(int argc, char *argv[])
 {
     int i;
-    struct parser_ctx_t *ctx;
-    FILE *asm_file;
+    assemble_job_t *jobs;
+    stats_t *stats = NULL;
+    if ((argc = parse_options(argc, argv)) < 0)
+        return 1;
+    if (g_serve_socket) {
+        if (argc > 1) {
+            fprintf(ERR_STREAM, "no input files are accepted with \'--serve\'\n");
+            return 1;
+        }
+        if (!server_run(g_serve_socket, serve_file, NULL)) {
+            fprintf(ERR_STREAM, "unable to serve on \'%s\'\n", g_serve_socket);
+            return 1;
+        }
+        return 0;
+    }
     if (argc == 1) {
         fprintf(ERR_STREAM, "no input files given\n");
         return 1;
     }
+    if (!(jobs = calloc(argc - 1, sizeof(assemble_job_t)))) {
+        fprintf(ERR_STREAM, "out of memory\n");
+        return 1;
+    }
+    if ((g_stats || g_trace_file) && !(stats = calloc(argc - 1, sizeof(stats_t)))) {
+        fprintf(ERR_STREAM, "out of memory\n");
+        free(jobs);
+        return 1;
+    }
     for (i = 1; i < argc; i++) {
-        if (!(asm_file = get_assembly_path(argv[i]))) {
-            fprintf(ERR_STREAM, "unable to open \'%s.as\'\n", argv[i]);
-            continue;
-        }
-        fprintf(ERR_STREAM, "*******************************************\n""file = %s\n", argv[i]);
-        ctx = parser_new();
-        if (!parser_parse(ctx, asm_file))
-            fprintf(ERR_STREAM, "Bad input file - not outputting\n");
-        else if (!parser_output(ctx, argv[i]))
-            fprintf(ERR_STREAM, "Unable to output\n");
-        else
-            fprintf(ERR_STREAM, "All done\n");
-        parser_dealloc(ctx);
-        fclose(asm_file);
-        fprintf(ERR_STREAM, "*******************************************\n");
+        jobs[i - 1].basename = argv[i];
+        jobs[i - 1].index = i - 1;
+        jobs[i - 1].out = ERR_STREAM;
+        if (stats) {
+            jobs[i - 1].stats = stats + i - 1;
+            stats[i - 1].name = argv[i];
+        }
     }
+    /* a single file has no other files to run along, so the threads encode its code segment */
+    if (argc == 2)
+        g_output_threads = g_jobs_cnt;
+    if (g_jobs_cnt > 1 && argc > 2)
+        assemble_parallel(jobs, argc - 1);
+    else
+        for (i = 0; i < argc - 1; i++) {
+            assemble_file(jobs + i);
+            report_job(jobs + i);
+        }
+    if (g_trace_file && !stats_write_trace(stats, argc - 1, g_trace_file))
+        fprintf(ERR_STREAM, "unable to write trace into \'%s\'\n", g_trace_file);
+    free(stats);
+    free(jobs);
     return 0;
 }
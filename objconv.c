@@ -0,0 +1,55 @@
+/* This file is part of OpenU's C project implementation, called assembler
+ * Copyright (C) 2020 Arthur Zamarin, Norel Farjun */
+
+/*
+ * Converter between the text object files (.ob, .ent, .ext) and the binary object file (.obb):
+ *     objconv --to-binary basename...
+ *     objconv --to-text basename...
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "objfile.h"
+#include "parser.h"
+
+/**
+ * convert the object files of {basename} into the other format
+ * return false on any error, after printing it
+ */
+static BOOL convert_file(const char *basename, BOOL to_binary) {
+    objfile_t obj;
+    char *path;
+    BOOL res;
+
+    if (!(path = malloc(strlen(basename) + MAX_LEN_EXTENSION + 1))) {
+        fprintf(stderr, "out of memory\n");
+        return FALSE;
+    }
+    sprintf(path, "%s%s", basename, OUTPUT_BINARY_EXTENSION);
+    if (to_binary ? !objfile_open_text(&obj, basename) : !objfile_open_binary(&obj, path)) {
+        fprintf(stderr, "unable to load '%s'\n", to_binary ? basename : path);
+        free(path);
+        return FALSE;
+    }
+    if (!(res = to_binary ? objfile_write_binary(&obj, path, FALSE) : objfile_write_text(&obj, basename)))
+        fprintf(stderr, "unable to write object files of '%s'\n", basename);
+    objfile_close(&obj);
+    free(path);
+    return res;
+}
+
+int main(int argc, char *argv[]) {
+    BOOL to_binary, res = TRUE;
+    int i;
+
+    if (argc < 3 || (strcmp(argv[1], "--to-binary") && strcmp(argv[1], "--to-text"))) {
+        fprintf(stderr, "usage: %s --to-binary|--to-text basename...\n", argv[0]);
+        return 1;
+    }
+    to_binary = !strcmp(argv[1], "--to-binary");
+    for (i = 2; i < argc; i++)
+        res &= convert_file(argv[i], to_binary);
+    return !res;
+}
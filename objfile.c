@@ -0,0 +1,369 @@
+/* This file is part of OpenU's C project implementation, called assembler
+ * Copyright (C) 2020 Arthur Zamarin, Norel Farjun */
+
+#include "objfile.h"
+#include "outbuf.h"
+#include "parser.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** read and write little endian numbers */
+#define OBJFILE_GET16(ptr) ((unsigned)(ptr)[0] | ((unsigned)(ptr)[1] << 8))
+#define OBJFILE_GET32(ptr) ((unsigned long)OBJFILE_GET16(ptr) | ((unsigned long)OBJFILE_GET16((ptr) + 2) << 16))
+#define OBJFILE_ALIGN4(size) (((size) + 3) & ~(size_t)3)
+
+static void objfile_put16(unsigned char *ptr, unsigned value) {
+    ptr[0] = (unsigned char)(value & 0xff);
+    ptr[1] = (unsigned char)((value >> 8) & 0xff);
+}
+
+static void objfile_put32(unsigned char *ptr, unsigned long value) {
+    objfile_put16(ptr, (unsigned)(value & 0xffff));
+    objfile_put16(ptr + 2, (unsigned)((value >> 16) & 0xffff));
+}
+
+/**
+ * set all the section pointers of {obj}, using the sizes in {obj}
+ * return false if the sections don't fit exactly in {obj->len} bytes
+ */
+static BOOL objfile_set_sections(objfile_t *obj) {
+    const unsigned long words_cnt = (unsigned long)obj->code_size + obj->data_size;
+    const unsigned long symbols_cnt = (unsigned long)obj->entries_cnt + obj->externals_cnt;
+    const size_t strings_size = OBJFILE_GET32(obj->base + 24);
+    size_t offset;
+    unsigned i;
+
+    if (words_cnt > (obj->len - OBJFILE_HEADER_SIZE) / 2)
+        return FALSE;
+    offset = OBJFILE_ALIGN4(OBJFILE_HEADER_SIZE + 2 * words_cnt);
+    if (offset > obj->len || symbols_cnt > (obj->len - offset) / OBJFILE_SYMBOL_SIZE)
+        return FALSE;
+    obj->words = obj->base + OBJFILE_HEADER_SIZE;
+    obj->symbols = obj->base + offset;
+    offset += OBJFILE_SYMBOL_SIZE * symbols_cnt;
+    if (obj->len - offset != strings_size || (strings_size && obj->base[obj->len - 1] != '\0'))
+        return FALSE;
+    obj->strings = (const char *)obj->base + offset;
+
+    for (i = 0; i < symbols_cnt; ++i)
+        if (OBJFILE_GET32(obj->symbols + OBJFILE_SYMBOL_SIZE * i) >= strings_size)
+            return FALSE;
+    return TRUE;
+}
+
+/**
+ * read the header of {obj->base} into {obj} and set all its sections
+ * return false if the content isn't valid
+ */
+static BOOL objfile_parse_header(objfile_t *obj) {
+    if (obj->len < OBJFILE_HEADER_SIZE || memcmp(obj->base, OBJFILE_MAGIC, 4))
+        return FALSE;
+    obj->code_start    = (unsigned)OBJFILE_GET32(obj->base + 4);
+    obj->code_size     = (unsigned)OBJFILE_GET32(obj->base + 8);
+    obj->data_size     = (unsigned)OBJFILE_GET32(obj->base + 12);
+    obj->entries_cnt   = (unsigned)OBJFILE_GET32(obj->base + 16);
+    obj->externals_cnt = (unsigned)OBJFILE_GET32(obj->base + 20);
+    obj->flags         = (unsigned)OBJFILE_GET32(obj->base + 28);
+    return objfile_set_sections(obj);
+}
+
+BOOL objfile_open_binary(objfile_t *obj, const char *path) {
+    obj->image = NULL;
+    if (!source_open(&obj->src, path))
+        return FALSE;
+    obj->base = (const unsigned char *)obj->src.data;
+    obj->len = obj->src.len;
+    if (!objfile_parse_header(obj)) {
+        source_close(&obj->src);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/**
+ * write the header of {obj} into its {image}, with strings section of {strings_size} bytes
+ */
+static void objfile_put_header(const objfile_t *obj, unsigned char *image, size_t strings_size) {
+    memcpy(image, OBJFILE_MAGIC, 4);
+    objfile_put32(image + 4, obj->code_start);
+    objfile_put32(image + 8, obj->code_size);
+    objfile_put32(image + 12, obj->data_size);
+    objfile_put32(image + 16, obj->entries_cnt);
+    objfile_put32(image + 20, obj->externals_cnt);
+    objfile_put32(image + 24, (unsigned long)strings_size);
+    objfile_put32(image + 28, obj->flags);
+}
+
+BOOL objfile_create(objfile_t *obj, unsigned code_start, unsigned code_size, unsigned data_size,
+                    unsigned entries_cnt, unsigned externals_cnt, size_t strings_size, unsigned flags) {
+    obj->code_start = code_start;
+    obj->code_size = code_size;
+    obj->data_size = data_size;
+    obj->entries_cnt = entries_cnt;
+    obj->externals_cnt = externals_cnt;
+    obj->flags = flags;
+    obj->len = OBJFILE_ALIGN4(OBJFILE_HEADER_SIZE + 2 * ((size_t)code_size + data_size)) +
+               OBJFILE_SYMBOL_SIZE * ((size_t)entries_cnt + externals_cnt) + strings_size;
+    if (!(obj->image = calloc(obj->len, 1)))
+        return FALSE;
+    objfile_put_header(obj, obj->image, strings_size);
+    obj->base = obj->image;
+    /* the strings are all zeros yet, so their last byte is a valid terminator */
+    if (!objfile_set_sections(obj)) {
+        free(obj->image);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+void objfile_set_word(objfile_t *obj, unsigned index, unsigned word) {
+    objfile_put16(obj->image + (obj->words - obj->base) + 2 * index, word);
+}
+
+void objfile_set_symbol(objfile_t *obj, unsigned index, size_t name_offset, const char *name, unsigned addr) {
+    unsigned char *symbol = obj->image + (obj->symbols - obj->base) + OBJFILE_SYMBOL_SIZE * index;
+    objfile_put32(symbol, (unsigned long)name_offset);
+    objfile_put32(symbol + 4, addr);
+    strcpy((char *)obj->image + (obj->strings - (const char *)obj->base) + name_offset, name);
+}
+
+/**
+ * Cursor over text content
+ */
+typedef struct {
+    const char *ptr;
+    const char *end;
+} objfile_text_t;
+
+static void objfile_text_skip_spaces(objfile_text_t *text) {
+    while (text->ptr != text->end && (*text->ptr == ' ' || *text->ptr == '\t' || *text->ptr == '\r'))
+        ++text->ptr;
+}
+
+/**
+ * read a number in {base} (up to 10) from {text} into {value}
+ * return false if there is no number, or it doesn't fit 32 bits
+ */
+static BOOL objfile_text_number(objfile_text_t *text, unsigned base, unsigned long *value) {
+    const char *start;
+    objfile_text_skip_spaces(text);
+    for (start = text->ptr, *value = 0; text->ptr != text->end && *text->ptr >= '0' && *text->ptr < (char)('0' + base); ++text->ptr)
+        if ((*value = *value * base + (unsigned)(*text->ptr - '0')) > 0xffffffffUL)
+            return FALSE;
+    return text->ptr != start;
+}
+
+/**
+ * read a label name from {text} into {name} and {len}
+ * return false if there is no name
+ */
+static BOOL objfile_text_name(objfile_text_t *text, const char **name, size_t *len) {
+    objfile_text_skip_spaces(text);
+    for (*name = text->ptr; text->ptr != text->end && !strchr(" \t\r\n", *text->ptr); ++text->ptr);
+    return (*len = (size_t)(text->ptr - *name)) > 0;
+}
+
+/**
+ * skip the end of the current line in {text}
+ * return false if there are more characters in the line
+ */
+static BOOL objfile_text_end_line(objfile_text_t *text) {
+    objfile_text_skip_spaces(text);
+    if (text->ptr == text->end)
+        return TRUE;
+    return *text->ptr++ == '\n';
+}
+
+/**
+ * parse the symbols file {data} of {len} bytes, count its symbols into {cnt} and their strings size into {strings_size}
+ * if {symbols} isn't NULL also fill them, with names stored at offset {*strings_size} of {strings}
+ * return false if the text isn't valid
+ */
+static BOOL objfile_parse_symbols(const char *data, size_t len, unsigned *cnt, size_t *strings_size,
+                                  unsigned char *symbols, char *strings) {
+    objfile_text_t text;
+    const char *name;
+    size_t name_len;
+    unsigned long addr;
+
+    text.ptr = data;
+    text.end = data + len;
+    for (*cnt = 0; text.ptr != text.end; ++*cnt) {
+        if (!objfile_text_name(&text, &name, &name_len) || !objfile_text_number(&text, 10, &addr) ||
+                !objfile_text_end_line(&text))
+            return FALSE;
+        if (symbols) {
+            objfile_put32(symbols + OBJFILE_SYMBOL_SIZE * *cnt, (unsigned long)*strings_size);
+            objfile_put32(symbols + OBJFILE_SYMBOL_SIZE * *cnt + 4, addr);
+            memcpy(strings + *strings_size, name, name_len);
+            strings[*strings_size + name_len] = '\0';
+        }
+        *strings_size += name_len + 1;
+    }
+    return TRUE;
+}
+
+/**
+ * parse the object file {data} of {len} bytes into the words of {obj}, which must have its sizes set
+ * if {words} is NULL only read the sizes into {obj}
+ * return false if the text isn't valid
+ */
+static BOOL objfile_parse_object(objfile_t *obj, const char *data, size_t len, unsigned char *words) {
+    objfile_text_t text;
+    unsigned long code_size, data_size, addr, word, i;
+
+    text.ptr = data;
+    text.end = data + len;
+    if (!objfile_text_number(&text, 10, &code_size) || !objfile_text_number(&text, 10, &data_size) ||
+            !objfile_text_end_line(&text) || code_size + data_size > len / 4) /* a record takes at least 4 bytes */
+        return FALSE;
+    obj->code_size = (unsigned)code_size;
+    obj->data_size = (unsigned)data_size;
+    obj->code_start = OUTPUT_OBJECT_CODE_START;
+    if (!words)
+        return TRUE;
+
+    for (i = 0; i < code_size + data_size; ++i) {
+        if (!objfile_text_number(&text, 10, &addr) || !objfile_text_number(&text, 8, &word) ||
+                !objfile_text_end_line(&text) || word > 077777)
+            return FALSE;
+        if (i == 0)
+            obj->code_start = (unsigned)addr;
+        else if (addr != obj->code_start + i)
+            return FALSE; /* addresses must be sequential */
+        objfile_put16(words + 2 * i, (unsigned)word);
+    }
+    objfile_text_skip_spaces(&text);
+    return text.ptr == text.end;
+}
+
+BOOL objfile_from_text(objfile_t *obj, const char *ob, size_t ob_len, const char *ent, size_t ent_len,
+                       const char *ext, size_t ext_len) {
+    size_t symbols_offset, strings_offset, strings_size = 0;
+    unsigned char *image;
+
+    obj->image = NULL;
+    obj->entries_cnt = obj->externals_cnt = 0;
+    obj->flags = (ent ? OBJFILE_HAS_ENTRIES : 0) | (ext ? OBJFILE_HAS_EXTERNALS : 0);
+    /* first pass counts the sizes, second pass fills the image */
+    if (!objfile_parse_object(obj, ob, ob_len, NULL) ||
+            (ent && !objfile_parse_symbols(ent, ent_len, &obj->entries_cnt, &strings_size, NULL, NULL)) ||
+            (ext && !objfile_parse_symbols(ext, ext_len, &obj->externals_cnt, &strings_size, NULL, NULL)))
+        return FALSE;
+
+    symbols_offset = OBJFILE_ALIGN4(OBJFILE_HEADER_SIZE + 2 * ((size_t)obj->code_size + obj->data_size));
+    strings_offset = symbols_offset + OBJFILE_SYMBOL_SIZE * ((size_t)obj->entries_cnt + obj->externals_cnt);
+    obj->len = strings_offset + strings_size;
+    if (!(image = calloc(obj->len, 1)))
+        return FALSE;
+
+    strings_size = 0;
+    if (!objfile_parse_object(obj, ob, ob_len, image + OBJFILE_HEADER_SIZE) ||
+            (ent && !objfile_parse_symbols(ent, ent_len, &obj->entries_cnt, &strings_size,
+                                           image + symbols_offset, (char *)image + strings_offset)) ||
+            (ext && !objfile_parse_symbols(ext, ext_len, &obj->externals_cnt, &strings_size,
+                                           image + symbols_offset + OBJFILE_SYMBOL_SIZE * obj->entries_cnt,
+                                           (char *)image + strings_offset))) {
+        free(image);
+        return FALSE;
+    }
+
+    objfile_put_header(obj, image, strings_size);
+    obj->image = image;
+    obj->base = image;
+    return objfile_set_sections(obj);
+}
+
+BOOL objfile_open_text(objfile_t *obj, const char *basename) {
+    static const char *const extensions[] = {OUTPUT_OBJECT_EXTENSION, OUTPUT_ENTRIES_EXTENSION, OUTPUT_EXTERNALS_EXTENSION};
+    source_t files[ARR_SIZE(extensions)];
+    BOOL opened[ARR_SIZE(extensions)], res;
+    char *path;
+    unsigned i;
+
+    if (!(path = malloc(strlen(basename) + MAX_LEN_EXTENSION + 1)))
+        return FALSE;
+    for (i = 0; i < ARR_SIZE(extensions); ++i) {
+        sprintf(path, "%s%s", basename, extensions[i]);
+        opened[i] = source_open(files + i, path);
+    }
+    free(path);
+
+    res = opened[0] && objfile_from_text(obj, files[0].data, files[0].len,
+                                         opened[1] ? files[1].data : NULL, opened[1] ? files[1].len : 0,
+                                         opened[2] ? files[2].data : NULL, opened[2] ? files[2].len : 0);
+    for (i = 0; i < ARR_SIZE(extensions); ++i)
+        if (opened[i])
+            source_close(files + i);
+    return res;
+}
+
+void objfile_close(objfile_t *obj) {
+    if (obj->image)
+        free(obj->image);
+    else
+        source_close(&obj->src);
+}
+
+const char *objfile_symbol(const objfile_t *obj, unsigned index, unsigned *addr) {
+    const unsigned char *symbol = obj->symbols + OBJFILE_SYMBOL_SIZE * index;
+    *addr = (unsigned)OBJFILE_GET32(symbol + 4);
+    return obj->strings + OBJFILE_GET32(symbol);
+}
+
+BOOL objfile_write_binary(const objfile_t *obj, const char *path, BOOL keep_identical) {
+    return outbuf_write_data((const char *)obj->base, obj->len, path, keep_identical);
+}
+
+/**
+ * write the {cnt} symbols of {obj} starting with symbol {first} as text file into {path}, allocating from {arena}
+ */
+static BOOL objfile_write_symbols(const objfile_t *obj, unsigned first, unsigned cnt, const char *path, arena_t *arena) {
+    outbuf_t buf;
+    const char *name;
+    unsigned i, addr;
+    size_t len = 0;
+
+    for (i = first; i < first + cnt; ++i) {
+        name = objfile_symbol(obj, i, &addr);
+        len += OUTBUF_SYMBOL_LEN(strlen(name), addr);
+    }
+    if (!outbuf_init(&buf, arena, len))
+        return FALSE;
+    for (i = first; i < first + cnt; ++i) {
+        name = objfile_symbol(obj, i, &addr);
+        outbuf_put_symbol(&buf, name, strlen(name), addr);
+    }
+    return outbuf_write_file(&buf, path, FALSE);
+}
+
+BOOL objfile_write_text(const objfile_t *obj, const char *basename) {
+    arena_t arena = arena_new();
+    outbuf_t object;
+    char header[32], *path;
+    unsigned i;
+    BOOL res;
+
+    sprintf(header, "%4u %u\n", obj->code_size, obj->data_size);
+    res = (path = arena_alloc(&arena, strlen(basename) + MAX_LEN_EXTENSION + 1)) &&
+          outbuf_init(&object, &arena, strlen(header) + outbuf_object_len(obj->code_start, obj->code_size + obj->data_size));
+    if (res) {
+        outbuf_put_text(&object, header, strlen(header));
+        for (i = 0; i < obj->code_size + obj->data_size; ++i)
+            outbuf_put_object_word(&object, obj->code_start + i, objfile_word(obj, i) & 077777);
+        sprintf(path, "%s%s", basename, OUTPUT_OBJECT_EXTENSION);
+        res = outbuf_write_file(&object, path, FALSE);
+    }
+    if (res && (obj->flags & OBJFILE_HAS_EXTERNALS)) {
+        sprintf(path, "%s%s", basename, OUTPUT_EXTERNALS_EXTENSION);
+        res = objfile_write_symbols(obj, obj->entries_cnt, obj->externals_cnt, path, &arena);
+    }
+    if (res && (obj->flags & OBJFILE_HAS_ENTRIES)) {
+        sprintf(path, "%s%s", basename, OUTPUT_ENTRIES_EXTENSION);
+        res = objfile_write_symbols(obj, 0, obj->entries_cnt, path, &arena);
+    }
+    arena_dealloc(&arena);
+    return res;
+}
@@ -0,0 +1,117 @@
+/* This file is part of OpenU's C project implementation, called assembler
+ * Copyright (C) 2020 Arthur Zamarin, Norel Farjun */
+
+#ifndef ASM_OBJFILE_H
+#define ASM_OBJFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "global.h"
+#include "source.h"
+
+/**
+ * Binary object file (.obb), holding the same content as the .ob, .ent and .ext text files.
+ * All numbers are little endian, and every section is aligned to its items, so the file can be used
+ * directly after mapping it:
+ *
+ *   offset 0   magic "OBB1"
+ *          4   uint32 code start address
+ *          8   uint32 code segment size, in words
+ *         12   uint32 data segment size, in words
+ *         16   uint32 count of entries
+ *         20   uint32 count of externals (relocations to patch with the external label's address)
+ *         24   uint32 size of the strings section, in bytes
+ *         28   uint32 flags, objfile_flags
+ *         32   uint16 words[code size + data size]
+ *              padding to 4 bytes
+ *              symbols[entries + externals], each one is uint32 name offset in strings, uint32 address
+ *              strings, all zero terminated
+ */
+#define OBJFILE_MAGIC "OBB1"
+#define OBJFILE_HEADER_SIZE 32
+#define OBJFILE_SYMBOL_SIZE 8
+
+/** flags of the binary object file */
+enum objfile_flags {
+    OBJFILE_HAS_ENTRIES   = 1, /* the .ent file exists, even if empty */
+    OBJFILE_HAS_EXTERNALS = 2  /* the .ext file exists, even if empty */
+};
+
+/**
+ * Loaded object file, which points into a mapped .obb file or into an image built from text files
+ */
+typedef struct {
+    source_t src;                 /* mapped or read .obb content, when loaded from binary */
+    unsigned char *image;         /* malloced image, when built from text */
+    const unsigned char *base;    /* the whole binary content */
+    size_t len;
+    unsigned code_start, code_size, data_size;
+    unsigned entries_cnt, externals_cnt;
+    unsigned flags;
+    const unsigned char *words;   /* code and data words */
+    const unsigned char *symbols; /* entries followed by externals */
+    const char *strings;
+} objfile_t;
+
+/**
+ * load the binary object file at {path} into {obj}, validating its structure
+ * return false if the file can't be read or isn't valid
+ */
+BOOL objfile_open_binary(objfile_t *obj, const char *path);
+/**
+ * build {obj} from the content of the text files: {ob} of {ob_len} bytes, and {ent} and {ext} which are
+ * NULL when the file doesn't exist
+ * return false if the text isn't valid or out of memory
+ */
+BOOL objfile_from_text(objfile_t *obj, const char *ob, size_t ob_len, const char *ent, size_t ent_len,
+                       const char *ext, size_t ext_len);
+/**
+ * load the text files of {basename} (.ob, and .ent and .ext if they exist) into {obj}
+ * return false if the files can't be read or aren't valid
+ */
+BOOL objfile_open_text(objfile_t *obj, const char *basename);
+/**
+ * create an empty {obj} of the given sizes, with all its words and symbols zeroed, to be filled by
+ * objfile_set_word and objfile_set_symbol
+ * return false if out of memory
+ */
+BOOL objfile_create(objfile_t *obj, unsigned code_start, unsigned code_size, unsigned data_size,
+                    unsigned entries_cnt, unsigned externals_cnt, size_t strings_size, unsigned flags);
+/**
+ * set the word number {index} of created {obj} to {word}
+ */
+void objfile_set_word(objfile_t *obj, unsigned index, unsigned word);
+/**
+ * set the symbol number {index} of created {obj} to {name} at {addr}, storing the name at {name_offset} of the
+ * strings section (the caller places the names one after the other, including their terminators)
+ */
+void objfile_set_symbol(objfile_t *obj, unsigned index, size_t name_offset, const char *name, unsigned addr);
+/**
+ * release all the memory of {obj}
+ */
+void objfile_close(objfile_t *obj);
+
+/**
+ * return the word number {index} of {obj}, counting the code words and then the data words
+ */
+#define objfile_word(obj, index) \
+    ((unsigned)(obj)->words[2 * (index)] | ((unsigned)(obj)->words[2 * (index) + 1] << 8))
+/**
+ * return the name of the symbol number {index} of {obj} (entries, then externals) and set its address into {addr}
+ */
+const char *objfile_symbol(const objfile_t *obj, unsigned index, unsigned *addr);
+
+/**
+ * write {obj} as binary object file into {path}
+ * if {keep_identical} is set and the file already has this content, it isn't touched
+ * return false on any error
+ */
+BOOL objfile_write_binary(const objfile_t *obj, const char *path, BOOL keep_identical);
+/**
+ * write {obj} as text files of {basename}: .ob, and .ent and .ext if their flags are set
+ * return false on any error
+ */
+BOOL objfile_write_text(const objfile_t *obj, const char *basename);
+
+#endif
@@ -3,43 +3,71 @@
 
 #include "opcodes.h"
 #include "global.h"
-
-#include <string.h>
+#include "keywords.h"
+#include "instructions_list.h"
 
 /**
-  * Fully heap best sorted BTree of all instruction's texts
-  * The array is sorted so that for every i:
-  *     [2i + 1] < [i] < [2i + 2]
+  * All instructions, indexed by their opcode
   */
 static opcode_t g_all_instructions[] = {
-/*  sort IDX  text  opcode    [3..6]        [7..10]       */
-    /* 08 */ {"lea",  4, {OPERAND_ALL_RW, OPERAND_LABEL}},
-    /* 04 */ {"dec",  8, {OPERAND_ALL_RW, OPERAND_NONE}},
-    /* 12 */ {"red", 11, {OPERAND_ALL_RW, OPERAND_NONE}},
-    /* 02 */ {"clr",  5, {OPERAND_ALL_RW, OPERAND_NONE}},
-    /* 06 */ {"jmp",  9, {OPERAND_ALL_ADDR, OPERAND_NONE}},
-    /* 10 */ {"not",  6, {OPERAND_ALL_RW, OPERAND_NONE}},
-    /* 14 */ {"stop",15, {OPERAND_NONE, OPERAND_NONE}},
-    /* 01 */ {"bne", 10, {OPERAND_ALL_ADDR, OPERAND_NONE}},
-    /* 03 */ {"cmp",  1, {OPERAND_ALL_RO, OPERAND_ALL_RO}},
-    /* 05 */ {"inc",  7, {OPERAND_ALL_RW, OPERAND_NONE}},
-    /* 07 */ {"jsr", 13, {OPERAND_ALL_ADDR, OPERAND_NONE}},
-    /* 09 */ {"mov",  0, {OPERAND_ALL_RW, OPERAND_ALL_RO}},
-    /* 11 */ {"prn", 12, {OPERAND_ALL_RO, OPERAND_NONE}},
-    /* 13 */ {"rts", 14, {OPERAND_NONE, OPERAND_NONE}},
-    /* 15 */ {"sub",  3, {OPERAND_ALL_RW, OPERAND_ALL_RO}},
-    /* 00 */ {"add",  2, {OPERAND_ALL_RW, OPERAND_ALL_RO}},
+/*    text   opcode       [3..6]          [7..10]       */
+    {"mov",  OPCODE_MOV,  {OPERAND_ALL_RW, OPERAND_ALL_RO}},
+    {"cmp",  OPCODE_CMP,  {OPERAND_ALL_RO, OPERAND_ALL_RO}},
+    {"add",  OPCODE_ADD,  {OPERAND_ALL_RW, OPERAND_ALL_RO}},
+    {"sub",  OPCODE_SUB,  {OPERAND_ALL_RW, OPERAND_ALL_RO}},
+    {"lea",  OPCODE_LEA,  {OPERAND_ALL_RW, OPERAND_LABEL}},
+    {"clr",  OPCODE_CLR,  {OPERAND_ALL_RW, OPERAND_NONE}},
+    {"not",  OPCODE_NOT,  {OPERAND_ALL_RW, OPERAND_NONE}},
+    {"inc",  OPCODE_INC,  {OPERAND_ALL_RW, OPERAND_NONE}},
+    {"dec",  OPCODE_DEC,  {OPERAND_ALL_RW, OPERAND_NONE}},
+    {"jmp",  OPCODE_JMP,  {OPERAND_ALL_ADDR, OPERAND_NONE}},
+    {"bne",  OPCODE_BNE,  {OPERAND_ALL_ADDR, OPERAND_NONE}},
+    {"red",  OPCODE_RED,  {OPERAND_ALL_RW, OPERAND_NONE}},
+    {"prn",  OPCODE_PRN,  {OPERAND_ALL_RO, OPERAND_NONE}},
+    {"jsr",  OPCODE_JSR,  {OPERAND_ALL_ADDR, OPERAND_NONE}},
+    {"rts",  OPCODE_RTS,  {OPERAND_NONE, OPERAND_NONE}},
+    {"stop", OPCODE_STOP, {OPERAND_NONE, OPERAND_NONE}},
+};
+
+/* Start of encoding table generation, all done by the preprocessor */
+#define ENC_VALID(mask, type) ((type) == OPERAND_NONE ? (mask) == OPERAND_NONE : (((type) & ((type) - 1)) == 0 && ((mask) & (type))))
+#define ENC_WORD(op, src, dst) (((op) << INST_OPCODE_RANGE(BIT_RANGE_START)) | ((src) << INST_OPR2_ACCS_RANGE(BIT_RANGE_START)) | \
+                                ((dst) << INST_OPR1_ACCS_RANGE(BIT_RANGE_START)) | (INST_ARE_ABSOLUTE << INST_ARE_RANGE(BIT_RANGE_START)))
+#define ENC(op, dmask, smask, src, dst) ((ENC_VALID(smask, src) && ENC_VALID(dmask, dst)) ? ENC_WORD(op, src, dst) : 0)
+#define ENC_SRC_ROW(op, dmask, smask, src) { \
+    ENC(op, dmask, smask, src, 0), ENC(op, dmask, smask, src, 1), ENC(op, dmask, smask, src, 2), \
+    ENC(op, dmask, smask, src, 3), ENC(op, dmask, smask, src, 4), ENC(op, dmask, smask, src, 5), \
+    ENC(op, dmask, smask, src, 6), ENC(op, dmask, smask, src, 7), ENC(op, dmask, smask, src, 8) }
+#define ENC_OPCODE(op, dmask, smask) { \
+    ENC_SRC_ROW(op, dmask, smask, 0), ENC_SRC_ROW(op, dmask, smask, 1), ENC_SRC_ROW(op, dmask, smask, 2), \
+    ENC_SRC_ROW(op, dmask, smask, 3), ENC_SRC_ROW(op, dmask, smask, 4), ENC_SRC_ROW(op, dmask, smask, 5), \
+    ENC_SRC_ROW(op, dmask, smask, 6), ENC_SRC_ROW(op, dmask, smask, 7), ENC_SRC_ROW(op, dmask, smask, 8) }
+
+const uint16_t g_opcode_encoding[OPCODES_COUNT][OPERAND_ACCESS_RANGE][OPERAND_ACCESS_RANGE] = {
+    ENC_OPCODE(OPCODE_MOV,  OPERAND_ALL_RW, OPERAND_ALL_RO),
+    ENC_OPCODE(OPCODE_CMP,  OPERAND_ALL_RO, OPERAND_ALL_RO),
+    ENC_OPCODE(OPCODE_ADD,  OPERAND_ALL_RW, OPERAND_ALL_RO),
+    ENC_OPCODE(OPCODE_SUB,  OPERAND_ALL_RW, OPERAND_ALL_RO),
+    ENC_OPCODE(OPCODE_LEA,  OPERAND_ALL_RW, OPERAND_LABEL),
+    ENC_OPCODE(OPCODE_CLR,  OPERAND_ALL_RW, OPERAND_NONE),
+    ENC_OPCODE(OPCODE_NOT,  OPERAND_ALL_RW, OPERAND_NONE),
+    ENC_OPCODE(OPCODE_INC,  OPERAND_ALL_RW, OPERAND_NONE),
+    ENC_OPCODE(OPCODE_DEC,  OPERAND_ALL_RW, OPERAND_NONE),
+    ENC_OPCODE(OPCODE_JMP,  OPERAND_ALL_ADDR, OPERAND_NONE),
+    ENC_OPCODE(OPCODE_BNE,  OPERAND_ALL_ADDR, OPERAND_NONE),
+    ENC_OPCODE(OPCODE_RED,  OPERAND_ALL_RW, OPERAND_NONE),
+    ENC_OPCODE(OPCODE_PRN,  OPERAND_ALL_RO, OPERAND_NONE),
+    ENC_OPCODE(OPCODE_JSR,  OPERAND_ALL_ADDR, OPERAND_NONE),
+    ENC_OPCODE(OPCODE_RTS,  OPERAND_NONE, OPERAND_NONE),
+    ENC_OPCODE(OPCODE_STOP, OPERAND_NONE, OPERAND_NONE)
 };
+/* End of encoding table generation */
+
+opcode_t *find_opcode(const char *instruction_text, size_t len) {
+    const keyword_t *kw = keywords_find(instruction_text, len);
+    return (kw && kw->kind == KW_OPCODE) ? g_all_instructions + kw->value : NULL;
+}
 
-opcode_t *find_opcode(const char *instruction_text) {
-    /* uses sorted BTree traversal */
-    unsigned index = 0;
-    while (index < ARR_SIZE(g_all_instructions)) {
-        const int cmp_res = strcmp(g_all_instructions[index].opcode_text, instruction_text);
-        if (cmp_res == 0)
-            return g_all_instructions + index;
-        else
-            index = (2 * index) + (1 + !!(cmp_res < 0));
-    }
-    return NULL;
+const opcode_t *get_opcode(unsigned opcode) {
+    return (opcode < ARR_SIZE(g_all_instructions)) ? g_all_instructions + opcode : NULL;
 }
@@ -4,6 +4,7 @@
 #ifndef ASM_INSTRUCTIONS_H
 #define ASM_INSTRUCTIONS_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 #define MAX_CNT_OPERAND 2
@@ -19,9 +20,19 @@ enum operand_access {
     OPERAND_ALL_ADDR  = OPERAND_MEM_REG  | OPERAND_LABEL,
     OPERAND_ALL_RW    = OPERAND_ALL_ADDR | OPERAND_REG,
     OPERAND_ALL_RO    = OPERAND_ALL_RW   | OPERAND_IMMEDIATE,
-    OPERAND_ALL_REG   = OPERAND_MEM_REG  | OPERAND_REG
+    OPERAND_ALL_REG   = OPERAND_MEM_REG  | OPERAND_REG,
+
+    OPERAND_ACCESS_RANGE = OPERAND_REG + 1 /* count of values an access field may hold */
+};
+
+/** numbers of the opcodes, as encoded in the command word */
+enum opcode_number {
+    OPCODE_MOV = 0, OPCODE_CMP, OPCODE_ADD, OPCODE_SUB, OPCODE_LEA, OPCODE_CLR, OPCODE_NOT, OPCODE_INC,
+    OPCODE_DEC, OPCODE_JMP, OPCODE_BNE, OPCODE_RED, OPCODE_PRN, OPCODE_JSR, OPCODE_RTS, OPCODE_STOP
 };
 
+#define OPCODES_COUNT (OPCODE_STOP + 1)
+
 /**
  * information about an opcode
  */
@@ -34,9 +45,20 @@ typedef struct {
 #define INST_OPCODE_PARAM_COUNT(inst) ((!((inst)->operands[0] == OPERAND_NONE)) + (!((inst)->operands[1] == OPERAND_NONE)))
 
 /**
- * returns the instruction info represented by {instruction_text} parameter,
+ * returns the instruction info represented by {instruction_text} parameter of {len} characters,
  *  or NULL if not found.
  */
-opcode_t *find_opcode(const char *instruction_text);
+opcode_t *find_opcode(const char *instruction_text, size_t len);
+/**
+ * returns the instruction info of opcode number {opcode}, or NULL if there is no such opcode
+ */
+const opcode_t *get_opcode(unsigned opcode);
+
+/**
+ * Precomputed command words, indexed by [opcode][src access][dst access].
+ * Holds 0 when the combination isn't legal (a legal command word is never 0, as ARE is absolute).
+ */
+extern const uint16_t g_opcode_encoding[OPCODES_COUNT][OPERAND_ACCESS_RANGE][OPERAND_ACCESS_RANGE];
+#define OPCODE_ENCODE(opcode, src, dst) (g_opcode_encoding[opcode][src][dst])
 
 #endif
@@ -6,23 +6,64 @@ CONFIG -= qt
 QMAKE_CFLAGS += -Wall -pedantic -ansi
 
 QMAKE_CFLAGS += -m32
-QMAKE_LFLAGS += -m32
+QMAKE_LFLAGS += -m32 -pthread
 
 SOURCES += \
+        arena.c \
+        cache.c \
         data_seg.c \
+        incremental.c \
         instructions_list.c \
+        keywords.c \
         labels_list.c \
+        lexer.c \
+        macro.c \
         main.c \
+        objfile.c \
         opcodes.c \
-        parser.c
+    optimizer.c \
+        outbuf.c \
+        parser.c \
+        pipeline.c \
+        prescan.c \
+        scheduler.c \
+        server.c \
+        source.c \
+        spill.c \
+        stats.c
 
 HEADERS += \
+    arena.h \
+    cache.h \
     data_seg.h \
     global.h \
+    incremental.h \
     instructions_list.h \
+    keywords.h \
     labels_list.h \
+    lexer.h \
+    macro.h \
+    objfile.h \
     opcodes.h \
-    parser.h
+    optimizer.h \
+    outbuf.h \
+    parser.h \
+    pipeline.h \
+    prescan.h \
+    scheduler.h \
+    server.h \
+    source.h \
+    spill.h \
+    stats.h
 
 OTHER_FILES += \
-    tests/run_tests.sh
+    client.c \
+    disassembler.c \
+    linker.c \
+    objconv.c \
+    simulator.c \
+    tests/run_tests.sh \
+    tests/run_roundtrip.sh \
+    tests/run_parallel.sh \
+    tests/run_stats.sh \
+    bench/run_bench.sh
@@ -0,0 +1,121 @@
+/* This file is part of OpenU's C project implementation, called assembler
+ * Copyright (C) 2020 Arthur Zamarin, Norel Farjun */
+
+#include <string.h>
+
+#include "optimizer.h"
+
+/** longest chain of jmp instructions followed by one threaded operand, so a cycle of them ends */
+#define OPTIMIZER_MAX_HOPS 64
+
+/** flags of every code word */
+enum optimizer_mark {
+    OPTIMIZER_LABELED = 0x1, /* a code label points at the instruction */
+    OPTIMIZER_REMOVED = 0x2  /* the instruction is removed */
+};
+
+#define OPTIMIZER_OPCODE(command) BITS_GET(INST_OPCODE_RANGE, command)
+
+/**
+ * return the code address of the label {id} of {labels}, or {size} if it isn't a label of the code segment
+ * of {size} words
+ */
+static unsigned optimizer_code_label(const labels_list_t *labels, uint32_t id, unsigned size) {
+    const labels_list_node_t *node = labels_list_get_by_id(labels, id);
+    return (node->isSet && !node->isDS && !node->isExtr && node->addr < size) ? (unsigned)node->addr : size;
+}
+
+/**
+ * point every jmp, bne and jsr of {list} which jumps to a jmp of a label straight at the label of that jmp
+ */
+static void optimizer_thread_jumps(instructions_list *list, const labels_list_t *labels, optimizer_report_t *report) {
+    uint32_t *const slots = list->slots;
+    unsigned i, size, src, dst, opcode, target, hops;
+    uint32_t id;
+
+    for (i = 0; i < list->size; i += 1 + size) {
+        size = instructions_list_operands_size(slots[i], &src, &dst);
+        opcode = OPTIMIZER_OPCODE(slots[i]);
+        if ((opcode != OPCODE_JMP && opcode != OPCODE_BNE && opcode != OPCODE_JSR) || dst != OPERAND_LABEL)
+            continue;
+        /* a single operand is dst, so its slot is right after the command */
+        for (id = slots[i + 1], hops = 0; hops < OPTIMIZER_MAX_HOPS; ++hops) {
+            target = optimizer_code_label(labels, id, list->size);
+            if (target == list->size || OPTIMIZER_OPCODE(slots[target]) != OPCODE_JMP ||
+                    BITS_GET(INST_OPR1_ACCS_RANGE, slots[target]) != OPERAND_LABEL || slots[target + 1] == id)
+                break;
+            id = slots[target + 1];
+        }
+        if (id != slots[i + 1]) {
+            slots[i + 1] = id;
+            ++report->threaded;
+        }
+    }
+}
+
+/**
+ * mark in {marks} the instructions of {list} to remove: the unreachable ones, and the moves of a register to itself
+ */
+static void optimizer_mark_removed(const instructions_list *list, unsigned char *marks, optimizer_report_t *report) {
+    const uint32_t *const slots = list->slots;
+    unsigned i, size, src, dst, opcode;
+    BOOL is_reachable = TRUE;
+
+    for (i = 0; i < list->size; i += 1 + size) {
+        size = instructions_list_operands_size(slots[i], &src, &dst);
+        opcode = OPTIMIZER_OPCODE(slots[i]);
+        if (marks[i] & OPTIMIZER_LABELED)
+            is_reachable = TRUE;
+        if (!is_reachable) {
+            marks[i] |= OPTIMIZER_REMOVED;
+            ++report->unreachable;
+        } else if (opcode == OPCODE_MOV && src == OPERAND_REG && dst == OPERAND_REG &&
+                   BITS_GET(DATA_SRC_REG_RANGE, slots[i + 1]) == BITS_GET(DATA_DST_REG_RANGE, slots[i + 1])) {
+            marks[i] |= OPTIMIZER_REMOVED;
+            ++report->self_moves;
+        }
+        if (opcode == OPCODE_STOP || opcode == OPCODE_RTS || opcode == OPCODE_JMP)
+            is_reachable = FALSE;
+    }
+}
+
+BOOL optimizer_run(instructions_list *list, labels_list_t *labels, optimizer_report_t *report) {
+    unsigned char *marks;
+    uint32_t *moved;
+    labels_list_node_t *iter;
+    unsigned i, index, kept, kept_count, size, src, dst;
+
+    memset(report, 0, sizeof(optimizer_report_t));
+    if (list->size == 0)
+        return TRUE;
+    /* the new address of every instruction, a removed one moves its labels to the next kept instruction */
+    if (!(marks = arena_alloc(list->arena, list->size)) ||
+            !(moved = arena_alloc(list->arena, (list->size + 1) * sizeof(uint32_t))))
+        return FALSE;
+    memset(marks, 0, list->size);
+    for (iter = labels->head; iter; iter = iter->next)
+        if ((i = optimizer_code_label(labels, iter->id, list->size)) < list->size)
+            marks[i] |= OPTIMIZER_LABELED;
+
+    optimizer_thread_jumps(list, labels, report);
+    optimizer_mark_removed(list, marks, report);
+
+    /* compact the slots and the lines of the kept instructions */
+    for (i = index = kept = kept_count = 0; i < list->size; i += 1 + size, ++index) {
+        size = instructions_list_operands_size(list->slots[i], &src, &dst);
+        moved[i] = kept;
+        if (marks[i] & OPTIMIZER_REMOVED)
+            continue;
+        memmove(list->slots + kept, list->slots + i, (1 + size) * sizeof(uint32_t));
+        list->linenums[kept_count++] = list->linenums[index];
+        kept += 1 + size;
+    }
+    moved[list->size] = kept;
+    for (iter = labels->head; iter; iter = iter->next)
+        if (iter->isSet && !iter->isDS && !iter->isExtr && iter->addr <= list->size)
+            iter->addr = moved[iter->addr];
+    report->words_saved = list->size - kept;
+    list->size = kept;
+    list->count = kept_count;
+    return TRUE;
+}
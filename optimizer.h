@@ -0,0 +1,35 @@
+/* This file is part of OpenU's C project implementation, called assembler
+ * Copyright (C) 2020 Arthur Zamarin, Norel Farjun */
+
+#ifndef ASM_OPTIMIZER_H
+#define ASM_OPTIMIZER_H
+
+#include "global.h"
+#include "instructions_list.h"
+#include "labels_list.h"
+
+/**
+ * Peephole optimizer of the code segment, run between parsing and labels_list_check_and_fix.
+ * It rewrites the instructions in place and moves the code labels with them, while their addresses are still
+ * relative to the code segment, so fixing the labels afterwards gives the addresses of the shrunk segment.
+ * The rewrites assume code is reached only through labels, and is never read or written as data.
+ */
+
+/**
+ * Counts of the rewrites made by optimizer_run
+ */
+typedef struct optimizer_report_t {
+    unsigned long threaded;    /* jmp, bne and jsr operands moved past the jmp they jumped to */
+    unsigned long unreachable; /* instructions removed after stop, rts or jmp, up to the next label */
+    unsigned long self_moves;  /* "mov" of a register to itself removed */
+    unsigned long words_saved; /* code words removed by all the rewrites */
+} optimizer_report_t;
+
+/**
+ * optimize the code segment {list}, whose code labels in {labels} have addresses relative to it
+ * the rewrites are counted into {report}, which is zeroed first
+ * return false if out of memory, leaving {list} and {labels} unchanged
+ */
+BOOL optimizer_run(instructions_list *list, labels_list_t *labels, optimizer_report_t *report);
+
+#endif
@@ -0,0 +1,167 @@
+/* This file is part of OpenU's C project implementation, called assembler
+ * Copyright (C) 2020 Arthur Zamarin, Norel Farjun */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include "outbuf.h"
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/** all decimal numbers 0..99 as two digits */
+static const char g_decimal_pairs[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+/** all octal numbers 0..63 as two digits */
+static const char g_octal_pairs[] =
+    "0001020304050607101112131415161720212223242526273031323334353637"
+    "4041424344454647505152535455565760616263646566677071727374757677";
+
+/** length of an object file record without the address: space, 5 octal digits and new line */
+#define OBJECT_WORD_LEN 7
+
+BOOL outbuf_init(outbuf_t *buf, arena_t *arena, size_t capacity) {
+    buf->len = 0;
+    buf->capacity = capacity;
+    return (buf->data = arena_alloc(arena, capacity ? capacity : 1)) != NULL;
+}
+
+size_t outbuf_addr_len(unsigned number) {
+    size_t len = 4;
+    for (number /= 10000; number; number /= 10)
+        ++len;
+    return len;
+}
+
+size_t outbuf_object_len(unsigned start_addr, unsigned count) {
+    const unsigned long end = (unsigned long)start_addr + count;
+    unsigned long threshold;
+    size_t len = (size_t)count * (4 + OBJECT_WORD_LEN);
+    /* every address past a power of ten threshold has one more digit */
+    for (threshold = 10000; threshold < end; threshold *= 10)
+        len += end - (threshold > start_addr ? threshold : start_addr);
+    return len;
+}
+
+void outbuf_put_text(outbuf_t *buf, const char *text, size_t len) {
+    memcpy(buf->data + buf->len, text, len);
+    buf->len += len;
+}
+
+/**
+ * write {number} with exactly {len} decimal digits into {out}, filling from the end with two digits at once
+ */
+static void outbuf_format_decimal(char *out, unsigned number, size_t len) {
+    char *p = out + len;
+    for (; p - out >= 2; number /= 100) {
+        p -= 2;
+        memcpy(p, g_decimal_pairs + (number % 100) * 2, 2);
+    }
+    if (p != out)
+        *out = (char)('0' + number % 10);
+}
+
+/**
+ * write object file record of {word} at {addr}, whose length is {addr_len}, into {out}
+ */
+static void outbuf_format_object_word(char *out, unsigned addr, size_t addr_len, unsigned word) {
+    outbuf_format_decimal(out, addr, addr_len);
+    out += addr_len;
+    out[0] = ' ';
+    out[1] = (char)('0' + ((word >> 12) & 07));
+    memcpy(out + 2, g_octal_pairs + ((word >> 6) & 077) * 2, 2);
+    memcpy(out + 4, g_octal_pairs + (word & 077) * 2, 2);
+    out[6] = '\n';
+}
+
+void outbuf_put_object_word(outbuf_t *buf, unsigned addr, unsigned word) {
+    const size_t addr_len = outbuf_addr_len(addr);
+    outbuf_format_object_word(buf->data + buf->len, addr, addr_len, word);
+    buf->len += addr_len + OBJECT_WORD_LEN;
+}
+
+void outbuf_put_object_words(outbuf_t *buf, unsigned start_addr, const uint16_t *words, size_t count) {
+    size_t addr_len = outbuf_addr_len(start_addr), i;
+    unsigned long next_len_addr = 10000; /* first address with one more digit */
+    char *out = buf->data + buf->len;
+
+    while (next_len_addr <= start_addr)
+        next_len_addr *= 10;
+    for (i = 0; i < count; ++i) {
+        if (start_addr + i == next_len_addr) {
+            ++addr_len;
+            next_len_addr *= 10;
+        }
+        outbuf_format_object_word(out, (unsigned)(start_addr + i), addr_len, words[i]);
+        out += addr_len + OBJECT_WORD_LEN;
+    }
+    buf->len = (size_t)(out - buf->data);
+}
+
+void outbuf_put_symbol(outbuf_t *buf, const char *label, size_t len, unsigned addr) {
+    const size_t addr_len = outbuf_addr_len(addr);
+    char *out = buf->data + buf->len;
+
+    memcpy(out, label, len);
+    out[len] = ' ';
+    outbuf_format_decimal(out + len + 1, addr, addr_len);
+    out[len + 1 + addr_len] = '\n';
+    buf->len += len + 2 + addr_len;
+}
+
+/**
+ * return true if the file {filename} exists and its content is exactly {len} bytes of {data}
+ */
+static BOOL outbuf_file_equals(const char *data, size_t len, const char *filename) {
+    char buffer[4096];
+    struct stat st;
+    ssize_t ret;
+    int fd;
+
+    if ((fd = open(filename, O_RDONLY)) < 0)
+        return FALSE;
+    if (fstat(fd, &st) || (size_t)st.st_size != len) {
+        close(fd);
+        return FALSE;
+    }
+    while (len) {
+        if ((ret = read(fd, buffer, len < sizeof(buffer) ? len : sizeof(buffer))) <= 0) {
+            if (ret < 0 && errno == EINTR)
+                continue;
+            break;
+        }
+        if (memcmp(buffer, data, (size_t)ret))
+            break;
+        data += ret;
+        len -= (size_t)ret;
+    }
+    close(fd);
+    return len == 0;
+}
+
+BOOL outbuf_write_data(const char *data, size_t len, const char *filename, BOOL keep_identical) {
+    const char *ptr = data;
+    size_t remaining = len;
+    ssize_t ret;
+    int fd;
+
+    if (keep_identical && outbuf_file_equals(data, len, filename))
+        return TRUE;
+    if ((fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0666)) < 0)
+        return FALSE;
+    while (remaining) {
+        if ((ret = write(fd, ptr, remaining)) < 0) {
+            if (errno == EINTR)
+                continue;
+            close(fd);
+            return FALSE;
+        }
+        ptr += ret;
+        remaining -= (size_t)ret;
+    }
+    return close(fd) == 0;
+}
@@ -0,0 +1,74 @@
+/* This file is part of OpenU's C project implementation, called assembler
+ * Copyright (C) 2020 Arthur Zamarin, Norel Farjun */
+
+#ifndef ASM_OUTBUF_H
+#define ASM_OUTBUF_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "global.h"
+#include "arena.h"
+
+/**
+ * Output file content, formatted in memory and written with one system call.
+ * The buffer is allocated once with the exact size of the file, so there are no bounds checks when filling it.
+ */
+typedef struct {
+    char *data;
+    size_t len;      /* bytes filled */
+    size_t capacity; /* bytes allocated */
+} outbuf_t;
+
+/**
+ * allocate {capacity} bytes for {buf} from {arena}
+ * return false if out of memory
+ */
+BOOL outbuf_init(outbuf_t *buf, arena_t *arena, size_t capacity);
+
+/**
+ * return the length of {number} when formatted with at least 4 digits, as in "%04u"
+ */
+size_t outbuf_addr_len(unsigned number);
+/**
+ * return the length of {count} object file records, whose addresses start with {start_addr}
+ */
+size_t outbuf_object_len(unsigned start_addr, unsigned count);
+/**
+ * return the length of an entries or externals file record of {label_len} characters label at {addr}
+ */
+#define OUTBUF_SYMBOL_LEN(label_len, addr) ((label_len) + 2 + outbuf_addr_len(addr))
+
+/**
+ * append {len} bytes of {text} into {buf}
+ */
+void outbuf_put_text(outbuf_t *buf, const char *text, size_t len);
+/**
+ * append object file record of {word} at {addr} into {buf}, formatted as OBJECT_FILE_OUTPUT_FORMAT
+ * {word} must fit in 15 bits
+ */
+void outbuf_put_object_word(outbuf_t *buf, unsigned addr, unsigned word);
+/**
+ * append object file records of {count} {words}, whose addresses start with {start_addr}, into {buf}
+ * every word must fit in 15 bits
+ */
+void outbuf_put_object_words(outbuf_t *buf, unsigned start_addr, const uint16_t *words, size_t count);
+/**
+ * append entries or externals file record of {label} with {len} characters at {addr} into {buf},
+ * formatted as ENTRIES_FILE_OUTPUT_FORMAT
+ */
+void outbuf_put_symbol(outbuf_t *buf, const char *label, size_t len, unsigned addr);
+
+/**
+ * create (or truncate) the file {filename} and write {len} bytes of {data} into it
+ * if {keep_identical} is set and the file already has exactly this content, it isn't touched (so its mtime stays)
+ * return false on any error
+ */
+BOOL outbuf_write_data(const char *data, size_t len, const char *filename, BOOL keep_identical);
+/**
+ * write all the content of {buf} into the file {filename}, as outbuf_write_data
+ */
+#define outbuf_write_file(buf, filename, keep_identical) \
+    outbuf_write_data((buf)->data, (buf)->len, filename, keep_identical)
+
+#endif
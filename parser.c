@@ -3,19 +3,58 @@
 
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
 
 #include "parser.h"
+#include "arena.h"
+#include "stats.h"
+#include "lexer.h"
+#include "prescan.h"
+#include "macro.h"
+#include "optimizer.h"
+#include "pipeline.h"
+#include "spill.h"
 #include "opcodes.h"
+#include "keywords.h"
+#include "outbuf.h"
+#include "objfile.h"
 #include "data_seg.h"
 #include "labels_list.h"
 #include "instructions_list.h"
 
+/** count of lines to scan at once */
+#define PARSER_LINES_BATCH 256
+/** count of .data numbers to append at once */
+#define PARSER_DATA_BATCH 64
+/** count of parsed source bytes whose memory is released at once, when streaming */
+#define PARSER_DROP_BYTES (1UL << 20)
+/** least count of code words handed to the writer at once, when pipelined */
+#define PARSER_PIPELINE_WORDS 16384
+
 struct parser_ctx_t {
+    arena_t arena;    /* owns all the memory of the structures below */
+    FILE *err_stream; /* destination of all the diagnostics */
+    size_t max_line_len;
     instructions_list insts;
     labels_list_t labels;
     dataseg_t data_seg;
-    uint16_t entry_cnt, extern_cnt;
+    unsigned long entry_cnt, extern_cnt;
+    stats_t *stats;   /* destination of timings and counters, or NULL */
+    BOOL keep_identical;  /* don't rewrite output files which already have the same content */
+    BOOL binary;          /* also output the binary object file */
+    BOOL large;           /* large-program mode: labels addresses don't wrap, and numbers are never truncated */
+    BOOL optimize;        /* run the peephole optimizer over the code segment */
+    optimizer_report_t optimized; /* rewrites of the last optimizer run */
+    unsigned output_threads; /* count of threads encoding the code segment, 0 or 1 to encode in this thread */
+    BOOL pipeline;        /* scan the input and write the outputs on threads of their own */
+    struct pipeline_writer_t *writer; /* writer of the output files, started while parsing when it formats the
+                                       * code records, or NULL to write them here */
+    unsigned pipelined_size; /* count of code words handed to the writer while parsing */
+    char *records;        /* code records taken from the writer, freed once it is done */
+    BOOL stream;          /* spill the segments into temporary files while parsing, so memory is bounded */
+    spill_t spill;        /* the spilled part of the segments, open only while streaming a file */
+    const char *copy_dir; /* directory receiving a copy of all output files, or NULL */
+    parser_output_func output_func; /* receiver of the output files instead of writing them, or NULL */
+    void *output_arg;
 };
 
 struct parser_ctx_t *parser_new(void) {
@@ -24,48 +63,205 @@ struct parser_ctx_t *parser_new(void) {
         return NULL;
 
     ctx->entry_cnt = ctx->extern_cnt = 0;
-    ctx->insts = instructions_list_new();
-    ctx->labels = labels_list_new();
-    ctx->data_seg = dataseg_new();
+    ctx->err_stream = ERR_STREAM;
+    ctx->max_line_len = MAX_LINE_LEN;
+    ctx->stats = NULL;
+    ctx->keep_identical = FALSE;
+    ctx->binary = FALSE;
+    ctx->large = FALSE;
+    ctx->optimize = FALSE;
+    memset(&ctx->optimized, 0, sizeof(optimizer_report_t));
+    ctx->output_threads = 0;
+    ctx->pipeline = FALSE;
+    ctx->writer = NULL;
+    ctx->pipelined_size = 0;
+    ctx->records = NULL;
+    ctx->stream = FALSE;
+    ctx->spill = spill_new();
+    ctx->copy_dir = NULL;
+    ctx->output_func = NULL;
+    ctx->output_arg = NULL;
+    ctx->arena = arena_new();
+    ctx->insts = instructions_list_new(&ctx->arena);
+    ctx->labels = labels_list_new(&ctx->arena);
+    ctx->data_seg = dataseg_new(&ctx->arena);
     return ctx;
 }
 
+/**
+ * stop the writer of {ctx}, if it was started while parsing, and free the records taken from it
+ * return false if any of the files put into it couldn't be written
+ */
+static BOOL parser_stop_writer(struct parser_ctx_t *ctx) {
+    BOOL res = TRUE;
+    if (ctx->writer)
+        res = pipeline_writer_dealloc(ctx->writer);
+    ctx->writer = NULL;
+    ctx->pipelined_size = 0;
+    free(ctx->records);
+    ctx->records = NULL;
+    return res;
+}
+
+void parser_reset(struct parser_ctx_t *ctx) {
+    parser_stop_writer(ctx);
+    spill_close(&ctx->spill);
+    arena_reset(&ctx->arena);
+    ctx->entry_cnt = ctx->extern_cnt = 0;
+    memset(&ctx->optimized, 0, sizeof(optimizer_report_t));
+    ctx->insts = instructions_list_new(&ctx->arena);
+    ctx->labels = labels_list_new(&ctx->arena);
+    ctx->data_seg = dataseg_new(&ctx->arena);
+}
+
 void parser_dealloc(struct parser_ctx_t *ctx) {
-    dataseg_dealloc(&ctx->data_seg);
-    labels_list_dealloc(&ctx->labels);
-    instructions_list_dealloc(&ctx->insts);
+    parser_stop_writer(ctx);
+    spill_close(&ctx->spill);
+    arena_dealloc(&ctx->arena);
     free(ctx);
 }
 
-static BOOL check_good_label_name(const char *label) {
-    const char *ptr;
-    if (!isalpha(*label))
+void parser_set_err_stream(struct parser_ctx_t *ctx, FILE *err_stream) {
+    ctx->err_stream = err_stream;
+}
+
+void parser_set_max_line_len(struct parser_ctx_t *ctx, size_t max_line_len) {
+    ctx->max_line_len = max_line_len;
+}
+
+void parser_set_stats(struct parser_ctx_t *ctx, stats_t *stats) {
+    ctx->stats = stats;
+}
+
+void parser_set_keep_identical(struct parser_ctx_t *ctx, BOOL keep_identical) {
+    ctx->keep_identical = keep_identical;
+}
+
+void parser_set_binary(struct parser_ctx_t *ctx, BOOL binary) {
+    ctx->binary = binary;
+}
+
+void parser_set_large(struct parser_ctx_t *ctx, BOOL large) {
+    ctx->large = large;
+}
+
+void parser_set_optimize(struct parser_ctx_t *ctx, BOOL optimize) {
+    ctx->optimize = optimize;
+}
+
+void parser_set_output_threads(struct parser_ctx_t *ctx, unsigned threads_cnt) {
+    ctx->output_threads = threads_cnt;
+}
+
+void parser_set_pipeline(struct parser_ctx_t *ctx, BOOL pipeline) {
+    ctx->pipeline = pipeline;
+}
+
+void parser_set_stream(struct parser_ctx_t *ctx, BOOL stream) {
+    ctx->stream = stream;
+}
+
+void parser_set_copy_dir(struct parser_ctx_t *ctx, const char *copy_dir) {
+    ctx->copy_dir = copy_dir;
+}
+
+void parser_set_output_func(struct parser_ctx_t *ctx, parser_output_func func, void *arg) {
+    ctx->output_func = func;
+    ctx->output_arg = arg;
+}
+
+FILE *parser_get_err_stream(struct parser_ctx_t *ctx) {
+    return ctx->err_stream;
+}
+
+BOOL parser_get_large(struct parser_ctx_t *ctx) {
+    return ctx->large;
+}
+
+BOOL parser_get_optimize(struct parser_ctx_t *ctx) {
+    return ctx->optimize;
+}
+
+const struct arena_t *parser_get_arena(struct parser_ctx_t *ctx) {
+    return &ctx->arena;
+}
+
+const struct optimizer_report_t *parser_get_optimizer_report(struct parser_ctx_t *ctx) {
+    return &ctx->optimized;
+}
+
+char *parser_filename(struct parser_ctx_t *ctx, const char *basename, const char *extension) {
+    char *name;
+    size_t len = strlen(basename);
+    if (!(name = arena_alloc(&ctx->arena, len + MAX_LEN_EXTENSION + 1)))
+        return NULL;
+    memcpy(name, basename, len);
+    strcpy(name + len, extension);
+    return name;
+}
+
+/** printf arguments for printing line_view_t {view} with "%.*s" */
+#define VIEW_ARGS(view) (int)(view).len, (view).ptr
+
+static BOOL check_good_label_name(line_view_t label) {
+    size_t i;
+    const keyword_t *kw;
+    if (label.len == 0 || !LEXER_IS(label.ptr[0], LEX_ALPHA))
         return FALSE; /* first char must be a letter */
 
-    for (ptr = label; *ptr; ++ptr)
-        if (!isalnum(*ptr))
+    for (i = 1; i < label.len; ++i)
+        if (!LEXER_IS(label.ptr[i], LEX_ALNUM))
             return FALSE; /* other chars must be a alphanumeric */
 
-    if (find_opcode(label))
-        return FALSE; /* label is a opcode keyword */
-    if (label[0] == 'r' && label[2] == '\0' && BITS_IS_IN_RANGE(DATA_DST_REG_RANGE, label[1] - '0'))
-        return FALSE; /* label is a register keyword */
+    if ((kw = keywords_find(label.ptr, label.len)) &&
+        (kw->kind == KW_OPCODE || kw->kind == KW_REGISTER || kw->kind == KW_MACRO))
+        return FALSE; /* label is a opcode, register or macro keyword */
     return TRUE;
 }
 
+/** mask of the labels addresses of {ctx} */
+#define PARSER_ADDR_MASK(ctx) ((ctx)->large ? LABELS_LIST_LARGE_ADDR_MASK : LABELS_LIST_ADDR_MASK)
+/** count of words of the code and data segments of {ctx}, including the spilled ones */
+#define PARSER_CODE_SIZE(ctx) ((ctx)->spill.code_size + (ctx)->insts.size)
+#define PARSER_DATA_SIZE(ctx) ((ctx)->spill.data_size + (ctx)->data_seg.size)
+
+/**
+ * convert {text} like lexer_parse_number, but truncated to 16 bits
+ * if {large} is set, the number is clamped instead, so it stays out of every range when it doesn't fit
+ * return false if {text} isn't a number
+ */
+static BOOL parser_parse_number(line_view_t text, int16_t *value, BOOL large) {
+    long number;
+    BOOL res = lexer_parse_number(text, &number);
+    if (large && number > INT16_MAX)
+        *value = INT16_MAX;
+    else if (large && number < INT16_MIN)
+        *value = INT16_MIN;
+    else
+        *value = (int16_t)number;
+    return res;
+}
+
 /**
- * parse {operand} string and return the calculated operand_t
+ * return {view} without its first {count} characters
+ */
+static line_view_t view_skip(line_view_t view, size_t count) {
+    view.ptr += count;
+    view.len -= count;
+    return view;
+}
+
+/**
+ * parse {operand} string and return the calculated operand_t, numbers are parsed with {large} mode
  * if it is a label, it only sets type to OPERAND_LABEL and caller should find the label_node_object
  * if the input it mismatched, {error_text} is set to the error.
  */
-static operand_t parser_parse_operand(const char *operand, const char **error_text) {
-    char *endp;
+static operand_t parser_parse_operand(line_view_t operand, BOOL large, const char **error_text) {
     operand_t res;
     res.type = OPERAND_NONE;
-    switch (*operand) {
+    switch (operand.ptr[0]) {
         case '#':
-            res.u.value = (int16_t)strtol(operand + 1, &endp, 10);
-            if (endp && *endp)
+            if (!parser_parse_number(view_skip(operand, 1), &res.u.value, large))
                 *error_text = "Incorrect immediate value - not a number";
             else {
                 const int16_t UB = (1 << (DATA_IMMEDIATE_RANGE(BIT_RANGE_END) - DATA_IMMEDIATE_RANGE(BIT_RANGE_START)));
@@ -78,17 +274,15 @@ static operand_t parser_parse_operand(const char *operand, const char **error_te
             }
             break;
         case '*':
-            res.u.value = (int16_t)strtol(operand + 2, &endp, 10);
-            if (operand[1] != 'r')
+            if (operand.len < 2 || operand.ptr[1] != 'r')
                 *error_text = "Incorrect indirect register format";
-            else if ((endp && *endp) || !BITS_IS_IN_RANGE(DATA_DST_REG_RANGE, res.u.value))
+            else if (!parser_parse_number(view_skip(operand, 2), &res.u.value, large) || !BITS_IS_IN_RANGE(DATA_DST_REG_RANGE, res.u.value))
                 *error_text = "Incorrect indirect register value";
             else
                 res.type = OPERAND_MEM_REG;
             break;
         case 'r':
-            res.u.value = (int16_t)strtol(operand + 1, &endp, 10);
-            if ((!endp || !*endp) && BITS_IS_IN_RANGE(DATA_DST_REG_RANGE, res.u.value)) {
+            if (parser_parse_number(view_skip(operand, 1), &res.u.value, large) && BITS_IS_IN_RANGE(DATA_DST_REG_RANGE, res.u.value)) {
                 res.type = OPERAND_REG;
                 break;
             }
@@ -103,140 +297,152 @@ static operand_t parser_parse_operand(const char *operand, const char **error_te
     return res;
 }
 
-static BOOL parser_parse_instuction(struct parser_ctx_t *ctx, unsigned linenum, const char *str) {
-    char opcode_str[MAX_INPUT_LEN + 1], operands[MAX_CNT_OPERAND][MAX_INPUT_LEN + 1], sink[MAX_INPUT_LEN + 1];
+static BOOL parser_parse_instuction(struct parser_ctx_t *ctx, unsigned linenum, lexer_t *lex) {
+    line_view_t words[LEXER_INSTRUCTION_WORDS];
     int line_parse_ret, oprn_i;
 
     opcode_t *opcode;
 
-#define READ_STR "%" XSTR(MAX_INPUT_LEN) "[-#*A-Z0-9a-z]"
-    line_parse_ret = sscanf(str, " " READ_STR " " READ_STR " , " READ_STR " %" XSTR(MAX_INPUT_LEN) "s",
-                            opcode_str, operands[0], operands[1], sink);
-#undef READ_STR
+    line_parse_ret = (int)lexer_scan_instruction(lex, words);
     if (line_parse_ret <= 0) {
-        fprintf(ERR_STREAM, "%u: Incorrect instruction line\n", linenum);
+        fprintf(ctx->err_stream, "%u: Incorrect instruction line\n", linenum);
         return FALSE;
     }
     --line_parse_ret;
-    if (!(opcode = find_opcode(opcode_str))) {
-        fprintf(ERR_STREAM, "%u: unknown instruction \'%s\'\n", linenum, opcode_str);
+    if (!(opcode = find_opcode(words[0].ptr, words[0].len))) {
+        fprintf(ctx->err_stream, "%u: unknown instruction \'%.*s\'\n", linenum, VIEW_ARGS(words[0]));
         return FALSE;
     } else if (line_parse_ret < INST_OPCODE_PARAM_COUNT(opcode)) {
-        fprintf(ERR_STREAM, "%u: missing operands for instruction \'%s\'\n", linenum, opcode_str);
+        fprintf(ctx->err_stream, "%u: missing operands for instruction \'%.*s\'\n", linenum, VIEW_ARGS(words[0]));
         return FALSE;
     } else if (line_parse_ret > INST_OPCODE_PARAM_COUNT(opcode)) {
-        fprintf(ERR_STREAM, "%u: extra operands for instruction \'%s\'\n", linenum, opcode_str);
+        fprintf(ctx->err_stream, "%u: extra operands for instruction \'%.*s\'\n", linenum, VIEW_ARGS(words[0]));
         return FALSE;
     } else {
-        instruction_t *inst = malloc(sizeof(instruction_t));
+        operand_t operands[MAX_CNT_OPERAND];
         for (oprn_i = 0; oprn_i < line_parse_ret; ++oprn_i) {
-            const char *error_text = NULL, *oprn_str = operands[line_parse_ret - 1 - oprn_i];
-            inst->operands[oprn_i] = parser_parse_operand(oprn_str, &error_text);
+            const char *error_text = NULL;
+            const line_view_t oprn_str = words[line_parse_ret - oprn_i];
+            operands[oprn_i] = parser_parse_operand(oprn_str, ctx->large, &error_text);
             if (error_text) {
-                fprintf(ERR_STREAM, "%u: error with \'%s\': %s\n", linenum, oprn_str, error_text);
-                free(inst);
+                fprintf(ctx->err_stream, "%u: error with \'%.*s\': %s\n", linenum, VIEW_ARGS(oprn_str), error_text);
+                return FALSE;
+            } else if ((operands[oprn_i].type & opcode->operands[oprn_i]) == 0) {
+                fprintf(ctx->err_stream, "%u: \'%.*s\' is illegal as operand number %d for %.*s\n", linenum, VIEW_ARGS(oprn_str), line_parse_ret - oprn_i, VIEW_ARGS(words[0]));
                 return FALSE;
-            } else if ((inst->operands[oprn_i].type & opcode->operands[oprn_i]) == 0) {
-                fprintf(ERR_STREAM, "%u: \'%s\' is illegal as operand number %d for %s\n", linenum, oprn_str, line_parse_ret - oprn_i, opcode_str);
-                free(inst);
+            } else if (operands[oprn_i].type == OPERAND_LABEL &&
+                       !(operands[oprn_i].u.label_ptr = labels_list_get_label(&ctx->labels, oprn_str.ptr, oprn_str.len))) {
+                fprintf(ctx->err_stream, "%u: out of memory\n", linenum);
                 return FALSE;
-            } else if (inst->operands[oprn_i].type == OPERAND_LABEL)
-                inst->operands[oprn_i].u.label_ptr = labels_list_get_label(&ctx->labels, oprn_str);
+            }
         }
         for (; oprn_i < MAX_CNT_OPERAND; ++oprn_i)
-            inst->operands[oprn_i].type = OPERAND_NONE;
-
-        inst->linenum = linenum;
-        inst->command = 0;
-        BITS_SET(INST_ARE_RANGE, inst->command, INST_ARE_ABSOLUTE);
-        BITS_SET(INST_OPCODE_RANGE, inst->command, opcode->opcode);
-        BITS_SET(INST_OPR1_ACCS_RANGE, inst->command, (uint16_t)inst->operands[0].type); /* dst */
-        BITS_SET(INST_OPR2_ACCS_RANGE, inst->command, (uint16_t)inst->operands[1].type); /* src */
-        instructions_list_add(&ctx->insts, inst);
+            operands[oprn_i].type = OPERAND_NONE;
+
+        if (!instructions_list_add(&ctx->insts, OPCODE_ENCODE(opcode->opcode, operands[1].type, operands[0].type),
+                                   operands, linenum)) {
+            fprintf(ctx->err_stream, "%u: out of memory\n", linenum);
+            return FALSE;
+        }
         return TRUE;
     }
 }
 
-static BOOL parser_parse_definition_data(struct parser_ctx_t *ctx, unsigned linenum, const char *str) {
-    char data[MAX_INPUT_LEN + 1] = {0}, delim[2], sink[MAX_INPUT_LEN + 1];
-    char *endp;
-    int line_parse_ret, pos1, pos2;
+static BOOL parser_parse_definition_data(struct parser_ctx_t *ctx, unsigned linenum, lexer_t *lex) {
+    line_view_t data;
+    BOOL has_comma;
     int16_t number;
+    uint16_t numbers[PARSER_DATA_BATCH];
+    size_t count = 0;
     const int16_t UB = (1 << (DATASEG_VALUE(BIT_RANGE_END) - DATASEG_VALUE(BIT_RANGE_START)));
 
-    while ((line_parse_ret = sscanf(str, " %"XSTR(MAX_INPUT_LEN)"[^, \t\n] %n %1[,] %n %"XSTR(MAX_INPUT_LEN)"s",
-                                    data, &pos1, delim, &pos2, sink)) > 0) {
-        number = (int16_t)strtol(data, &endp, 10);
-        if ((line_parse_ret > 1) ? (delim[0] != ',') : (str[pos1] != '\0')) {
-            fprintf(ERR_STREAM, "%u: Missing comma after \'%s\'\n", linenum, data);
+    for (;;) {
+        lexer_skip_spaces(lex);
+        if ((data = lexer_take_run(lex, LEX_VALUE)).len == 0)
+            break;
+        lexer_skip_spaces(lex);
+        if (!(has_comma = lexer_take_char(lex, ',')) && !lexer_at_end(lex)) {
+            fprintf(ctx->err_stream, "%u: Missing comma after \'%.*s\'\n", linenum, VIEW_ARGS(data));
             return FALSE;
-        } else if (endp && *endp) {
-            fprintf(ERR_STREAM, "%u: Incorrect value \'%s\'\n", linenum, data);
+        } else if (!parser_parse_number(data, &number, ctx->large)) {
+            fprintf(ctx->err_stream, "%u: Incorrect value \'%.*s\'\n", linenum, VIEW_ARGS(data));
             return FALSE;
         } else if (number >= UB || number < -UB) {
-            fprintf(ERR_STREAM, "%u: Value \'%s\' not in range\n", linenum, data);
+            fprintf(ctx->err_stream, "%u: Value \'%.*s\' not in range\n", linenum, VIEW_ARGS(data));
+            return FALSE;
+        }
+        numbers[count++] = (uint16_t)((number + (UB << 1)) & ((UB << 1) - 1));
+        /* the numbers are appended in batches, and the last batch when the line ends */
+        if ((count == PARSER_DATA_BATCH || !has_comma) && !dataseg_append_numbers(&ctx->data_seg, numbers, count)) {
+            fprintf(ctx->err_stream, "%u: out of memory\n", linenum);
             return FALSE;
         }
-        dataseg_append_number(&ctx->data_seg, (number + (UB << 1)) & ((UB << 1) - 1));
-        str += pos2;
-        if (line_parse_ret == 1)
+        if (!has_comma)
             return TRUE;
+        count %= PARSER_DATA_BATCH;
     }
-    fprintf(ERR_STREAM, "%u: Incorrect line\n", linenum);
+    fprintf(ctx->err_stream, "%u: Incorrect line\n", linenum);
     return FALSE;
 }
 
-static BOOL parser_parse_definition_string(struct parser_ctx_t *ctx, unsigned linenum, const char *str) {
-    char data[MAX_INPUT_LEN + 1] = {0}, sink[MAX_INPUT_LEN + 1];
-    int line_parse_ret;
+static BOOL parser_parse_definition_string(struct parser_ctx_t *ctx, unsigned linenum, lexer_t *lex) {
+    line_view_t data;
 
-    line_parse_ret = sscanf(str, " \"%" XSTR(MAX_INPUT_LEN) "[A-Z0-9a-z]\" %" XSTR(MAX_INPUT_LEN) "s",
-                            data, sink);
-    if (line_parse_ret == 0) {
-        fprintf(ERR_STREAM, "%u: missing string\n", linenum);
+    lexer_skip_spaces(lex);
+    if (lexer_at_end(lex)) {
+        /* nothing at all is an empty string */
+        data.len = 0;
+    } else if (!lexer_take_char(lex, '\"') || (data = lexer_take_run(lex, LEX_ALNUM)).len == 0) {
+        fprintf(ctx->err_stream, "%u: missing string\n", linenum);
         return FALSE;
-    } else if (line_parse_ret == 2) {
-        fprintf(ERR_STREAM, "%u: extra objects with string definition\n", linenum);
+    } else if (lexer_take_char(lex, '\"')) {
+        lexer_skip_spaces(lex);
+        if (!lexer_at_end(lex)) {
+            fprintf(ctx->err_stream, "%u: extra objects with string definition\n", linenum);
+            return FALSE;
+        }
+    }
+    if (!dataseg_append_string(&ctx->data_seg, data.ptr, data.len)) {
+        fprintf(ctx->err_stream, "%u: out of memory\n", linenum);
         return FALSE;
     }
-    dataseg_append_string(&ctx->data_seg, data);
     return TRUE;
 }
 
 /**
- * small helper function to parse the label string from {str} and return the label_node_object
+ * small helper function to parse the label string from {lex} and return the label_node_object
  * {type_name} should be the definition type ("entry" or "external") and used for pretty printing
  */
-static labels_list_node_t *parser_parse_definition_label(struct parser_ctx_t *ctx, unsigned linenum, const char *str, const char *type_name) {
-    char label[MAX_INPUT_LEN + 1] = {0}, sink[MAX_INPUT_LEN + 1];
-    int line_parse_ret;
-
-    line_parse_ret = sscanf(str, " %" XSTR(MAX_INPUT_LEN) "[A-Z0-9a-z] %" XSTR(MAX_INPUT_LEN) "s",
-                            label, sink);
-    if (line_parse_ret == 0)
-        fprintf(ERR_STREAM, "%u: missing label\n", linenum);
-    else if (line_parse_ret == 2)
-        fprintf(ERR_STREAM, "%u: extra objects with %s definition\n", linenum, type_name);
+static labels_list_node_t *parser_parse_definition_label(struct parser_ctx_t *ctx, unsigned linenum, lexer_t *lex, const char *type_name) {
+    line_view_t label;
+
+    lexer_skip_spaces(lex);
+    if (lexer_at_end(lex))
+        fprintf(ctx->err_stream, "%u: Incorrect label name \'\'\n", linenum);
+    else if ((label = lexer_take_run(lex, LEX_ALNUM)).len == 0)
+        fprintf(ctx->err_stream, "%u: missing label\n", linenum);
+    else if (lexer_skip_spaces(lex), !lexer_at_end(lex))
+        fprintf(ctx->err_stream, "%u: extra objects with %s definition\n", linenum, type_name);
     else if (!check_good_label_name(label))
-        fprintf(ERR_STREAM, "%u: Incorrect label name \'%s\'\n", linenum, label);
+        fprintf(ctx->err_stream, "%u: Incorrect label name \'%.*s\'\n", linenum, VIEW_ARGS(label));
     else
-        return labels_list_get_label(&ctx->labels, label);
+        return labels_list_get_label(&ctx->labels, label.ptr, label.len);
     return NULL;
 }
 
-static BOOL parser_parse_definition_entry(struct parser_ctx_t *ctx, unsigned linenum, const char *str) {
-    labels_list_node_t *node = parser_parse_definition_label(ctx, linenum, str, "entry");
+static BOOL parser_parse_definition_entry(struct parser_ctx_t *ctx, unsigned linenum, lexer_t *lex) {
+    labels_list_node_t *node = parser_parse_definition_label(ctx, linenum, lex, "entry");
     if (node)
         node->isEntr = TRUE;
     ctx->entry_cnt++;
     return !!node;
 }
 
-static BOOL parser_parse_definition_extern(struct parser_ctx_t *ctx, unsigned linenum, const char *str) {
-    labels_list_node_t *node = parser_parse_definition_label(ctx, linenum, str, "external");
+static BOOL parser_parse_definition_extern(struct parser_ctx_t *ctx, unsigned linenum, lexer_t *lex) {
+    labels_list_node_t *node = parser_parse_definition_label(ctx, linenum, lex, "external");
     if (node) {
         if (node->isSet) {
-            fprintf(ERR_STREAM, "%u: label \'%s\' was already set previously\n", linenum, labels_listnode_get_label(node));
+            fprintf(ctx->err_stream, "%u: label \'%s\' was already set previously\n", linenum, labels_listnode_get_label(node));
             return FALSE;
         }
         node->isExtr = TRUE;
@@ -247,115 +453,399 @@ static BOOL parser_parse_definition_extern(struct parser_ctx_t *ctx, unsigned li
     return !!node;
 }
 
-BOOL parser_parse(struct parser_ctx_t *ctx, FILE* file) {
-    unsigned linenum;
-    char buffer[MAX_INPUT_LEN + 1] = {0}, label[MAX_INPUT_LEN + 1], definition[MAX_INPUT_LEN + 1];
-    char label_delim[2];
+/**
+ * parse one meaningful line, described by {line} inside {src}
+ * return true if the line was parsed successfully
+ */
+static BOOL parser_parse_line(struct parser_ctx_t *ctx, const source_t *src, const prescan_line_t *line) {
+    const unsigned linenum = line->linenum;
+    line_view_t view;
+    lexer_statement_t stmt;
     BOOL flag = TRUE;
-    for (linenum = 0; fgets(buffer, MAX_INPUT_LEN, file); ++linenum) {
-        char *buf_ptr = buffer;
-        int line_parse_ret, pos;
-        BOOL (*parse_func)(struct parser_ctx_t *, unsigned, const char *) = parser_parse_instuction;
-
-        while (isspace(*buf_ptr))
-            buf_ptr++;
-        if (*buf_ptr == '\0' || *buf_ptr == ';')
-            continue; /* blank line or comment line */
-
-        line_parse_ret = sscanf(buf_ptr, " %" XSTR(MAX_INPUT_LEN) "[A-Z0-9a-z] %1[:] %n", label, label_delim, &pos);
-        if (line_parse_ret == 2) { /* found label */
-            if (!check_good_label_name(label)) {
-                fprintf(ERR_STREAM, "%u: bad label name \'%s\'\n", linenum, label);
-                flag = FALSE;
-                continue;
-            }
-            buf_ptr += pos;
-        } else
-            label[0] = '\0';
+    BOOL (*parse_func)(struct parser_ctx_t *, unsigned, lexer_t *) = parser_parse_instuction;
+
+    if (line->flags & PRESCAN_TOO_LONG) {
+        fprintf(ctx->err_stream, "%u: line is too long, maximal length is %lu\n", linenum, (unsigned long)ctx->max_line_len);
+        return FALSE;
+    }
+    view.ptr = src->data + line->start;
+    view.len = line->len;
 
-        line_parse_ret = sscanf(buf_ptr, " .%" XSTR(MAX_INPUT_LEN) "[A-Z0-9a-z] %n", definition, &pos);
-        if (line_parse_ret == 1) { /* found definition */
-            if (!strcmp(definition, "data"))
+    lexer_scan_statement(view, line->colon != PRESCAN_NONE, line->dot != PRESCAN_NONE, &stmt);
+    if (stmt.label.len) { /* found label */
+        if (!check_good_label_name(stmt.label)) {
+            fprintf(ctx->err_stream, "%u: bad label name \'%.*s\'\n", linenum, VIEW_ARGS(stmt.label));
+            return FALSE;
+        }
+    }
+
+    if (stmt.directive.len) { /* found definition */
+        const keyword_t *kw = keywords_find(stmt.directive.ptr, stmt.directive.len);
+        if (!kw || kw->kind != KW_DIRECTIVE) {
+            fprintf(ctx->err_stream, "%u: incorrect definition \'%.*s\'\n", linenum, VIEW_ARGS(stmt.directive));
+            return FALSE;
+        }
+        switch ((enum directive_kind)kw->value) {
+            case DIRECTIVE_DATA:
                 parse_func = parser_parse_definition_data;
-            else if (!strcmp(definition, "string"))
+                break;
+            case DIRECTIVE_STRING:
                 parse_func = parser_parse_definition_string;
-            else if (!strcmp(definition, "entry"))
+                break;
+            case DIRECTIVE_ENTRY:
                 parse_func = parser_parse_definition_entry;
-            else if (!strcmp(definition, "extern"))
+                break;
+            case DIRECTIVE_EXTERN:
                 parse_func = parser_parse_definition_extern;
-            else {
-                fprintf(ERR_STREAM, "%u: incorrect definition \'%s\'\n", linenum, definition);
+                break;
+        }
+    }
+    if (stmt.label.len) {
+        if (parse_func == parser_parse_definition_entry || parse_func == parser_parse_definition_extern)
+            fprintf(ctx->err_stream, "%u: useless label definition with %.*s definition\n", linenum, VIEW_ARGS(stmt.directive));
+        else {
+            labels_list_node_t *node = labels_list_get_label(&ctx->labels, stmt.label.ptr, stmt.label.len);
+            if (node->isSet) {
+                fprintf(ctx->err_stream, "%u: label \'%.*s\' address had been already set\n", linenum, VIEW_ARGS(stmt.label));
                 flag = FALSE;
-                continue;
+            } else {
+                node->isSet = TRUE;
+                node->isDS = parse_func != parser_parse_instuction;
+                /* kept relative to the segment and unwrapped until labels_list_check_and_fix, for the optimizer */
+                node->addr = (node->isDS) ? PARSER_DATA_SIZE(ctx) : PARSER_CODE_SIZE(ctx);
             }
-            buf_ptr += pos;
         }
-        if (*label) {
-            if (parse_func == parser_parse_definition_entry || parse_func == parser_parse_definition_extern)
-                fprintf(ERR_STREAM, "%u: useless label definition with %s definition\n", linenum, definition);
-            else {
-                labels_list_node_t *node = labels_list_get_label(&ctx->labels, label);
-                if (node->isSet) {
-                    fprintf(ERR_STREAM, "%u: label \'%s\' address had been already set\n", linenum, label);
-                    flag = FALSE;
-                } else {
-                    node->isSet = TRUE;
-                    node->isDS = parse_func != parser_parse_instuction;
-                    node->addr = ((node->isDS) ? ctx->data_seg.size : ctx->insts.size);
-                }
-            }
+    }
+    return parse_func(ctx, linenum, &stmt.rest) && flag;
+}
+
+BOOL parser_parse_text_line(struct parser_ctx_t *ctx, const char *text, size_t len, unsigned linenum) {
+    source_t src;
+    prescan_t scan;
+    prescan_line_t line;
+
+    src.data = text;
+    src.len = len;
+    src.is_mapped = FALSE;
+    scan = prescan_new(&src, ctx->max_line_len);
+    if (prescan_next(&scan, &line, 1) == 0)
+        return TRUE;
+    line.linenum = linenum;
+    return parser_parse_line(ctx, &src, &line);
+}
+
+const instructions_list *parser_get_instructions(struct parser_ctx_t *ctx) {
+    return &ctx->insts;
+}
+
+const labels_list_t *parser_get_labels(struct parser_ctx_t *ctx) {
+    return &ctx->labels;
+}
+
+const dataseg_t *parser_get_data_seg(struct parser_ctx_t *ctx) {
+    return &ctx->data_seg;
+}
+
+/**
+ * move the segments of {ctx} into its spill, after the lines of {src} up to {parsed} bytes were parsed
+ * the memory of the parsed source past {*dropped} bytes is released, once it is worth it. {parsed} never goes
+ * back, and macro bodies before it are read again from the file when expanded.
+ */
+static void parser_spill(struct parser_ctx_t *ctx, const source_t *src, size_t parsed, size_t *dropped) {
+    spill_code(&ctx->spill, &ctx->insts);
+    spill_data(&ctx->spill, &ctx->data_seg);
+    instructions_list_clear(&ctx->insts);
+    dataseg_clear(&ctx->data_seg);
+    if (parsed - *dropped >= PARSER_DROP_BYTES) {
+        source_drop(src, *dropped, parsed);
+        *dropped = parsed;
+    }
+}
+
+/**
+ * hand the code words of {ctx} parsed since the last call to its writer, once there are PARSER_PIPELINE_WORDS of
+ * them or if {all} is set
+ * return false if out of memory
+ */
+static BOOL parser_pipeline_code(struct parser_ctx_t *ctx, BOOL all) {
+    const unsigned count = ctx->insts.size - ctx->pipelined_size;
+    uint16_t *words;
+    if (count == 0 || (!all && count < PARSER_PIPELINE_WORDS))
+        return TRUE;
+    if (!(words = malloc(count * sizeof(uint16_t))))
+        return FALSE;
+    instructions_list_words(&ctx->insts, ctx->pipelined_size, ctx->insts.size, words);
+    if (!pipeline_writer_put_words(ctx->writer, OUTPUT_OBJECT_CODE_START + ctx->pipelined_size, words, count))
+        return FALSE;
+    ctx->pipelined_size = ctx->insts.size;
+    return TRUE;
+}
+
+BOOL parser_parse(struct parser_ctx_t *ctx, const source_t *src) {
+    macro_expander_t exp;
+    prescan_line_t lines[PARSER_LINES_BATCH];
+    struct pipeline_reader_t *reader = NULL;
+    size_t i, cnt, dropped = 0;
+    BOOL flag = TRUE;
+    if (ctx->stats)
+        stats_phase_begin(ctx->stats, STATS_PHASE_PARSE);
+    macro_expander_init(&exp, src, ctx->max_line_len, &ctx->arena, ctx->err_stream);
+    /* the macros are still expanded in this thread, so their diagnostics keep their order */
+    if (ctx->pipeline && (reader = pipeline_reader_new(src, ctx->max_line_len)))
+        macro_set_feed(&exp, pipeline_reader_next, reader);
+    /* without temporary files, the file is assembled in memory */
+    spill_close(&ctx->spill);
+    parser_stop_writer(ctx);
+    if (ctx->stream)
+        spill_open(&ctx->spill);
+    /* the writer formats the code while it is parsed, unless the optimizer moves it after */
+    else if (ctx->pipeline && !ctx->optimize && !ctx->output_func && (ctx->writer = pipeline_writer_new()))
+        instructions_list_resolve_labels(&ctx->insts, OUTPUT_OBJECT_CODE_START, PARSER_ADDR_MASK(ctx));
+    while ((cnt = macro_next(&exp, lines, ARR_SIZE(lines))) > 0) {
+        for (i = 0; i < cnt; i++)
+            flag &= parser_parse_line(ctx, src, lines + i);
+        if (spill_is_open(&ctx->spill))
+            parser_spill(ctx, src, macro_consumed(&exp), &dropped);
+        else if (ctx->writer && !parser_pipeline_code(ctx, FALSE)) {
+            fprintf(ctx->err_stream, "out of memory\n");
+            parser_stop_writer(ctx);
+            flag = FALSE;
         }
-        flag &= parse_func(ctx, linenum, buf_ptr);
     }
-    if (flag && ctx->insts.size == 0 && ctx->data_seg.size == 0) {
-        fprintf(ERR_STREAM, "No declaration in file\n");
+    instructions_list_resolve_labels(&ctx->insts, 0, 0);
+    flag &= macro_is_ok(&exp);
+    if (ctx->spill.is_failed) {
+        fprintf(ctx->err_stream, "unable to write the temporary files\n");
+        flag = FALSE;
+    }
+    if (flag && PARSER_CODE_SIZE(ctx) == 0 && PARSER_DATA_SIZE(ctx) == 0) {
+        fprintf(ctx->err_stream, "No declaration in file\n");
+        flag = FALSE;
+    }
+    if (ctx->stats) {
+        stats_phase_end(ctx->stats, STATS_PHASE_PARSE);
+        stats_phase_begin(ctx->stats, STATS_PHASE_FIX);
+    }
+    if (flag && ctx->optimize && !spill_is_open(&ctx->spill) && !optimizer_run(&ctx->insts, &ctx->labels, &ctx->optimized)) {
+        fprintf(ctx->err_stream, "out of memory optimizing the code\n");
         flag = FALSE;
     }
-    flag &= labels_list_check_and_fix(&ctx->labels, ctx->insts.size);
+    flag &= labels_list_check_and_fix(&ctx->labels, PARSER_CODE_SIZE(ctx), PARSER_ADDR_MASK(ctx), ctx->err_stream);
+    /* wrapped addresses always fit, but in large-program mode a label may be out of reach of its operand */
+    if (flag && ctx->large)
+        flag = spill_is_open(&ctx->spill) ? spill_check_labels(&ctx->spill, &ctx->labels, ctx->err_stream)
+                                          : instructions_list_check_labels(&ctx->insts, &ctx->labels, ctx->err_stream);
+    if (ctx->stats) {
+        stats_phase_end(ctx->stats, STATS_PHASE_FIX);
+        ctx->stats->lines = reader ? pipeline_reader_linenum(reader) : macro_linenum(&exp);
+        ctx->stats->instructions = ctx->spill.count + ctx->insts.count;
+        ctx->stats->data_words = PARSER_DATA_SIZE(ctx);
+        ctx->stats->labels = ctx->labels.count;
+        ctx->stats->label_lookups = ctx->labels.lookups;
+        ctx->stats->label_probes = ctx->labels.probes;
+    }
+    if (reader)
+        pipeline_reader_dealloc(reader);
+    if (!flag)
+        parser_stop_writer(ctx);
     return flag;
 }
 
-BOOL parser_output(struct parser_ctx_t *ctx, const char *basename) {
-    FILE *object, *entries, *externals = NULL;
+/**
+ * write {buf} into the file {name}, or queue it to the writer of {ctx} when it has one
+ */
+static BOOL parser_write_file(struct parser_ctx_t *ctx, const outbuf_t *buf, const char *name, BOOL keep_identical) {
+    if (ctx->writer)
+        return pipeline_writer_put(ctx->writer, buf->data, buf->len, name, keep_identical);
+    return outbuf_write_file(buf, name, keep_identical);
+}
 
-    /* open all files */
-    char *newName;
-    size_t len = strlen(basename);
-    if (!(newName = malloc(len + MAX_LEN_EXTENSION + 1)))
+/**
+ * write {buf} into the output file of {basename} with {extension}, and its copy into the copy directory
+ * when an output function is set, {buf} goes only to it
+ */
+static BOOL parser_write_output(struct parser_ctx_t *ctx, const outbuf_t *buf, const char *basename, const char *extension) {
+    char *name;
+    if (ctx->output_func)
+        return ctx->output_func(ctx->output_arg, extension, buf->data, buf->len);
+    if (!(name = parser_filename(ctx, basename, extension)) || !parser_write_file(ctx, buf, name, ctx->keep_identical))
+        return FALSE;
+    if (!ctx->copy_dir)
+        return TRUE;
+    /* copies are named by the extension without the dot */
+    if (!(name = arena_alloc(&ctx->arena, strlen(ctx->copy_dir) + MAX_LEN_EXTENSION + 1)))
         return FALSE;
-    memcpy(newName, basename, len);
+    sprintf(name, "%s/%s", ctx->copy_dir, extension + 1);
+    return parser_write_file(ctx, buf, name, FALSE);
+}
 
-    strcpy(newName + len, OUTPUT_OBJECT_EXTENSION);
-    if (!(object = fopen(newName, "w"))) {
-        free(newName);
+/**
+ * write the binary object file of {basename}, converted from the text files {object}, {entries} and {externals}
+ * (the last two are NULL when the file isn't written), so both formats always have the same content
+ */
+static BOOL parser_write_binary(struct parser_ctx_t *ctx, const char *basename, const outbuf_t *object,
+                                const outbuf_t *entries, const outbuf_t *externals) {
+    objfile_t obj;
+    outbuf_t image;
+    struct pipeline_writer_t *writer = ctx->writer;
+    BOOL res;
+    if (!objfile_from_text(&obj, object->data, object->len, entries ? entries->data : NULL, entries ? entries->len : 0,
+                           externals ? externals->data : NULL, externals ? externals->len : 0))
         return FALSE;
-    }
-    fprintf(object, "%4d %d\n", ctx->insts.size, ctx->data_seg.size);
+    image.data = (char *)obj.image;
+    image.len = image.capacity = obj.len;
+    /* the image is freed right after, so it is written here and not by the writer */
+    ctx->writer = NULL;
+    res = parser_write_output(ctx, &image, basename, OUTPUT_BINARY_EXTENSION);
+    ctx->writer = writer;
+    objfile_close(&obj);
+    return res;
+}
+
+BOOL parser_write_outputs(struct parser_ctx_t *ctx, const char *basename, const outbuf_t *object,
+                          const outbuf_t *entries, const outbuf_t *externals) {
+    if (!parser_write_output(ctx, object, basename, OUTPUT_OBJECT_EXTENSION))
+        return FALSE;
+    if (externals && !parser_write_output(ctx, externals, basename, OUTPUT_EXTERNALS_EXTENSION))
+        return FALSE;
+    if (entries && !parser_write_output(ctx, entries, basename, OUTPUT_ENTRIES_EXTENSION))
+        return FALSE;
+    return !ctx->binary || parser_write_binary(ctx, basename, object, entries, externals);
+}
 
-    if (ctx->extern_cnt > 0) {
-        strcpy(newName + len, OUTPUT_EXTERNALS_EXTENSION);
-        if (!(externals = fopen(newName, "w"))) {
-            fclose(object);
-            free(newName);
+/**
+ * output the {ctx} context using {basename}, parser_output without the statistics
+ */
+static BOOL parser_output_files(struct parser_ctx_t *ctx, const char *basename) {
+    outbuf_t object, entries, externals;
+    char header[32];
+    size_t header_len, records_len, data_len;
+    unsigned long externals_cnt;
+
+    /* format all files in memory, every buffer has exactly the size of its file */
+    sprintf(header, "%4u %u\n", ctx->insts.size, ctx->data_seg.size);
+    header_len = strlen(header);
+    if (ctx->writer) {
+        /* the code records were formatted by the writer while parsing, the header goes into the room before them */
+        data_len = outbuf_object_len(OUTPUT_OBJECT_CODE_START + ctx->insts.size, ctx->data_seg.size);
+        if (!parser_pipeline_code(ctx, TRUE) ||
+                !(ctx->records = pipeline_writer_take_records(ctx->writer, data_len, &records_len)))
             return FALSE;
-        }
+        object.data = ctx->records + PIPELINE_OBJECT_HEADER_ROOM - header_len;
+        object.len = 0;
+        object.capacity = header_len + records_len + data_len;
+    } else if (!outbuf_init(&object, &ctx->arena, header_len +
+                            outbuf_object_len(OUTPUT_OBJECT_CODE_START, ctx->insts.size + ctx->data_seg.size)))
+        return FALSE;
+    if (ctx->extern_cnt > 0 &&
+        !outbuf_init(&externals, &ctx->arena, instructions_list_externals_len(&ctx->insts, &ctx->labels, OUTPUT_OBJECT_CODE_START)))
+        return FALSE;
+    if (ctx->entry_cnt > 0 && !outbuf_init(&entries, &ctx->arena, labels_list_entries_len(&ctx->labels)))
+        return FALSE;
+
+    outbuf_put_text(&object, header, header_len);
+    if (ctx->writer) {
+        /* only the label operands which weren't resolved while parsing are left */
+        externals_cnt = instructions_list_output_labels(&ctx->insts, &ctx->labels, OUTPUT_OBJECT_CODE_START,
+                                                        object.data + object.len,
+                                                        ctx->extern_cnt > 0 ? &externals : NULL);
+        object.len += records_len;
+    } else if (!instructions_list_output_parallel(&ctx->insts, &ctx->labels, OUTPUT_OBJECT_CODE_START, &object,
+                                                  ctx->extern_cnt > 0 ? &externals : NULL, ctx->output_threads,
+                                                  &externals_cnt))
+        return FALSE;
+    if (ctx->stats)
+        ctx->stats->externals = externals_cnt;
+    dataseg_output(&ctx->data_seg, OUTPUT_OBJECT_CODE_START + ctx->insts.size, &object);
+    if (ctx->entry_cnt > 0)
+        labels_list_output_entries(&ctx->labels, &entries);
+
+    return parser_write_outputs(ctx, basename, &object, ctx->entry_cnt > 0 ? &entries : NULL,
+                                ctx->extern_cnt > 0 ? &externals : NULL);
+}
+
+/**
+ * output the {ctx} context, whose segments are spilled, using {basename}
+ * the object and externals files are streamed from the spill, and only the entries are formatted in memory
+ */
+static BOOL parser_output_spilled(struct parser_ctx_t *ctx, const char *basename) {
+    FILE *object, *externals = NULL;
+    outbuf_t entries;
+    unsigned long externals_cnt;
+    char *name;
+    BOOL res;
+
+    if (!(name = parser_filename(ctx, basename, OUTPUT_OBJECT_EXTENSION)) || !(object = fopen(name, "w")))
+        return FALSE;
+    if (ctx->extern_cnt > 0 &&
+            (!(name = parser_filename(ctx, basename, OUTPUT_EXTERNALS_EXTENSION)) || !(externals = fopen(name, "w")))) {
+        fclose(object);
+        return FALSE;
     }
-    instructions_list_output(&ctx->insts, OUTPUT_OBJECT_CODE_START, object, externals);
+    fprintf(object, "%4u %u\n", ctx->spill.code_size, ctx->spill.data_size);
+    res = spill_backpatch(&ctx->spill, &ctx->labels, OUTPUT_OBJECT_CODE_START, externals, &externals_cnt) &&
+          spill_output(&ctx->spill, OUTPUT_OBJECT_CODE_START, object);
+    res &= fclose(object) == 0;
     if (externals)
-        fclose(externals);
-    dataseg_output(&ctx->data_seg, OUTPUT_OBJECT_CODE_START + ctx->insts.size, object);
-    fclose(object);
-
-    if (ctx->entry_cnt > 0) {
-        strcpy(newName + len, OUTPUT_ENTRIES_EXTENSION);
-        if (!(entries = fopen(newName, "w"))) {
-            free(newName);
-            return FALSE;
-        }
-        labels_list_output_entries(&ctx->labels, entries);
-        fclose(entries);
+        res &= fclose(externals) == 0;
+    if (ctx->stats)
+        ctx->stats->externals = externals_cnt;
+    if (!res || ctx->entry_cnt == 0)
+        return res;
+    if (!outbuf_init(&entries, &ctx->arena, labels_list_entries_len(&ctx->labels)))
+        return FALSE;
+    labels_list_output_entries(&ctx->labels, &entries);
+    return parser_write_output(ctx, &entries, basename, OUTPUT_ENTRIES_EXTENSION);
+}
+
+/**
+ * output the {ctx} context using {basename}, with a writer thread when {ctx} is pipelined
+ */
+static BOOL parser_output_pipelined(struct parser_ctx_t *ctx, const char *basename) {
+    BOOL res;
+    if (spill_is_open(&ctx->spill))
+        return parser_output_spilled(ctx, basename);
+    if (ctx->writer) { /* started while parsing */
+        res = parser_output_files(ctx, basename);
+        return parser_stop_writer(ctx) && res;
     }
+    /* an output function receives the files in this thread */
+    if (!ctx->pipeline || ctx->output_func || !(ctx->writer = pipeline_writer_new()))
+        return parser_output_files(ctx, basename);
+    res = parser_output_files(ctx, basename);
+    res &= pipeline_writer_dealloc(ctx->writer);
+    ctx->writer = NULL;
+    return res;
+}
 
-    free(newName);
-    return TRUE;
+BOOL parser_output(struct parser_ctx_t *ctx, const char *basename) {
+    BOOL res;
+    if (!ctx->stats)
+        return parser_output_pipelined(ctx, basename);
+    stats_phase_begin(ctx->stats, STATS_PHASE_OUTPUT);
+    res = parser_output_pipelined(ctx, basename);
+    stats_phase_end(ctx->stats, STATS_PHASE_OUTPUT);
+    return res;
+}
+
+BOOL parser_output_expanded(struct parser_ctx_t *ctx, const source_t *src, const char *basename) {
+    macro_expander_t exp;
+    prescan_line_t lines[PARSER_LINES_BATCH];
+    size_t i, cnt, len = 0;
+    outbuf_t expanded;
+
+    /* expanding is cheap, so it runs once for the length and once more for the content */
+    macro_expander_init(&exp, src, ctx->max_line_len, &ctx->arena, NULL);
+    while ((cnt = macro_next(&exp, lines, ARR_SIZE(lines))) > 0)
+        for (i = 0; i < cnt; i++)
+            len += lines[i].len + 1;
+    if (!outbuf_init(&expanded, &ctx->arena, len))
+        return FALSE;
+    macro_expander_init(&exp, src, ctx->max_line_len, &ctx->arena, NULL);
+    while ((cnt = macro_next(&exp, lines, ARR_SIZE(lines))) > 0)
+        for (i = 0; i < cnt; i++) {
+            outbuf_put_text(&expanded, src->data + lines[i].start, lines[i].len);
+            outbuf_put_text(&expanded, "\n", 1);
+        }
+    return parser_write_output(ctx, &expanded, basename, OUTPUT_EXPANDED_EXTENSION);
 }
@@ -7,35 +7,176 @@
 #include <stdio.h>
 
 #include "global.h"
+#include "source.h"
+#include "stats.h"
+#include "outbuf.h"
+#include "data_seg.h"
+#include "labels_list.h"
+#include "instructions_list.h"
 
-#define MAX_INPUT_LEN 81
+/** default limit for the length of input lines */
+#define MAX_LINE_LEN 80
 
 struct parser_ctx_t;
 
 /**
- * create a new parser structure
+ * create a new parser structure, which outputs diagnostics into ERR_STREAM
  */
 struct parser_ctx_t *parser_new(void);
 /**
- * free and close {ctx} context
+ * free and close {ctx} context, including all the memory allocated for it
  */
 void parser_dealloc(struct parser_ctx_t *ctx);
 
 /**
- * parse {file} line by line and work on the {ctx} context
+ * make {ctx} ready for assembling another file, dropping everything of the previous one
+ * all the settings are kept, and its memory is kept warm for reuse
+ */
+void parser_reset(struct parser_ctx_t *ctx);
+
+/**
+ * set {err_stream} as the destination of all diagnostics of {ctx}
+ */
+void parser_set_err_stream(struct parser_ctx_t *ctx, FILE *err_stream);
+/**
+ * set {max_line_len} as the maximal length of a line {ctx} accepts, longer lines are diagnosed as errors
+ */
+void parser_set_max_line_len(struct parser_ctx_t *ctx, size_t max_line_len);
+
+/**
+ * set {stats} as the destination of timings and counters of {ctx}, or NULL to not collect them
+ * the parser fills the parse, fix and output phases, and all the counters
+ */
+void parser_set_stats(struct parser_ctx_t *ctx, stats_t *stats);
+
+/**
+ * if {keep_identical} is set, output files of {ctx} which already have the right content aren't rewritten
+ */
+void parser_set_keep_identical(struct parser_ctx_t *ctx, BOOL keep_identical);
+/**
+ * if {binary} is set, {ctx} also outputs the binary object file (OUTPUT_BINARY_EXTENSION)
+ */
+void parser_set_binary(struct parser_ctx_t *ctx, BOOL binary);
+/**
+ * if {large} is set, {ctx} assembles in large-program mode: the labels have full 32 bit addresses, and a label
+ * operand whose address doesn't fit in its 12 bits is an error, instead of wrapping like by default
+ */
+void parser_set_large(struct parser_ctx_t *ctx, BOOL large);
+/**
+ * if {optimize} is set, {ctx} runs the peephole optimizer (optimizer.h) over the code segment of every file
+ */
+void parser_set_optimize(struct parser_ctx_t *ctx, BOOL optimize);
+/**
+ * set {threads_cnt} as the count of threads encoding the code segment of every file, 0 or 1 for this thread only
+ */
+void parser_set_output_threads(struct parser_ctx_t *ctx, unsigned threads_cnt);
+/**
+ * if {pipeline} is set, {ctx} scans the input of every file ahead of the parsing, and writes its output files while
+ * formatting the next ones, each on a thread of its own (pipeline.h)
+ */
+void parser_set_pipeline(struct parser_ctx_t *ctx, BOOL pipeline);
+/**
+ * if {stream} is set, {ctx} spills the segments of every file into temporary files while parsing (spill.h), so
+ * the memory used depends on the labels of the file and not on its size. The outputs are written straight into
+ * their files, without the optimizer, the binary object file, the copy directory or the output function.
+ */
+void parser_set_stream(struct parser_ctx_t *ctx, BOOL stream);
+/**
+ * set {copy_dir} as a directory which receives a copy of every output file of {ctx}, named by the extension
+ * without the dot ("ob", "ent", "ext", "obb"), or NULL for no copies
+ */
+void parser_set_copy_dir(struct parser_ctx_t *ctx, const char *copy_dir);
+
+/**
+ * Receiver of one output file of {len} bytes of {data}, named by its {extension}, with the {arg} it was set with
+ * return false on error, which fails the output
+ */
+typedef BOOL (*parser_output_func)(void *arg, const char *extension, const char *data, size_t len);
+/**
+ * set {func} to receive every output file of {ctx} instead of writing it, or NULL to write the files
+ */
+void parser_set_output_func(struct parser_ctx_t *ctx, parser_output_func func, void *arg);
+
+/**
+ * return the destination of all diagnostics of {ctx}
+ */
+FILE *parser_get_err_stream(struct parser_ctx_t *ctx);
+/**
+ * return true if {ctx} assembles in large-program mode
+ */
+BOOL parser_get_large(struct parser_ctx_t *ctx);
+/**
+ * return true if {ctx} runs the peephole optimizer
+ */
+BOOL parser_get_optimize(struct parser_ctx_t *ctx);
+
+struct arena_t;
+/**
+ * return the memory arena of {ctx}, for reading its usage counters
+ */
+const struct arena_t *parser_get_arena(struct parser_ctx_t *ctx);
+struct optimizer_report_t;
+/**
+ * return the rewrites made by the optimizer in the last parser_parse of {ctx}, all zero when it didn't run
+ */
+const struct optimizer_report_t *parser_get_optimizer_report(struct parser_ctx_t *ctx);
+/**
+ * return a new string, allocated inside {ctx}, of {basename} followed by {extension}
+ * {extension} must be no longer than MAX_LEN_EXTENSION
+ * return NULL if out of memory
+ */
+char *parser_filename(struct parser_ctx_t *ctx, const char *basename, const char *extension);
+
+/**
+ * parse {src} line by line and work on the {ctx} context, after expanding its macros
  * return true if input file was parsed successfully
  */
-BOOL parser_parse(struct parser_ctx_t *ctx, FILE* file);
+BOOL parser_parse(struct parser_ctx_t *ctx, const source_t *src);
 /**
- * output the {ctx} context using {basename} with all 3 extensions
+ * output the {ctx} context using {basename} with all 3 extensions, and the binary object file if it was enabled
  * return true if output was successful
  */
 BOOL parser_output(struct parser_ctx_t *ctx, const char *basename);
+/**
+ * parse the single line {text} of {len} characters (without the line break) as line {linenum} of a file,
+ * and work on the {ctx} context like parser_parse does, but without macros and without the checks of the whole file
+ * blank and comment lines are skipped
+ * return true if the line was parsed successfully
+ */
+BOOL parser_parse_text_line(struct parser_ctx_t *ctx, const char *text, size_t len, unsigned linenum);
+/**
+ * return the code segment of {ctx}, whose label operands hold ids of parser_get_labels
+ */
+const instructions_list *parser_get_instructions(struct parser_ctx_t *ctx);
+/**
+ * return the labels of {ctx}, by order of first appearance
+ */
+const labels_list_t *parser_get_labels(struct parser_ctx_t *ctx);
+/**
+ * return the data segment of {ctx}
+ */
+const dataseg_t *parser_get_data_seg(struct parser_ctx_t *ctx);
+/**
+ * write the formatted output files {object}, {entries} and {externals} (the last two are NULL when the file isn't
+ * written) of {basename} with the settings of {ctx}, and the binary object file if it was enabled
+ * return true if output was successful
+ */
+BOOL parser_write_outputs(struct parser_ctx_t *ctx, const char *basename, const outbuf_t *object,
+                          const outbuf_t *entries, const outbuf_t *externals);
+/**
+ * output {src} after expanding its macros, exactly as parser_parse sees it, into the file of {basename} with
+ * OUTPUT_EXPANDED_EXTENSION. Only the meaningful lines are written, without their indentation.
+ * The macro errors aren't reported, parser_parse does it.
+ * return true if output was successful
+ */
+BOOL parser_output_expanded(struct parser_ctx_t *ctx, const source_t *src, const char *basename);
 
 #define INPUT_EXTENSION            ".as"
 #define OUTPUT_OBJECT_EXTENSION    ".ob"
 #define OUTPUT_ENTRIES_EXTENSION   ".ent"
 #define OUTPUT_EXTERNALS_EXTENSION ".ext"
+#define OUTPUT_BINARY_EXTENSION    ".obb"
+#define OUTPUT_EXPANDED_EXTENSION  ".am"
 #define MAX_LEN_EXTENSION 4
 
 #define OUTPUT_OBJECT_CODE_START 100
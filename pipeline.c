@@ -0,0 +1,404 @@
+/* This file is part of OpenU's C project implementation, called assembler
+ * Copyright (C) 2020 Arthur Zamarin, Norel Farjun */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include "pipeline.h"
+#include "outbuf.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+/** count of files and chunks of words the writer may be behind */
+#define PIPELINE_WRITER_ITEMS 8
+
+/**
+ * Bounded queue of pointers passed between threads.
+ * Closing it wakes all the waiting threads: pushing fails from then on, and popping fails once it is empty.
+ */
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    void **items;       /* ring of {capacity} items, starting at {head} */
+    unsigned capacity;
+    unsigned head;
+    unsigned count;
+    BOOL is_closed;
+} pipeline_queue_t;
+
+/**
+ * initialize {queue} for up to {capacity} items
+ * return false if out of memory
+ */
+static BOOL pipeline_queue_init(pipeline_queue_t *queue, unsigned capacity) {
+    if (!(queue->items = malloc(capacity * sizeof(void *))))
+        return FALSE;
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->not_empty, NULL);
+    pthread_cond_init(&queue->not_full, NULL);
+    queue->capacity = capacity;
+    queue->head = queue->count = 0;
+    queue->is_closed = FALSE;
+    return TRUE;
+}
+
+/**
+ * free {queue}, no thread may be using it
+ */
+static void pipeline_queue_destroy(pipeline_queue_t *queue) {
+    pthread_cond_destroy(&queue->not_full);
+    pthread_cond_destroy(&queue->not_empty);
+    pthread_mutex_destroy(&queue->lock);
+    free(queue->items);
+}
+
+/**
+ * add {item} at the end of {queue}, waiting while it is full
+ * return false if {queue} was closed
+ */
+static BOOL pipeline_queue_push(pipeline_queue_t *queue, void *item) {
+    BOOL res;
+    pthread_mutex_lock(&queue->lock);
+    while (!queue->is_closed && queue->count == queue->capacity)
+        pthread_cond_wait(&queue->not_full, &queue->lock);
+    if ((res = !queue->is_closed)) {
+        queue->items[(queue->head + queue->count++) % queue->capacity] = item;
+        pthread_cond_signal(&queue->not_empty);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return res;
+}
+
+/**
+ * remove and return the first item of {queue}, waiting while it is empty
+ * return NULL if {queue} was closed and is empty
+ */
+static void *pipeline_queue_pop(pipeline_queue_t *queue) {
+    void *item = NULL;
+    pthread_mutex_lock(&queue->lock);
+    while (!queue->is_closed && queue->count == 0)
+        pthread_cond_wait(&queue->not_empty, &queue->lock);
+    if (queue->count > 0) {
+        item = queue->items[queue->head];
+        queue->head = (queue->head + 1) % queue->capacity;
+        --queue->count;
+        pthread_cond_signal(&queue->not_full);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return item;
+}
+
+/**
+ * close {queue}, waking all the threads waiting on it
+ */
+static void pipeline_queue_close(pipeline_queue_t *queue) {
+    pthread_mutex_lock(&queue->lock);
+    queue->is_closed = TRUE;
+    pthread_cond_broadcast(&queue->not_empty);
+    pthread_cond_broadcast(&queue->not_full);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+/** lines scanned at once by the reader, an empty batch ends the source */
+typedef struct {
+    size_t cnt;
+    prescan_line_t lines[PIPELINE_BATCH_LINES];
+} pipeline_batch_t;
+
+struct pipeline_reader_t {
+    prescan_t scan;                 /* used by the reader thread only, until it queued the empty batch */
+    pthread_t thread;
+    pipeline_queue_t free_batches;  /* batches for the reader to fill */
+    pipeline_queue_t full_batches;  /* batches for the parser to take */
+    pipeline_batch_t *batches;      /* all the batches */
+    pipeline_batch_t *current;      /* batch the parser takes lines from, or NULL */
+    size_t pos;                     /* count of lines already taken from {current} */
+    BOOL is_done;                   /* was the empty batch taken */
+};
+
+/**
+ * thread function of a pipeline_reader_t {arg}, filling the free batches until the source is done
+ */
+static void *pipeline_reader_main(void *arg) {
+    struct pipeline_reader_t *reader = arg;
+    pipeline_batch_t *batch;
+    size_t cnt;
+    do {
+        if (!(batch = pipeline_queue_pop(&reader->free_batches)))
+            break;
+        batch->cnt = cnt = prescan_next(&reader->scan, batch->lines, PIPELINE_BATCH_LINES);
+        if (!pipeline_queue_push(&reader->full_batches, batch))
+            break;
+    } while (cnt > 0);
+    return NULL;
+}
+
+struct pipeline_reader_t *pipeline_reader_new(const source_t *src, size_t max_line_len) {
+    struct pipeline_reader_t *reader;
+    unsigned i;
+
+    if (!(reader = malloc(sizeof(struct pipeline_reader_t))))
+        return NULL;
+    if (!(reader->batches = malloc(PIPELINE_BATCHES * sizeof(pipeline_batch_t)))) {
+        free(reader);
+        return NULL;
+    }
+    if (!pipeline_queue_init(&reader->free_batches, PIPELINE_BATCHES)) {
+        free(reader->batches);
+        free(reader);
+        return NULL;
+    }
+    if (!pipeline_queue_init(&reader->full_batches, PIPELINE_BATCHES)) {
+        pipeline_queue_destroy(&reader->free_batches);
+        free(reader->batches);
+        free(reader);
+        return NULL;
+    }
+    reader->scan = prescan_new(src, max_line_len);
+    reader->current = NULL;
+    reader->pos = 0;
+    reader->is_done = FALSE;
+    for (i = 0; i < PIPELINE_BATCHES; ++i)
+        pipeline_queue_push(&reader->free_batches, reader->batches + i);
+    if (pthread_create(&reader->thread, NULL, pipeline_reader_main, reader)) {
+        pipeline_queue_destroy(&reader->full_batches);
+        pipeline_queue_destroy(&reader->free_batches);
+        free(reader->batches);
+        free(reader);
+        return NULL;
+    }
+    return reader;
+}
+
+size_t pipeline_reader_next(void *arg, prescan_line_t *lines, size_t max_lines) {
+    struct pipeline_reader_t *reader = arg;
+    size_t cnt;
+
+    while (!reader->is_done && (!reader->current || reader->pos == reader->current->cnt)) {
+        /* the batch is parsed already, as the lines were copied out of it */
+        if (reader->current)
+            pipeline_queue_push(&reader->free_batches, reader->current);
+        reader->pos = 0;
+        if (!(reader->current = pipeline_queue_pop(&reader->full_batches)) || reader->current->cnt == 0)
+            reader->is_done = TRUE;
+    }
+    if (reader->is_done)
+        return 0;
+    cnt = reader->current->cnt - reader->pos;
+    if (cnt > max_lines)
+        cnt = max_lines;
+    memcpy(lines, reader->current->lines + reader->pos, cnt * sizeof(prescan_line_t));
+    reader->pos += cnt;
+    return cnt;
+}
+
+unsigned pipeline_reader_linenum(const struct pipeline_reader_t *reader) {
+    return reader->scan.linenum;
+}
+
+void pipeline_reader_dealloc(struct pipeline_reader_t *reader) {
+    pipeline_queue_close(&reader->free_batches);
+    pipeline_queue_close(&reader->full_batches);
+    pthread_join(reader->thread, NULL);
+    pipeline_queue_destroy(&reader->full_batches);
+    pipeline_queue_destroy(&reader->free_batches);
+    free(reader->batches);
+    free(reader);
+}
+
+/** kinds of the items queued for the writer */
+enum pipeline_item_kind {
+    PIPELINE_ITEM_FILE,     /* a whole file to write */
+    PIPELINE_ITEM_WORDS,    /* code words to format after the records before them */
+    PIPELINE_ITEM_DRAIN     /* the records are taken, once all the items before are done */
+};
+
+/** one item queued for the writer */
+typedef struct {
+    enum pipeline_item_kind kind;
+    const char *data;       /* content of a file */
+    size_t len;
+    const char *filename;
+    BOOL keep_identical;
+    uint16_t *words;        /* malloced code words, freed once formatted */
+    unsigned start_addr;    /* address of the first of {words} */
+    size_t extra;           /* bytes to leave after the records, when draining */
+} pipeline_item_t;
+
+struct pipeline_writer_t {
+    pthread_t thread;
+    pipeline_queue_t items;
+    char *records;      /* object file records formatted from the words, after PIPELINE_OBJECT_HEADER_ROOM bytes */
+    size_t records_len;
+    size_t records_capacity;
+    pthread_mutex_t lock;
+    pthread_cond_t drained;
+    BOOL is_drained;    /* was the drain item reached, protected by {lock} */
+    BOOL is_failed;     /* written by the writer thread only, until it is joined or drained */
+};
+
+/**
+ * format the object file records of the {count} {words} starting with {start_addr} after the records of {writer},
+ * growing them as needed
+ * return false if out of memory
+ */
+static BOOL pipeline_writer_format(struct pipeline_writer_t *writer, unsigned start_addr, const uint16_t *words,
+                                   size_t count, size_t extra) {
+    const size_t needed = PIPELINE_OBJECT_HEADER_ROOM + writer->records_len +
+                          outbuf_object_len(start_addr, (unsigned)count) + extra;
+    size_t capacity = writer->records_capacity ? writer->records_capacity : needed;
+    outbuf_t records;
+    char *tmp;
+
+    if (needed > writer->records_capacity) {
+        while (capacity < needed)
+            capacity *= 2;
+        if (!(tmp = realloc(writer->records, capacity)))
+            return FALSE;
+        writer->records = tmp;
+        writer->records_capacity = capacity;
+    }
+    records.data = writer->records + PIPELINE_OBJECT_HEADER_ROOM;
+    records.len = writer->records_len;
+    records.capacity = writer->records_capacity - PIPELINE_OBJECT_HEADER_ROOM;
+    outbuf_put_object_words(&records, start_addr, words, count);
+    writer->records_len = records.len;
+    return TRUE;
+}
+
+/**
+ * thread function of a pipeline_writer_t {arg}, writing the queued files and formatting the queued words until it
+ * is closed
+ */
+static void *pipeline_writer_main(void *arg) {
+    struct pipeline_writer_t *writer = arg;
+    pipeline_item_t *item;
+    while ((item = pipeline_queue_pop(&writer->items))) {
+        switch (item->kind) {
+            case PIPELINE_ITEM_FILE:
+                if (!outbuf_write_data(item->data, item->len, item->filename, item->keep_identical))
+                    writer->is_failed = TRUE;
+                break;
+            case PIPELINE_ITEM_WORDS:
+                if (!writer->is_failed && !pipeline_writer_format(writer, item->start_addr, item->words, item->len, 0))
+                    writer->is_failed = TRUE;
+                free(item->words);
+                break;
+            case PIPELINE_ITEM_DRAIN:
+                /* formatting no words makes sure there is room for the records taker */
+                if (!writer->is_failed && !pipeline_writer_format(writer, 0, NULL, 0, item->extra))
+                    writer->is_failed = TRUE;
+                pthread_mutex_lock(&writer->lock);
+                writer->is_drained = TRUE;
+                pthread_cond_signal(&writer->drained);
+                pthread_mutex_unlock(&writer->lock);
+                break;
+        }
+        free(item);
+    }
+    return NULL;
+}
+
+struct pipeline_writer_t *pipeline_writer_new(void) {
+    struct pipeline_writer_t *writer;
+
+    if (!(writer = malloc(sizeof(struct pipeline_writer_t))))
+        return NULL;
+    if (!pipeline_queue_init(&writer->items, PIPELINE_WRITER_ITEMS)) {
+        free(writer);
+        return NULL;
+    }
+    writer->records = NULL;
+    writer->records_len = writer->records_capacity = 0;
+    pthread_mutex_init(&writer->lock, NULL);
+    pthread_cond_init(&writer->drained, NULL);
+    writer->is_drained = FALSE;
+    writer->is_failed = FALSE;
+    if (pthread_create(&writer->thread, NULL, pipeline_writer_main, writer)) {
+        pthread_cond_destroy(&writer->drained);
+        pthread_mutex_destroy(&writer->lock);
+        pipeline_queue_destroy(&writer->items);
+        free(writer);
+        return NULL;
+    }
+    return writer;
+}
+
+/**
+ * queue {item} of {kind} into {writer}, freeing it if it can't be queued
+ * return false if out of memory
+ */
+static BOOL pipeline_writer_push(struct pipeline_writer_t *writer, pipeline_item_t *item, enum pipeline_item_kind kind) {
+    item->kind = kind;
+    if (!pipeline_queue_push(&writer->items, item)) {
+        free(item);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+BOOL pipeline_writer_put(struct pipeline_writer_t *writer, const char *data, size_t len, const char *filename,
+                         BOOL keep_identical) {
+    pipeline_item_t *item;
+
+    if (!(item = malloc(sizeof(pipeline_item_t))))
+        return FALSE;
+    item->data = data;
+    item->len = len;
+    item->filename = filename;
+    item->keep_identical = keep_identical;
+    return pipeline_writer_push(writer, item, PIPELINE_ITEM_FILE);
+}
+
+BOOL pipeline_writer_put_words(struct pipeline_writer_t *writer, unsigned start_addr, uint16_t *words, size_t count) {
+    pipeline_item_t *item;
+
+    if (!(item = malloc(sizeof(pipeline_item_t)))) {
+        free(words);
+        return FALSE;
+    }
+    item->words = words;
+    item->len = count;
+    item->start_addr = start_addr;
+    if (!pipeline_writer_push(writer, item, PIPELINE_ITEM_WORDS)) {
+        free(words);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+char *pipeline_writer_take_records(struct pipeline_writer_t *writer, size_t extra, size_t *len) {
+    pipeline_item_t *item;
+    char *records;
+
+    if (!(item = malloc(sizeof(pipeline_item_t))))
+        return NULL;
+    item->extra = extra;
+    if (!pipeline_writer_push(writer, item, PIPELINE_ITEM_DRAIN))
+        return NULL;
+    pthread_mutex_lock(&writer->lock);
+    while (!writer->is_drained)
+        pthread_cond_wait(&writer->drained, &writer->lock);
+    pthread_mutex_unlock(&writer->lock);
+    /* the writer thread doesn't touch the records anymore, and only files may be put from now on */
+    records = writer->is_failed ? NULL : writer->records;
+    *len = writer->records_len;
+    if (records)
+        writer->records = NULL;
+    return records;
+}
+
+BOOL pipeline_writer_dealloc(struct pipeline_writer_t *writer) {
+    BOOL res;
+    pipeline_queue_close(&writer->items);
+    pthread_join(writer->thread, NULL);
+    pthread_cond_destroy(&writer->drained);
+    pthread_mutex_destroy(&writer->lock);
+    pipeline_queue_destroy(&writer->items);
+    res = !writer->is_failed;
+    free(writer->records);
+    free(writer);
+    return res;
+}
@@ -0,0 +1,87 @@
+/* This file is part of OpenU's C project implementation, called assembler
+ * Copyright (C) 2020 Arthur Zamarin, Norel Farjun */
+
+#ifndef ASM_PIPELINE_H
+#define ASM_PIPELINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "global.h"
+#include "source.h"
+#include "prescan.h"
+
+/**
+ * Stages of assembling one file, running on threads of their own so reading the input and writing the outputs
+ * overlap with parsing and encoding.
+ * The reader scans the source (prescan.h) ahead of the parser, faulting its pages in, and passes batches of lines
+ * through a bounded queue. The parser gives every batch back once it is parsed, so the reader is never more than
+ * a few batches ahead. The writer writes the output files handed to it, while the next ones are being formatted.
+ * While parsing, the writer also formats the object file records of the code words handed to it in chunks, so most
+ * of the object file is ready once the parser is done; the label operands which weren't resolved yet are patched
+ * into the taken records.
+ */
+
+/** count of lines in every batch passed from the reader */
+#define PIPELINE_BATCH_LINES 256
+/** count of batches the reader may be ahead of the parser */
+#define PIPELINE_BATCHES 8
+/** room left before the records formatted by the writer, for the header of the object file */
+#define PIPELINE_OBJECT_HEADER_ROOM 32
+
+struct pipeline_reader_t;
+struct pipeline_writer_t;
+
+/**
+ * start a reader thread scanning {src}, where lines longer than {max_line_len} are flagged like prescan_new does
+ * {src} must stay valid until the reader is freed
+ * return NULL if unable to start the thread
+ */
+struct pipeline_reader_t *pipeline_reader_new(const source_t *src, size_t max_line_len);
+/**
+ * take the next meaningful lines scanned by the pipeline_reader_t {reader} into {lines}, up to {max_lines}, like
+ * prescan_next. It matches macro_feed_func, so it can feed a macro expander.
+ * return the count of lines filled, 0 when the source is done
+ */
+size_t pipeline_reader_next(void *reader, prescan_line_t *lines, size_t max_lines);
+/**
+ * return the count of source lines scanned by {reader}, valid after pipeline_reader_next returned 0
+ */
+unsigned pipeline_reader_linenum(const struct pipeline_reader_t *reader);
+/**
+ * stop the thread of {reader}, even if the source isn't done, and free it
+ */
+void pipeline_reader_dealloc(struct pipeline_reader_t *reader);
+
+/**
+ * start a writer thread, writing the files in the order they are put
+ * return NULL if unable to start the thread
+ */
+struct pipeline_writer_t *pipeline_writer_new(void);
+/**
+ * queue writing the {len} bytes of {data} into the file {filename} using {writer}, like outbuf_write_data with
+ * {keep_identical} does. Both {data} and {filename} must stay valid until the writer is freed.
+ * return false if out of memory
+ */
+BOOL pipeline_writer_put(struct pipeline_writer_t *writer, const char *data, size_t len, const char *filename,
+                         BOOL keep_identical);
+/**
+ * queue formatting the {count} code {words}, starting with the address {start_addr}, into object file records
+ * following the records of the words put before them into {writer}. {words} must be malloced, and it is freed.
+ * return false if out of memory
+ */
+BOOL pipeline_writer_put_words(struct pipeline_writer_t *writer, unsigned start_addr, uint16_t *words, size_t count);
+/**
+ * wait for all the words put into {writer} to be formatted, and take their records, with room for {extra} more
+ * bytes after them. The records start PIPELINE_OBJECT_HEADER_ROOM bytes into the returned buffer, and their length
+ * is set into {len}. No words may be put after.
+ * return the malloced buffer, or NULL if out of memory
+ */
+char *pipeline_writer_take_records(struct pipeline_writer_t *writer, size_t extra, size_t *len);
+/**
+ * wait for all the files put into {writer} to be written, and free it
+ * return false if any of the files couldn't be written
+ */
+BOOL pipeline_writer_dealloc(struct pipeline_writer_t *writer);
+
+#endif
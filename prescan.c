@@ -0,0 +1,212 @@
+/* This file is part of OpenU's C project implementation, called assembler
+ * Copyright (C) 2020 Arthur Zamarin, Norel Farjun */
+
+#include "prescan.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PRESCAN_X86
+#include <immintrin.h>
+#endif
+
+/** bytes in one scanned block, one bit per byte in each mask */
+#define PRESCAN_BLOCK 64
+
+/** indexes of the masks in a block */
+enum prescan_mask {
+    MASK_NEWLINE = 0,
+    MASK_NONSPACE,
+    MASK_COLON,
+    MASK_DOT
+};
+
+/**
+ * fill {masks} for the first {len} bytes (up to PRESCAN_BLOCK) at {ptr}, bit i stands for ptr[i]
+ */
+typedef void (*prescan_kernel_t)(const char *ptr, size_t len, uint64_t masks[4]);
+
+static void prescan_kernel_scalar(const char *ptr, size_t len, uint64_t masks[4]) {
+    size_t i;
+    masks[MASK_NEWLINE] = masks[MASK_NONSPACE] = masks[MASK_COLON] = masks[MASK_DOT] = 0;
+    for (i = 0; i < len; i++) {
+        const uint64_t bit = (uint64_t)1 << i;
+        switch (ptr[i]) {
+            case '\n':
+                masks[MASK_NEWLINE] |= bit;
+                break;
+            case ' ': case '\t': case '\v': case '\f': case '\r':
+                break;
+            case ':':
+                masks[MASK_COLON] |= bit;
+                masks[MASK_NONSPACE] |= bit;
+                break;
+            case '.':
+                masks[MASK_DOT] |= bit;
+                masks[MASK_NONSPACE] |= bit;
+                break;
+            default:
+                masks[MASK_NONSPACE] |= bit;
+                break;
+        }
+    }
+}
+
+#ifdef PRESCAN_X86
+__attribute__((target("sse2")))
+static void prescan_kernel_sse2(const char *ptr, size_t len, uint64_t masks[4]) {
+    const __m128i newline = _mm_set1_epi8('\n'), colon = _mm_set1_epi8(':'), dot = _mm_set1_epi8('.');
+    const __m128i space = _mm_set1_epi8(' '), ctrl_low = _mm_set1_epi8('\t' - 1), ctrl_high = _mm_set1_epi8('\r' + 1);
+    unsigned i;
+    masks[MASK_NEWLINE] = masks[MASK_NONSPACE] = masks[MASK_COLON] = masks[MASK_DOT] = 0;
+    for (i = 0; i < PRESCAN_BLOCK; i += 16) {
+        const __m128i v = _mm_loadu_si128((const __m128i *)(ptr + i));
+        const __m128i is_space = _mm_or_si128(_mm_cmpeq_epi8(v, space),
+                                              _mm_and_si128(_mm_cmpgt_epi8(v, ctrl_low), _mm_cmplt_epi8(v, ctrl_high)));
+        masks[MASK_NEWLINE]  |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, newline)) << i;
+        masks[MASK_NONSPACE] |= (uint64_t)(uint16_t)~_mm_movemask_epi8(is_space) << i;
+        masks[MASK_COLON]    |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, colon)) << i;
+        masks[MASK_DOT]      |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, dot)) << i;
+    }
+    (void)len;
+}
+
+__attribute__((target("avx2")))
+static void prescan_kernel_avx2(const char *ptr, size_t len, uint64_t masks[4]) {
+    const __m256i newline = _mm256_set1_epi8('\n'), colon = _mm256_set1_epi8(':'), dot = _mm256_set1_epi8('.');
+    const __m256i space = _mm256_set1_epi8(' '), ctrl_low = _mm256_set1_epi8('\t' - 1), ctrl_high = _mm256_set1_epi8('\r' + 1);
+    unsigned i;
+    masks[MASK_NEWLINE] = masks[MASK_NONSPACE] = masks[MASK_COLON] = masks[MASK_DOT] = 0;
+    for (i = 0; i < PRESCAN_BLOCK; i += 32) {
+        const __m256i v = _mm256_loadu_si256((const __m256i *)(ptr + i));
+        const __m256i is_space = _mm256_or_si256(_mm256_cmpeq_epi8(v, space),
+                                                 _mm256_and_si256(_mm256_cmpgt_epi8(v, ctrl_low), _mm256_cmpgt_epi8(ctrl_high, v)));
+        masks[MASK_NEWLINE]  |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, newline)) << i;
+        masks[MASK_NONSPACE] |= (uint64_t)(uint32_t)~_mm256_movemask_epi8(is_space) << i;
+        masks[MASK_COLON]    |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, colon)) << i;
+        masks[MASK_DOT]      |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, dot)) << i;
+    }
+    (void)len;
+}
+#endif
+
+/**
+ * return the best kernel for full blocks on this CPU, and set {name} to its name
+ */
+static prescan_kernel_t prescan_select_kernel(const char **name) {
+#ifdef PRESCAN_X86
+    if (__builtin_cpu_supports("avx2")) {
+        *name = "avx2";
+        return prescan_kernel_avx2;
+    } else if (__builtin_cpu_supports("sse2")) {
+        *name = "sse2";
+        return prescan_kernel_sse2;
+    }
+#endif
+    *name = "scalar";
+    return prescan_kernel_scalar;
+}
+
+const char *prescan_kernel_name(void) {
+    const char *name;
+    prescan_select_kernel(&name);
+    return name;
+}
+
+/** return index of lowest set bit of nonzero {mask} */
+#ifdef __GNUC__
+#define PRESCAN_CTZ(mask) ((unsigned)__builtin_ctzll(mask))
+#else
+static unsigned PRESCAN_CTZ(uint64_t mask) {
+    unsigned res = 0;
+    for (; !(mask & 1); mask >>= 1)
+        res++;
+    return res;
+}
+#endif
+
+prescan_t prescan_new(const source_t *src, size_t max_line_len) {
+    prescan_t scan;
+    scan.data = src->data;
+    scan.len = src->len;
+    scan.max_line_len = max_line_len;
+    scan.block = 0;
+    scan.has_block = FALSE;
+    scan.line.start = 0;
+    scan.line.len = PRESCAN_NONE; /* offset of first non space character */
+    scan.line.colon = scan.line.dot = PRESCAN_NONE;
+    scan.linenum = 0;
+    return scan;
+}
+
+/**
+ * finish the current line of {scan}, which ends at {end}, and reset it for the next line
+ * if the line is meaningful, fill it into {line}
+ * return true if {line} was filled
+ */
+static BOOL prescan_finish_line(prescan_t *scan, size_t end, prescan_line_t *line) {
+    const size_t first = scan->line.len;
+    BOOL res = FALSE;
+
+    if (end > scan->line.start && scan->data[end - 1] == '\r')
+        end--; /* CRLF line break */
+    line->flags = (end - scan->line.start > scan->max_line_len) ? PRESCAN_TOO_LONG : 0;
+    if (line->flags || (first != PRESCAN_NONE && scan->data[first] != ';')) {
+        line->start = (first != PRESCAN_NONE) ? first : scan->line.start;
+        line->len = (end > line->start) ? end - line->start : 0;
+        line->colon = (scan->line.colon != PRESCAN_NONE) ? scan->line.colon - line->start : PRESCAN_NONE;
+        line->dot = (scan->line.dot != PRESCAN_NONE) ? scan->line.dot - line->start : PRESCAN_NONE;
+        line->linenum = scan->linenum;
+        res = TRUE;
+    }
+
+    scan->linenum++;
+    scan->line.start = end;
+    scan->line.len = scan->line.colon = scan->line.dot = PRESCAN_NONE;
+    return res;
+}
+
+size_t prescan_next(prescan_t *scan, prescan_line_t *lines, size_t max_lines) {
+    const char *kernel_name;
+    const prescan_kernel_t kernel = prescan_select_kernel(&kernel_name);
+    size_t cnt = 0;
+
+    while (cnt < max_lines) {
+        uint64_t newline, before;
+        if (!scan->has_block) {
+            if (scan->block >= scan->len) {
+                /* last line without line break */
+                if (scan->line.start < scan->len)
+                    cnt += prescan_finish_line(scan, scan->len, lines + cnt);
+                break;
+            }
+            if (scan->len - scan->block >= PRESCAN_BLOCK)
+                kernel(scan->data + scan->block, PRESCAN_BLOCK, scan->masks);
+            else
+                prescan_kernel_scalar(scan->data + scan->block, scan->len - scan->block, scan->masks);
+            scan->has_block = TRUE;
+        }
+
+        newline = scan->masks[MASK_NEWLINE];
+        before = newline ? (newline & (~newline + 1)) - 1 : ~(uint64_t)0; /* bits of the current line */
+        if (scan->line.len == PRESCAN_NONE && (scan->masks[MASK_NONSPACE] & before))
+            scan->line.len = scan->block + PRESCAN_CTZ(scan->masks[MASK_NONSPACE] & before);
+        if (scan->line.colon == PRESCAN_NONE && (scan->masks[MASK_COLON] & before))
+            scan->line.colon = scan->block + PRESCAN_CTZ(scan->masks[MASK_COLON] & before);
+        if (scan->line.dot == PRESCAN_NONE && (scan->masks[MASK_DOT] & before))
+            scan->line.dot = scan->block + PRESCAN_CTZ(scan->masks[MASK_DOT] & before);
+
+        if (!newline) {
+            scan->has_block = FALSE;
+            scan->block += PRESCAN_BLOCK;
+        } else {
+            const size_t end = scan->block + PRESCAN_CTZ(newline);
+            const uint64_t keep = ~(before | (before + 1));
+            cnt += prescan_finish_line(scan, end, lines + cnt);
+            scan->line.start = end + 1;
+            scan->masks[MASK_NEWLINE] &= keep;
+            scan->masks[MASK_NONSPACE] &= keep;
+            scan->masks[MASK_COLON] &= keep;
+            scan->masks[MASK_DOT] &= keep;
+        }
+    }
+    return cnt;
+}
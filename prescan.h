@@ -0,0 +1,64 @@
+/* This file is part of OpenU's C project implementation, called assembler
+ * Copyright (C) 2020 Arthur Zamarin, Norel Farjun */
+
+#ifndef ASM_PRESCAN_H
+#define ASM_PRESCAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "global.h"
+#include "source.h"
+
+/** value of prescan_line_t offsets when the character wasn't found */
+#define PRESCAN_NONE ((size_t)-1)
+
+/** prescan_line_t flags */
+enum prescan_flags {
+    PRESCAN_TOO_LONG = 0x1 /* line is longer than the maximal length */
+};
+
+/**
+ * Index information about one meaningful line - not blank and not a comment.
+ */
+typedef struct {
+    size_t start;     /* offset in the source of the line's first non space character */
+    size_t len;       /* characters count from {start} until the line break */
+    size_t colon;     /* offset of the first ':' relative to {start}, or PRESCAN_NONE */
+    size_t dot;       /* offset of the first '.' relative to {start}, or PRESCAN_NONE */
+    unsigned linenum; /* zero based line number */
+    unsigned flags;   /* prescan_flags */
+} prescan_line_t;
+
+/**
+ * Holds the state of scanning a source in batches.
+ * The scan runs over 64 bytes blocks, using vector instructions when the CPU supports them.
+ */
+typedef struct {
+    const char *data;
+    size_t len;
+    size_t max_line_len;
+    size_t block;         /* offset of the current block */
+    uint64_t masks[4];    /* not yet handled bits of the current block's masks */
+    BOOL has_block;       /* are {masks} valid */
+    prescan_line_t line;  /* the line being scanned, {line.start} is the start of the line */
+    unsigned linenum;
+} prescan_t;
+
+/**
+ * create a scanner over {src}, where lines longer than {max_line_len} are flagged with PRESCAN_TOO_LONG
+ */
+prescan_t prescan_new(const source_t *src, size_t max_line_len);
+/**
+ * scan the next meaningful lines of {scan} into {lines}, up to {max_lines}.
+ * Blank lines and comment lines are skipped, unless they are too long.
+ * return the count of lines filled, 0 when the source is done
+ */
+size_t prescan_next(prescan_t *scan, prescan_line_t *lines, size_t max_lines);
+
+/**
+ * return the name of the scanning kernel used on this CPU
+ */
+const char *prescan_kernel_name(void);
+
+#endif
@@ -0,0 +1,194 @@
+/* This file is part of OpenU's C project implementation, called assembler
+ * Copyright (C) 2020 Arthur Zamarin, Norel Farjun */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include "scheduler.h"
+#include "global.h"
+
+#include <stdlib.h>
+#include <pthread.h>
+
+/**
+ * Jobs queue of one worker, as slice of the shared jobs array.
+ * The owner takes from {head} (heaviest), thieves take from {tail} (lightest).
+ */
+struct sched_deque {
+    pthread_mutex_t lock;
+    unsigned head, tail; /* indexes range [head, tail) inside the worker's slice */
+    unsigned *jobs;      /* the worker's slice */
+};
+
+struct scheduler_t {
+    scheduler_job_func func;
+    void *arg;
+    unsigned threads_cnt;    /* count of workers, each has one deque */
+    unsigned started_cnt;    /* count of threads started, to be joined */
+    pthread_t *threads;
+    struct sched_deque *deques;
+    unsigned *jobs;          /* all job indexes, sliced between the deques */
+
+    pthread_mutex_t done_lock;
+    pthread_cond_t done_cond;
+    unsigned char *done;     /* is job done, per job */
+};
+
+/** argument for a worker's thread */
+struct sched_worker {
+    struct scheduler_t *sched;
+    unsigned id;
+};
+
+/** job index and it's weight, used for sorting */
+struct sched_weighted_job {
+    unsigned long weight;
+    unsigned job;
+};
+
+static int sched_weighted_job_cmp(const void *a, const void *b) {
+    const struct sched_weighted_job *ja = a, *jb = b;
+    if (ja->weight != jb->weight)
+        return (ja->weight < jb->weight) ? 1 : -1; /* heaviest first */
+    return (ja->job > jb->job) - (ja->job < jb->job);
+}
+
+/**
+ * take the next job for worker {id} of {sched}, from its own deque or stolen from other's
+ * return FALSE if no job is left
+ */
+static BOOL sched_take_job(struct scheduler_t *sched, unsigned id, unsigned *job) {
+    unsigned i;
+    struct sched_deque *deque = sched->deques + id;
+    BOOL found = FALSE;
+
+    pthread_mutex_lock(&deque->lock);
+    if (deque->head < deque->tail) {
+        *job = deque->jobs[deque->head++];
+        found = TRUE;
+    }
+    pthread_mutex_unlock(&deque->lock);
+
+    for (i = 1; !found && i < sched->threads_cnt; i++) {
+        deque = sched->deques + (id + i) % sched->threads_cnt;
+        pthread_mutex_lock(&deque->lock);
+        if (deque->head < deque->tail) {
+            *job = deque->jobs[--deque->tail];
+            found = TRUE;
+        }
+        pthread_mutex_unlock(&deque->lock);
+    }
+    return found;
+}
+
+/**
+ * run jobs as worker {id} of {sched}, until no job is left
+ */
+static void sched_run_worker(struct scheduler_t *sched, unsigned id) {
+    unsigned job;
+    while (sched_take_job(sched, id, &job)) {
+        sched->func(job, sched->arg);
+
+        pthread_mutex_lock(&sched->done_lock);
+        sched->done[job] = TRUE;
+        pthread_cond_broadcast(&sched->done_cond);
+        pthread_mutex_unlock(&sched->done_lock);
+    }
+}
+
+static void *sched_worker_main(void *param) {
+    struct sched_worker worker = *(struct sched_worker *)param;
+    free(param);
+    sched_run_worker(worker.sched, worker.id);
+    return NULL;
+}
+
+struct scheduler_t *scheduler_new(unsigned threads_cnt, unsigned jobs_cnt, const unsigned long *weights,
+                                  scheduler_job_func func, void *arg) {
+    struct scheduler_t *sched;
+    struct sched_weighted_job *order;
+    unsigned i, pos;
+
+    if (threads_cnt > jobs_cnt)
+        threads_cnt = jobs_cnt;
+    if (threads_cnt == 0)
+        threads_cnt = 1;
+    if (!(sched = calloc(1, sizeof(struct scheduler_t))))
+        return NULL;
+    sched->func = func;
+    sched->arg = arg;
+    sched->threads_cnt = threads_cnt;
+    sched->threads = calloc(threads_cnt, sizeof(pthread_t));
+    sched->deques = calloc(threads_cnt, sizeof(struct sched_deque));
+    sched->jobs = calloc(jobs_cnt + 1, sizeof(unsigned));
+    sched->done = calloc(jobs_cnt + 1, sizeof(unsigned char));
+    order = calloc(jobs_cnt + 1, sizeof(struct sched_weighted_job));
+    if (!sched->threads || !sched->deques || !sched->jobs || !sched->done || !order) {
+        free(order);
+        free(sched->done);
+        free(sched->jobs);
+        free(sched->deques);
+        free(sched->threads);
+        free(sched);
+        return NULL;
+    }
+
+    for (i = 0; i < jobs_cnt; i++) {
+        order[i].weight = weights[i];
+        order[i].job = i;
+    }
+    qsort(order, jobs_cnt, sizeof(struct sched_weighted_job), sched_weighted_job_cmp);
+
+    /* deal the sorted jobs round robin, so every deque is sorted heaviest first */
+    for (i = 0, pos = 0; i < threads_cnt; i++) {
+        unsigned j;
+        struct sched_deque *deque = sched->deques + i;
+        pthread_mutex_init(&deque->lock, NULL);
+        deque->jobs = sched->jobs + pos;
+        deque->head = deque->tail = 0;
+        for (j = i; j < jobs_cnt; j += threads_cnt)
+            deque->jobs[deque->tail++] = order[j].job;
+        pos += deque->tail;
+    }
+    free(order);
+
+    pthread_mutex_init(&sched->done_lock, NULL);
+    pthread_cond_init(&sched->done_cond, NULL);
+
+    for (i = 0; i < threads_cnt; i++) {
+        struct sched_worker *worker = malloc(sizeof(struct sched_worker));
+        if (worker) {
+            worker->sched = sched;
+            worker->id = i;
+        }
+        if (!worker || pthread_create(sched->threads + i, NULL, sched_worker_main, worker)) {
+            /* unable to start more threads, so work in this one until all jobs are done */
+            free(worker);
+            sched_run_worker(sched, i);
+            break;
+        }
+        sched->started_cnt++;
+    }
+    return sched;
+}
+
+void scheduler_wait_job(struct scheduler_t *sched, unsigned job) {
+    pthread_mutex_lock(&sched->done_lock);
+    while (!sched->done[job])
+        pthread_cond_wait(&sched->done_cond, &sched->done_lock);
+    pthread_mutex_unlock(&sched->done_lock);
+}
+
+void scheduler_dealloc(struct scheduler_t *sched) {
+    unsigned i;
+    for (i = 0; i < sched->started_cnt; i++)
+        pthread_join(sched->threads[i], NULL);
+    for (i = 0; i < sched->threads_cnt; i++)
+        pthread_mutex_destroy(&sched->deques[i].lock);
+    pthread_mutex_destroy(&sched->done_lock);
+    pthread_cond_destroy(&sched->done_cond);
+    free(sched->done);
+    free(sched->jobs);
+    free(sched->deques);
+    free(sched->threads);
+    free(sched);
+}
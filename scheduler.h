@@ -0,0 +1,35 @@
+/* This file is part of OpenU's C project implementation, called assembler
+ * Copyright (C) 2020 Arthur Zamarin, Norel Farjun */
+
+#ifndef ASM_SCHEDULER_H
+#define ASM_SCHEDULER_H
+
+/**
+ * Pool of worker threads running independent jobs, balanced by work stealing.
+ * Jobs are dealt between the workers from the heaviest to the lightest. Every worker
+ * runs its own jobs heaviest first, and when done steals the lightest jobs of others.
+ */
+struct scheduler_t;
+
+/**
+ * function running the job number {job}, with the user's {arg}
+ */
+typedef void (*scheduler_job_func)(unsigned job, void *arg);
+
+/**
+ * create a scheduler and start running {jobs_cnt} jobs using {func} and {arg} on {threads_cnt} threads
+ * {weights} is the estimated cost of every job, used for ordering
+ * return NULL if unable to create the scheduler
+ */
+struct scheduler_t *scheduler_new(unsigned threads_cnt, unsigned jobs_cnt, const unsigned long *weights,
+                                  scheduler_job_func func, void *arg);
+/**
+ * block until job number {job} of {sched} is done
+ */
+void scheduler_wait_job(struct scheduler_t *sched, unsigned job);
+/**
+ * wait for all jobs of {sched} to end, and free it
+ */
+void scheduler_dealloc(struct scheduler_t *sched);
+
+#endif
@@ -0,0 +1,466 @@
+/* This file is part of OpenU's C project implementation, called assembler
+ * Copyright (C) 2020 Arthur Zamarin, Norel Farjun */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include "server.h"
+#include "outbuf.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/** longest accepted request line, enough for a path and the request name */
+#define SERVER_MAX_LINE 4200
+/** seconds a client may stay silent before its connection is closed, freeing its held source */
+#define SERVER_IDLE_SECONDS 300
+
+/**
+ * A warm parser and the buffer of its diagnostics, kept between connections
+ */
+typedef struct server_worker_t {
+    struct parser_ctx_t *ctx;
+    FILE *diag;
+    struct server_worker_t *next; /* next idle worker */
+} server_worker_t;
+
+/**
+ * State shared by the listening thread and the connection threads
+ */
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t done;     /* signaled when a connection ends */
+    server_worker_t *idle;   /* workers of no connection */
+    unsigned active;         /* count of connection threads */
+    BOOL stop;               /* did a client ask to shut down */
+    int listen_fd;
+    server_assemble_func func;
+    void *arg;
+} server_t;
+
+/**
+ * One client connection
+ */
+typedef struct {
+    server_t *server;
+    int fd;
+    FILE *in;
+    FILE *out;
+    char *path;           /* basename of the current request joined to {cwd}, for reading and writing the files */
+    char *cwd;            /* directory set by CWD, or NULL for the directory of the server */
+    struct incremental_t *held; /* source held by OPEN for the EDIT requests, or NULL */
+    char *held_basename;        /* basename of {held} */
+} server_conn_t;
+
+/**
+ * parser_output_func which writes the output file next to the source, and tells the client its path
+ */
+static BOOL server_output_file(void *arg, const char *extension, const char *data, size_t len) {
+    server_conn_t *conn = arg;
+    char *path = malloc(strlen(conn->path) + MAX_LEN_EXTENSION + 1);
+    BOOL res;
+
+    if (!path)
+        return FALSE;
+    sprintf(path, "%s%s", conn->path, extension);
+    if ((res = outbuf_write_data(data, len, path, FALSE)))
+        fprintf(conn->out, "OUTPUT %s\n", path);
+    free(path);
+    return res;
+}
+
+/**
+ * parser_output_func which sends the content of the output file to the client
+ */
+static BOOL server_output_content(void *arg, const char *extension, const char *data, size_t len) {
+    server_conn_t *conn = arg;
+    fprintf(conn->out, "CONTENT %s %lu\n", extension, (unsigned long)len);
+    return fwrite(data, 1, len, conn->out) == len;
+}
+
+/**
+ * return a new string of {basename} joined to the directory of {conn}, or NULL if out of memory
+ */
+static char *server_join(const server_conn_t *conn, const char *basename) {
+    char *path;
+    if (!conn->cwd || basename[0] == '/') {
+        if ((path = malloc(strlen(basename) + 1)))
+            strcpy(path, basename);
+    } else if ((path = malloc(strlen(conn->cwd) + strlen(basename) + 2)))
+        sprintf(path, "%s/%s", conn->cwd, basename);
+    return path;
+}
+
+/**
+ * assemble {basename} with the held source {inc}, or content {src} (or NULL to read the file) for {conn}, using
+ * the warm {ctx} and buffering the diagnostics in {diag}
+ * return false if the answer can't be sent
+ */
+static BOOL server_request(server_conn_t *conn, struct parser_ctx_t *ctx, FILE *diag, const char *basename,
+                           const source_t *src, struct incremental_t *inc) {
+    char buffer[4096];
+    long len;
+    size_t chunk;
+    BOOL done;
+
+    if (!(conn->path = server_join(conn, basename)))
+        return FALSE;
+    parser_reset(ctx);
+    parser_set_output_func(ctx, src ? server_output_content : server_output_file, conn);
+    rewind(diag);
+    done = conn->server->func(conn->server->arg, ctx, basename, conn->path, src, inc, diag);
+    free(conn->path);
+    conn->path = NULL;
+    fflush(diag);
+    if ((len = ftell(diag)) < 0)
+        return FALSE;
+
+    /* the buffer file isn't truncated, only the first {len} bytes belong to this request */
+    rewind(diag);
+    fprintf(conn->out, "DIAG %ld\n", len);
+    for (; len > 0; len -= (long)chunk) {
+        chunk = (size_t)len < sizeof(buffer) ? (size_t)len : sizeof(buffer);
+        if (fread(buffer, 1, chunk, diag) != chunk || fwrite(buffer, 1, chunk, conn->out) != chunk)
+            return FALSE;
+    }
+    fprintf(conn->out, "END %d\n", done ? 1 : 0);
+    return fflush(conn->out) == 0;
+}
+
+/**
+ * read the {len} bytes of a SOURCE request from {conn} into {src}
+ * return false if the client sent less, or out of memory
+ */
+static BOOL server_read_source(server_conn_t *conn, unsigned long len, source_t *src) {
+    char *data = malloc(len ? len : 1);
+    if (!data)
+        return FALSE;
+    if (fread(data, 1, len, conn->in) != len) {
+        free(data);
+        return FALSE;
+    }
+    src->data = data;
+    src->len = len;
+    src->is_mapped = FALSE;
+    return TRUE;
+}
+
+/**
+ * hold the {len} bytes which follow the OPEN request from {conn} as the source of {basename}
+ * return the error text, or NULL on success
+ */
+static const char *server_open(server_conn_t *conn, unsigned long len, const char *basename) {
+    source_t src;
+    BOOL res;
+    char *name;
+
+    if (!server_read_source(conn, len, &src))
+        return "can't read the source";
+    if (!conn->held && !(conn->held = incremental_new())) {
+        source_close(&src);
+        return "out of memory";
+    }
+    res = incremental_load(conn->held, src.data, src.len);
+    source_close(&src);
+    if (!res || !(name = malloc(strlen(basename) + 1)))
+        return "out of memory";
+    strcpy(name, basename);
+    free(conn->held_basename);
+    conn->held_basename = name;
+    return NULL;
+}
+
+/**
+ * apply to the held source of {conn} the EDIT request of {args} ("<first> <count> <len>"), whose text follows
+ * return the error text, or NULL on success
+ */
+static const char *server_edit(server_conn_t *conn, const char *args) {
+    unsigned long first, count, len;
+    source_t src;
+    char *end;
+    BOOL res;
+
+    first = strtoul(args, &end, 10);
+    if (end == args || *end != ' ')
+        return "bad EDIT request";
+    count = strtoul(args = end + 1, &end, 10);
+    if (end == args || *end != ' ')
+        return "bad EDIT request";
+    len = strtoul(args = end + 1, &end, 10);
+    if (end == args || *end)
+        return "bad EDIT request";
+    if (!conn->held_basename)
+        return "no source is held";
+    if (!server_read_source(conn, len, &src))
+        return "can't read the source";
+    res = first <= UINT_MAX && count <= UINT_MAX &&
+          incremental_edit(conn->held, (unsigned)first, (unsigned)count, src.data, src.len);
+    source_close(&src);
+    return res ? NULL : "bad EDIT lines";
+}
+
+/**
+ * set the directory of {conn} to {dir}
+ * return the error text, or NULL on success
+ */
+static const char *server_cwd(server_conn_t *conn, const char *dir) {
+    struct stat st;
+    char *copy;
+    if (stat(dir, &st) || !S_ISDIR(st.st_mode))
+        return "can't change directory";
+    if (!(copy = malloc(strlen(dir) + 1)))
+        return "out of memory";
+    strcpy(copy, dir);
+    free(conn->cwd);
+    conn->cwd = copy;
+    return NULL;
+}
+
+/**
+ * serve all the requests of the client of {conn}, using the warm {ctx} and {diag}
+ * return true if the client asked to shut down the server
+ */
+static BOOL server_serve(server_conn_t *conn, struct parser_ctx_t *ctx, FILE *diag) {
+    char line[SERVER_MAX_LINE], *end;
+    const char *error = NULL;
+    unsigned long len;
+    source_t src;
+    BOOL stop = FALSE, sent;
+
+    while (!error && fgets(line, sizeof(line), conn->in)) {
+        if (!(end = strchr(line, '\n'))) {
+            error = "request line too long";
+            break;
+        }
+        *end = '\0';
+        if (!strncmp(line, "CWD ", 4))
+            error = server_cwd(conn, line + 4);
+        else if (!strncmp(line, "FILE ", 5) && line[5]) {
+            if (!server_request(conn, ctx, diag, line + 5, NULL, NULL))
+                break;
+        } else if (!strncmp(line, "SOURCE ", 7)) {
+            len = strtoul(line + 7, &end, 10);
+            if (end == line + 7 || *end != ' ' || !end[1])
+                error = "bad SOURCE request";
+            else if (!server_read_source(conn, len, &src))
+                error = "can't read the source";
+            else {
+                sent = server_request(conn, ctx, diag, end + 1, &src, NULL);
+                source_close(&src);
+                if (!sent)
+                    break;
+            }
+        } else if (!strncmp(line, "OPEN ", 5)) {
+            len = strtoul(line + 5, &end, 10);
+            if (end == line + 5 || *end != ' ' || !end[1])
+                error = "bad OPEN request";
+            else if (!(error = server_open(conn, len, end + 1)) &&
+                     !server_request(conn, ctx, diag, conn->held_basename, NULL, conn->held))
+                break;
+        } else if (!strncmp(line, "EDIT ", 5)) {
+            if (!(error = server_edit(conn, line + 5)) &&
+                    !server_request(conn, ctx, diag, conn->held_basename, NULL, conn->held))
+                break;
+        } else if (!strcmp(line, "SHUTDOWN"))
+            stop = TRUE;
+        else
+            error = "unknown request";
+    }
+    if (error)
+        fprintf(conn->out, "ERROR %s\n", error);
+    return stop;
+}
+
+/**
+ * take an idle worker of {server}, or create one
+ * return NULL if out of memory
+ */
+static server_worker_t *server_worker_take(server_t *server) {
+    server_worker_t *worker;
+    pthread_mutex_lock(&server->lock);
+    if ((worker = server->idle))
+        server->idle = worker->next;
+    pthread_mutex_unlock(&server->lock);
+    if (worker)
+        return worker;
+    if (!(worker = malloc(sizeof(server_worker_t))))
+        return NULL;
+    if (!(worker->ctx = parser_new())) {
+        free(worker);
+        return NULL;
+    }
+    if (!(worker->diag = tmpfile())) {
+        parser_dealloc(worker->ctx);
+        free(worker);
+        return NULL;
+    }
+    return worker;
+}
+
+/**
+ * thread function of a server_conn_t {arg}, serving its client and closing it at the end
+ */
+static void *server_connection(void *arg) {
+    server_conn_t *conn = arg;
+    server_t *server = conn->server;
+    server_worker_t *worker = server_worker_take(server);
+    int out_fd = -1;
+    BOOL stop = FALSE;
+
+    if (!worker || (out_fd = dup(conn->fd)) < 0 || !(conn->in = fdopen(conn->fd, "r")))
+        close(conn->fd);
+    else if (!(conn->out = fdopen(out_fd, "w")))
+        fclose(conn->in);
+    else {
+        out_fd = -1;
+        stop = server_serve(conn, worker->ctx, worker->diag);
+        fclose(conn->out);
+        fclose(conn->in);
+    }
+    if (out_fd >= 0)
+        close(out_fd);
+    if (conn->held)
+        incremental_dealloc(conn->held);
+    free(conn->held_basename);
+    free(conn->cwd);
+    free(conn);
+
+    pthread_mutex_lock(&server->lock);
+    if (worker) {
+        worker->next = server->idle;
+        server->idle = worker;
+    }
+    if (stop && !server->stop) {
+        server->stop = TRUE;
+        /* wakes the listening thread out of accept */
+        shutdown(server->listen_fd, SHUT_RDWR);
+    }
+    --server->active;
+    pthread_cond_signal(&server->done);
+    pthread_mutex_unlock(&server->lock);
+    return NULL;
+}
+
+/**
+ * start a thread serving the client connected on {fd} of {server}
+ * return false if unable to, closing {fd}
+ */
+static BOOL server_start_connection(server_t *server, int fd) {
+    struct timeval timeout;
+    pthread_attr_t attr;
+    pthread_t thread;
+    server_conn_t *conn;
+    BOOL res;
+
+    if (!(conn = malloc(sizeof(server_conn_t)))) {
+        close(fd);
+        return FALSE;
+    }
+    memset(conn, 0, sizeof(server_conn_t));
+    conn->server = server;
+    conn->fd = fd;
+    timeout.tv_sec = SERVER_IDLE_SECONDS;
+    timeout.tv_usec = 0;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_mutex_lock(&server->lock);
+    if ((res = !pthread_create(&thread, &attr, server_connection, conn)))
+        ++server->active;
+    pthread_mutex_unlock(&server->lock);
+    pthread_attr_destroy(&attr);
+    if (!res) {
+        close(fd);
+        free(conn);
+    }
+    return res;
+}
+
+/**
+ * remove the socket at {socket_path}, only if it is a socket, and the one bound at {bound} when it isn't NULL
+ * return false if something else is there, true if it was removed or there is nothing
+ */
+static BOOL server_unlink_socket(const char *socket_path, const struct stat *bound) {
+    struct stat st;
+    if (lstat(socket_path, &st))
+        return errno == ENOENT;
+    if (!S_ISSOCK(st.st_mode) || (bound && (st.st_dev != bound->st_dev || st.st_ino != bound->st_ino)))
+        return FALSE;
+    return unlink(socket_path) == 0 || errno == ENOENT;
+}
+
+BOOL server_run(const char *socket_path, server_assemble_func func, void *arg) {
+    struct sockaddr_un addr;
+    struct stat bound;
+    server_t server;
+    server_worker_t *worker;
+    BOOL stop;
+    int fd;
+
+    if (strlen(socket_path) >= sizeof(addr.sun_path))
+        return FALSE;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socket_path);
+
+    /* clients going away in the middle of an answer must not kill the server */
+    signal(SIGPIPE, SIG_IGN);
+    if ((server.listen_fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+        return FALSE;
+    /* a socket left by a previous server is replaced, but never any other file */
+    if (!server_unlink_socket(socket_path, NULL) ||
+            bind(server.listen_fd, (struct sockaddr *)&addr, sizeof(addr)) || listen(server.listen_fd, 16) ||
+            lstat(socket_path, &bound)) {
+        close(server.listen_fd);
+        return FALSE;
+    }
+    pthread_mutex_init(&server.lock, NULL);
+    pthread_cond_init(&server.done, NULL);
+    server.idle = NULL;
+    server.active = 0;
+    server.stop = FALSE;
+    server.func = func;
+    server.arg = arg;
+
+    for (;;) {
+        fd = accept(server.listen_fd, NULL, NULL);
+        pthread_mutex_lock(&server.lock);
+        stop = server.stop;
+        pthread_mutex_unlock(&server.lock);
+        if (stop) {
+            if (fd >= 0)
+                close(fd);
+            break;
+        }
+        if (fd >= 0)
+            server_start_connection(&server, fd);
+        else if (errno != EINTR && errno != ECONNABORTED)
+            break;
+    }
+
+    /* the other clients finish their requests, or are closed when idle */
+    pthread_mutex_lock(&server.lock);
+    while (server.active > 0)
+        pthread_cond_wait(&server.done, &server.lock);
+    pthread_mutex_unlock(&server.lock);
+    while ((worker = server.idle)) {
+        server.idle = worker->next;
+        fclose(worker->diag);
+        parser_dealloc(worker->ctx);
+        free(worker);
+    }
+    pthread_cond_destroy(&server.done);
+    pthread_mutex_destroy(&server.lock);
+    close(server.listen_fd);
+    server_unlink_socket(socket_path, &bound); /* unless another server took the path meanwhile */
+    return stop;
+}
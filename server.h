@@ -0,0 +1,56 @@
+/* This file is part of OpenU's C project implementation, called assembler
+ * Copyright (C) 2020 Arthur Zamarin, Norel Farjun */
+
+#ifndef ASM_SERVER_H
+#define ASM_SERVER_H
+
+#include <stdio.h>
+
+#include "global.h"
+#include "source.h"
+#include "parser.h"
+#include "incremental.h"
+
+/**
+ * Persistent assembler over a Unix domain socket, saving the process startup of every file.
+ *
+ * A client connects, sends requests, and closes its writing side. Every connection is served by a thread of its
+ * own, with a warm parser kept from an earlier connection, so a client holding a source for EDIT requests doesn't
+ * block the others. A connection silent for a few minutes is closed. Requests are lines, some followed by raw bytes:
+ *     CWD <dir>                    following basenames are relative to <dir>
+ *     FILE <basename>              assemble <basename>.as and write the outputs next to it
+ *     SOURCE <len> <basename>      assemble the <len> bytes which follow, and send the outputs back
+ *     OPEN <len> <basename>        hold the <len> bytes which follow as the source of <basename> for the EDIT
+ *                                  requests of this connection, assemble it and write the outputs next to it
+ *     EDIT <first> <count> <len>   replace <count> lines from the zero based line <first> of the held source by
+ *                                  the lines of the <len> bytes which follow, and assemble it again like OPEN,
+ *                                  parsing only the new lines (incremental.h)
+ *     SHUTDOWN                     stop the server after this connection, once the other connections end
+ * Every FILE, SOURCE, OPEN and EDIT request is answered, in order, by:
+ *     OUTPUT <path>                for every written file (FILE, OPEN and EDIT)
+ *     CONTENT <extension> <len>    followed by <len> bytes of every output file (SOURCE)
+ *     DIAG <len>                   followed by <len> bytes of the diagnostics, exactly as printed without --serve
+ *     END <1 if outputs were made, otherwise 0>
+ * Bad requests are answered by "ERROR <text>", and close the connection.
+ */
+
+/** environment variable holding the default socket path of the client */
+#define SERVER_SOCKET_ENV "ASM_SOCKET"
+
+/**
+ * Assembles {basename} using the warm {ctx} (already reset, with its output function set), printing the
+ * diagnostics into {out}. The content is the held source {inc} when it isn't NULL, otherwise {src}, or NULL to
+ * read {path}.as, where {path} is {basename} in the directory of the client.
+ * It is called from many threads at once, each with a {ctx} of its own.
+ * return true if the outputs were made
+ */
+typedef BOOL (*server_assemble_func)(void *arg, struct parser_ctx_t *ctx, const char *basename, const char *path,
+                                     const source_t *src, struct incremental_t *inc, FILE *out);
+
+/**
+ * listen on the Unix domain socket {socket_path}, and serve the clients in parallel with {func} and {arg}
+ * return false if the socket can't be set up, otherwise true after a client asked to shut down
+ */
+BOOL server_run(const char *socket_path, server_assemble_func func, void *arg);
+
+#endif
@@ -0,0 +1,432 @@
+/* This file is part of OpenU's C project implementation, called assembler
+ * Copyright (C) 2020 Arthur Zamarin, Norel Farjun */
+
+/*
+ * Simulator of the 15 bit machine, running an assembled program:
+ *     simulator [--max-steps=N] [--stats] [--regs] program
+ * The program is a basename of text object files (.ob), or a path of a binary object file (.obb). It must have
+ * no externals, so a program of many modules is linked first. The run starts at the first code word, and ends
+ * with "stop".
+ *
+ * The machine has 8 registers and a 15 bit memory, with the program loaded at its addresses. Values are 15 bit
+ * two's complement words. "cmp" sets the zero flag which "bne" tests, "jsr" and "rts" use a return stack apart
+ * from the memory, "red" reads one character from stdin (-1 at its end) and "prn" prints its operand as a
+ * decimal number on its own line.
+ *
+ * Every instruction is decoded once into a micro-op, holding its handler and pointers to its operand cells, so
+ * running it is one indirect jump and no decoding. The code segment is decoded when loading, any other address
+ * the first time it runs, and writing into a decoded instruction makes it decoded again.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "global.h"
+#include "objfile.h"
+#include "opcodes.h"
+#include "instructions_list.h"
+#include "parser.h"
+
+/** count of memory words when the program is smaller, the whole 15 bit address space */
+#define SIM_MIN_MEMORY 0x8000UL
+#define SIM_WORD_MASK 0x7FFFU
+#define SIM_SIGN_BIT 0x4000U
+#define SIM_REGISTERS 8
+/** count of nested "jsr" calls */
+#define SIM_STACK_SIZE 4096
+
+/* computed goto is a GNU extension, every other compiler dispatches with a switch */
+#if defined(__GNUC__) && !defined(SIM_NO_COMPUTED_GOTO)
+#define SIM_COMPUTED_GOTO
+#endif
+
+/** micro-op handlers, every opcode is its handler minus 1 */
+enum sim_op {
+    SIM_OP_DECODE = 0, /* not decoded yet, so a zeroed micro-op is decoded when it runs */
+    SIM_OP_MOV = OPCODE_MOV + 1, SIM_OP_CMP, SIM_OP_ADD, SIM_OP_SUB, SIM_OP_LEA, SIM_OP_CLR, SIM_OP_NOT,
+    SIM_OP_INC, SIM_OP_DEC, SIM_OP_JMP, SIM_OP_BNE, SIM_OP_RED, SIM_OP_PRN, SIM_OP_JSR, SIM_OP_RTS,
+    SIM_OP_STOP = OPCODE_STOP + 1
+};
+
+/**
+ * One decoded instruction.
+ * Every operand is a pointer to its cell: a register, a memory word, or {src_value}/{dst_value} holding an
+ * immediate or the address of a jump target. Only register indirect operands depend on the registers at
+ * run time, so their pointer is NULL and the register is kept instead.
+ */
+typedef struct {
+    unsigned op;        /* sim_op */
+    unsigned size;      /* count of words of the instruction */
+    uint16_t *src;
+    uint16_t *dst;
+    unsigned src_reg;   /* register of a register indirect src */
+    unsigned dst_reg;   /* register of a register indirect dst */
+    BOOL dst_mem;       /* is dst a memory word, so writing it may change the code */
+    uint16_t src_value;
+    uint16_t dst_value;
+} sim_uop_t;
+
+/**
+ * The machine state
+ */
+typedef struct {
+    uint16_t regs[SIM_REGISTERS];
+    uint16_t *mem;          /* {mem_size} words, and 2 zero words after them for decoding at the end */
+    sim_uop_t *uops;        /* a micro-op for every address, and 3 after them for running off the end */
+    unsigned long mem_size;
+    unsigned long stack[SIM_STACK_SIZE];
+    unsigned sp;
+    BOOL zero;              /* did the last "cmp" find equal operands */
+    unsigned long pc;
+    unsigned long steps;    /* count of instructions run */
+} sim_t;
+
+/**
+ * return true if {path} ends with {suffix}
+ */
+static BOOL sim_has_suffix(const char *path, const char *suffix) {
+    const size_t len = strlen(path), suffix_len = strlen(suffix);
+    return len >= suffix_len && !strcmp(path + len - suffix_len, suffix);
+}
+
+/**
+ * decode the operand {word} accessed by {access} into the src or dst ({is_dst}) of {u}, at address {addr}
+ * an {is_address} operand is used by its address, like jump targets, instead of by its value
+ * return false if it can't run, reporting into {err} unless it is NULL
+ */
+static BOOL sim_decode_operand(sim_t *sim, sim_uop_t *u, unsigned access, unsigned word, BOOL is_dst,
+                               BOOL is_address, unsigned long addr, FILE *err) {
+    uint16_t **cell = is_dst ? &u->dst : &u->src, *value = is_dst ? &u->dst_value : &u->src_value;
+    unsigned reg = is_dst ? BITS_GET(DATA_DST_REG_RANGE, word) : BITS_GET(DATA_SRC_REG_RANGE, word);
+
+    switch (access) {
+        case OPERAND_REG:
+            *cell = sim->regs + reg;
+            return TRUE;
+        case OPERAND_MEM_REG:
+            if (is_address) /* the address is the register's value */
+                *cell = sim->regs + reg;
+            else {
+                *cell = NULL;
+                *(is_dst ? &u->dst_reg : &u->src_reg) = reg;
+                u->dst_mem |= is_dst;
+            }
+            return TRUE;
+        case OPERAND_IMMEDIATE:
+            *value = (uint16_t)BITS_GET(DATA_IMMEDIATE_RANGE, word);
+            if (*value & 0x800U) /* sign extend the 12 bits into 15 */
+                *value |= SIM_WORD_MASK & ~0xFFFU;
+            *cell = value;
+            return TRUE;
+        default:
+            if (BITS_GET(DATA_ARE_RANGE, word) != INST_ARE_RELETIVE) {
+                if (err)
+                    fprintf(err, "%04lu: external label operand, the program must be linked\n", addr);
+                return FALSE;
+            }
+            *value = (uint16_t)BITS_GET(DATA_LABEL_RANGE, word);
+            *cell = is_address ? value : sim->mem + *value;
+            u->dst_mem |= is_dst && !is_address;
+            return TRUE;
+    }
+}
+
+/**
+ * decode the instruction at address {addr} into its micro-op
+ * return false if it isn't a valid instruction, reporting into {err} unless it is NULL
+ */
+static BOOL sim_decode(sim_t *sim, unsigned long addr, FILE *err) {
+    sim_uop_t *u = sim->uops + addr;
+    const unsigned word = addr < sim->mem_size ? sim->mem[addr] : 0;
+    const unsigned opcode = BITS_GET(INST_OPCODE_RANGE, word);
+    const unsigned src = BITS_GET(INST_OPR2_ACCS_RANGE, word), dst = BITS_GET(INST_OPR1_ACCS_RANGE, word);
+    const BOOL is_address = opcode == OPCODE_JMP || opcode == OPCODE_BNE || opcode == OPCODE_JSR;
+
+    if (addr >= sim->mem_size) {
+        if (err)
+            fprintf(err, "%04lu: ran past the end of the memory\n", addr);
+        return FALSE;
+    }
+    if (src >= OPERAND_ACCESS_RANGE || dst >= OPERAND_ACCESS_RANGE || OPCODE_ENCODE(opcode, src, dst) != word) {
+        if (err)
+            fprintf(err, "%04lu: invalid instruction %05o\n", addr, word);
+        return FALSE;
+    }
+    memset(u, 0, sizeof(sim_uop_t));
+    u->size = 1;
+    if ((src & OPERAND_ALL_REG) && (dst & OPERAND_ALL_REG)) {
+        /* both operands are register based, so they share one word */
+        if (!sim_decode_operand(sim, u, src, sim->mem[addr + 1], FALSE, FALSE, addr, err) ||
+                !sim_decode_operand(sim, u, dst, sim->mem[addr + 1], TRUE, is_address, addr, err))
+            return FALSE;
+        ++u->size;
+    } else {
+        if (src && !sim_decode_operand(sim, u, src, sim->mem[addr + u->size++], FALSE,
+                                       opcode == OPCODE_LEA, addr, err))
+            return FALSE;
+        if (dst && !sim_decode_operand(sim, u, dst, sim->mem[addr + u->size++], TRUE, is_address, addr, err))
+            return FALSE;
+    }
+    if (addr + u->size > sim->mem_size) {
+        if (err)
+            fprintf(err, "%04lu: instruction past the end of the memory\n", addr);
+        return FALSE;
+    }
+    u->op = opcode + 1;
+    return TRUE;
+}
+
+/**
+ * forget the micro-ops of the instructions which hold the memory word {addr}, after it was written
+ */
+static void sim_invalidate(sim_t *sim, unsigned long addr) {
+    unsigned k;
+    for (k = 0; k <= 2 && k <= addr; ++k)
+        if (sim->uops[addr - k].op != SIM_OP_DECODE && sim->uops[addr - k].size > k)
+            sim->uops[addr - k].op = SIM_OP_DECODE;
+}
+
+/**
+ * load {obj} into the memory of {sim}, and decode its code segment
+ * return false if out of memory or it has externals
+ */
+static BOOL sim_load(sim_t *sim, const objfile_t *obj) {
+    const unsigned long end = (unsigned long)obj->code_start + obj->code_size + obj->data_size;
+    unsigned long addr, i;
+
+    memset(sim, 0, sizeof(sim_t));
+    if (obj->externals_cnt > 0) {
+        fprintf(ERR_STREAM, "the program has externals, it must be linked\n");
+        return FALSE;
+    }
+    sim->mem_size = end > SIM_MIN_MEMORY ? end : SIM_MIN_MEMORY;
+    if (!(sim->mem = calloc(sim->mem_size + 2, sizeof(uint16_t))) ||
+            !(sim->uops = calloc(sim->mem_size + 3, sizeof(sim_uop_t)))) {
+        free(sim->mem);
+        fprintf(ERR_STREAM, "out of memory\n");
+        return FALSE;
+    }
+    for (i = 0; i < (unsigned long)obj->code_size + obj->data_size; ++i)
+        sim->mem[obj->code_start + i] = (uint16_t)(objfile_word(obj, i) & SIM_WORD_MASK);
+    /* a bad word in the code segment is only an error if it runs */
+    for (addr = obj->code_start; addr < (unsigned long)obj->code_start + obj->code_size && sim_decode(sim, addr, NULL);
+         addr += sim->uops[addr].size);
+    sim->pc = obj->code_start;
+    return TRUE;
+}
+
+/**
+ * run {sim} from its pc until "stop", an error, or {max_steps} instructions
+ * return true if it stopped
+ */
+static BOOL sim_run(sim_t *sim, unsigned long max_steps) {
+    uint16_t *const regs = sim->regs, *const mem = sim->mem;
+    sim_uop_t *const uops = sim->uops, *u;
+    unsigned long pc = sim->pc, steps = sim->steps;
+    uint16_t *src, *dst;
+    BOOL res = FALSE;
+    int ch;
+#ifdef SIM_COMPUTED_GOTO
+    static void *const handlers[] = {
+        __extension__ &&op_decode, __extension__ &&op_mov, __extension__ &&op_cmp, __extension__ &&op_add,
+        __extension__ &&op_sub, __extension__ &&op_lea, __extension__ &&op_clr, __extension__ &&op_not,
+        __extension__ &&op_inc, __extension__ &&op_dec, __extension__ &&op_jmp, __extension__ &&op_bne,
+        __extension__ &&op_red, __extension__ &&op_prn, __extension__ &&op_jsr, __extension__ &&op_rts,
+        __extension__ &&op_stop
+    };
+#define SIM_HANDLER(name, op) op_##name
+#define SIM_DISPATCH() do { \
+        if (++steps > max_steps) goto limit; \
+        u = uops + pc; \
+        __extension__ ({ goto *handlers[u->op]; }); \
+    } while (0)
+#else
+#define SIM_HANDLER(name, op) case op
+#define SIM_DISPATCH() goto dispatch
+#endif
+/** cells of the operands of the running micro-op */
+#define SIM_SRC() (u->src ? u->src : mem + regs[u->src_reg])
+#define SIM_DST() (u->dst ? u->dst : mem + regs[u->dst_reg])
+/** write {value} into the dst cell of the running micro-op */
+#define SIM_STORE(value) do { \
+        *dst = (uint16_t)((value) & SIM_WORD_MASK); \
+        if (u->dst_mem) \
+            sim_invalidate(sim, (unsigned long)(dst - mem)); \
+    } while (0)
+#define SIM_NEXT() do { pc += u->size; SIM_DISPATCH(); } while (0)
+
+    SIM_DISPATCH();
+#ifndef SIM_COMPUTED_GOTO
+dispatch:
+    if (++steps > max_steps)
+        goto limit;
+    u = uops + pc;
+    switch (u->op) {
+#endif
+    SIM_HANDLER(decode, SIM_OP_DECODE):
+        if (!sim_decode(sim, pc, ERR_STREAM))
+            goto end;
+        --steps; /* decoding isn't an instruction */
+        SIM_DISPATCH();
+    SIM_HANDLER(mov, SIM_OP_MOV):
+        src = SIM_SRC();
+        dst = SIM_DST();
+        SIM_STORE(*src);
+        SIM_NEXT();
+    SIM_HANDLER(cmp, SIM_OP_CMP):
+        sim->zero = *SIM_SRC() == *SIM_DST();
+        SIM_NEXT();
+    SIM_HANDLER(add, SIM_OP_ADD):
+        src = SIM_SRC();
+        dst = SIM_DST();
+        SIM_STORE(*dst + *src);
+        SIM_NEXT();
+    SIM_HANDLER(sub, SIM_OP_SUB):
+        src = SIM_SRC();
+        dst = SIM_DST();
+        SIM_STORE(*dst - *src);
+        SIM_NEXT();
+    SIM_HANDLER(lea, SIM_OP_LEA):
+        src = SIM_SRC();
+        dst = SIM_DST();
+        SIM_STORE(*src);
+        SIM_NEXT();
+    SIM_HANDLER(clr, SIM_OP_CLR):
+        dst = SIM_DST();
+        SIM_STORE(0);
+        SIM_NEXT();
+    SIM_HANDLER(not, SIM_OP_NOT):
+        dst = SIM_DST();
+        SIM_STORE(~*dst);
+        SIM_NEXT();
+    SIM_HANDLER(inc, SIM_OP_INC):
+        dst = SIM_DST();
+        SIM_STORE(*dst + 1);
+        SIM_NEXT();
+    SIM_HANDLER(dec, SIM_OP_DEC):
+        dst = SIM_DST();
+        SIM_STORE(*dst - 1);
+        SIM_NEXT();
+    SIM_HANDLER(jmp, SIM_OP_JMP):
+        pc = *SIM_DST();
+        SIM_DISPATCH();
+    SIM_HANDLER(bne, SIM_OP_BNE):
+        if (sim->zero)
+            SIM_NEXT();
+        pc = *SIM_DST();
+        SIM_DISPATCH();
+    SIM_HANDLER(red, SIM_OP_RED):
+        dst = SIM_DST();
+        ch = getchar();
+        SIM_STORE(ch == EOF ? -1 : ch);
+        SIM_NEXT();
+    SIM_HANDLER(prn, SIM_OP_PRN):
+        src = SIM_DST();
+        printf("%d\n", (*src & SIM_SIGN_BIT) ? (int)*src - (int)(SIM_WORD_MASK + 1) : (int)*src);
+        SIM_NEXT();
+    SIM_HANDLER(jsr, SIM_OP_JSR):
+        if (sim->sp == SIM_STACK_SIZE) {
+            fprintf(ERR_STREAM, "%04lu: stack overflow, more than %d nested calls\n", pc, SIM_STACK_SIZE);
+            goto end;
+        }
+        sim->stack[sim->sp++] = pc + u->size;
+        pc = *SIM_DST();
+        SIM_DISPATCH();
+    SIM_HANDLER(rts, SIM_OP_RTS):
+        if (sim->sp == 0) {
+            fprintf(ERR_STREAM, "%04lu: return without a call\n", pc);
+            goto end;
+        }
+        pc = sim->stack[--sim->sp];
+        SIM_DISPATCH();
+    SIM_HANDLER(stop, SIM_OP_STOP):
+        res = TRUE;
+        goto end;
+#ifndef SIM_COMPUTED_GOTO
+    }
+#endif
+
+limit:
+    --steps;
+    fprintf(ERR_STREAM, "%04lu: stopped after %lu instructions\n", pc, steps);
+end:
+    sim->pc = pc;
+    sim->steps = steps;
+    return res;
+#undef SIM_HANDLER
+#undef SIM_DISPATCH
+#undef SIM_SRC
+#undef SIM_DST
+#undef SIM_STORE
+#undef SIM_NEXT
+}
+
+/**
+ * print the registers of {sim} into {out}
+ */
+static void sim_print_regs(const sim_t *sim, FILE *out) {
+    unsigned i;
+    for (i = 0; i < SIM_REGISTERS; ++i)
+        fprintf(out, "r%u=%05o%c", i, sim->regs[i], i + 1 < SIM_REGISTERS ? ' ' : '\n');
+}
+
+int main(int argc, char *argv[]) {
+    const char *program = NULL;
+    unsigned long max_steps = (unsigned long)-1;
+    BOOL stats = FALSE, regs = FALSE, res = TRUE;
+    objfile_t obj;
+    sim_t sim;
+    clock_t start;
+    double seconds;
+    char *endp;
+    int arg;
+
+    for (arg = 1; arg < argc; ++arg) {
+        if (!strncmp(argv[arg], "--max-steps=", 12)) {
+            max_steps = strtoul(argv[arg] + 12, &endp, 10);
+            if (*endp || !argv[arg][12] || max_steps == 0) {
+                fprintf(ERR_STREAM, "bad count for option \'--max-steps\'\n");
+                res = FALSE;
+            }
+        } else if (!strcmp(argv[arg], "--stats"))
+            stats = TRUE;
+        else if (!strcmp(argv[arg], "--regs"))
+            regs = TRUE;
+        else if (argv[arg][0] == '-') {
+            fprintf(ERR_STREAM, "unknown option \'%s\'\n", argv[arg]);
+            res = FALSE;
+        } else if (program)
+            res = FALSE;
+        else
+            program = argv[arg];
+    }
+    if (!res || !program) {
+        fprintf(ERR_STREAM, "usage: %s [--max-steps=N] [--stats] [--regs] program\n", argv[0]);
+        return 1;
+    }
+
+    if (!(sim_has_suffix(program, OUTPUT_BINARY_EXTENSION) ? objfile_open_binary(&obj, program) :
+                                                             objfile_open_text(&obj, program))) {
+        fprintf(ERR_STREAM, "unable to load \'%s\'\n", program);
+        return 1;
+    }
+    res = sim_load(&sim, &obj);
+    objfile_close(&obj);
+    if (!res)
+        return 1;
+
+    start = clock();
+    res = sim_run(&sim, max_steps);
+    seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+    fflush(stdout);
+    if (regs)
+        sim_print_regs(&sim, stderr);
+    if (stats)
+        fprintf(stderr, "instructions=%lu time=%.3fs mips=%.1f\n", sim.steps, seconds,
+                seconds > 0 ? sim.steps / seconds / 1e6 : 0.0);
+    free(sim.mem);
+    free(sim.uops);
+    return !res;
+}
@@ -0,0 +1,110 @@
+/* This file is part of OpenU's C project implementation, called assembler
+ * Copyright (C) 2020 Arthur Zamarin, Norel Farjun */
+
+#define _POSIX_C_SOURCE 200112L
+/* for madvise, as posix_madvise doesn't release memory on every system */
+#define _DEFAULT_SOURCE
+
+#include "source.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+/**
+ * read all the content of {fd} into {src} using plain reads, used when mapping failed
+ * {size_hint} is the expected size of the file
+ */
+static BOOL source_read_all(source_t *src, int fd, size_t size_hint) {
+    size_t cap = size_hint + 1, len = 0;
+    char *data = malloc(cap), *tmp;
+    ssize_t ret;
+
+    while (data) {
+        if (len == cap) {
+            if (!(tmp = realloc(data, cap *= 2)))
+                break;
+            data = tmp;
+        }
+        if ((ret = read(fd, data + len, cap - len)) < 0)
+            break;
+        else if (ret == 0) {
+            src->data = data;
+            src->len = len;
+            src->is_mapped = FALSE;
+            return TRUE;
+        }
+        len += (size_t)ret;
+    }
+    free(data);
+    return FALSE;
+}
+
+BOOL source_open(source_t *src, const char *path) {
+    struct stat st;
+    BOOL res = FALSE;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return FALSE;
+
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            posix_madvise(data, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+            src->data = data;
+            src->len = (size_t)st.st_size;
+            src->is_mapped = TRUE;
+            res = TRUE;
+        }
+    }
+    if (!res)
+        res = source_read_all(src, fd, (fstat(fd, &st) == 0 && st.st_size > 0) ? (size_t)st.st_size : 4096);
+    close(fd);
+    return res;
+}
+
+void source_close(source_t *src) {
+    if (src->is_mapped)
+        munmap((void *)src->data, src->len);
+    else
+        free((void *)src->data);
+    src->data = NULL;
+    src->len = 0;
+}
+
+void source_drop(const source_t *src, size_t start, size_t end) {
+#ifdef MADV_DONTNEED
+    const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    if (!src->is_mapped)
+        return;
+    /* the content is mapped at a page boundary, so the offsets are rounded down to whole pages */
+    start = start / page * page;
+    end = end / page * page;
+    if (start < end)
+        madvise((char *)src->data + start, end - start, MADV_DONTNEED);
+#else
+    (void)src;
+    (void)start;
+    (void)end;
+#endif
+}
+
+BOOL source_next_line(const source_t *src, size_t *pos, line_view_t *line) {
+    const char *end;
+    if (*pos >= src->len)
+        return FALSE;
+    line->ptr = src->data + *pos;
+    if ((end = memchr(line->ptr, '\n', src->len - *pos))) {
+        line->len = (size_t)(end - line->ptr);
+        *pos += line->len + 1;
+    } else {
+        line->len = src->len - *pos;
+        *pos = src->len;
+    }
+    if (line->len && line->ptr[line->len - 1] == '\r')
+        line->len--; /* CRLF line break */
+    return TRUE;
+}
@@ -0,0 +1,53 @@
+/* This file is part of OpenU's C project implementation, called assembler
+ * Copyright (C) 2020 Arthur Zamarin, Norel Farjun */
+
+#ifndef ASM_SOURCE_H
+#define ASM_SOURCE_H
+
+#include <stddef.h>
+
+#include "global.h"
+
+/**
+ * Holds the whole content of one input file.
+ * The content is memory mapped, or read at once into memory when mapping isn't possible.
+ * Note that the content isn't zero terminated.
+ */
+typedef struct {
+    const char *data;
+    size_t len;
+    BOOL is_mapped; /* was {data} mapped, otherwise it was malloced */
+} source_t;
+
+/**
+ * View of one line inside a source_t, without the line break
+ * Note that the line isn't zero terminated.
+ */
+typedef struct {
+    const char *ptr;
+    size_t len;
+} line_view_t;
+
+/**
+ * open the file at {path} and load it into {src}
+ * return false if the file can't be read
+ */
+BOOL source_open(source_t *src, const char *path);
+/**
+ * release the content of {src}
+ */
+void source_close(source_t *src);
+
+/**
+ * advise that the content of {src} before the offset {end}, starting with {start}, isn't needed soon, so its memory
+ * can be released. It is read again from the file if it is needed after all. Only whole pages of mapped content
+ * are released, so the range is rounded down to the pages.
+ */
+void source_drop(const source_t *src, size_t start, size_t end);
+/**
+ * set {line} to view the line starting at offset {*pos} of {src}, and advance {*pos} to the next line
+ * return false if there are no more lines
+ */
+BOOL source_next_line(const source_t *src, size_t *pos, line_view_t *line);
+
+#endif
@@ -0,0 +1,240 @@
+/* This file is part of OpenU's C project implementation, called assembler
+ * Copyright (C) 2020 Arthur Zamarin, Norel Farjun */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "spill.h"
+#include "outbuf.h"
+
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+
+/** count of words written, patched or output at once */
+#define SPILL_WINDOW_WORDS 65536
+/** count of fixups read at once */
+#define SPILL_FIXUPS_BATCH 4096
+
+spill_t spill_new(void) {
+    spill_t spill = {NULL, NULL, NULL, 0, 0, 0, 0, FALSE};
+    return spill;
+}
+
+BOOL spill_open(spill_t *spill) {
+    *spill = spill_new();
+    if ((spill->code = tmpfile()) && (spill->data = tmpfile()) && (spill->fixups = tmpfile()))
+        return TRUE;
+    spill_close(spill);
+    return FALSE;
+}
+
+void spill_close(spill_t *spill) {
+    if (spill->fixups)
+        fclose(spill->fixups);
+    if (spill->data)
+        fclose(spill->data);
+    if (spill->code)
+        fclose(spill->code);
+    *spill = spill_new();
+}
+
+/**
+ * append the {count} {words} to {file} of {spill}
+ */
+static void spill_put_words(spill_t *spill, FILE *file, const uint16_t *words, size_t count) {
+    if (fwrite(words, sizeof(uint16_t), count, file) != count)
+        spill->is_failed = TRUE;
+}
+
+/**
+ * add the word of the operand in slot {i} of {list}, accessed by {access}, into {words} of {*count} words
+ * a label operand is added as an empty word, and its fixup is logged into {spill}
+ */
+static void spill_operand(spill_t *spill, const instructions_list *list, unsigned i, unsigned access, BOOL is_dst,
+                          unsigned linenum, uint16_t *words, size_t *count) {
+    spill_fixup_t fixup;
+    if (access != OPERAND_LABEL) {
+        words[(*count)++] = (uint16_t)list->slots[i];
+        return;
+    }
+    words[(*count)++] = 0;
+    fixup.addr = spill->code_size + i;
+    fixup.id = list->slots[i];
+    fixup.linenum = linenum;
+    fixup.is_dst = is_dst;
+    if (fwrite(&fixup, sizeof(spill_fixup_t), 1, spill->fixups) != 1)
+        spill->is_failed = TRUE;
+    ++spill->fixups_cnt;
+}
+
+void spill_code(spill_t *spill, const instructions_list *list) {
+    uint16_t words[1 + MAX_CNT_OPERAND];
+    unsigned i, index, size, src, dst;
+    size_t count;
+
+    for (i = index = 0; i < list->size; i += 1 + size, ++index) {
+        size = instructions_list_operands_size(list->slots[i], &src, &dst);
+        words[0] = (uint16_t)list->slots[i];
+        count = 1;
+        /* the fixups are logged in address order: src, then dst */
+        if (size == 2) {
+            spill_operand(spill, list, i + 1, src, FALSE, instructions_list_linenum(list, index), words, &count);
+            spill_operand(spill, list, i + 2, dst, TRUE, instructions_list_linenum(list, index), words, &count);
+        } else if (size == 1) /* a single operand word is dst, or both registers */
+            spill_operand(spill, list, i + 1, src ? OPERAND_REG : dst, TRUE, instructions_list_linenum(list, index),
+                          words, &count);
+        spill_put_words(spill, spill->code, words, count);
+    }
+    spill->code_size += list->size;
+    spill->count += list->count;
+}
+
+void spill_data(spill_t *spill, const dataseg_t *seg) {
+    spill_put_words(spill, spill->data, seg->words, seg->size);
+    spill->data_size += seg->size;
+}
+
+BOOL spill_check_labels(spill_t *spill, const labels_list_t *labels, FILE *err_stream) {
+    spill_fixup_t fixups[SPILL_FIXUPS_BATCH];
+    size_t cnt, i;
+    BOOL flag = TRUE;
+
+    rewind(spill->fixups);
+    while ((cnt = fread(fixups, sizeof(spill_fixup_t), ARR_SIZE(fixups), spill->fixups)) > 0)
+        for (i = 0; i < cnt; ++i)
+            flag &= instructions_list_check_label(labels, fixups[i].id, fixups[i].linenum, err_stream);
+    return flag && !ferror(spill->fixups);
+}
+
+/**
+ * read, or write if {is_write}, the {count} words starting with the word {first} of the code file {fd}, into or
+ * from {words}, retrying on partial transfers
+ * return false if the transfer failed
+ */
+static BOOL spill_transfer(BOOL is_write, int fd, uint16_t *words, unsigned first, unsigned count) {
+    char *ptr = (char *)words;
+    size_t remaining = count * sizeof(uint16_t);
+    off_t offset = (off_t)first * (off_t)sizeof(uint16_t);
+    ssize_t ret;
+
+    while (remaining) {
+        if ((ret = is_write ? pwrite(fd, ptr, remaining, offset) : pread(fd, ptr, remaining, offset)) < 0) {
+            if (errno == EINTR)
+                continue;
+            return FALSE;
+        }
+        if (ret == 0)
+            return FALSE;
+        ptr += ret;
+        offset += ret;
+        remaining -= (size_t)ret;
+    }
+    return TRUE;
+}
+
+/**
+ * output the externals record of {node} at {addr} into {externals}, and count it in {externals_cnt}
+ */
+static void spill_put_external(FILE *externals, const labels_list_node_t *node, unsigned addr,
+                               unsigned long *externals_cnt) {
+    fprintf(externals, EXTERNALS_FILE_OUTPUT_FORMAT, labels_listnode_get_label(node), addr);
+    ++*externals_cnt;
+}
+
+BOOL spill_backpatch(spill_t *spill, const labels_list_t *labels, unsigned start_addr, FILE *externals,
+                     unsigned long *externals_cnt) {
+    spill_fixup_t fixups[SPILL_FIXUPS_BATCH];
+    const spill_fixup_t *fixup;
+    const labels_list_node_t *node, *pending = NULL;
+    uint16_t *window;
+    unsigned first = 0, count = 0, pending_addr = 0;
+    size_t cnt, i;
+    int fd;
+    BOOL res = TRUE, is_dirty = FALSE;
+
+    *externals_cnt = 0;
+    if (fflush(spill->code) != 0 || !(window = malloc(SPILL_WINDOW_WORDS * sizeof(uint16_t))))
+        return FALSE;
+    fd = fileno(spill->code);
+    rewind(spill->fixups);
+    /* the fixups are sorted by address, so every window of the code is read and written back once */
+    while (res && (cnt = fread(fixups, sizeof(spill_fixup_t), ARR_SIZE(fixups), spill->fixups)) > 0)
+        for (i = 0; res && i < cnt; ++i) {
+            fixup = fixups + i;
+            if (fixup->addr >= first + count) {
+                if (is_dirty && !spill_transfer(TRUE, fd, window, first, count))
+                    res = FALSE;
+                first = fixup->addr;
+                count = spill->code_size - first < SPILL_WINDOW_WORDS ? spill->code_size - first : SPILL_WINDOW_WORDS;
+                is_dirty = FALSE;
+                if (!spill_transfer(FALSE, fd, window, first, count))
+                    res = FALSE;
+            }
+            node = labels_list_get_by_id(labels, fixup->id);
+            window[fixup->addr - first] = instructions_list_label_word(node);
+            is_dirty = TRUE;
+            if (!node->isExtr && !pending)
+                continue;
+            /* the dst record of an instruction comes before its src record, so the src one waits for it */
+            if (pending && (!fixup->is_dst || fixup->addr != pending_addr + 1)) {
+                spill_put_external(externals, pending, start_addr + pending_addr, externals_cnt);
+                pending = NULL;
+            }
+            if (node->isExtr && !fixup->is_dst) {
+                pending = node;
+                pending_addr = fixup->addr;
+                continue;
+            }
+            if (node->isExtr)
+                spill_put_external(externals, node, start_addr + fixup->addr, externals_cnt);
+            if (pending) {
+                spill_put_external(externals, pending, start_addr + pending_addr, externals_cnt);
+                pending = NULL;
+            }
+        }
+    if (res && is_dirty && !spill_transfer(TRUE, fd, window, first, count))
+        res = FALSE;
+    if (pending)
+        spill_put_external(externals, pending, start_addr + pending_addr, externals_cnt);
+    free(window);
+    return res && !ferror(spill->fixups) && (!externals || !ferror(externals));
+}
+
+/**
+ * output all the {size} words of {file} into {object} through {window} and {records}, while the addressing
+ * starts with {start_addr}
+ * return false if {file} can't be read
+ */
+static BOOL spill_output_file(FILE *file, unsigned size, unsigned start_addr, uint16_t *window, outbuf_t *records,
+                              FILE *object) {
+    size_t cnt;
+    if (fflush(file) != 0)
+        return FALSE;
+    rewind(file);
+    while (size > 0 && (cnt = fread(window, sizeof(uint16_t), SPILL_WINDOW_WORDS, file)) > 0) {
+        records->len = 0;
+        outbuf_put_object_words(records, start_addr, window, cnt);
+        fwrite(records->data, 1, records->len, object);
+        start_addr += (unsigned)cnt;
+        size -= (unsigned)cnt;
+    }
+    return size == 0 && !ferror(file);
+}
+
+BOOL spill_output(spill_t *spill, unsigned start_addr, FILE *object) {
+    uint16_t *window;
+    outbuf_t records;
+    BOOL res;
+
+    /* the addresses only grow, so the last window has the longest records */
+    records.capacity = outbuf_object_len(start_addr + spill->code_size + spill->data_size, SPILL_WINDOW_WORDS);
+    records.len = 0;
+    window = malloc(SPILL_WINDOW_WORDS * sizeof(uint16_t));
+    records.data = malloc(records.capacity);
+    res = window && records.data &&
+          spill_output_file(spill->code, spill->code_size, start_addr, window, &records, object) &&
+          spill_output_file(spill->data, spill->data_size, start_addr + spill->code_size, window, &records, object);
+    free(records.data);
+    free(window);
+    return res && !ferror(object);
+}
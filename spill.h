@@ -0,0 +1,96 @@
+/* This file is part of OpenU's C project implementation, called assembler
+ * Copyright (C) 2020 Arthur Zamarin, Norel Farjun */
+
+#ifndef ASM_SPILL_H
+#define ASM_SPILL_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "global.h"
+#include "instructions_list.h"
+#include "labels_list.h"
+#include "data_seg.h"
+
+/**
+ * Program store on temporary files, for sources too big to keep in memory.
+ * The parser spills its code segment and data segment after every batch of lines, so only one batch is ever in
+ * memory. A label operand is spilled as an empty word, and its fixup is appended to a log of its own. Once the
+ * labels are fixed, spill_backpatch resolves all the fixups into the code file with positioned writes, and
+ * spill_output streams both segments into the object file. So the memory used depends on the labels only.
+ */
+
+/**
+ * Fixup of one label operand word, logged in address order
+ */
+typedef struct {
+    uint32_t addr;    /* address of the operand word, relative to the code segment */
+    uint32_t id;      /* id of the label */
+    uint32_t linenum; /* line of the instruction */
+    uint32_t is_dst;  /* is it the dst operand, otherwise src */
+} spill_fixup_t;
+
+/**
+ * Holds the temporary files of one program, and the counts of what was spilled into them
+ */
+typedef struct {
+    FILE *code;              /* code words, label operands are 0 until spill_backpatch */
+    FILE *data;              /* data words */
+    FILE *fixups;            /* spill_fixup_t of every label operand */
+    unsigned code_size;      /* count of code words */
+    unsigned data_size;      /* count of data words */
+    unsigned long count;     /* count of instructions */
+    unsigned long fixups_cnt;
+    BOOL is_failed;          /* did any write into the files fail */
+} spill_t;
+
+/**
+ * create and return a closed spill_t structure
+ */
+spill_t spill_new(void);
+/**
+ * create the temporary files of {spill}
+ * return false if unable to create them, leaving {spill} closed
+ */
+BOOL spill_open(spill_t *spill);
+/**
+ * close the temporary files of {spill}, if it is open
+ */
+void spill_close(spill_t *spill);
+/**
+ * return true if {spill} is open
+ */
+#define spill_is_open(spill) ((spill)->code != NULL)
+
+/**
+ * append the code segment {list} at the end of the code of {spill}, and log its label operands
+ * {list} may then be cleared, as its words are continued by the next ones
+ */
+void spill_code(spill_t *spill, const instructions_list *list);
+/**
+ * append the data segment {seg} at the end of the data of {spill}
+ * {seg} may then be cleared, as its words are continued by the next ones
+ */
+void spill_data(spill_t *spill, const dataseg_t *seg);
+
+/**
+ * check that every label operand of {spill} fits in an operand word, like instructions_list_check_labels does
+ * return false if any operand can't be encoded, or the fixups can't be read
+ */
+BOOL spill_check_labels(spill_t *spill, const labels_list_t *labels, FILE *err_stream);
+/**
+ * resolve every label operand of {spill} into its code, with the absolute addresses of {labels}
+ * for every external label usage, output it into {externals} like instructions_list_output does, while the
+ * addressing starts with {start_addr}, and count it into {externals_cnt}. {externals} may be NULL if there are no
+ * external labels.
+ * return false if the files can't be read or written
+ */
+BOOL spill_backpatch(spill_t *spill, const labels_list_t *labels, unsigned start_addr, FILE *externals,
+                     unsigned long *externals_cnt);
+/**
+ * output the code and then the data of {spill} into {object}, while the addressing starts with {start_addr}
+ * return false if the files can't be read or written
+ */
+BOOL spill_output(spill_t *spill, unsigned start_addr, FILE *object);
+
+#endif
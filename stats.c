@@ -0,0 +1,131 @@
+/* This file is part of OpenU's C project implementation, called assembler
+ * Copyright (C) 2020 Arthur Zamarin, Norel Farjun */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include "stats.h"
+
+#include <stdlib.h>
+#include <time.h>
+
+static const char *const g_phase_names[STATS_PHASES_CNT] = {"read", "parse", "fix", "output"};
+
+double stats_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+void stats_print(const stats_t *stats, FILE *out) {
+    unsigned i;
+    fprintf(out, "%s: time", stats->name);
+    for (i = 0; i < STATS_PHASES_CNT; ++i)
+        fprintf(out, " %s=%.3fms", g_phase_names[i], (stats->end[i] - stats->start[i]) * 1e3);
+    fprintf(out, "\n%s: lines=%lu instructions=%lu data-words=%lu labels=%lu externals=%lu\n", stats->name,
+            stats->lines, stats->instructions, stats->data_words, stats->labels, stats->externals);
+    fprintf(out, "%s: label-lookups=%lu label-probes=%lu (%.2f per lookup)\n", stats->name,
+            stats->label_lookups, stats->label_probes,
+            stats->label_lookups ? (double)stats->label_probes / stats->label_lookups : 0.0);
+}
+
+/**
+ * return the start time of the whole work on {stats}
+ */
+#define STATS_FILE_START(stats) ((stats)->start[STATS_PHASE_READ])
+/**
+ * return the end time of the whole work on {stats}
+ */
+static double stats_file_end(const stats_t *stats) {
+    double end = stats->end[0];
+    unsigned i;
+    for (i = 1; i < STATS_PHASES_CNT; ++i)
+        if (stats->end[i] > end)
+            end = stats->end[i];
+    return end;
+}
+
+/**
+ * write {str} into {out} as JSON string
+ */
+static void stats_write_json_string(FILE *out, const char *str) {
+    putc('"', out);
+    for (; *str; ++str) {
+        if (*str == '"' || *str == '\\')
+            fprintf(out, "\\%c", *str);
+        else if ((unsigned char)*str < 0x20)
+            fprintf(out, "\\u%04x", (unsigned)(unsigned char)*str);
+        else
+            putc(*str, out);
+    }
+    putc('"', out);
+}
+
+/**
+ * write one complete event named {name} of file {stats}, from {start} to {end} into {out}
+ * times are relative to {origin}, and {row} is the thread row of the event
+ * the event of the whole file, {is_file}, also has the counters of {stats}
+ */
+static void stats_write_event(FILE *out, const char *name, const stats_t *stats, double start, double end,
+                              double origin, unsigned row, BOOL is_first, BOOL is_file) {
+    fprintf(out, "%s\n{\"name\":", is_first ? "" : ",");
+    stats_write_json_string(out, name);
+    fprintf(out, ",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"file\":",
+            row, (start - origin) * 1e6, (end - start) * 1e6);
+    stats_write_json_string(out, stats->name);
+    if (is_file)
+        fprintf(out, ",\"lines\":%lu,\"instructions\":%lu,\"data_words\":%lu,\"labels\":%lu,\"externals\":%lu",
+                stats->lines, stats->instructions, stats->data_words, stats->labels, stats->externals);
+    fprintf(out, "}}");
+}
+
+/**
+ * qsort comparator of pointers to stats_t by their start time
+ */
+static int stats_compare_start(const void *a, const void *b) {
+    const double start_a = STATS_FILE_START(*(const stats_t *const *)a);
+    const double start_b = STATS_FILE_START(*(const stats_t *const *)b);
+    return (start_a > start_b) - (start_a < start_b);
+}
+
+BOOL stats_write_trace(const stats_t *stats, unsigned cnt, const char *filename) {
+    const stats_t **sorted;
+    double *rows_end;
+    unsigned i, row, phase, sorted_cnt = 0, rows_cnt = 0;
+    BOOL res;
+    FILE *out;
+
+    sorted = malloc((cnt ? cnt : 1) * sizeof(const stats_t *));
+    rows_end = malloc((cnt ? cnt : 1) * sizeof(double));
+    if (!sorted || !rows_end || !(out = fopen(filename, "w"))) {
+        free(sorted);
+        free(rows_end);
+        return FALSE;
+    }
+    for (i = 0; i < cnt; ++i)
+        if (STATS_FILE_START(stats + i) != 0) /* skip files which were never assembled */
+            sorted[sorted_cnt++] = stats + i;
+    qsort(sorted, sorted_cnt, sizeof(const stats_t *), stats_compare_start);
+
+    fprintf(out, "{\"traceEvents\":[");
+    for (i = 0; i < sorted_cnt; ++i) {
+        const double start = STATS_FILE_START(sorted[i]), end = stats_file_end(sorted[i]);
+
+        /* place every file on the first row free at its start, so rows match the worker threads */
+        for (row = 0; row < rows_cnt && rows_end[row] > start; ++row);
+        if (row == rows_cnt)
+            ++rows_cnt;
+        rows_end[row] = end;
+
+        stats_write_event(out, sorted[i]->name, sorted[i], start, end, STATS_FILE_START(sorted[0]), row, i == 0, TRUE);
+        for (phase = 0; phase < STATS_PHASES_CNT; ++phase)
+            if (sorted[i]->end[phase] > sorted[i]->start[phase])
+                stats_write_event(out, g_phase_names[phase], sorted[i], sorted[i]->start[phase], sorted[i]->end[phase],
+                                  STATS_FILE_START(sorted[0]), row, FALSE, FALSE);
+    }
+    fprintf(out, "\n],\"displayTimeUnit\":\"ms\"}\n");
+    res = !ferror(out);
+    res &= fclose(out) == 0;
+    free(sorted);
+    free(rows_end);
+    return res;
+}
@@ -0,0 +1,63 @@
+/* This file is part of OpenU's C project implementation, called assembler
+ * Copyright (C) 2020 Arthur Zamarin, Norel Farjun */
+
+#ifndef ASM_STATS_H
+#define ASM_STATS_H
+
+#include <stdio.h>
+
+#include "global.h"
+
+/** phases of assembling one file, in running order */
+typedef enum {
+    STATS_PHASE_READ,   /* opening and mapping the input */
+    STATS_PHASE_PARSE,  /* parsing all lines */
+    STATS_PHASE_FIX,    /* checking and fixing label addresses */
+    STATS_PHASE_OUTPUT, /* formatting and writing the output files */
+    STATS_PHASES_CNT
+} stats_phase_t;
+
+/**
+ * Holds the timings and counters of assembling one file
+ * All times are in seconds, taken from stats_now
+ */
+typedef struct {
+    const char *name;                         /* name of the file */
+    double start[STATS_PHASES_CNT];
+    double end[STATS_PHASES_CNT];             /* equals to start if the phase didn't run */
+    unsigned long lines;                      /* input lines */
+    unsigned long instructions;               /* parsed instructions */
+    unsigned long data_words;                 /* words in data segment */
+    unsigned long labels;                     /* distinct labels */
+    unsigned long label_lookups;              /* searches in the labels table */
+    unsigned long label_probes;               /* table slots visited by all the searches */
+    unsigned long externals;                  /* records written into the externals file */
+} stats_t;
+
+/**
+ * return a monotonic time stamp, in seconds
+ */
+double stats_now(void);
+
+/**
+ * mark the start of {phase} in {stats}
+ */
+#define stats_phase_begin(stats, phase) ((stats)->start[phase] = (stats)->end[phase] = stats_now())
+/**
+ * mark the end of {phase} in {stats}
+ */
+#define stats_phase_end(stats, phase) ((stats)->end[phase] = stats_now())
+
+/**
+ * print the timings and counters of {stats} in human readable form into {out}
+ */
+void stats_print(const stats_t *stats, FILE *out);
+/**
+ * write the phases of all the {cnt} files in {stats} into {filename}, as Chrome trace event JSON
+ * every file has one event of its own, with its counters as arguments, and one event for every phase
+ * files which ran at the same time are put on different rows
+ * return false on any error
+ */
+BOOL stats_write_trace(const stats_t *stats, unsigned cnt, const char *filename);
+
+#endif
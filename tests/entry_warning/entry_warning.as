@@ -0,0 +1,2 @@
+L: .entry M
+M: stop
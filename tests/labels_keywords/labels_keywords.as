@@ -6,3 +6,6 @@ _Bad: rts
 
 ; This is fine here
 r9: .data 0
+mcro: mov r1, r2
+endmcro: stop
+.extern endmcro
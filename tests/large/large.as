@@ -0,0 +1,78 @@
+; past 4096 words, a label is out of reach of its operand
+MAIN:   lea FAR, r1
+        jmp NEAR
+NEAR:   prn FAR
+        jsr NEAR
+        stop
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+        .string "abcdefghijabcdefghijabcdefghijabcdefghijabcdefghijabcdefghij"
+FAR:    .data 7
+.entry FAR
@@ -0,0 +1,6 @@
+; numbers which do not fit in 16 bits are out of range, instead of wrapping
+MAIN:   prn #65537
+        prn #1
+        stop
+NUM:    .data 65537, -65537
+        .data 7, -7
@@ -0,0 +1,10 @@
+; calls into util, which reads VALUE back from this module
+.extern PRINT
+.extern COUNT
+MAIN:   mov COUNT, r1
+        jsr PRINT
+        prn VALUE
+        stop
+VALUE:  .data 42
+.entry MAIN
+.entry VALUE
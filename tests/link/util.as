@@ -0,0 +1,7 @@
+.extern VALUE
+PRINT:  prn r1
+        prn VALUE
+        rts
+COUNT:  .data 3, -3
+.entry PRINT
+.entry COUNT
@@ -0,0 +1,6 @@
+; MISSING isn't an entry of any module
+.extern PRINT
+.extern MISSING
+MAIN:   jsr PRINT
+        prn MISSING
+        stop
@@ -0,0 +1,3 @@
+PRINT:  prn #1
+        rts
+.entry PRINT
@@ -0,0 +1,22 @@
+; macros are expanded in place, and may use earlier macros
+.extern EXT
+mcro save
+    mov r1, STORE
+    mov r2, *r3
+endmcro
+
+mcro step
+    save
+    inc COUNT
+    jsr EXT
+endmcro
+
+MAIN:   clr COUNT
+        step
+        step
+        cmp COUNT, #2
+        bne MAIN
+        stop
+.entry MAIN
+COUNT:  .data 0
+STORE:  .data 0
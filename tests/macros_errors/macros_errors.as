@@ -0,0 +1,17 @@
+mcro twice
+    inc r1
+    inc r1
+endmcro
+mcro mov
+    stop
+endmcro
+mcro twice
+endmcro
+    twice
+    mcro bad name
+    stop
+    endmcro
+endmcro
+unknown r1
+mcro open
+    twice
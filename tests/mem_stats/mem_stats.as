@@ -0,0 +1,9 @@
+; the memory of a fixed input, counted by --mem-stats
+MAIN:   mov r3, LIST
+        add #5, COUNT
+        jsr SUB
+        stop
+SUB:    inc COUNT
+        rts
+LIST:   .data 6, -9, 15
+COUNT:  .data 0
@@ -0,0 +1,24 @@
+; jumps to a jmp chain go to its end, code after stop, rts and jmp is removed
+MAIN:   mov #3, r1
+        jsr PRINT
+LOOP:   mov r2, r2
+        dec r1
+        cmp r1, #0
+        bne NEXT
+        jmp END
+        prn #99
+        clr r2
+NEXT:   jmp AGAIN
+AGAIN:  jmp LOOP
+PRINT:  jmp SHOW
+        stop
+SHOW:   prn r1
+        prn COUNT
+        rts
+        inc r1
+END:    mov r3, r3
+        stop
+        prn r1
+COUNT:  .data 5
+.entry SHOW
+.entry COUNT
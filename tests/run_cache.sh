@@ -0,0 +1,75 @@
+#!/bin/bash
+
+# This file is part of OpenU's C project implementation, called assembler
+# Copyright (C) 2020 Arthur Zamarin */
+
+# You shouldn't cal this script by itself, but by calling `make tests-cache`
+
+# $1 - assembler executable file
+# $2 - basedir
+# Every test which assembles is assembled again with an empty cache, and then twice more: with its outputs in
+# place, which must be left untouched and print the same diagnostics, and without them, which must restore the
+# same files. At last the cached object file is changed, and assembling must restore it, so the outputs really
+# come from the cache.
+
+_CACHE_EXTS="ob ent ext"
+
+_save_outputs() {
+    # $1 - basename of the testcase
+    # $2 - directory to save the outputs and their modification times into
+    local _ext
+    rm -rf "$2" && mkdir "$2"
+    for _ext in ${_CACHE_EXTS}; do
+        [[ -f "$1.${_ext}" ]] || continue
+        cp "$1.${_ext}" "$2/${_ext}"
+        stat -c %y "$1.${_ext}" > "$2/${_ext}.mtime"
+    done
+}
+
+_cache_case() {
+    # $1 - assembler executable file
+    # $2 - basename of the testcase
+    # $3 - options of the testcase
+    local _cache_dir _saved _entry _first _second
+    _cache_dir=$(mktemp -d)
+    _saved="${_cache_dir}.saved"
+    _first=$($1 $3 --cache-dir="${_cache_dir}" "$2" 2>/dev/null)
+    _save_outputs "$2" "${_saved}.first"
+    _entry="${_cache_dir}/$(ls "${_cache_dir}")"
+
+    _second=$($1 $3 --cache-dir="${_cache_dir}" "$2" 2>/dev/null)
+    _save_outputs "$2" "${_saved}.second"
+    if [[ "${_first}" == "${_second}" ]] && diff -qr "${_saved}.first" "${_saved}.second" >/dev/null; then
+        echo "[OK] ${testcase}: cache hit leaves the same outputs untouched"
+    else
+        echo "[FAIL] ${testcase}: cache hit changed the outputs or diagnostics"
+    fi
+
+    rm -f "$2".{ob,ent,ext}
+    $1 $3 --cache-dir="${_cache_dir}" "$2" >&/dev/null
+    _save_outputs "$2" "${_saved}.third"
+    if diff -qr -x "*.mtime" "${_saved}.first" "${_saved}.third" >/dev/null; then
+        echo "[OK] ${testcase}: cache hit restores the outputs"
+    else
+        echo "[FAIL] ${testcase}: cache hit restored different outputs"
+    fi
+
+    echo "; changed in the cache" >> "${_entry}/ob"
+    $1 $3 --cache-dir="${_cache_dir}" "$2" >&/dev/null
+    if cmp -s "${_entry}/ob" "$2.ob"; then
+        echo "[OK] ${testcase}: outputs restored from the cache"
+    else
+        echo "[FAIL] ${testcase}: outputs not restored from the cache"
+    fi
+    rm -rf "${_cache_dir}" "${_saved}".*
+}
+
+find "$2" \( -name "*.ob" -o -name "*.ent" -o -name "*.ext" \) -delete # clean old generated files
+for testcase in $(ls "$2"); do
+    [[ -f "${2}/${testcase}/${testcase}.as" ]] || continue
+    _options=$(cat "${2}/${testcase}/${testcase}.options" 2>/dev/null)
+    $1 ${_options} "${2}/${testcase}/${testcase}" >&/dev/null
+    [[ -f "${2}/${testcase}/${testcase}.ob" ]] || continue # only the tests which assemble
+    rm -f "${2}/${testcase}/${testcase}".{ob,ent,ext}
+    _cache_case "$1" "${2}/${testcase}/${testcase}" "${_options}"
+done
@@ -0,0 +1,65 @@
+#!/bin/bash
+
+# This file is part of OpenU's C project implementation, called assembler
+# Copyright (C) 2020 Arthur Zamarin */
+
+# You shouldn't cal this script by itself, but by calling `make tests-link`
+
+# $1 - assembler executable file
+# $2 - linker executable file
+# $3 - basedir
+# Every testcase with a .modules file, listing the basenames of its modules, is linked into its own basename after
+# assembling the modules. The linker errors are matched with the .error.expected file, where the testcase
+# directory is removed from the module names, and the linked files with the .ob and .ent expected files.
+
+_diff_sorted_columns_file() {
+    # $1 - first file
+    # $2 - second file
+    diff -q <(awk '$1=$1' < "$1") <(awk '$1=$1' < "$2")
+}
+
+_link_case() {
+    # $1 - assembler executable file
+    # $2 - linker executable file
+    # $3 - testcase directory
+    local _basename _modules _module _ext
+    _basename="${3}/${testcase}"
+    _modules=()
+    for _module in $(cat "${_basename}.modules"); do
+        _modules+=("${3}/${_module}")
+    done
+    if ! "$1" "${_modules[@]}" >/dev/null; then
+        echo "[FAIL] ${testcase}: modules don't assemble"
+        return
+    fi
+
+    if [[ -f "${_basename}.error.expected" ]]; then
+        if "$2" -o "${_basename}" "${_modules[@]}" | sed "s|${3}/||g" | diff -q - "${_basename}.error.expected"; then
+            echo "[OK] ${testcase}: match with errors file"
+        else
+            echo "[FAIL] ${testcase}: mismatch with errors file"
+        fi
+    else
+        "$2" -o "${_basename}" "${_modules[@]}" >/dev/null || { echo "${testcase}: exited with error"; return; }
+    fi
+
+    for _ext in ob ent; do
+        if [[ -f "${_basename}.${_ext}.expected" ]]; then
+            if [[ ! -f "${_basename}.${_ext}" ]]; then
+                echo "[FAIL] ${testcase}: ${_ext} file hadn't been generated"
+            elif _diff_sorted_columns_file "${_basename}.${_ext}" "${_basename}.${_ext}.expected"; then
+                echo "[OK] ${testcase}: match with ${_ext} file"
+            else
+                echo "[FAIL] ${testcase}: mismatch with ${_ext} file"
+            fi
+        elif [[ -f "${_basename}.${_ext}" ]]; then
+            echo "[FAIL] ${testcase}: ${_ext} file generated when it shouldn't"
+        fi
+    done
+}
+
+find "$3" \( -name "*.ob" -o -name "*.ent" -o -name "*.ext" \) -delete # clean old generated files
+for testcase in $(ls "$3"); do
+    [[ -f "${3}/${testcase}/${testcase}.modules" ]] || continue
+    _link_case "$1" "$2" "${3}/${testcase}"
+done
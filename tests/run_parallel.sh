@@ -0,0 +1,75 @@
+#!/bin/bash
+
+# This file is part of OpenU's C project implementation, called assembler
+# Copyright (C) 2020 Arthur Zamarin */
+
+# You shouldn't cal this script by itself, but by calling `make tests-parallel`
+# All the tests without options of their own, and a missing file, are assembled in one invocation, once serially
+# and once with `-j 4`. Both must print the same diagnostics in the same order, and make the same files.
+# At last a generated source, big enough for its code segment to be encoded in chunks on the threads of `-j 4`,
+# must give the same files as encoded serially.
+
+# $1 - assembler executable file
+# $2 - basedir
+# $3 - source generator executable file
+
+_PARALLEL_EXTS="ob ent ext"
+
+_save_outputs() {
+    # $1 - directory to save the outputs into
+    # rest - basenames of the testcases
+    local _dir="$1" _basename _ext
+    shift
+    rm -rf "${_dir}" && mkdir "${_dir}"
+    for _basename in "$@"; do
+        for _ext in ${_PARALLEL_EXTS}; do
+            [[ -f "${_basename}.${_ext}" ]] && cp "${_basename}.${_ext}" "${_dir}/$(basename "${_basename}").${_ext}"
+        done
+    done
+}
+
+_basenames=()
+for testcase in $(ls "$2"); do
+    [[ -f "${2}/${testcase}/${testcase}.as" ]] || continue
+    [[ -f "${2}/${testcase}/${testcase}.options" ]] && continue
+    _basenames+=("${2}/${testcase}/${testcase}")
+done
+_basenames+=("${2}/missing_file/missing_file")
+
+_saved=$(mktemp -d)
+find "$2" \( -name "*.ob" -o -name "*.ent" -o -name "*.ext" \) -delete # clean old generated files
+$1 "${_basenames[@]}" > "${_saved}/serial.out" 2>/dev/null
+_save_outputs "${_saved}/serial" "${_basenames[@]}"
+find "$2" \( -name "*.ob" -o -name "*.ent" -o -name "*.ext" \) -delete
+$1 -j 4 "${_basenames[@]}" > "${_saved}/parallel.out" 2>/dev/null
+_save_outputs "${_saved}/parallel" "${_basenames[@]}"
+
+if grep -q "unable to open '${2}/missing_file/missing_file.as'" "${_saved}/serial.out"; then
+    echo "[OK] parallel: missing file reported"
+else
+    echo "[FAIL] parallel: missing file not reported"
+fi
+if cmp -s "${_saved}/serial.out" "${_saved}/parallel.out"; then
+    echo "[OK] parallel: same diagnostics as serial"
+else
+    echo "[FAIL] parallel: different diagnostics than serial"
+fi
+if diff -qr "${_saved}/serial" "${_saved}/parallel" >/dev/null; then
+    echo "[OK] parallel: same outputs as serial ($(ls "${_saved}/serial" | wc -l) files)"
+else
+    echo "[FAIL] parallel: different outputs than serial"
+fi
+
+# 200000 lines have about 400000 code words, so all the 16 chunks of 4 threads are used
+"$3" --lines 200000 --externs 50 --entries 50 > "${_saved}/generated.as"
+$1 "${_saved}/generated" >/dev/null 2>&1
+_save_outputs "${_saved}/serial" "${_saved}/generated"
+rm -f "${_saved}/generated".{ob,ent,ext}
+$1 -j 4 "${_saved}/generated" >/dev/null 2>&1
+_save_outputs "${_saved}/parallel" "${_saved}/generated"
+if [[ -s "${_saved}/serial/generated.ext" ]] && diff -qr "${_saved}/serial" "${_saved}/parallel" >/dev/null; then
+    echo "[OK] parallel: same outputs for a generated source encoded in chunks"
+else
+    echo "[FAIL] parallel: different outputs for a generated source encoded in chunks"
+fi
+rm -rf "${_saved}"
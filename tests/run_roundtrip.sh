@@ -0,0 +1,64 @@
+#!/bin/bash
+
+# This file is part of OpenU's C project implementation, called assembler
+# Copyright (C) 2020 Arthur Zamarin */
+
+# You shouldn't cal this script by itself, but by calling `make tests-roundtrip`
+# Every test which assembles is checked twice: disassembled and assembled again, and converted from its binary
+# object file back into the text object files. Both must give the same files.
+
+# $1 - assembler executable file
+# $2 - disassembler executable file
+# $3 - object converter executable file
+# $4 - basedir
+
+_roundtrip_case() {
+    # $1 - assembler executable file
+    # $2 - disassembler executable file
+    # $3 - basename of the assembled testcase
+    local _ext
+    if ! "$2" "$3" >/dev/null; then
+        echo "[FAIL] ${testcase}: disassembler failed"
+        return
+    fi
+    "$1" "$3_dis" >/dev/null
+    for _ext in ob ent ext; do
+        if [[ -f "$3.${_ext}" ]] || [[ -f "$3_dis.${_ext}" ]]; then
+            if cmp -s "$3.${_ext}" "$3_dis.${_ext}"; then
+                echo "[OK] ${testcase}: same ${_ext} file"
+            else
+                echo "[FAIL] ${testcase}: different ${_ext} file"
+            fi
+        fi
+    done
+}
+
+_objconv_case() {
+    # $1 - object converter executable file
+    # $2 - basename of the assembled testcase
+    local _ext
+    cp "$2.obb" "$2_obb.obb"
+    if ! "$1" --to-text "$2_obb" >/dev/null; then
+        echo "[FAIL] ${testcase}: object converter failed"
+        return
+    fi
+    for _ext in ob ent ext; do
+        if [[ -f "$2.${_ext}" ]] || [[ -f "$2_obb.${_ext}" ]]; then
+            if cmp -s "$2.${_ext}" "$2_obb.${_ext}"; then
+                echo "[OK] ${testcase}: same ${_ext} file from the binary object file"
+            else
+                echo "[FAIL] ${testcase}: different ${_ext} file from the binary object file"
+            fi
+        fi
+    done
+}
+
+# clean old generated files
+find "$4" \( -name "*.ob" -o -name "*.ent" -o -name "*.ext" -o -name "*.obb" -o -name "*_dis.as" \) -delete
+for testcase in $(ls "$4"); do
+    [[ -f "${4}/${testcase}" ]] && continue
+    "$1" --binary "${4}/${testcase}/${testcase}" >/dev/null
+    [[ -f "${4}/${testcase}/${testcase}.ob" ]] || continue # only the tests which assemble
+    _roundtrip_case "$1" "$2" "${4}/${testcase}/${testcase}"
+    _objconv_case "$3" "${4}/${testcase}/${testcase}"
+done
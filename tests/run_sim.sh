@@ -0,0 +1,35 @@
+#!/bin/bash
+
+# This file is part of OpenU's C project implementation, called assembler
+# Copyright (C) 2020 Arthur Zamarin */
+
+# You shouldn't cal this script by itself, but by calling `make tests-sim`
+
+# $1 - assembler executable file
+# $2 - simulator executable file
+# $3 - basedir
+# Every test with a .output.expected file is assembled and run, reading its .input file if it has one, and what it
+# prints must match that file.
+
+_sim_case() {
+    # $1 - assembler executable file
+    # $2 - simulator executable file
+    # $3 - basename of the testcase
+    local _input=/dev/null
+    [[ -f "$3.input" ]] && _input="$3.input"
+    if ! "$1" "$3" >/dev/null; then
+        echo "[FAIL] ${testcase}: doesn't assemble"
+        return
+    fi
+    if "$2" "$3" < "${_input}" | diff -q - "$3.output.expected"; then
+        echo "[OK] ${testcase}: match with output file"
+    else
+        echo "[FAIL] ${testcase}: mismatch with output file"
+    fi
+}
+
+find "$3" \( -name "*.ob" -o -name "*.ent" -o -name "*.ext" \) -delete # clean old generated files
+for testcase in $(ls "$3"); do
+    [[ -f "${3}/${testcase}/${testcase}.output.expected" ]] || continue
+    _sim_case "$1" "$2" "${3}/${testcase}/${testcase}"
+done
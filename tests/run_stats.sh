@@ -0,0 +1,51 @@
+#!/bin/bash
+
+# This file is part of OpenU's C project implementation, called assembler
+# Copyright (C) 2020 Arthur Zamarin */
+
+# You shouldn't cal this script by itself, but by calling `make tests-stats`
+# All the tests with a `.counters.expected` file are assembled in one invocation with `--stats` and `--trace`. The
+# trace must be valid JSON with one event for every file, and both the counters printed by `--stats` and those of
+# the trace must match the expected file. The timings change from run to run, so they aren't checked.
+
+# $1 - assembler executable file
+# $2 - basedir
+
+_basenames=()
+for testcase in $(ls "$2"); do
+    [[ -f "${2}/${testcase}/${testcase}.counters.expected" ]] && _basenames+=("${2}/${testcase}/${testcase}")
+done
+
+_saved=$(mktemp -d)
+$1 --stats --trace="${_saved}/trace.json" "${_basenames[@]}" >/dev/null 2>"${_saved}/stats.out"
+# prints "basename counters" for every event named by a basename, or "ERROR" if the trace isn't valid JSON
+python3 - "${_saved}/trace.json" > "${_saved}/trace.out" 2>/dev/null <<'PYTHON' || echo "ERROR" > "${_saved}/trace.out"
+import json, sys
+for event in json.load(open(sys.argv[1]))["traceEvents"]:
+    if event["name"] == event["args"]["file"]:
+        print(event["name"], "lines=%(lines)d instructions=%(instructions)d data-words=%(data_words)d "
+              "labels=%(labels)d externals=%(externals)d" % event["args"])
+PYTHON
+
+if grep -qx "ERROR" "${_saved}/trace.out"; then
+    echo "[FAIL] stats: trace isn't valid JSON"
+else
+    echo "[OK] stats: trace is valid JSON"
+fi
+for _basename in "${_basenames[@]}"; do
+    testcase=$(basename "${_basename}")
+    _expected=$(cat "${_basename}.counters.expected")
+    if [[ $(grep -c "^${_basename} " "${_saved}/trace.out") -ne 1 ]]; then
+        echo "[FAIL] ${testcase}: not exactly one trace event"
+    elif [[ "$(grep "^${_basename} " "${_saved}/trace.out" | cut -d' ' -f2-)" == "${_expected}" ]]; then
+        echo "[OK] ${testcase}: trace counters match"
+    else
+        echo "[FAIL] ${testcase}: trace counters mismatch"
+    fi
+    if [[ "$(grep "^${_basename}: lines=" "${_saved}/stats.out" | cut -d' ' -f2-)" == "${_expected}" ]]; then
+        echo "[OK] ${testcase}: stats counters match"
+    else
+        echo "[FAIL] ${testcase}: stats counters mismatch"
+    fi
+done
+rm -rf "${_saved}"
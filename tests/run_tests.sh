@@ -5,8 +5,11 @@
 
 # You shouldn't cal this script by itself, but by calling `make tests`
 
-# $1 - executable file
+# $1 - executable file, followed by its options
 # $2 - basedir
+# A testcase may have a .options file with more options of the assembler for it. It is skipped when one of them is
+# listed in TESTS_NO_OPTIONS, or it is "all", for the executables which can't take them. A .stderr.expected file is matched with the stderr of a
+# testcase which assembles, where the testcase directory is removed from the file names.
 _SKIP_FIRST_LINES_CNT=3 # remove (cnt-1) lines from start
 _SKIP_LAST_LINES_CNT=1  # remove cnt     lines from end
 
@@ -23,21 +26,38 @@ _diff_sorted_columns_file() {
 }
 
 _test_case() {
-    # $1 - executable file
+    # $1 - executable file, followed by its options
     # $2 - basedir
     # $3 - testcase name
-    local _basename
+    local _basename _options _option _stderr
     _basename="${2}/${testcase}/${testcase}"
     [[ -f "${_basename}.as" ]] || return # no as file
 
+    if [[ -f "${_basename}.options" ]]; then
+        _options=$(cat "${_basename}.options")
+        for _option in ${_options}; do
+            if [[ "${TESTS_NO_OPTIONS}" == all || " ${TESTS_NO_OPTIONS} " == *" ${_option} "* ]]; then
+                echo "[SKIP] ${testcase}: needs ${_options}"
+                return
+            fi
+        done
+    fi
+
     if [[ -f "${_basename}.error.expected" ]]; then
-        if "$1" "${_basename}" | tail -n +${_SKIP_FIRST_LINES_CNT}  | head -n -${_SKIP_LAST_LINES_CNT} | diff -q - "${_basename}.error.expected"; then
+        if $1 ${_options} "${_basename}" | tail -n +${_SKIP_FIRST_LINES_CNT}  | head -n -${_SKIP_LAST_LINES_CNT} | diff -q - "${_basename}.error.expected"; then
             echo "[OK] ${testcase}: match with errors file"
         else
             echo "[FAIL] ${testcase}: mismatch with errors file"
         fi
     else
-        "$1" "${_basename}" >&/dev/null || { echo "${testcase}: exited with error"; return; }
+        _stderr=$($1 ${_options} "${_basename}" 2>&1 >/dev/null) || { echo "${testcase}: exited with error"; return; }
+        if [[ -f "${_basename}.stderr.expected" ]]; then
+            if diff -q <(echo "${_stderr//${2}\/${testcase}\//}") "${_basename}.stderr.expected" >/dev/null; then
+                echo "[OK] ${testcase}: match with stderr file"
+            else
+                echo "[FAIL] ${testcase}: mismatch with stderr file"
+            fi
+        fi
     fi
 
     for ext in ob ent ext; do
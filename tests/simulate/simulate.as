@@ -0,0 +1,31 @@
+; calls, loops, indirect operands, input, and code which patches itself
+MAIN:   mov #3, r1
+LOOP:   jsr SHOW
+        dec r1
+        cmp r1, #0
+        bne LOOP
+        lea PATCH, r2
+        inc r2
+        mov #2, r4
+; 76 is the operand word of #9, so the second call prints 9 instead of 7
+AGAIN:  jsr PATCH
+        mov #76, *r2
+        dec r4
+        cmp r4, #0
+        bne AGAIN
+        red r3
+        prn r3
+        red r3
+        prn r3
+        red r3
+        prn r3
+        lea TABLE, r5
+        prn *r5
+        inc r5
+        prn *r5
+        stop
+SHOW:   prn r1
+        rts
+PATCH:  prn #7
+        rts
+TABLE:  .data -5, 17